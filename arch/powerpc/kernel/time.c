@@ -865,7 +865,8 @@ static cycle_t timebase_read(struct clocksource *cs)
 }
 
 void update_vsyscall(struct timespec *wall_time, struct timespec *wtm,
-			struct clocksource *clock, u32 mult)
+			struct clocksource *clock, u32 mult,
+			struct timespec *raw_time, struct timespec *sleep_time)
 {
 	u64 t2x, stamp_xsec;
 	u32 frac_sec;
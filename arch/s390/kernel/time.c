@@ -215,7 +215,8 @@ struct clocksource * __init clocksource_default_clock(void)
 }
 
 void update_vsyscall(struct timespec *wall_time, struct timespec *wtm,
-			struct clocksource *clock, u32 mult)
+			struct clocksource *clock, u32 mult,
+			struct timespec *raw_time, struct timespec *sleep_time)
 {
 	if (clock != &clocksource_tod)
 		return;
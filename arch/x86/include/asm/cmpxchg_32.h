@@ -345,4 +345,28 @@ extern unsigned long long cmpxchg_486_u64(volatile void *, u64, u64);
 
 #endif
 
+/*
+ * Compare and exchange two adjacent words, the first aligned to 8 bytes,
+ * without the lock prefix: atomic against interrupts on this cpu only.
+ * Check system_has_cmpxchg_double() before use.
+ */
+#define cmpxchg_double_local(p1, p2, o1, o2, n1, n2)			\
+({									\
+	char __ret;							\
+	__typeof__(o2) __junk;						\
+	__typeof__(*(p1)) __old1 = (o1);				\
+	__typeof__(o2) __old2 = (o2);					\
+	__typeof__(*(p1)) __new1 = (n1);				\
+	__typeof__(o2) __new2 = (n2);					\
+	BUILD_BUG_ON(sizeof(*(p1)) != 4 || sizeof(*(p2)) != 4);		\
+	asm volatile("cmpxchg8b %2; setz %1"				\
+		     : "=d" (__junk), "=a" (__ret), "+m" (*(p1))	\
+		     : "b" (__new1), "c" (__new2),			\
+		       "a" (__old1), "d" (__old2)			\
+		     : "memory");					\
+	__ret;								\
+})
+
+#define system_has_cmpxchg_double() cpu_has_cx8
+
 #endif /* _ASM_X86_CMPXCHG_32_H */
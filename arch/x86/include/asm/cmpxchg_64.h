@@ -182,4 +182,28 @@ static inline unsigned long __cmpxchg_local(volatile void *ptr,
 	cmpxchg_local((ptr), (o), (n));					\
 })
 
+/*
+ * Compare and exchange two adjacent words, the first aligned to 16 bytes,
+ * without the lock prefix: atomic against interrupts on this cpu only.
+ * Check system_has_cmpxchg_double() before use.
+ */
+#define cmpxchg_double_local(p1, p2, o1, o2, n1, n2)			\
+({									\
+	char __ret;							\
+	__typeof__(o2) __junk;						\
+	__typeof__(*(p1)) __old1 = (o1);				\
+	__typeof__(o2) __old2 = (o2);					\
+	__typeof__(*(p1)) __new1 = (n1);				\
+	__typeof__(o2) __new2 = (n2);					\
+	BUILD_BUG_ON(sizeof(*(p1)) != 8 || sizeof(*(p2)) != 8);		\
+	asm volatile("cmpxchg16b %2; setz %1"				\
+		     : "=d" (__junk), "=a" (__ret), "+m" (*(p1))	\
+		     : "b" (__new1), "c" (__new2),			\
+		       "a" (__old1), "d" (__old2)			\
+		     : "memory");					\
+	__ret;								\
+})
+
+#define system_has_cmpxchg_double() cpu_has_cx16
+
 #endif /* _ASM_X86_CMPXCHG_64_H */
@@ -0,0 +1,95 @@
+#ifndef _ASM_X86_QSPINLOCK_H
+#define _ASM_X86_QSPINLOCK_H
+
+/*
+ * Queued spinlocks
+ *
+ * The 32-bit lock word is split into
+ *
+ *  0- 7: locked byte, set by the owner
+ *  8-15: pending byte, set by the first waiter
+ * 16-17: tail index, the nesting level of the last queued waiter's node
+ * 18-31: tail cpu + 1, the cpu of the last queued waiter, 0 if none
+ *
+ * The uncontended lock is a single cmpxchg of the whole word, unlock a
+ * byte store.  The first waiter only sets the pending byte and spins on
+ * the lock word; further waiters queue up on per cpu MCS nodes, each
+ * spinning on its own node, and only the waiter at the head of the
+ * queue touches the lock word.  See arch/x86/kernel/qspinlock.c.
+ *
+ * (the type definitions are in asm/spinlock_types.h)
+ */
+
+#include <asm/atomic.h>
+
+#if NR_CPUS >= (1U << 14)
+# error "queued spinlocks support at most 16383 cpus"
+#endif
+
+#define _Q_LOCKED_OFFSET	0
+#define _Q_LOCKED_BITS		8
+#define _Q_LOCKED_MASK		(((1U << _Q_LOCKED_BITS) - 1) << _Q_LOCKED_OFFSET)
+
+#define _Q_PENDING_OFFSET	(_Q_LOCKED_OFFSET + _Q_LOCKED_BITS)
+#define _Q_PENDING_BITS		8
+#define _Q_PENDING_MASK		(((1U << _Q_PENDING_BITS) - 1) << _Q_PENDING_OFFSET)
+
+#define _Q_TAIL_IDX_OFFSET	(_Q_PENDING_OFFSET + _Q_PENDING_BITS)
+#define _Q_TAIL_IDX_BITS	2
+#define _Q_TAIL_IDX_MASK	(((1U << _Q_TAIL_IDX_BITS) - 1) << _Q_TAIL_IDX_OFFSET)
+
+#define _Q_TAIL_CPU_OFFSET	(_Q_TAIL_IDX_OFFSET + _Q_TAIL_IDX_BITS)
+#define _Q_TAIL_CPU_BITS	(32 - _Q_TAIL_CPU_OFFSET)
+#define _Q_TAIL_CPU_MASK	(((1U << _Q_TAIL_CPU_BITS) - 1) << _Q_TAIL_CPU_OFFSET)
+
+#define _Q_TAIL_OFFSET		_Q_TAIL_IDX_OFFSET
+#define _Q_TAIL_MASK		(_Q_TAIL_IDX_MASK | _Q_TAIL_CPU_MASK)
+
+#define _Q_LOCKED_PENDING_MASK	(_Q_LOCKED_MASK | _Q_PENDING_MASK)
+
+#define _Q_LOCKED_VAL		(1U << _Q_LOCKED_OFFSET)
+#define _Q_PENDING_VAL		(1U << _Q_PENDING_OFFSET)
+
+extern void queued_spin_lock_slowpath(raw_spinlock_t *lock, u32 val);
+
+static inline atomic_t *queued_spin_val(raw_spinlock_t *lock)
+{
+	return (atomic_t *)&lock->slock;
+}
+
+static inline int queued_spin_is_locked(raw_spinlock_t *lock)
+{
+	return atomic_read(queued_spin_val(lock)) != 0;
+}
+
+static inline int queued_spin_is_contended(raw_spinlock_t *lock)
+{
+	return (atomic_read(queued_spin_val(lock)) & ~_Q_LOCKED_MASK) != 0;
+}
+
+static __always_inline int queued_spin_trylock(raw_spinlock_t *lock)
+{
+	atomic_t *val = queued_spin_val(lock);
+
+	return !atomic_read(val) &&
+	       atomic_cmpxchg(val, 0, _Q_LOCKED_VAL) == 0;
+}
+
+static __always_inline void queued_spin_lock(raw_spinlock_t *lock)
+{
+	u32 val;
+
+	val = atomic_cmpxchg(queued_spin_val(lock), 0, _Q_LOCKED_VAL);
+	if (likely(val == 0))
+		return;
+	queued_spin_lock_slowpath(lock, val);
+}
+
+static __always_inline void queued_spin_unlock(raw_spinlock_t *lock)
+{
+	/* stores are not reordered with older loads or stores on x86 */
+	barrier();
+	ACCESS_ONCE(*(u8 *)&lock->slock) = 0;
+}
+
+#endif /* _ASM_X86_QSPINLOCK_H */
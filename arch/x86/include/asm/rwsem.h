@@ -22,11 +22,12 @@
  *
  * The value of ACTIVE_BIAS supports up to 65535 active processes.
  *
- * This should be totally fair - if anything is waiting, a process that wants a
- * lock will go to the back of the queue. When the currently active lock is
- * released, if there's a writer at the front of the queue, then that and only
- * that will be woken up; if there's a bunch of consequtive readers at the
- * front, then they'll all be woken up, but no other readers will be.
+ * Readers that find anything waiting go to the back of the queue.  When the
+ * currently active lock is released, if there's a writer at the front of the
+ * queue, then that and only that will be woken up, and it takes the lock
+ * itself unless another writer got it first; if there's a bunch of
+ * consequtive readers at the front, then they'll all be granted the lock and
+ * woken up, but no other readers will be.  See lib/rwsem.c.
  */
 
 #ifndef _ASM_X86_RWSEM_H
@@ -44,6 +45,7 @@
 #include <asm/asm.h>
 
 struct rwsem_waiter;
+struct rwsem_spinner;
 
 extern asmregparm struct rw_semaphore *
  rwsem_down_read_failed(struct rw_semaphore *sem);
@@ -80,6 +82,14 @@ struct rw_semaphore {
 	rwsem_count_t		count;
 	spinlock_t		wait_lock;
 	struct list_head	wait_list;
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	/*
+	 * The writer holding the sem, for optimistic spinning, or
+	 * RWSEM_READER_OWNED once readers got it.  Only a hint.
+	 */
+	struct thread_info	*owner;
+	struct rwsem_spinner	*spinners;	/* MCS queue of spinners */
+#endif
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 	struct lockdep_map dep_map;
 #endif
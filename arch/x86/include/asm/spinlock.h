@@ -13,8 +13,8 @@
  * Simple spin lock operations.  There are two variants, one clears IRQ's
  * on the local processor, one does not.
  *
- * These are fair FIFO ticket locks, which are currently limited to 256
- * CPUs.
+ * These are fair FIFO locks: queued locks if CONFIG_QUEUED_SPINLOCKS is
+ * set (see asm/qspinlock.h), ticket locks otherwise.
  *
  * (the type definitions are in asm/spinlock_types.h)
  */
@@ -40,6 +40,18 @@
 # define UNLOCK_LOCK_ALT_PREFIX
 #endif
 
+#ifdef CONFIG_QUEUED_SPINLOCKS
+
+#include <asm/qspinlock.h>
+
+#define native_spin_is_locked		queued_spin_is_locked
+#define native_spin_is_contended	queued_spin_is_contended
+#define native_spin_lock		queued_spin_lock
+#define native_spin_trylock		queued_spin_trylock
+#define native_spin_unlock		queued_spin_unlock
+
+#else	/* !CONFIG_QUEUED_SPINLOCKS */
+
 /*
  * Ticket locks are conceptually two parts, one indicating the current head of
  * the queue, and the other indicating the current tail. The lock is acquired
@@ -194,32 +206,40 @@ static inline int __ticket_spin_is_contended(raw_spinlock_t *lock)
 	return (((tmp >> TICKET_SHIFT) - tmp) & ((1 << TICKET_SHIFT) - 1)) > 1;
 }
 
+#define native_spin_is_locked		__ticket_spin_is_locked
+#define native_spin_is_contended	__ticket_spin_is_contended
+#define native_spin_lock		__ticket_spin_lock
+#define native_spin_trylock		__ticket_spin_trylock
+#define native_spin_unlock		__ticket_spin_unlock
+
+#endif	/* CONFIG_QUEUED_SPINLOCKS */
+
 #ifndef CONFIG_PARAVIRT_SPINLOCKS
 
 static inline int __raw_spin_is_locked(raw_spinlock_t *lock)
 {
-	return __ticket_spin_is_locked(lock);
+	return native_spin_is_locked(lock);
 }
 
 static inline int __raw_spin_is_contended(raw_spinlock_t *lock)
 {
-	return __ticket_spin_is_contended(lock);
+	return native_spin_is_contended(lock);
 }
 #define __raw_spin_is_contended	__raw_spin_is_contended
 
 static __always_inline void __raw_spin_lock(raw_spinlock_t *lock)
 {
-	__ticket_spin_lock(lock);
+	native_spin_lock(lock);
 }
 
 static __always_inline int __raw_spin_trylock(raw_spinlock_t *lock)
 {
-	return __ticket_spin_trylock(lock);
+	return native_spin_trylock(lock);
 }
 
 static __always_inline void __raw_spin_unlock(raw_spinlock_t *lock)
 {
-	__ticket_spin_unlock(lock);
+	native_spin_unlock(lock);
 }
 
 static __always_inline void __raw_spin_lock_flags(raw_spinlock_t *lock,
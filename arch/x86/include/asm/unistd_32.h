@@ -354,10 +354,12 @@
 #define __NR_setns		346
 #define __NR_process_vm_readv  347
 #define __NR_process_vm_writev 348
+#define __NR_io_ring_setup	349
+#define __NR_io_ring_enter	350
 
 #ifdef __KERNEL__
 
-#define NR_syscalls 349
+#define NR_syscalls 351
 
 #define __ARCH_WANT_IPC_PARSE_VERSION
 #define __ARCH_WANT_OLD_READDIR
@@ -687,6 +687,10 @@ __SYSCALL(__NR_get_cpu, sys_ni_syscall)
 __SYSCALL(__NR_process_vm_readv, sys_process_vm_readv)
 #define __NR_process_vm_writev			311
 __SYSCALL(__NR_process_vm_writev, sys_process_vm_writev)
+#define __NR_io_ring_setup			312
+__SYSCALL(__NR_io_ring_setup, sys_io_ring_setup)
+#define __NR_io_ring_enter			313
+__SYSCALL(__NR_io_ring_enter, sys_io_ring_enter)
 
 #ifndef __NO_STUBS
 #define __ARCH_WANT_OLD_READDIR
@@ -18,10 +18,13 @@ struct vsyscall_gtod_data {
 		cycle_t	cycle_last;
 		cycle_t	mask;
 		u32	mult;
+		u32	raw_mult;	/* not NTP adjusted */
 		u32	shift;
 	} clock;
 	struct timespec wall_to_monotonic;
 	struct timespec wall_time_coarse;
+	struct timespec raw_time;
+	struct timespec total_sleep_time;
 };
 extern struct vsyscall_gtod_data __vsyscall_gtod_data
 __section_vsyscall_gtod_data;
@@ -26,6 +26,10 @@
 
 #include <asm/x86_init.h>
 #include <asm/reboot.h>
+#include <asm/fixmap.h>
+#include <asm/vsyscall.h>
+#include <asm/vgtod.h>
+#include <asm/tsc.h>
 
 #define KVM_SCALE 22
 
@@ -44,6 +48,24 @@ early_param("no-kvmclock", parse_no_kvmclock);
 static DEFINE_PER_CPU_SHARED_ALIGNED(struct pvclock_vcpu_time_info, hv_clock);
 static struct pvclock_wall_clock wall_clock;
 
+/*
+ * The boot cpu's time info gets a page of its own, so that it can be
+ * mapped read-only into the vsyscall area for vread_kvm_clock().
+ */
+static union {
+	struct pvclock_vcpu_time_info info;
+	char pad[PAGE_SIZE];
+} hv_clock_boot __page_aligned_bss;
+
+static bool kvm_clock_vsyscall;
+
+static struct pvclock_vcpu_time_info *kvm_hv_clock(int cpu)
+{
+	if (cpu == 0)
+		return &hv_clock_boot.info;
+	return &per_cpu(hv_clock, cpu);
+}
+
 /*
  * The wallclock is the time of day when we booted. Since then, some time may
  * have elapsed since the hypervisor wrote the data. So we try to account for
@@ -60,9 +82,9 @@ static unsigned long kvm_get_wallclock(void)
 
 	native_write_msr(msr_kvm_wall_clock, low, high);
 
-	vcpu_time = &get_cpu_var(hv_clock);
+	vcpu_time = kvm_hv_clock(get_cpu());
 	pvclock_read_wallclock(&wall_clock, vcpu_time, &ts);
-	put_cpu_var(hv_clock);
+	put_cpu();
 
 	return ts.tv_sec;
 }
@@ -77,12 +99,49 @@ static cycle_t kvm_clock_read(void)
 	struct pvclock_vcpu_time_info *src;
 	cycle_t ret;
 
-	src = &get_cpu_var(hv_clock);
+	src = kvm_hv_clock(get_cpu());
 	ret = pvclock_clocksource_read(src);
-	put_cpu_var(hv_clock);
+	put_cpu();
 	return ret;
 }
 
+#ifdef CONFIG_X86_64
+/*
+ * Userspace read of kvm-clock for the vDSO and vsyscalls. Only the boot
+ * cpu's time info is visible to userspace, which is correct as long as
+ * the host keeps the TSCs of all vcpus in sync (PVCLOCK_TSC_STABLE_BIT);
+ * kvm_clock.vread is only set up in that case.
+ */
+static cycle_t __vsyscall_fn vread_kvm_clock(void)
+{
+	const struct pvclock_vcpu_time_info *src;
+	u32 version;
+	u64 delta;
+	cycle_t ret;
+
+	src = (const struct pvclock_vcpu_time_info *)
+		fix_to_virt(VSYSCALL_PVCLOCK);
+	do {
+		version = src->version;
+		/* fetch version before data, and data before the TSC */
+		rdtsc_barrier();
+		delta = (u64)vget_cycles() - src->tsc_timestamp;
+		ret = src->system_time +
+			pvclock_scale_delta(delta, src->tsc_to_system_mul,
+					    src->tsc_shift);
+		/* test version after fetching data */
+		rdtsc_barrier();
+	} while ((version & 1) || version != src->version);
+
+	/*
+	 * Should the host ever drop the stable bit, do not let time go
+	 * backwards relative to the last timer tick.
+	 */
+	return ret >= __vsyscall_gtod_data.clock.cycle_last ?
+		ret : __vsyscall_gtod_data.clock.cycle_last;
+}
+#endif
+
 static cycle_t kvm_clock_get_cycles(struct clocksource *cs)
 {
 	return kvm_clock_read();
@@ -100,7 +159,7 @@ static cycle_t kvm_clock_get_cycles(struct clocksource *cs)
 static unsigned long kvm_get_tsc_khz(void)
 {
 	struct pvclock_vcpu_time_info *src;
-	src = &per_cpu(hv_clock, 0);
+	src = kvm_hv_clock(0);
 	return pvclock_tsc_khz(src);
 }
 
@@ -121,9 +180,9 @@ bool kvm_check_and_clear_guest_paused(void)
 	bool ret = false;
 	struct pvclock_vcpu_time_info *src;
 
-	src = &__get_cpu_var(hv_clock);
+	src = kvm_hv_clock(smp_processor_id());
 	if ((src->flags & PVCLOCK_GUEST_STOPPED) != 0) {
-		percpu_and(hv_clock.flags, ~PVCLOCK_GUEST_STOPPED);
+		src->flags &= ~PVCLOCK_GUEST_STOPPED;
 		ret = true;
 	}
 
@@ -144,8 +203,8 @@ int kvm_register_clock(char *txt)
 {
 	int cpu = smp_processor_id();
 	int low, high;
-	low = (int)__pa(&per_cpu(hv_clock, cpu)) | 1;
-	high = ((u64)__pa(&per_cpu(hv_clock, cpu)) >> 32);
+	low = (int)__pa(kvm_hv_clock(cpu)) | 1;
+	high = ((u64)__pa(kvm_hv_clock(cpu)) >> 32);
 	printk(KERN_INFO "kvm-clock: cpu %d, msr %x:%x, %s\n",
 	       cpu, high, low, txt);
 
@@ -231,6 +290,28 @@ void __init kvmclock_init(void)
 	pv_info.paravirt_enabled = 1;
 	pv_info.name = "KVM";
 
-	if (kvm_para_has_feature(KVM_FEATURE_CLOCKSOURCE_STABLE_BIT))
+	if (kvm_para_has_feature(KVM_FEATURE_CLOCKSOURCE_STABLE_BIT)) {
 		pvclock_set_flags(PVCLOCK_TSC_STABLE_BIT);
+		kvm_clock_vsyscall = true;
+	}
 }
+
+#ifdef CONFIG_X86_64
+/*
+ * Map the boot cpu's time info for the vDSO once the fixmap can be
+ * populated. The vsyscall gtod data picks up kvm_clock.vread at the
+ * next timekeeping update.
+ */
+static int __init kvm_setup_vsyscall_timeinfo(void)
+{
+	if (!kvm_clock_vsyscall)
+		return 0;
+
+	__set_fixmap(VSYSCALL_PVCLOCK, __pa_symbol(&hv_clock_boot),
+		     PAGE_KERNEL_VSYSCALL);
+	kvm_clock.vread = vread_kvm_clock;
+	printk(KERN_INFO "kvm-clock: using vsyscall time info\n");
+	return 0;
+}
+arch_initcall(kvm_setup_vsyscall_timeinfo);
+#endif
@@ -15,13 +15,13 @@ default_spin_lock_flags(raw_spinlock_t *lock, unsigned long flags)
 
 struct pv_lock_ops pv_lock_ops = {
 #ifdef CONFIG_SMP
-	.spin_is_locked = __ticket_spin_is_locked,
-	.spin_is_contended = __ticket_spin_is_contended,
+	.spin_is_locked = native_spin_is_locked,
+	.spin_is_contended = native_spin_is_contended,
 
-	.spin_lock = __ticket_spin_lock,
+	.spin_lock = native_spin_lock,
 	.spin_lock_flags = default_spin_lock_flags,
-	.spin_trylock = __ticket_spin_trylock,
-	.spin_unlock = __ticket_spin_unlock,
+	.spin_trylock = native_spin_trylock,
+	.spin_unlock = native_spin_unlock,
 #endif
 };
 EXPORT_SYMBOL(pv_lock_ops);
@@ -0,0 +1,286 @@
+/*
+ * Queued spinlock slow path
+ *
+ * Based on the MCS lock (Mellor-Crummey and Scott, "Algorithms for
+ * scalable synchronization on shared-memory multiprocessors"): every
+ * waiter spins on a node of its own and is handed the lock by its
+ * predecessor, so a contended lock costs one cacheline transfer per
+ * hand-over however many cpus are waiting.  The queue lives in per cpu
+ * nodes, one per context that can take a spinlock (task, softirq,
+ * hardirq, nmi), and the lock word only holds the tail of the queue.
+ *
+ * A waiter that finds the lock held but nobody waiting sets the pending
+ * byte and spins on the lock word instead of queueing, which is cheaper
+ * for the common case of a single waiter.
+ *
+ * Once a waiter is at the head of the queue, it waits for both the owner
+ * and the pending waiter to go away and then takes the lock.  If it is
+ * also the tail, it clears the tail with a cmpxchg; otherwise it passes
+ * the head of the queue on to the next waiter.
+ *
+ * This relies on x86 not reordering loads with older loads nor stores
+ * with older loads or stores, so a plain load is an acquire and a plain
+ * store a release.  CONFIG_X86_PPRO_FENCE and CONFIG_X86_OOSTORE systems
+ * don't provide that and use ticket locks.
+ */
+
+#include <linux/bug.h>
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/smp.h>
+#include <linux/spinlock.h>
+#include <asm/cpufeature.h>
+#include <asm/processor.h>
+
+#define MAX_NODES	4
+
+struct mcs_spinlock {
+	struct mcs_spinlock *next;
+	int locked;		/* 1 if lock acquired */
+	int count;		/* nesting count, only used in the first node */
+};
+
+static DEFINE_PER_CPU_ALIGNED(struct mcs_spinlock, mcs_nodes[MAX_NODES]);
+
+/* The lock word, as seen by the slow path */
+struct __qspinlock {
+	union {
+		atomic_t val;
+		struct {
+			u8	locked;
+			u8	pending;
+		};
+		struct {
+			u16	locked_pending;
+			u16	tail;
+		};
+	};
+};
+
+static inline u32 encode_tail(int cpu, int idx)
+{
+	return ((cpu + 1) << _Q_TAIL_CPU_OFFSET) | (idx << _Q_TAIL_IDX_OFFSET);
+}
+
+static inline struct mcs_spinlock *decode_tail(u32 tail)
+{
+	int cpu = (tail >> _Q_TAIL_CPU_OFFSET) - 1;
+	int idx = (tail & _Q_TAIL_IDX_MASK) >> _Q_TAIL_IDX_OFFSET;
+
+	return &per_cpu(mcs_nodes, cpu)[idx];
+}
+
+/* *,1,0 -> *,0,1: the pending waiter takes the lock */
+static __always_inline void clear_pending_set_locked(struct __qspinlock *l)
+{
+	ACCESS_ONCE(l->locked_pending) = _Q_LOCKED_VAL;
+}
+
+/* Publish our node as the new tail, returning the previous tail */
+static __always_inline u32 xchg_tail(struct __qspinlock *l, u32 tail)
+{
+	return (u32)xchg(&l->tail, tail >> _Q_TAIL_OFFSET) << _Q_TAIL_OFFSET;
+}
+
+static __always_inline void set_locked(struct __qspinlock *l)
+{
+	ACCESS_ONCE(l->locked) = _Q_LOCKED_VAL;
+}
+
+/*
+ * Under a hypervisor a vCPU can be preempted while it waits in the
+ * queue, and a fair lock then makes everybody behind it wait for it to
+ * run again.  When unfair spinlocks have been chosen (spinlock-type=,
+ * the default in guests), just spin until the lock word is free and grab
+ * it, which only ever uses the locked byte.
+ */
+static inline bool virt_spin_lock(struct __qspinlock *l)
+{
+	if (!boot_cpu_has(X86_FEATURE_UNFAIR_SPINLOCK))
+		return false;
+
+	do {
+		while (atomic_read(&l->val) != 0)
+			cpu_relax();
+	} while (atomic_cmpxchg(&l->val, 0, _Q_LOCKED_VAL) != 0);
+
+	return true;
+}
+
+/**
+ * queued_spin_lock_slowpath - acquire a contended queued spinlock
+ * @lock: the spinlock
+ * @val: the lock word, as found by the failed fast path
+ *
+ * The lock word is (tail, pending, locked):
+ *
+ *              fast     :    slow                                  :    unlock
+ *                       :                                          :
+ * uncontended  (0,0,0) -:--> (0,0,1) ------------------------------:--> (*,*,0)
+ *                       :       | ^--------.------.             /  :
+ *                       :       v           \      \            |  :
+ * pending               :    (0,1,1) +--> (0,1,0)   \           |  :
+ *                       :       | ^--'              |           |  :
+ *                       :       v                   |           |  :
+ * uncontended           :    (n,x,y) +--> (n,0,0) --'           |  :
+ *   queue               :       | ^--'                          |  :
+ *                       :       v                               |  :
+ * contended             :    (*,x,y) +--> (*,0,0) ---> (*,0,1) -'  :
+ *   queue               :         ^--'                             :
+ */
+void queued_spin_lock_slowpath(raw_spinlock_t *lock, u32 val)
+{
+	struct __qspinlock *l = (struct __qspinlock *)lock;
+	struct mcs_spinlock *prev, *next, *node;
+	u32 new, old, tail;
+	int idx;
+
+	BUILD_BUG_ON(sizeof(struct __qspinlock) != sizeof(raw_spinlock_t));
+
+	if (virt_spin_lock(l))
+		return;
+
+	/*
+	 * Wait for a pending waiter that is just taking the lock,
+	 * 0,1,0 -> 0,0,1, rather than queueing behind it.
+	 */
+	if (val == _Q_PENDING_VAL) {
+		while ((val = atomic_read(&l->val)) == _Q_PENDING_VAL)
+			cpu_relax();
+	}
+
+	/*
+	 * trylock || pending
+	 *
+	 * 0,0,0 -> 0,0,1 ; trylock
+	 * 0,0,1 -> 0,1,1 ; pending
+	 */
+	for (;;) {
+		/* somebody is waiting already, queue up */
+		if (val & ~_Q_LOCKED_MASK)
+			goto queue;
+
+		new = _Q_LOCKED_VAL;
+		if (val == new)
+			new |= _Q_PENDING_VAL;
+
+		old = atomic_cmpxchg(&l->val, val, new);
+		if (old == val)
+			break;
+
+		val = old;
+	}
+
+	/* we won the trylock */
+	if (new == _Q_LOCKED_VAL)
+		return;
+
+	/*
+	 * We're pending, wait for the owner to go away.
+	 *
+	 * *,1,1 -> *,1,0
+	 */
+	while ((val = atomic_read(&l->val)) & _Q_LOCKED_MASK)
+		cpu_relax();
+
+	/*
+	 * Take ownership and clear the pending bit.  Nobody else can
+	 * change the locked and pending bytes now, so a store will do.
+	 *
+	 * *,1,0 -> *,0,1
+	 */
+	clear_pending_set_locked(l);
+	return;
+
+	/*
+	 * End of pending bit optimistic spinning and beginning of MCS
+	 * queuing.
+	 */
+queue:
+	node = &__get_cpu_var(mcs_nodes)[0];
+	idx = node->count++;
+	tail = encode_tail(smp_processor_id(), idx);
+
+	/*
+	 * Out of nodes: an nmi hit while all the other contexts were
+	 * spinning.  Not worth a node of its own, just spin.
+	 */
+	if (unlikely(idx >= MAX_NODES)) {
+		while (!queued_spin_trylock(lock))
+			cpu_relax();
+		goto release;
+	}
+
+	node += idx;
+	node->locked = 0;
+	node->next = NULL;
+
+	/*
+	 * We touched a (possibly) cold cacheline in the per cpu queue
+	 * node; try again before queueing.
+	 */
+	if (queued_spin_trylock(lock))
+		goto release;
+
+	/*
+	 * The node must be initialized before it becomes visible through
+	 * the tail; the locked xchg orders that.
+	 *
+	 * p,*,* -> n,*,*
+	 */
+	old = xchg_tail(l, tail);
+
+	/*
+	 * If there was a previous tail, link behind it and wait for it
+	 * to hand us the head of the queue.
+	 */
+	if (old & _Q_TAIL_MASK) {
+		prev = decode_tail(old);
+		ACCESS_ONCE(prev->next) = node;
+
+		while (!ACCESS_ONCE(node->locked))
+			cpu_relax();
+	}
+
+	/*
+	 * We're at the head of the queue: wait for the owner and the
+	 * pending waiter to go away.  Nobody can set the pending byte
+	 * while the tail is set.
+	 *
+	 * *,x,y -> *,0,0
+	 */
+	while ((val = atomic_read(&l->val)) & _Q_LOCKED_PENDING_MASK)
+		cpu_relax();
+
+	/*
+	 * Claim the lock:
+	 *
+	 * n,0,0 -> 0,0,1 : lock, uncontended
+	 * *,0,0 -> *,0,1 : lock, contended
+	 *
+	 * If the queue head is the only one in the queue (lock value ==
+	 * tail), clear the tail code and grab the lock.  Otherwise, we
+	 * only need to grab the lock.
+	 */
+	for (;;) {
+		if (val != tail) {
+			set_locked(l);
+			break;
+		}
+		old = atomic_cmpxchg(&l->val, val, _Q_LOCKED_VAL);
+		if (old == val)
+			goto release;	/* no contention */
+
+		val = old;
+	}
+
+	/* contended: pass the head of the queue on */
+	while (!(next = ACCESS_ONCE(node->next)))
+		cpu_relax();
+
+	ACCESS_ONCE(next->locked) = 1;
+
+release:
+	__get_cpu_var(mcs_nodes)[0].count--;
+}
+EXPORT_SYMBOL(queued_spin_lock_slowpath);
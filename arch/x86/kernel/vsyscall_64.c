@@ -74,7 +74,8 @@ void update_vsyscall_tz(void)
 }
 
 void update_vsyscall(struct timespec *wall_time, struct timespec *wtm,
-			struct clocksource *clock, u32 mult)
+			struct clocksource *clock, u32 mult,
+			struct timespec *raw_time, struct timespec *sleep_time)
 {
 	unsigned long flags;
 
@@ -84,11 +85,14 @@ void update_vsyscall(struct timespec *wall_time, struct timespec *wtm,
 	vsyscall_gtod_data.clock.cycle_last = clock->cycle_last;
 	vsyscall_gtod_data.clock.mask = clock->mask;
 	vsyscall_gtod_data.clock.mult = mult;
+	vsyscall_gtod_data.clock.raw_mult = clock->mult;
 	vsyscall_gtod_data.clock.shift = clock->shift;
 	vsyscall_gtod_data.wall_time_sec = wall_time->tv_sec;
 	vsyscall_gtod_data.wall_time_nsec = wall_time->tv_nsec;
 	vsyscall_gtod_data.wall_to_monotonic = *wtm;
 	vsyscall_gtod_data.wall_time_coarse = __current_kernel_time();
+	vsyscall_gtod_data.raw_time = *raw_time;
+	vsyscall_gtod_data.total_sleep_time = *sleep_time;
 	write_sequnlock_irqrestore(&vsyscall_gtod_data.lock, flags);
 }
 
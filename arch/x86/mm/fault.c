@@ -1079,6 +1079,28 @@ static inline void __do_page_fault(struct pt_regs *regs, unsigned long address,
 		return;
 	}
 
+	/*
+	 * Try to fill in a missing page of user space without mmap_sem
+	 * first.  Anything that isn't simple, including all the errors,
+	 * is left to the fault handling below.
+	 */
+	if ((error_code & (PF_USER | PF_PROT)) == PF_USER) {
+		fault = handle_speculative_fault(mm, address, flags);
+		if (fault != VM_FAULT_RETRY) {
+			if (fault & VM_FAULT_MAJOR) {
+				tsk->maj_flt++;
+				perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MAJ, 1,
+					      regs, address);
+			} else {
+				tsk->min_flt++;
+				perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MIN, 1,
+					      regs, address);
+			}
+			check_v8086_mode(regs, address, tsk);
+			return;
+		}
+	}
+
 	/*
 	 * When running in the kernel we expect faults to occur only to
 	 * addresses in user space.  All other faults represent errors in
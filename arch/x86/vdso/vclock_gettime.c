@@ -43,6 +43,16 @@ notrace static inline unsigned long vgetns(void)
 	return (v * gtod->clock.mult) >> gtod->clock.shift;
 }
 
+/* Same as vgetns() but without the NTP frequency correction */
+notrace static inline unsigned long vgetns_raw(void)
+{
+	cycle_t v;
+	cycle_t (*vread)(void);
+	vread = gtod->clock.vread;
+	v = (vread() - gtod->clock.cycle_last) & gtod->clock.mask;
+	return (v * gtod->clock.raw_mult) >> gtod->clock.shift;
+}
+
 notrace static noinline int do_realtime(struct timespec *ts)
 {
 	unsigned long seq, ns;
@@ -86,6 +96,34 @@ notrace static noinline int do_monotonic(struct timespec *ts)
 	return 0;
 }
 
+notrace static noinline int do_monotonic_raw(struct timespec *ts)
+{
+	unsigned long seq, ns, secs;
+	do {
+		seq = read_seqbegin(&gtod->lock);
+		secs = gtod->raw_time.tv_sec;
+		ns = gtod->raw_time.tv_nsec + vgetns_raw();
+	} while (unlikely(read_seqretry(&gtod->lock, seq)));
+	vset_normalized_timespec(ts, secs, ns);
+	return 0;
+}
+
+notrace static noinline int do_boottime(struct timespec *ts)
+{
+	unsigned long seq, ns, secs;
+	do {
+		seq = read_seqbegin(&gtod->lock);
+		secs = gtod->wall_time_sec;
+		ns = gtod->wall_time_nsec + vgetns();
+		secs += gtod->wall_to_monotonic.tv_sec;
+		ns += gtod->wall_to_monotonic.tv_nsec;
+		secs += gtod->total_sleep_time.tv_sec;
+		ns += gtod->total_sleep_time.tv_nsec;
+	} while (unlikely(read_seqretry(&gtod->lock, seq)));
+	vset_normalized_timespec(ts, secs, ns);
+	return 0;
+}
+
 notrace static noinline int do_realtime_coarse(struct timespec *ts)
 {
 	unsigned long seq;
@@ -123,6 +161,14 @@ notrace int __vdso_clock_gettime(clockid_t clock, struct timespec *ts)
 			if (likely(gtod->clock.vread))
 				return do_monotonic(ts);
 			break;
+		case CLOCK_MONOTONIC_RAW:
+			if (likely(gtod->clock.vread))
+				return do_monotonic_raw(ts);
+			break;
+		case CLOCK_BOOTTIME:
+			if (likely(gtod->clock.vread))
+				return do_boottime(ts);
+			break;
 		case CLOCK_REALTIME_COARSE:
 			return do_realtime_coarse(ts);
 		case CLOCK_MONOTONIC_COARSE:
@@ -469,11 +469,13 @@ EXPORT_SYMBOL(blk_limits_io_opt);
  *   for disk drives.  For RAID arrays it is usually the stripe width or
  *   the internal track size.  A properly aligned multiple of
  *   optimal_io_size is the preferred request size for workloads where
- *   sustained throughput is desired.
+ *   sustained throughput is desired.  Readahead windows are sized to
+ *   cover at least one optimal request.
  */
 void blk_queue_io_opt(struct request_queue *q, unsigned int opt)
 {
 	blk_limits_io_opt(&q->limits, opt);
+	q->backing_dev_info.io_pages = opt >> PAGE_CACHE_SHIFT;
 }
 EXPORT_SYMBOL(blk_queue_io_opt);
 
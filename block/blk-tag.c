@@ -1,10 +1,16 @@
 /*
  * Functions related to tagged command queuing
+ *
+ * Free tags are handed out by a percpu_ida pool, so that queues on many
+ * cpus sharing one tag map (a host wide map, or a single fast device)
+ * don't all hit the same cachelines of a bitmap.  The tag_map stays the
+ * record of which tags are busy.
  */
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/bio.h>
 #include <linux/blkdev.h>
+#include <linux/percpu_ida.h>
 
 #include "blk.h"
 
@@ -47,6 +53,7 @@ static int __blk_free_tags(struct blk_queue_tag *bqt)
 		kfree(bqt->tag_map);
 		bqt->tag_map = NULL;
 
+		percpu_ida_destroy(&bqt->free_tags);
 		kfree(bqt);
 	}
 
@@ -103,34 +110,83 @@ void blk_queue_free_tags(struct request_queue *q)
 }
 EXPORT_SYMBOL(blk_queue_free_tags);
 
+/*
+ * A request that doesn't get a tag is only retried once another one
+ * completes, so allocation must not fail while any tag is free.  With
+ * per cpu caches holding more than half of the tags, percpu_ida_alloc()
+ * steals from every cpu that has some before it gives up.
+ */
+static int init_tag_pool(struct percpu_ida *pool, int depth)
+{
+	unsigned long max_size;
+
+	max_size = max_t(unsigned long, IDA_DEFAULT_PCPU_SIZE, depth / 2 + 1);
+	return __percpu_ida_init(pool, depth, max_size,
+				 IDA_DEFAULT_PCPU_BATCH_MOVE);
+}
+
+/*
+ * Keep the tags at or above max_depth out of circulation: they are
+ * parked busy in the tag_map, with no request in the tag_index, until
+ * blk_queue_resize_tags() raises the depth.  Nobody else may be using
+ * the map.
+ */
+static void park_tags(struct blk_queue_tag *bqt)
+{
+	int tag;
+
+	while ((tag = percpu_ida_alloc(&bqt->free_tags, GFP_ATOMIC)) >= 0)
+		set_bit(tag, bqt->tag_map);
+
+	for (tag = 0; tag < bqt->max_depth; tag++) {
+		clear_bit(tag, bqt->tag_map);
+		percpu_ida_free(&bqt->free_tags, tag);
+	}
+}
+
+/*
+ * The tag pool can't be allocated under the queue lock, which
+ * blk_queue_resize_tags() runs under, so everything is sized up front
+ * for the deepest the queue may be resized to.  Must be called from
+ * process context.
+ */
 static int
 init_tag_map(struct request_queue *q, struct blk_queue_tag *tags, int depth)
 {
 	struct request **tag_index;
 	unsigned long *tag_map;
-	int nr_ulongs;
+	int nr_ulongs, real_depth;
 
 	if (q && depth > q->nr_requests * 2) {
 		depth = q->nr_requests * 2;
 		printk(KERN_ERR "%s: adjusted depth to %d\n",
 		       __func__, depth);
 	}
+	real_depth = q ? q->nr_requests * 2 : depth;
 
-	tag_index = kzalloc(depth * sizeof(struct request *), GFP_ATOMIC);
+	tag_index = kzalloc(real_depth * sizeof(struct request *), GFP_KERNEL);
 	if (!tag_index)
 		goto fail;
 
-	nr_ulongs = ALIGN(depth, BITS_PER_LONG) / BITS_PER_LONG;
-	tag_map = kzalloc(nr_ulongs * sizeof(unsigned long), GFP_ATOMIC);
+	nr_ulongs = ALIGN(real_depth, BITS_PER_LONG) / BITS_PER_LONG;
+	tag_map = kzalloc(nr_ulongs * sizeof(unsigned long), GFP_KERNEL);
 	if (!tag_map)
 		goto fail;
 
-	tags->real_max_depth = depth;
+	if (init_tag_pool(&tags->free_tags, real_depth))
+		goto fail_map;
+
+	tags->real_max_depth = real_depth;
 	tags->max_depth = depth;
 	tags->tag_index = tag_index;
 	tags->tag_map = tag_map;
 
+	if (depth < real_depth)
+		park_tags(tags);
+
 	return 0;
+fail_map:
+	kfree(tag_map);
 fail:
 	kfree(tag_index);
 	return -ENOMEM;
@@ -141,7 +197,7 @@ static struct blk_queue_tag *__blk_queue_init_tags(struct request_queue *q,
 {
 	struct blk_queue_tag *tags;
 
-	tags = kmalloc(sizeof(struct blk_queue_tag), GFP_ATOMIC);
+	tags = kmalloc(sizeof(struct blk_queue_tag), GFP_KERNEL);
 	if (!tags)
 		goto fail;
 
@@ -158,6 +214,8 @@ fail:
 /**
  * blk_init_tags - initialize the tag info for an external tag map
  * @depth:	the maximum queue depth supported
+ *
+ * May sleep.
  **/
 struct blk_queue_tag *blk_init_tags(int depth)
 {
@@ -172,7 +230,7 @@ EXPORT_SYMBOL(blk_init_tags);
  * @tags: the tag to use
  *
  * Queue lock must be held here if the function is called to resize an
- * existing map.
+ * existing map.  Otherwise it may sleep.
  **/
 int blk_queue_init_tags(struct request_queue *q, int depth,
 			struct blk_queue_tag *tags)
@@ -219,50 +277,116 @@ EXPORT_SYMBOL(blk_queue_init_tags);
 int blk_queue_resize_tags(struct request_queue *q, int new_depth)
 {
 	struct blk_queue_tag *bqt = q->queue_tags;
-	struct request **tag_index;
-	unsigned long *tag_map;
-	int max_depth, nr_ulongs;
+	int tag;
 
 	if (!bqt)
 		return -ENXIO;
 
+	/* The map was sized for the deepest queue, see init_tag_map() */
+	if (new_depth > bqt->real_max_depth) {
+		new_depth = bqt->real_max_depth;
+		printk(KERN_ERR "%s: adjusted depth to %d\n",
+		       __func__, new_depth);
+	}
+
 	/*
-	 * if we already have large enough real_max_depth.  just
-	 * adjust max_depth.  *NOTE* as requests with tag value
-	 * between new_depth and real_max_depth can be in-flight, tag
-	 * map can not be shrunk blindly here.
+	 * *NOTE* as requests with tag value between new_depth and
+	 * max_depth can be in-flight, a shrink only takes effect as
+	 * their tags come back: blk_map_put_tag() parks them.
 	 */
-	if (new_depth <= bqt->real_max_depth) {
+	if (new_depth <= bqt->max_depth) {
 		bqt->max_depth = new_depth;
 		return 0;
 	}
 
 	/*
-	 * Currently cannot replace a shared tag map with a new
-	 * one, so error out if this is the case
+	 * Return the parked tags below the new depth to the pool.  Another
+	 * queue of a shared map could be between taking a tag and setting
+	 * its tag_index, so error out if this is the case.
 	 */
 	if (atomic_read(&bqt->refcnt) != 1)
 		return -EBUSY;
 
-	/*
-	 * save the old state info, so we can copy it back
-	 */
-	tag_index = bqt->tag_index;
-	tag_map = bqt->tag_map;
-	max_depth = bqt->real_max_depth;
+	for (tag = bqt->max_depth; tag < new_depth; tag++) {
+		if (test_bit(tag, bqt->tag_map) && !bqt->tag_index[tag]) {
+			clear_bit(tag, bqt->tag_map);
+			percpu_ida_free(&bqt->free_tags, tag);
+		}
+	}
+	bqt->max_depth = new_depth;
+	return 0;
+}
+EXPORT_SYMBOL(blk_queue_resize_tags);
 
-	if (init_tag_map(q, bqt, new_depth))
-		return -ENOMEM;
+/**
+ * blk_map_get_tag - take a free tag of a tag map
+ * @bqt:  the tag map
+ *
+ *  Description:
+ *    Returns a tag below the map's max_depth, marked busy in its tag_map,
+ *    or -1 if all are busy.  Requests get their tags through
+ *    blk_queue_start_tag(); this is for drivers tagging commands of a
+ *    shared map themselves.
+ *
+ *  Notes:
+ *    Safe from any context.
+ **/
+int blk_map_get_tag(struct blk_queue_tag *bqt)
+{
+	int tag;
 
-	memcpy(bqt->tag_index, tag_index, max_depth * sizeof(struct request *));
-	nr_ulongs = ALIGN(max_depth, BITS_PER_LONG) / BITS_PER_LONG;
-	memcpy(bqt->tag_map, tag_map, nr_ulongs * sizeof(unsigned long));
+	for (;;) {
+		tag = percpu_ida_alloc(&bqt->free_tags, GFP_ATOMIC);
+		if (tag < 0)
+			return -1;
 
-	kfree(tag_index);
-	kfree(tag_map);
-	return 0;
+		/*
+		 * We need lock ordering semantics given by
+		 * test_and_set_bit_lock.  See blk_map_put_tag for details.
+		 */
+		if (unlikely(test_and_set_bit_lock(tag, bqt->tag_map))) {
+			printk(KERN_ERR "%s: free tag %d is busy\n",
+			       __func__, tag);
+			continue;
+		}
+
+		if (likely(tag < bqt->max_depth))
+			return tag;
+
+		/* left over from before the depth was reduced: park it */
+	}
 }
-EXPORT_SYMBOL(blk_queue_resize_tags);
+EXPORT_SYMBOL(blk_map_get_tag);
+
+/**
+ * blk_map_put_tag - release a tag taken with blk_map_get_tag()
+ * @bqt:  the tag map
+ * @tag:  the tag
+ *
+ *  Notes:
+ *    The caller must have cleared tag_index[@tag].  Safe from any
+ *    context.
+ **/
+void blk_map_put_tag(struct blk_queue_tag *bqt, int tag)
+{
+	if (unlikely(!test_bit(tag, bqt->tag_map))) {
+		printk(KERN_ERR "%s: attempt to clear non-busy tag (%d)\n",
+		       __func__, tag);
+		return;
+	}
+
+	/* Beyond a reduced depth: stays parked until it is raised again */
+	if (unlikely(tag >= bqt->max_depth))
+		return;
+
+	/*
+	 * The tag_map bit acts as a lock for tag_index[bit], so we need
+	 * unlock memory barrier semantics.
+	 */
+	clear_bit_unlock(tag, bqt->tag_map);
+	percpu_ida_free(&bqt->free_tags, tag);
+}
+EXPORT_SYMBOL(blk_map_put_tag);
 
 /**
  * blk_queue_end_tag - end tag operations for a request
@@ -301,17 +425,7 @@ void blk_queue_end_tag(struct request_queue *q, struct request *rq)
 		       __func__, tag);
 
 	bqt->tag_index[tag] = NULL;
-
-	if (unlikely(!test_bit(tag, bqt->tag_map))) {
-		printk(KERN_ERR "%s: attempt to clear non-busy tag (%d)\n",
-		       __func__, tag);
-		return;
-	}
-	/*
-	 * The tag_map bit acts as a lock for tag_index[bit], so we need
-	 * unlock memory barrier semantics.
-	 */
-	clear_bit_unlock(tag, bqt->tag_map);
+	blk_map_put_tag(bqt, tag);
 }
 EXPORT_SYMBOL(blk_queue_end_tag);
 
@@ -348,9 +462,6 @@ int blk_queue_start_tag(struct request_queue *q, struct request *rq)
 	}
 
 	/*
-	 * Protect against shared tag maps, as we may not have exclusive
-	 * access to the tag map.
-	 *
 	 * We reserve a few tags just for sync IO, since we don't want
 	 * to starve sync IO on behalf of flooding async IO.
 	 */
@@ -363,16 +474,9 @@ int blk_queue_start_tag(struct request_queue *q, struct request *rq)
 			return 1;
 	}
 
-	do {
-		tag = find_first_zero_bit(bqt->tag_map, max_depth);
-		if (tag >= max_depth)
-			return 1;
-
-	} while (test_and_set_bit_lock(tag, bqt->tag_map));
-	/*
-	 * We need lock ordering semantics given by test_and_set_bit_lock.
-	 * See blk_queue_end_tag for details.
-	 */
+	tag = blk_map_get_tag(bqt);
+	if (tag < 0)
+		return 1;
 
 	rq->cmd_flags |= REQ_QUEUED;
 	rq->tag = tag;
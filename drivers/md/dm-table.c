@@ -1420,6 +1420,7 @@ void dm_table_set_restrictions(struct dm_table *t, struct request_queue *q,
 	 * Copy table's limits to the DM device's request_queue
 	 */
 	q->limits = *limits;
+	q->backing_dev_info.io_pages = limits->io_opt >> PAGE_CACHE_SHIFT;
 
 	if (limits->no_cluster)
 		queue_flag_clear_unlocked(QUEUE_FLAG_CLUSTER, q);
@@ -851,9 +851,10 @@ static void ixgbe_tx_timeout_reset(struct ixgbe_adapter *adapter)
  * ixgbe_clean_tx_irq - Reclaim resources after transmit completes
  * @q_vector: structure containing interrupt and ring information
  * @tx_ring: tx ring to clean
+ * @napi_budget: Used to determine if we are in netpoll
  **/
 static bool ixgbe_clean_tx_irq(struct ixgbe_q_vector *q_vector,
-			       struct ixgbe_ring *tx_ring)
+			       struct ixgbe_ring *tx_ring, int napi_budget)
 {
 	struct ixgbe_adapter *adapter = q_vector->adapter;
 	struct ixgbe_tx_buffer *tx_buffer;
@@ -891,7 +892,7 @@ static bool ixgbe_clean_tx_irq(struct ixgbe_q_vector *q_vector,
 		total_packets += tx_buffer->gso_segs;
 
 		/* free the skb */
-		dev_kfree_skb_any(tx_buffer->skb);
+		napi_consume_skb(tx_buffer->skb, napi_budget);
 
 		/* unmap skb header data */
 		dma_unmap_single(tx_ring->dev,
@@ -1261,6 +1262,57 @@ static bool ixgbe_alloc_mapped_page(struct ixgbe_ring *rx_ring,
 	return true;
 }
 
+#define IXGBE_RX_BULK_PAGES	16
+
+/**
+ * ixgbe_bulk_alloc_rx_pages - Preallocate pages for buffers being replaced
+ * @rx_ring: ring to place buffers on
+ * @cleaned_count: number of buffers to replace
+ *
+ * Buffers that could not be recycled need a fresh page.  Get those from
+ * the bulk page allocator, IXGBE_RX_BULK_PAGES at a time, rather than
+ * one alloc_pages() call per buffer.  Anything not allocated here is
+ * left to ixgbe_alloc_mapped_page().
+ **/
+static void ixgbe_bulk_alloc_rx_pages(struct ixgbe_ring *rx_ring,
+				      u16 cleaned_count)
+{
+	struct ixgbe_rx_buffer *bi;
+	LIST_HEAD(pages);
+	u16 i, count, needed = 0;
+
+	/* only order-0 pages come from the bulk allocator */
+	if (ixgbe_rx_pg_order(rx_ring))
+		return;
+
+	for (i = rx_ring->next_to_use, count = cleaned_count; count; count--) {
+		bi = &rx_ring->rx_buffer_info[i];
+		if (!bi->dma && !bi->page)
+			needed++;
+		if (++i == rx_ring->count)
+			i = 0;
+	}
+
+	for (i = rx_ring->next_to_use, count = cleaned_count; count; count--) {
+		bi = &rx_ring->rx_buffer_info[i];
+		if (++i == rx_ring->count)
+			i = 0;
+		if (bi->dma || bi->page)
+			continue;
+
+		if (list_empty(&pages) &&
+		    !alloc_pages_bulk_list(GFP_ATOMIC | __GFP_COLD,
+					   min_t(u16, needed,
+						 IXGBE_RX_BULK_PAGES),
+					   &pages))
+			break;
+
+		bi->page = list_entry(pages.next, struct page, lru);
+		list_del(&bi->page->lru);
+		needed--;
+	}
+}
+
 /**
  * ixgbe_alloc_rx_buffers - Replace used receive buffers
  * @rx_ring: ring to place buffers on
@@ -1276,6 +1328,8 @@ void ixgbe_alloc_rx_buffers(struct ixgbe_ring *rx_ring, u16 cleaned_count)
 	if (!cleaned_count)
 		return;
 
+	ixgbe_bulk_alloc_rx_pages(rx_ring, cleaned_count);
+
 	rx_desc = IXGBE_RX_DESC(rx_ring, i);
 	bi = &rx_ring->rx_buffer_info[i];
 	i -= rx_ring->count;
@@ -2545,7 +2599,7 @@ int ixgbe_poll(struct napi_struct *napi, int budget)
 #endif
 
 	ixgbe_for_each_ring(ring, q_vector->tx)
-		clean_complete &= !!ixgbe_clean_tx_irq(q_vector, ring);
+		clean_complete &= !!ixgbe_clean_tx_irq(q_vector, ring, budget);
 
 	/* attempt to distribute budget to each queue fairly, but don't allow
 	 * the budget to go below 1 because we'll exit polling */
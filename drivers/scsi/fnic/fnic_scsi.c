@@ -1926,13 +1926,16 @@ fnic_scsi_host_start_tag(struct fnic *fnic, struct scsi_cmnd *sc)
 		goto end;
 	}
 
-	do {
-		tag = find_next_zero_bit(bqt->tag_map, bqt->max_depth, 1);
-		if (tag >= bqt->max_depth) {
-			pr_err("Tag allocation failure\n");
-			goto end;
-		}
-	} while (test_and_set_bit(tag, bqt->tag_map));
+	tag = blk_map_get_tag(bqt);
+	if (tag == 0) {
+		/* tag 0 is not used, hold it while taking another one */
+		tag = blk_map_get_tag(bqt);
+		blk_map_put_tag(bqt, 0);
+	}
+	if (tag < 0) {
+		pr_err("Tag allocation failure\n");
+		goto end;
+	}
 
 	bqt->tag_index[tag] = sc->request;
 	sc->request->tag = tag;
@@ -1964,7 +1967,7 @@ fnic_scsi_host_end_tag(struct fnic *fnic, struct scsi_cmnd *sc)
 		return;
 
 	bqt->tag_index[tag] = NULL;
-	clear_bit(tag, bqt->tag_map);
+	blk_map_put_tag(bqt, tag);
 
 	return;
 }
@@ -35,6 +35,13 @@
 #include <linux/blkdev.h>
 #include <linux/mempool.h>
 #include <linux/hash.h>
+#include <linux/poll.h>
+#include <linux/net.h>
+#include <linux/cred.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#include <linux/pagemap.h>
+#include <linux/completion.h>
 #ifndef __GENKSYMS__
 #include <linux/compat.h>
 #endif
@@ -57,7 +64,21 @@ unsigned long aio_max_nr = 0x10000; /* system wide maximum number of aio request
 static struct kmem_cache	*kiocb_cachep;
 static struct kmem_cache	*kioctx_cachep;
 
+/*
+ * Per-cpu state of a kioctx: a share of the free event ring slots, and
+ * a few kiocbs kept back from kiocb_cachep for the next submission.
+ * Only touched with interrupts off, as aio_complete() may run in irq
+ * context.
+ */
+#define KIOCB_CPU_CACHE		16
+struct kioctx_cpu {
+	unsigned		reqs_available;
+	unsigned		nr_free;
+	struct kiocb		*free[KIOCB_CPU_CACHE];
+};
+
 static struct workqueue_struct *aio_wq;
+static struct workqueue_struct *aio_fsync_wq;
 
 /* Used for rare fput completion. */
 static void aio_fput_routine(struct work_struct *);
@@ -87,6 +108,7 @@ static int __init aio_setup(void)
 	kioctx_cachep = KMEM_CACHE(kioctx,SLAB_HWCACHE_ALIGN|SLAB_PANIC);
 
 	aio_wq = create_workqueue("aio");
+	aio_fsync_wq = create_workqueue("aio_fsync");
 	abe_pool = mempool_create_kmalloc_pool(1, sizeof(struct aio_batch_entry));
 	BUG_ON(!abe_pool);
 
@@ -116,11 +138,10 @@ static void aio_free_ring(struct kioctx *ctx)
 	info->nr = 0;
 }
 
-static int aio_setup_ring(struct kioctx *ctx)
+static int aio_setup_ring(struct kioctx *ctx, unsigned nr_events)
 {
 	struct aio_ring *ring;
 	struct aio_ring_info *info = &ctx->ring_info;
-	unsigned nr_events = ctx->max_reqs;
 	unsigned long size;
 	int nr_pages;
 
@@ -186,6 +207,65 @@ static int aio_setup_ring(struct kioctx *ctx)
 }
 
 
+/* aio_setup_sq_ring
+ *	Maps the submission ring of a context created by io_ring_setup().
+ *	The ring is only ever read from io_ring_enter(), in the context
+ *	of the submitting process, so unlike the event ring it is not
+ *	pinned.
+ */
+static int aio_setup_sq_ring(struct kioctx *ctx, unsigned entries)
+{
+	struct aio_sq_info *sq = &ctx->sq_info;
+	struct aio_sq_ring __user *ring;
+	unsigned long size;
+	int ret = 0;
+
+	size = sizeof(struct aio_sq_ring) + entries * sizeof(struct iocb);
+
+	mutex_lock(&sq->lock);
+	sq->mmap_size = PAGE_ALIGN(size);
+	down_write(&ctx->mm->mmap_sem);
+	sq->mmap_base = do_mmap(NULL, 0, sq->mmap_size,
+				PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE,
+				0);
+	up_write(&ctx->mm->mmap_sem);
+	if (IS_ERR((void *)sq->mmap_base)) {
+		sq->mmap_size = 0;
+		ret = -EAGAIN;
+		goto out;
+	}
+
+	/* head, tail and dropped start out zeroed */
+	ring = (struct aio_sq_ring __user *)sq->mmap_base;
+	if (put_user(entries, &ring->nr) ||
+	    put_user(entries - 1, &ring->mask) ||
+	    put_user(AIO_SQ_RING_MAGIC, &ring->magic) ||
+	    put_user(sizeof(struct aio_sq_ring), &ring->header_length)) {
+		ret = -EFAULT;
+		goto out;
+	}
+
+	sq->head = 0;
+	sq->nr = entries;
+out:
+	mutex_unlock(&sq->lock);
+	return ret;
+}
+
+static void aio_free_sq_ring(struct kioctx *ctx)
+{
+	struct aio_sq_info *sq = &ctx->sq_info;
+
+	if (sq->mmap_size) {
+		down_write(&ctx->mm->mmap_sem);
+		do_munmap(ctx->mm, sq->mmap_base, sq->mmap_size);
+		up_write(&ctx->mm->mmap_sem);
+	}
+	sq->mmap_size = 0;
+	sq->nr = 0;
+}
+
+
 /* aio_ring_event: returns a pointer to the event at the given index from
  * kmap_atomic(, km).  Release the pointer with put_aio_ring_event();
  */
@@ -208,11 +288,31 @@ static int aio_setup_ring(struct kioctx *ctx)
 	kunmap_atomic((void *)((unsigned long)__event & PAGE_MASK), km); \
 } while(0)
 
+static void aio_free_cpu(struct kioctx *ctx)
+{
+	int cpu;
+
+	if (!ctx->cpu)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct kioctx_cpu *kcpu = per_cpu_ptr(ctx->cpu, cpu);
+
+		while (kcpu->nr_free)
+			kmem_cache_free(kiocb_cachep,
+					kcpu->free[--kcpu->nr_free]);
+	}
+	free_percpu(ctx->cpu);
+	ctx->cpu = NULL;
+}
+
 static void ctx_rcu_free(struct rcu_head *head)
 {
 	struct kioctx *ctx = container_of(head, struct kioctx, rcu_head);
 	unsigned nr_events = ctx->max_reqs;
 
+	percpu_ref_exit(&ctx->users);
+	aio_free_cpu(ctx);
 	kmem_cache_free(kioctx_cachep, ctx);
 
 	if (nr_events) {
@@ -229,27 +329,58 @@ static void ctx_rcu_free(struct rcu_head *head)
  */
 static void __put_ioctx(struct kioctx *ctx)
 {
-	BUG_ON(ctx->reqs_active);
+	BUG_ON(atomic_read(&ctx->reqs_active));
 
 	cancel_delayed_work(&ctx->wq);
 	cancel_work_sync(&ctx->wq.work);
 	aio_free_ring(ctx);
+	aio_free_sq_ring(ctx);
 	mmdrop(ctx->mm);
 	ctx->mm = NULL;
 	pr_debug("__put_ioctx: freeing %p\n", ctx);
+	if (ctx->free_done)
+		complete(ctx->free_done);
 	call_rcu(&ctx->rcu_head, ctx_rcu_free);
 }
 
+static void free_ioctx_work(struct work_struct *work)
+{
+	__put_ioctx(container_of(work, struct kioctx, free_work));
+}
+
+/*
+ * Called on the last put, which may come from irq or RCU callback
+ * context, while __put_ioctx() has to sleep.
+ */
+static void free_ioctx_ref(struct percpu_ref *ref)
+{
+	struct kioctx *ctx = container_of(ref, struct kioctx, users);
+
+	schedule_work(&ctx->free_work);
+}
+
 static inline int try_get_ioctx(struct kioctx *kioctx)
 {
-	return atomic_inc_not_zero(&kioctx->users);
+	return percpu_ref_tryget_live(&kioctx->users);
 }
 
 static inline void put_ioctx(struct kioctx *kioctx)
 {
-	BUG_ON(atomic_read(&kioctx->users) <= 0);
-	if (unlikely(atomic_dec_and_test(&kioctx->users)))
-		__put_ioctx(kioctx);
+	percpu_ref_put(&kioctx->users);
+}
+
+/*
+ * Drop the list's reference and wait until the ioctx has been freed, so
+ * that its rings are unmapped by the time we return.  Lookups still in
+ * flight keep it around until they put it; new ones fail.
+ */
+static void kill_ioctx_wait(struct kioctx *ctx)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+
+	ctx->free_done = &done;
+	percpu_ref_kill(&ctx->users);
+	wait_for_completion(&done);
 }
 
 /* ioctx_alloc
@@ -279,18 +410,40 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	mm = ctx->mm = current->mm;
 	atomic_inc(&mm->mm_count);
 
-	atomic_set(&ctx->users, 2);
 	spin_lock_init(&ctx->ctx_lock);
 	spin_lock_init(&ctx->ring_info.ring_lock);
+	spin_lock_init(&ctx->completion_lock);
 	init_waitqueue_head(&ctx->wait);
 
 	INIT_LIST_HEAD(&ctx->active_reqs);
 	INIT_LIST_HEAD(&ctx->run_list);
 	INIT_DELAYED_WORK(&ctx->wq, aio_kick_handler);
+	INIT_WORK(&ctx->free_work, free_ioctx_work);
+	mutex_init(&ctx->sq_info.lock);
+
+	/* one reference for the list, one for the caller */
+	if (percpu_ref_init(&ctx->users, free_ioctx_ref))
+		goto out_freectx;
+	percpu_ref_get(&ctx->users);
 
-	if (aio_setup_ring(ctx) < 0)
+	ctx->cpu = alloc_percpu(struct kioctx_cpu);
+	if (!ctx->cpu)
+		goto out_freectx;
+
+	/*
+	 * Slots parked in the per-cpu caches are not available to other
+	 * cpus, so size the ring with enough slack that nr_events can
+	 * always be in flight.
+	 */
+	if (aio_setup_ring(ctx, max_t(unsigned, nr_events,
+					 num_possible_cpus() * 4) * 2) < 0)
 		goto out_freectx;
 
+	atomic_set(&ctx->reqs_available, ctx->ring_info.nr - 1);
+	ctx->req_batch = (ctx->ring_info.nr - 1) / (num_possible_cpus() * 4);
+	if (ctx->req_batch < 1)
+		ctx->req_batch = 1;
+
 	/* limit the number of system wide aios */
 	do {
 		spin_lock_bh(&aio_nr_lock);
@@ -327,6 +480,8 @@ out_cleanup:
 
 out_freectx:
 	mmdrop(mm);
+	percpu_ref_exit(&ctx->users);
+	aio_free_cpu(ctx);
 	kmem_cache_free(kioctx_cachep, ctx);
 	ctx = ERR_PTR(-ENOMEM);
 
@@ -351,8 +506,8 @@ static void aio_cancel_all(struct kioctx *ctx)
 		list_del_init(&iocb->ki_list);
 		cancel = iocb->ki_cancel;
 		kiocbSetCancelled(iocb);
-		if (cancel) {
-			iocb->ki_users++;
+		/* a zero count means the final put is waiting for ctx_lock */
+		if (cancel && atomic_inc_not_zero(&iocb->ki_users)) {
 			spin_unlock_irq(&ctx->ctx_lock);
 			cancel(iocb, &res);
 			spin_lock_irq(&ctx->ctx_lock);
@@ -366,23 +521,17 @@ static void wait_for_all_aios(struct kioctx *ctx)
 	struct task_struct *tsk = current;
 	DECLARE_WAITQUEUE(wait, tsk);
 
-	spin_lock_irq(&ctx->ctx_lock);
-	if (!ctx->reqs_active)
-		goto out;
+	if (!atomic_read(&ctx->reqs_active))
+		return;
 
 	add_wait_queue(&ctx->wait, &wait);
 	set_task_state(tsk, TASK_UNINTERRUPTIBLE);
-	while (ctx->reqs_active) {
-		spin_unlock_irq(&ctx->ctx_lock);
+	while (atomic_read(&ctx->reqs_active)) {
 		io_schedule();
 		set_task_state(tsk, TASK_UNINTERRUPTIBLE);
-		spin_lock_irq(&ctx->ctx_lock);
 	}
 	__set_task_state(tsk, TASK_RUNNING);
 	remove_wait_queue(&ctx->wait, &wait);
-
-out:
-	spin_unlock_irq(&ctx->ctx_lock);
 }
 
 /* wait_on_sync_kiocb:
@@ -390,9 +539,9 @@ out:
  */
 ssize_t wait_on_sync_kiocb(struct kiocb *iocb)
 {
-	while (iocb->ki_users) {
+	while (atomic_read(&iocb->ki_users)) {
 		set_current_state(TASK_UNINTERRUPTIBLE);
-		if (!iocb->ki_users)
+		if (!atomic_read(&iocb->ki_users))
 			break;
 		io_schedule();
 	}
@@ -424,37 +573,177 @@ void exit_aio(struct mm_struct *mm)
 		 */
 		cancel_work_sync(&ctx->wq.work);
 
-		if (1 != atomic_read(&ctx->users))
-			printk(KERN_DEBUG
-				"exit_aio:ioctx still alive: %d %d %d\n",
-				atomic_read(&ctx->users), ctx->dead,
-				ctx->reqs_active);
-		put_ioctx(ctx);
+		/* the rings must be unmapped before the mm is torn down */
+		kill_ioctx_wait(ctx);
 	}
 }
 
+/*
+ * Event ring slots.  A submission takes a slot before it may complete
+ * into the ring.  Slots are handed back in bulk once the events in them
+ * have been consumed, whether by io_getevents() or by userspace moving
+ * the ring head itself, so no lock is shared between submitters,
+ * completions and reapers on the fast path.
+ */
+static void put_reqs_available(struct kioctx *ctx, unsigned nr)
+{
+	struct kioctx_cpu *kcpu;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	kcpu = this_cpu_ptr(ctx->cpu);
+	kcpu->reqs_available += nr;
+	while (kcpu->reqs_available >= ctx->req_batch * 2) {
+		kcpu->reqs_available -= ctx->req_batch;
+		atomic_add(ctx->req_batch, &ctx->reqs_available);
+	}
+	local_irq_restore(flags);
+}
+
+static int __get_reqs_available(struct kioctx *ctx)
+{
+	struct kioctx_cpu *kcpu;
+	unsigned long flags;
+	int avail, ret = 0;
+
+	local_irq_save(flags);
+	kcpu = this_cpu_ptr(ctx->cpu);
+	if (!kcpu->reqs_available) {
+		do {
+			avail = atomic_read(&ctx->reqs_available);
+			if (avail < ctx->req_batch)
+				goto out;
+		} while (atomic_cmpxchg(&ctx->reqs_available, avail,
+					avail - ctx->req_batch) != avail);
+		kcpu->reqs_available += ctx->req_batch;
+	}
+	kcpu->reqs_available--;
+	ret = 1;
+out:
+	local_irq_restore(flags);
+	return ret;
+}
+
+/* refill_reqs_available
+ *	Returns the slots of events that have been posted and consumed
+ *	since the last refill.  head is read from the ring and may be
+ *	anything userspace wrote there.  Called with completion_lock held.
+ */
+static void refill_reqs_available(struct kioctx *ctx, unsigned head,
+				  unsigned tail)
+{
+	unsigned nr = ctx->ring_info.nr;
+	unsigned events_in_ring, completed;
+
+	head %= nr;
+	if (head <= tail)
+		events_in_ring = tail - head;
+	else
+		events_in_ring = nr - (head - tail);
+
+	completed = ctx->completed_events;
+	if (events_in_ring < completed)
+		completed -= events_in_ring;
+	else
+		completed = 0;
+
+	if (!completed)
+		return;
+
+	ctx->completed_events -= completed;
+	put_reqs_available(ctx, completed);
+}
+
+/* user_refill_reqs_available
+ *	Called when we run out of slots: events may have been reaped
+ *	without a completion since, e.g. by userspace advancing the head.
+ */
+static void user_refill_reqs_available(struct kioctx *ctx)
+{
+	spin_lock_irq(&ctx->completion_lock);
+	if (ctx->completed_events) {
+		struct aio_ring *ring;
+		unsigned head;
+
+		ring = kmap_atomic(ctx->ring_info.ring_pages[0], KM_USER0);
+		head = ring->head;
+		kunmap_atomic(ring, KM_USER0);
+
+		refill_reqs_available(ctx, head, ctx->ring_info.tail);
+	}
+	spin_unlock_irq(&ctx->completion_lock);
+}
+
+static int get_reqs_available(struct kioctx *ctx)
+{
+	if (__get_reqs_available(ctx))
+		return 1;
+	user_refill_reqs_available(ctx);
+	return __get_reqs_available(ctx);
+}
+
+static struct kiocb *aio_alloc_kiocb(struct kioctx *ctx)
+{
+	struct kioctx_cpu *kcpu;
+	struct kiocb *req = NULL;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	kcpu = this_cpu_ptr(ctx->cpu);
+	if (kcpu->nr_free)
+		req = kcpu->free[--kcpu->nr_free];
+	local_irq_restore(flags);
+
+	if (!req)
+		req = kmem_cache_alloc(kiocb_cachep, GFP_KERNEL);
+	return req;
+}
+
+static void aio_free_kiocb(struct kioctx *ctx, struct kiocb *req)
+{
+	struct kioctx_cpu *kcpu;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	kcpu = this_cpu_ptr(ctx->cpu);
+	if (kcpu->nr_free < KIOCB_CPU_CACHE) {
+		kcpu->free[kcpu->nr_free++] = req;
+		req = NULL;
+	}
+	local_irq_restore(flags);
+
+	if (req)
+		kmem_cache_free(kiocb_cachep, req);
+}
+
 /* aio_get_req
- *	Allocate a slot for an aio request.  Increments the users count
- * of the kioctx so that the kioctx stays around until all requests are
- * complete.  Returns NULL if no requests are free.
+ *	Allocate a slot for an aio request.  Increments reqs_active so
+ * that exit_aio() and io_destroy() wait for the request to be freed.
+ * Returns NULL if no requests are free.
  *
  * Returns with kiocb->users set to 2.  The io submit code path holds
  * an extra reference while submitting the i/o.
  * This prevents races between the aio code path referencing the
  * req (after submitting it) and aio_complete() freeing the req.
  */
-static struct kiocb *__aio_get_req(struct kioctx *ctx)
+static struct kiocb *aio_get_req(struct kioctx *ctx)
 {
-	struct kiocb *req = NULL;
-	struct aio_ring *ring;
-	int okay = 0;
+	struct kiocb *req;
+
+	/* Check if the completion queue has enough free space to
+	 * accept an event from this io.
+	 */
+	if (!get_reqs_available(ctx))
+		return NULL;
 
-	req = kmem_cache_alloc(kiocb_cachep, GFP_KERNEL);
-	if (unlikely(!req))
+	req = aio_alloc_kiocb(ctx);
+	if (unlikely(!req)) {
+		put_reqs_available(ctx, 1);
 		return NULL;
+	}
 
 	req->ki_flags = 0;
-	req->ki_users = 2;
+	atomic_set(&req->ki_users, 2);
 	req->ki_key = 0;
 	req->ki_ctx = ctx;
 	req->ki_cancel = NULL;
@@ -463,59 +752,34 @@ static struct kiocb *__aio_get_req(struct kioctx *ctx)
 	req->private = NULL;
 	req->ki_iovec = NULL;
 	INIT_LIST_HEAD(&req->ki_run_list);
+	INIT_LIST_HEAD(&req->ki_list);
 	req->ki_eventfd = NULL;
+	req->ki_cred = NULL;
 
-	/* Check if the completion queue has enough free space to
-	 * accept an event from this io.
-	 */
-	spin_lock_irq(&ctx->ctx_lock);
-	ring = kmap_atomic(ctx->ring_info.ring_pages[0], KM_USER0);
-	if (ctx->reqs_active < aio_ring_avail(&ctx->ring_info, ring)) {
-		list_add(&req->ki_list, &ctx->active_reqs);
-		ctx->reqs_active++;
-		okay = 1;
-	}
-	kunmap_atomic(ring, KM_USER0);
-	spin_unlock_irq(&ctx->ctx_lock);
-
-	if (!okay) {
-		kmem_cache_free(kiocb_cachep, req);
-		req = NULL;
-	}
-
+	atomic_inc(&ctx->reqs_active);
 	return req;
 }
 
-static inline struct kiocb *aio_get_req(struct kioctx *ctx)
+static void really_put_req(struct kioctx *ctx, struct kiocb *req)
 {
-	struct kiocb *req;
-	/* Handle a potential starvation case -- should be exceedingly rare as 
-	 * requests will be stuck on fput_head only if the aio_fput_routine is 
-	 * delayed and the requests were the last user of the struct file.
-	 */
-	req = __aio_get_req(ctx);
-	if (unlikely(NULL == req)) {
-		aio_fput_routine(NULL);
-		req = __aio_get_req(ctx);
-	}
-	return req;
-}
-
-static inline void really_put_req(struct kioctx *ctx, struct kiocb *req)
-{
-	assert_spin_locked(&ctx->ctx_lock);
-
 	if (req->ki_eventfd != NULL)
 		eventfd_ctx_put(req->ki_eventfd);
+	if (req->ki_cred)
+		put_cred(req->ki_cred);
 	if (req->ki_dtor)
 		req->ki_dtor(req);
 	if (req->ki_iovec != &req->ki_inline_vec)
 		kfree(req->ki_iovec);
-	kmem_cache_free(kiocb_cachep, req);
-	ctx->reqs_active--;
+	aio_free_kiocb(ctx, req);
 
-	if (unlikely(!ctx->reqs_active && ctx->dead))
+	/*
+	 * Once reqs_active drops to zero a dead ctx may be freed, but
+	 * actual freeing is RCU'd.
+	 */
+	rcu_read_lock();
+	if (atomic_dec_and_test(&ctx->reqs_active) && unlikely(ctx->dead))
 		wake_up(&ctx->wait);
+	rcu_read_unlock();
 }
 
 static void aio_fput_routine(struct work_struct *data)
@@ -532,37 +796,24 @@ static void aio_fput_routine(struct work_struct *data)
 		if (req->ki_filp != NULL)
 			__fput(req->ki_filp);
 
-		/* Link the iocb into the context's free list */
-		rcu_read_lock();
-		spin_lock_irq(&ctx->ctx_lock);
 		really_put_req(ctx, req);
-		/*
-		 * at that point ctx might've been killed, but actual
-		 * freeing is RCU'd
-		 */
-		spin_unlock_irq(&ctx->ctx_lock);
-		rcu_read_unlock();
 
 		spin_lock_irq(&fput_lock);
 	}
 	spin_unlock_irq(&fput_lock);
 }
 
-/* __aio_put_req
- *	Returns true if this put was the last user of the request.
+/* aio_free_req
+ *	Releases a request whose last reference has been dropped and
+ *	which is no longer on active_reqs.
  */
-static int __aio_put_req(struct kioctx *ctx, struct kiocb *req)
+static void aio_free_req(struct kioctx *ctx, struct kiocb *req)
 {
+	unsigned long flags;
+
 	dprintk(KERN_DEBUG "aio_put(%p): f_count=%ld\n",
 		req, atomic_long_read(&req->ki_filp->f_count));
 
-	assert_spin_locked(&ctx->ctx_lock);
-
-	req->ki_users--;
-	BUG_ON(req->ki_users < 0);
-	if (likely(req->ki_users))
-		return 0;
-	list_del(&req->ki_list);		/* remove from active_reqs */
 	req->ki_cancel = NULL;
 	req->ki_retry = NULL;
 
@@ -573,32 +824,83 @@ static int __aio_put_req(struct kioctx *ctx, struct kiocb *req)
 	 * this function will be executed w/out any aio kthread wakeup.
 	 */
 	if (unlikely(atomic_long_dec_and_test(&req->ki_filp->f_count))) {
-		spin_lock(&fput_lock);
+		spin_lock_irqsave(&fput_lock, flags);
 		list_add(&req->ki_list, &fput_head);
-		spin_unlock(&fput_lock);
+		spin_unlock_irqrestore(&fput_lock, flags);
 		queue_work(aio_wq, &fput_work);
 	} else {
 		req->ki_filp = NULL;
 		really_put_req(ctx, req);
 	}
+}
+
+/* __aio_put_req
+ *	Returns true if this put was the last user of the request.
+ *	Called with ctx_lock held.
+ */
+static int __aio_put_req(struct kioctx *ctx, struct kiocb *req)
+{
+	int users;
+
+	assert_spin_locked(&ctx->ctx_lock);
+
+	users = atomic_dec_return(&req->ki_users);
+	BUG_ON(users < 0);
+	if (likely(users))
+		return 0;
+	list_del_init(&req->ki_list);		/* remove from active_reqs */
+	aio_free_req(ctx, req);
 	return 1;
 }
 
 /* aio_put_req
  *	Returns true if this put was the last user of the kiocb,
- *	false if the request is still in use.
+ *	false if the request is still in use.  Only cancellable
+ *	requests need ctx_lock to be freed.
  */
 int aio_put_req(struct kiocb *req)
 {
 	struct kioctx *ctx = req->ki_ctx;
-	int ret;
-	spin_lock_irq(&ctx->ctx_lock);
-	ret = __aio_put_req(ctx, req);
-	spin_unlock_irq(&ctx->ctx_lock);
-	return ret;
+	unsigned long flags;
+	int users;
+
+	users = atomic_dec_return(&req->ki_users);
+	BUG_ON(users < 0);
+	if (likely(users))
+		return 0;
+	if (req->ki_cancel) {
+		spin_lock_irqsave(&ctx->ctx_lock, flags);
+		list_del_init(&req->ki_list);	/* remove from active_reqs */
+		spin_unlock_irqrestore(&ctx->ctx_lock, flags);
+	}
+	aio_free_req(ctx, req);
+	return 1;
 }
 EXPORT_SYMBOL(aio_put_req);
 
+/* kiocb_set_cancel_fn
+ *	Makes a request cancellable by io_cancel() and on exit, by
+ *	putting it on active_reqs.  Must be called while the caller
+ *	still holds a reference to the request.
+ */
+void kiocb_set_cancel_fn(struct kiocb *req,
+			 int (*cancel)(struct kiocb *, struct io_event *))
+{
+	struct kioctx *ctx = req->ki_ctx;
+	unsigned long flags;
+
+	/* sync kiocbs have no ctx and nobody to cancel them */
+	if (is_sync_kiocb(req))
+		return;
+
+	spin_lock_irqsave(&ctx->ctx_lock, flags);
+	if (!req->ki_cancel)
+		list_add_tail(&req->ki_list, &ctx->active_reqs);
+	req->ki_cancel = cancel;
+	spin_unlock_irqrestore(&ctx->ctx_lock, flags);
+}
+EXPORT_SYMBOL(kiocb_set_cancel_fn);
+
 static struct kioctx *lookup_ioctx(unsigned long ctx_id)
 {
 	struct mm_struct *mm = current->mm;
@@ -610,9 +912,9 @@ static struct kioctx *lookup_ioctx(unsigned long ctx_id)
 	hlist_for_each_entry_rcu(ctx, n, &mm->ioctx_list, list) {
 		/*
 		 * RCU protects us against accessing freed memory but
-		 * we have to be careful not to get a reference when the
-		 * reference count already dropped to 0 (ctx->dead test
-		 * is unreliable because of races).
+		 * we have to be careful not to get a reference once the
+		 * ioctx has been killed (ctx->dead test is unreliable
+		 * because of races).
 		 */
 		if (ctx->user_id == ctx_id && !ctx->dead && try_get_ioctx(ctx)){
 			ret = ctx;
@@ -780,7 +1082,7 @@ static int __aio_run_iocbs(struct kioctx *ctx)
 		/*
 		 * Hold an extra reference while retrying i/o.
 		 */
-		iocb->ki_users++;       /* grab extra reference */
+		atomic_inc(&iocb->ki_users);	/* grab extra reference */
 		aio_run_iocb(iocb);
 		__aio_put_req(ctx, iocb);
  	}
@@ -929,8 +1231,7 @@ int aio_complete(struct kiocb *iocb, long res, long res2)
 	struct aio_ring	*ring;
 	struct io_event	*event;
 	unsigned long	flags;
-	unsigned long	tail;
-	int		ret;
+	unsigned	head, tail;
 
 	/*
 	 * Special case handling for sync iocbs:
@@ -940,34 +1241,44 @@ int aio_complete(struct kiocb *iocb, long res, long res2)
 	 *  - the sync task helpfully left a reference to itself in the iocb
 	 */
 	if (is_sync_kiocb(iocb)) {
-		BUG_ON(iocb->ki_users != 1);
+		BUG_ON(atomic_read(&iocb->ki_users) != 1);
 		iocb->ki_user_data = res;
-		iocb->ki_users = 0;
+		atomic_set(&iocb->ki_users, 0);
 		wake_up_process(iocb->ki_obj.tsk);
 		return 1;
 	}
 
 	info = &ctx->ring_info;
 
-	/* add a completion event to the ring buffer.
-	 * must be done holding ctx->ctx_lock to prevent
-	 * other code from messing with the tail
-	 * pointer since we might be called from irq
-	 * context.
+	/*
+	 * Only a kiocb that went through a retry which asked to be
+	 * kicked may still be on the run list.  Requests queued straight
+	 * to the device have a NULL ki_run_list.prev from aio_run_iocb()
+	 * and complete without touching ctx_lock.
 	 */
-	spin_lock_irqsave(&ctx->ctx_lock, flags);
-
-	if (iocb->ki_run_list.prev && !list_empty(&iocb->ki_run_list))
-		list_del_init(&iocb->ki_run_list);
+	if (iocb->ki_run_list.prev) {
+		spin_lock_irqsave(&ctx->ctx_lock, flags);
+		if (iocb->ki_run_list.prev && !list_empty(&iocb->ki_run_list))
+			list_del_init(&iocb->ki_run_list);
+		spin_unlock_irqrestore(&ctx->ctx_lock, flags);
+	}
 
 	/*
 	 * cancelled requests don't get events, userland was given one
 	 * when the event got cancelled.
 	 */
-	if (kiocbIsCancelled(iocb))
+	if (kiocbIsCancelled(iocb)) {
+		put_reqs_available(ctx, 1);
 		goto put_rq;
+	}
 
-	ring = kmap_atomic(info->ring_pages[0], KM_IRQ1);
+	/* add a completion event to the ring buffer.
+	 * must be done holding ctx->completion_lock to prevent
+	 * other code from messing with the tail
+	 * pointer since we might be called from irq
+	 * context.
+	 */
+	spin_lock_irqsave(&ctx->completion_lock, flags);
 
 	tail = info->tail;
 	event = aio_ring_event(info, tail, KM_IRQ0);
@@ -979,22 +1290,35 @@ int aio_complete(struct kiocb *iocb, long res, long res2)
 	event->res = res;
 	event->res2 = res2;
 
-	dprintk("aio_complete: %p[%lu]: %p: %p %Lx %lx %lx\n",
+	dprintk("aio_complete: %p[%u]: %p: %p %Lx %lx %lx\n",
 		ctx, tail, iocb, iocb->ki_obj.user, iocb->ki_user_data,
 		res, res2);
 
+	put_aio_ring_event(event, KM_IRQ0);
+
 	/* after flagging the request as done, we
 	 * must never even look at it again
 	 */
 	smp_wmb();	/* make event visible before updating tail */
 
 	info->tail = tail;
-	ring->tail = tail;
 
-	put_aio_ring_event(event, KM_IRQ0);
+	ring = kmap_atomic(info->ring_pages[0], KM_IRQ1);
+	head = ring->head;
+	ring->tail = tail;
 	kunmap_atomic(ring, KM_IRQ1);
 
-	pr_debug("added to ring %p at [%lu]\n", iocb, tail);
+	/*
+	 * Hand back the slots of whatever has been reaped since the
+	 * last completion, keeping this one's until it is consumed.
+	 */
+	ctx->completed_events++;
+	if (ctx->completed_events > 1)
+		refill_reqs_available(ctx, head, tail);
+
+	spin_unlock_irqrestore(&ctx->completion_lock, flags);
+
+	pr_debug("added to ring %p at [%u]\n", iocb, tail);
 
 	/*
 	 * Check if the user asked us to deliver the result through an
@@ -1004,10 +1328,6 @@ int aio_complete(struct kiocb *iocb, long res, long res2)
 	if (iocb->ki_eventfd != NULL)
 		eventfd_signal(iocb->ki_eventfd, 1);
 
-put_rq:
-	/* everything turned out well, dispose of the aiocb. */
-	ret = __aio_put_req(ctx, iocb);
-
 	/*
 	 * We have to order our ring_info tail store above and test
 	 * of the wait list below outside the wait lock.  This is
@@ -1019,16 +1339,17 @@ put_rq:
 	if (waitqueue_active(&ctx->wait))
 		wake_up(&ctx->wait);
 
-	spin_unlock_irqrestore(&ctx->ctx_lock, flags);
-	return ret;
+put_rq:
+	/* everything turned out well, dispose of the aiocb. */
+	return aio_put_req(iocb);
 }
 EXPORT_SYMBOL(aio_complete);
 
 /* aio_read_evt
  *	Pull an event off of the ioctx's event ring.  Returns the number of 
  *	events fetched (0 or 1 ;-)
- *	FIXME: make this use cmpxchg.
- *	TODO: make the ringbuffer user mmap()able (requires FIXME).
+ *	The slot is handed back to submitters lazily, by the next
+ *	completion or by a submitter that finds none available.
  */
 static int aio_read_evt(struct kioctx *ioctx, struct io_event *ent)
 {
@@ -1049,7 +1370,10 @@ static int aio_read_evt(struct kioctx *ioctx, struct io_event *ent)
 
 	head = ring->head % info->nr;
 	if (head != ring->tail) {
-		struct io_event *evp = aio_ring_event(info, head, KM_USER1);
+		struct io_event *evp;
+
+		smp_rmb(); /* read the tail before the event it covers */
+		evp = aio_ring_event(info, head, KM_USER1);
 		*ent = *evp;
 		head = (head + 1) % info->nr;
 		smp_mb(); /* finish reading the event before updatng the head */
@@ -1184,7 +1508,7 @@ retry:
 				break;
 			/* Try to only show up in io wait if there are ops
 			 *  in flight */
-			if (ctx->reqs_active)
+			if (atomic_read(&ctx->reqs_active))
 				io_schedule();
 			else
 				schedule();
@@ -1225,6 +1549,7 @@ out:
 static void io_destroy(struct kioctx *ioctx)
 {
 	struct mm_struct *mm = current->mm;
+	DECLARE_COMPLETION_ONSTACK(done);
 	int was_dead;
 
 	/* delete the entry from the list is someone else hasn't already */
@@ -1235,8 +1560,10 @@ static void io_destroy(struct kioctx *ioctx)
 	spin_unlock(&mm->ioctx_lock);
 
 	dprintk("aio_release(%p)\n", ioctx);
-	if (likely(!was_dead))
-		put_ioctx(ioctx);	/* twice for the list */
+	if (likely(!was_dead)) {
+		ioctx->free_done = &done;
+		percpu_ref_kill(&ioctx->users);	/* the list's reference */
+	}
 
 	aio_cancel_all(ioctx);
 	wait_for_all_aios(ioctx);
@@ -1248,6 +1575,10 @@ static void io_destroy(struct kioctx *ioctx)
 	 */
 	wake_up(&ioctx->wait);
 	put_ioctx(ioctx);	/* once for the lookup */
+
+	/* the ring is unmapped by the time io_destroy() returns */
+	if (likely(!was_dead))
+		wait_for_completion(&done);
 }
 
 /* sys_io_setup:
@@ -1335,6 +1666,83 @@ static void aio_advance_iovec(struct kiocb *iocb, ssize_t ret)
 	BUG_ON(ret > 0 && iocb->ki_left == 0);
 }
 
+/*
+ * aio_page_wake:
+ *	Wake function for a kiocb parked on a page by aio_read_pages_ready().
+ *	The hashed page wait queues are shared, so only the unlock of our
+ *	page kicks a retry.
+ */
+static int aio_page_wake(wait_queue_t *wait, unsigned mode, int sync,
+			 void *arg)
+{
+	struct wait_bit_key *key = arg;
+	struct page *page = wait->private;
+
+	if (key->flags != &page->flags || key->bit_nr != PG_locked)
+		return 0;
+
+	list_del_init(&wait->task_list);
+	kick_iocb(container_of(wait, struct kiocb, ki_wait));
+	return 1;
+}
+
+/*
+ * aio_read_pages_ready:
+ *	Makes sure the remaining range of a buffered read is in the page
+ *	cache and uptodate, so that ->aio_read copies it without blocking
+ *	on I/O.  Readahead is started for missing pages and the kiocb is
+ *	parked on the first page still under read, to be kicked when that
+ *	page is unlocked.  Returns 0 when the copy may proceed, or
+ *	-EIOCBRETRY when the kiocb has been parked.
+ */
+static ssize_t aio_read_pages_ready(struct kiocb *iocb)
+{
+	struct file *file = iocb->ki_filp;
+	struct address_space *mapping = file->f_mapping;
+	loff_t isize = i_size_read(mapping->host);
+	pgoff_t index, last;
+	loff_t end;
+
+	if (!iocb->ki_left || iocb->ki_pos >= isize)
+		return 0;
+
+	end = min_t(loff_t, iocb->ki_pos + iocb->ki_left, isize);
+	index = iocb->ki_pos >> PAGE_CACHE_SHIFT;
+	last = (end - 1) >> PAGE_CACHE_SHIFT;
+
+	for (; index <= last; index++) {
+		struct page *page;
+		ssize_t ret;
+		int uptodate;
+
+		page = find_get_page(mapping, index);
+		if (!page) {
+			page_cache_sync_readahead(mapping, &file->f_ra, file,
+						  index, last + 1 - index);
+			page = find_get_page(mapping, index);
+			/* leave allocation failures to the synchronous path */
+			if (!page)
+				return 0;
+		}
+		if (PageUptodate(page)) {
+			page_cache_release(page);
+			continue;
+		}
+
+		init_waitqueue_func_entry(&iocb->ki_wait, aio_page_wake);
+		iocb->ki_wait.private = page;
+		ret = wait_on_page_locked_async(page, &iocb->ki_wait);
+		uptodate = PageUptodate(page);
+		page_cache_release(page);
+		if (ret)
+			return ret;
+		/* unlocked but not uptodate: ->aio_read rereads and reports */
+		if (!uptodate)
+			return 0;
+	}
+	return 0;
+}
+
 static ssize_t aio_rw_vect_retry(struct kiocb *iocb)
 {
 	struct file *file = iocb->ki_filp;
@@ -1358,6 +1766,17 @@ static ssize_t aio_rw_vect_retry(struct kiocb *iocb)
 	if (iocb->ki_pos < 0)
 		return -EINVAL;
 
+	/*
+	 * Buffered reads must not sleep on page cache misses in the
+	 * submitter or in aio_wq: wait for the pages asynchronously.
+	 */
+	if (opcode == IOCB_CMD_PREADV && S_ISREG(inode->i_mode) &&
+	    !(file->f_flags & O_DIRECT) && mapping->a_ops->readpage) {
+		ret = aio_read_pages_ready(iocb);
+		if (ret)
+			return ret;
+	}
+
 	do {
 		ret = rw_op(iocb, &iocb->ki_iovec[iocb->ki_cur_seg],
 			    iocb->ki_nr_segs - iocb->ki_cur_seg,
@@ -1386,26 +1805,193 @@ static ssize_t aio_rw_vect_retry(struct kiocb *iocb)
 	return ret;
 }
 
-static ssize_t aio_fdsync(struct kiocb *iocb)
+/*
+ * Few filesystems implement ->aio_fsync, so for the others the sync is
+ * handed to aio_fsync_wq instead of blocking the submitter (or aio_wq,
+ * which services every context's retries).
+ */
+struct aio_fsync_work {
+	struct work_struct	work;
+	struct kiocb		*iocb;
+	int			datasync;
+};
+
+static void aio_fsync_work(struct work_struct *work)
+{
+	struct aio_fsync_work *fw = container_of(work, struct aio_fsync_work,
+						 work);
+	struct kiocb *iocb = fw->iocb;
+	struct file *file = iocb->ki_filp;
+	int ret;
+
+	ret = vfs_fsync(file, file->f_path.dentry, fw->datasync);
+	kfree(fw);
+	aio_complete(iocb, ret, 0);
+}
+
+static ssize_t aio_vfs_fsync(struct kiocb *iocb, int datasync)
 {
 	struct file *file = iocb->ki_filp;
-	ssize_t ret = -EINVAL;
+	struct aio_fsync_work *fw;
 
 	if (file->f_op->aio_fsync)
-		ret = file->f_op->aio_fsync(iocb, 1);
-	return ret;
+		return file->f_op->aio_fsync(iocb, datasync);
+
+	fw = kmalloc(sizeof(*fw), GFP_KERNEL);
+	if (unlikely(!fw))
+		return vfs_fsync(file, file->f_path.dentry, datasync);
+
+	INIT_WORK(&fw->work, aio_fsync_work);
+	fw->iocb = iocb;
+	fw->datasync = datasync;
+	queue_work(aio_fsync_wq, &fw->work);
+	return -EIOCBQUEUED;
+}
+
+static ssize_t aio_fdsync(struct kiocb *iocb)
+{
+	return aio_vfs_fsync(iocb, 1);
 }
 
 static ssize_t aio_fsync(struct kiocb *iocb)
+{
+	return aio_vfs_fsync(iocb, 0);
+}
+
+/*
+ * Readiness based operations (IOCB_CMD_POLL and the socket transfers)
+ * park ki_wait on the file's wait queue, so that aio_wake_function()
+ * kicks a retry once the file becomes ready.  ->private remembers the
+ * queue for cancellation.
+ */
+struct aio_poll_table {
+	poll_table		pt;
+	struct kiocb		*iocb;
+};
+
+static void aio_poll_queue_proc(struct file *file, wait_queue_head_t *head,
+				poll_table *pt)
+{
+	struct kiocb *iocb = container_of(pt, struct aio_poll_table, pt)->iocb;
+
+	/* ki_wait can only sit on one queue, the first one wins */
+	if (iocb->private)
+		return;
+	iocb->private = head;
+	add_wait_queue(head, &iocb->ki_wait);
+}
+
+/*
+ * aio_poll_disarm:
+ *	Takes the kiocb off its wait queue.  Returns 1 if it was still
+ *	queued, 0 if a wakeup (or nobody) got there first.
+ */
+static int aio_poll_disarm(struct kiocb *iocb)
+{
+	wait_queue_head_t *head = ACCESS_ONCE(iocb->private);
+	int ret = 0;
+
+	if (!head)
+		return 0;
+
+	spin_lock_irq(&head->lock);
+	if (iocb->private == head &&
+	    !list_empty(&iocb->ki_wait.task_list)) {
+		list_del_init(&iocb->ki_wait.task_list);
+		ret = 1;
+	}
+	spin_unlock_irq(&head->lock);
+	return ret;
+}
+
+/*
+ * aio_poll_arm:
+ *	Polls the file for @events and, if none is pending, leaves the
+ *	kiocb queued for a kick.  Returns the ready mask, -EIOCBRETRY if
+ *	the kiocb is queued, or -EINTR if it was cancelled meanwhile.
+ */
+static ssize_t aio_poll_arm(struct kiocb *iocb, unsigned events)
 {
 	struct file *file = iocb->ki_filp;
-	ssize_t ret = -EINVAL;
+	struct aio_poll_table apt;
+	unsigned mask;
+
+	init_poll_funcptr(&apt.pt, aio_poll_queue_proc);
+	apt.pt.key = events | POLLERR | POLLHUP;
+	apt.iocb = iocb;
+	iocb->private = NULL;
+
+	mask = file->f_op->poll(file, &apt.pt) & apt.pt.key;
+	if (mask) {
+		aio_poll_disarm(iocb);
+		return mask;
+	}
+	if (!iocb->private)
+		return -EINVAL;		/* nothing to wait on */
 
-	if (file->f_op->aio_fsync)
-		ret = file->f_op->aio_fsync(iocb, 0);
+	/*
+	 * Pairs with the barrier in aio_poll_cancel(): either we see
+	 * the cancellation here or the canceller sees us queued.
+	 */
+	smp_mb();
+	if (unlikely(kiocbIsCancelled(iocb)) && aio_poll_disarm(iocb))
+		return -EINTR;
+	return -EIOCBRETRY;
+}
+
+static int aio_poll_cancel(struct kiocb *iocb, struct io_event *res)
+{
+	int ret = -EAGAIN;
+
+	smp_mb();
+	if (aio_poll_disarm(iocb)) {
+		res->res = -EINTR;
+		aio_complete(iocb, -EINTR, 0);
+		ret = 0;
+	}
+	/*
+	 * Otherwise a retry is running or queued and will notice
+	 * the cancellation itself.
+	 */
+	aio_put_req(iocb);
 	return ret;
 }
 
+static ssize_t aio_poll(struct kiocb *iocb)
+{
+	return aio_poll_arm(iocb, (unsigned long)iocb->ki_buf);
+}
+
+#ifdef CONFIG_NET
+static ssize_t aio_sockmsg(struct kiocb *iocb)
+{
+	struct file *file = iocb->ki_filp;
+	struct msghdr __user *msg = (struct msghdr __user *)iocb->ki_buf;
+	unsigned flags = iocb->ki_nbytes;
+	int send = iocb->ki_opcode == IOCB_CMD_SENDMSG;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	/* we may be running from aio_wq rather than the submitter */
+	old_cred = override_creds(iocb->ki_cred);
+	for (;;) {
+		if (send)
+			ret = sock_file_sendmsg(file, msg, flags | MSG_DONTWAIT);
+		else
+			ret = sock_file_recvmsg(file, msg, flags | MSG_DONTWAIT);
+		if (ret != -EAGAIN || (flags & MSG_DONTWAIT) ||
+		    (file->f_flags & O_NONBLOCK))
+			break;
+
+		ret = aio_poll_arm(iocb, send ? POLLOUT : POLLIN);
+		if (ret <= 0)
+			break;
+	}
+	revert_creds(old_cred);
+	return ret;
+}
+#endif
+
 static ssize_t aio_setup_vectored_rw(int type, struct kiocb *kiocb, bool compat)
 {
 	ssize_t ret;
@@ -1523,14 +2109,36 @@ static ssize_t aio_setup_iocb(struct kiocb *kiocb, bool compat)
 		break;
 	case IOCB_CMD_FDSYNC:
 		ret = -EINVAL;
-		if (file->f_op->aio_fsync)
+		if (file->f_op->aio_fsync || file->f_op->fsync)
 			kiocb->ki_retry = aio_fdsync;
 		break;
 	case IOCB_CMD_FSYNC:
 		ret = -EINVAL;
-		if (file->f_op->aio_fsync)
+		if (file->f_op->aio_fsync || file->f_op->fsync)
 			kiocb->ki_retry = aio_fsync;
 		break;
+	case IOCB_CMD_POLL:
+		ret = -EINVAL;
+		if (file->f_op->poll) {
+			kiocb_set_cancel_fn(kiocb, aio_poll_cancel);
+			kiocb->ki_retry = aio_poll;
+		}
+		break;
+#ifdef CONFIG_NET
+	case IOCB_CMD_SENDMSG:
+	case IOCB_CMD_RECVMSG:
+		ret = -EINVAL;
+		if (unlikely(kiocb->ki_nbytes & MSG_CMSG_COMPAT))
+			break;
+		if (!file->f_op->poll)
+			break;
+		if (compat)
+			kiocb->ki_nbytes |= MSG_CMSG_COMPAT;
+		kiocb->ki_cred = get_current_cred();
+		kiocb_set_cancel_fn(kiocb, aio_poll_cancel);
+		kiocb->ki_retry = aio_sockmsg;
+		break;
+#endif
 	default:
 		dprintk("EINVAL: io_submit: no operation provided\n");
 		ret = -EINVAL;
@@ -1704,6 +2312,7 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 	return 0;
 
 out_put_req:
+	put_reqs_available(ctx, 1);	/* no event will be posted */
 	aio_put_req(req);	/* drop extra ref to req */
 	aio_put_req(req);	/* drop i/o ref to req */
 	return ret;
@@ -1780,7 +2389,8 @@ SYSCALL_DEFINE3(io_submit, aio_context_t, ctx_id, long, nr,
 }
 
 /* lookup_kiocb
- *	Finds a given iocb for cancellation.
+ *	Finds a given iocb for cancellation.  Only requests that set a
+ *	cancel method are on active_reqs.
  */
 static struct kiocb *lookup_kiocb(struct kioctx *ctx, struct iocb __user *iocb,
 				  u32 key)
@@ -1828,9 +2438,9 @@ SYSCALL_DEFINE3(io_cancel, aio_context_t, ctx_id, struct iocb __user *, iocb,
 	spin_lock_irq(&ctx->ctx_lock);
 	ret = -EAGAIN;
 	kiocb = lookup_kiocb(ctx, iocb, key);
-	if (kiocb && kiocb->ki_cancel) {
+	if (kiocb && kiocb->ki_cancel &&
+	    atomic_inc_not_zero(&kiocb->ki_users)) {
 		cancel = kiocb->ki_cancel;
-		kiocb->ki_users ++;
 		kiocbSetCancelled(kiocb);
 	} else
 		cancel = NULL;
@@ -1888,3 +2498,191 @@ SYSCALL_DEFINE5(io_getevents, aio_context_t, ctx_id,
 	asmlinkage_protect(5, ret, ctx_id, min_nr, nr, events, timeout);
 	return ret;
 }
+
+/* aio_sq_submit
+ *	Consumes up to to_submit iocbs from the submission ring and
+ *	submits them as io_submit() would.  Stops early, leaving the
+ *	entry in place, when the event ring is full.  Called with
+ *	sq_info.lock held.
+ */
+static long aio_sq_submit(struct kioctx *ctx, unsigned to_submit, bool compat)
+{
+	struct aio_sq_info *sq = &ctx->sq_info;
+	struct aio_sq_ring __user *ring;
+	struct hlist_head batch_hash[AIO_BATCH_HASH_SIZE] = { { 0, }, };
+	unsigned tail, submitted = 0;
+	long ret = 0;
+
+	ring = (struct aio_sq_ring __user *)sq->mmap_base;
+	if (unlikely(get_user(tail, &ring->tail)))
+		return -EFAULT;
+	/* read the tail before the entries it publishes */
+	smp_rmb();
+
+	to_submit = min(to_submit, min(tail - sq->head, sq->nr));
+	while (submitted < to_submit) {
+		struct iocb __user *user_iocb;
+		struct iocb tmp;
+
+		user_iocb = &ring->iocbs[sq->head & (sq->nr - 1)];
+		if (unlikely(copy_from_user(&tmp, user_iocb, sizeof(tmp)))) {
+			ret = -EFAULT;
+			break;
+		}
+
+		ret = io_submit_one(ctx, user_iocb, &tmp, batch_hash, compat);
+		if (ret == -EAGAIN)
+			break;
+		sq->head++;
+		if (ret) {
+			sq->dropped++;
+			if (put_user(sq->dropped, &ring->dropped))
+				ret = -EFAULT;
+			break;
+		}
+		submitted++;
+	}
+	aio_batch_free(batch_hash);
+
+	/* entries must be read before userspace may reuse their slots */
+	smp_mb();
+	if (put_user(sq->head, &ring->head))
+		ret = -EFAULT;
+
+	return submitted ? submitted : ret;
+}
+
+/* aio_ring_events
+ *	Number of completions sitting in the event ring.  The head may
+ *	be advanced by userspace reaping the ring directly, so this is
+ *	only a snapshot.
+ */
+static unsigned aio_ring_events(struct kioctx *ctx)
+{
+	struct aio_ring_info *info = &ctx->ring_info;
+	struct aio_ring *ring;
+	unsigned head;
+
+	ring = kmap_atomic(info->ring_pages[0], KM_USER0);
+	head = ring->head % info->nr;
+	kunmap_atomic(ring, KM_USER0);
+
+	return (info->tail + info->nr - head) % info->nr;
+}
+
+long do_io_ring_enter(aio_context_t ctx_id, unsigned to_submit,
+		      unsigned min_complete, unsigned flags, bool compat)
+{
+	struct kioctx *ctx;
+	long ret = -EINVAL;
+
+	if (unlikely(flags))
+		return -EINVAL;
+
+	ctx = lookup_ioctx(ctx_id);
+	if (unlikely(!ctx)) {
+		pr_debug("EINVAL: io_ring_enter: invalid context id\n");
+		return -EINVAL;
+	}
+
+	if (unlikely(!ctx->sq_info.nr || min_complete >= ctx->ring_info.nr))
+		goto out;
+
+	ret = 0;
+	if (to_submit) {
+		mutex_lock(&ctx->sq_info.lock);
+		ret = aio_sq_submit(ctx, to_submit, compat);
+		mutex_unlock(&ctx->sq_info.lock);
+		if (ret < 0)
+			goto out;
+	}
+
+	if (min_complete) {
+		long err;
+
+		/* racey check, as in read_events() */
+		if (unlikely(!list_empty(&ctx->run_list)))
+			aio_run_all_iocbs(ctx);
+
+		err = wait_event_interruptible(ctx->wait,
+				aio_ring_events(ctx) >= min_complete ||
+				ctx->dead);
+		if (err)
+			err = -EINTR;
+		else if (ctx->dead)
+			err = -EINVAL;
+		if (err && !ret)
+			ret = err;
+	}
+out:
+	put_ioctx(ctx);
+	return ret;
+}
+
+/* sys_io_ring_setup:
+ *	Creates an aio_context capable of receiving at least nr_events,
+ *	as io_setup() does, along with a submission ring of
+ *	params->sq_entries iocbs mapped into the caller's address space.
+ *	On success the context id and the address of the struct
+ *	aio_sq_ring are written back to *params.  The event ring behind
+ *	the context id is the completion ring and may be reaped directly
+ *	by userspace.  May fail with -EINVAL if sq_entries is not a
+ *	power of two no larger than AIO_SQ_RING_MAX or if flags or a
+ *	reserved field is set, and with any error io_setup() returns.
+ */
+SYSCALL_DEFINE2(io_ring_setup, unsigned, nr_events,
+		struct aio_ring_params __user *, params)
+{
+	struct aio_ring_params p;
+	struct kioctx *ioctx;
+	long ret;
+
+	if (copy_from_user(&p, params, sizeof(p)))
+		return -EFAULT;
+
+	if (unlikely(nr_events == 0 || p.flags ||
+		     p.resv[0] || p.resv[1] || p.resv[2] ||
+		     !p.sq_entries || p.sq_entries > AIO_SQ_RING_MAX ||
+		     !is_power_of_2(p.sq_entries))) {
+		pr_debug("EINVAL: io_ring_setup: nr_events %u sq_entries %u\n",
+			 nr_events, p.sq_entries);
+		return -EINVAL;
+	}
+
+	ioctx = ioctx_alloc(nr_events);
+	if (IS_ERR(ioctx))
+		return PTR_ERR(ioctx);
+
+	ret = aio_setup_sq_ring(ioctx, p.sq_entries);
+	if (!ret) {
+		p.ctx_id = ioctx->user_id;
+		p.sq_ring = ioctx->sq_info.mmap_base;
+		if (copy_to_user(params, &p, sizeof(p)))
+			ret = -EFAULT;
+	}
+	if (ret) {
+		io_destroy(ioctx);
+		return ret;
+	}
+
+	put_ioctx(ioctx);
+	return 0;
+}
+
+/* sys_io_ring_enter:
+ *	Submits up to to_submit iocbs queued on the submission ring of
+ *	the aio_context specified by ctx_id, then waits until at least
+ *	min_complete events are sitting in its event ring.  Returns the
+ *	number of iocbs submitted.  If none could be submitted, returns
+ *	the error of the first entry, which is consumed and counted in
+ *	the ring's dropped field unless the error is -EAGAIN (event ring
+ *	full).  May fail with -EINVAL if ctx_id was not created by
+ *	io_ring_setup(), if min_complete can never be satisfied or if
+ *	flags is not zero, and with -EINTR if a signal arrives while
+ *	waiting and nothing was submitted.
+ */
+SYSCALL_DEFINE4(io_ring_enter, aio_context_t, ctx_id, unsigned, to_submit,
+		unsigned, min_complete, unsigned, flags)
+{
+	return do_io_ring_enter(ctx_id, to_submit, min_complete, flags, 0);
+}
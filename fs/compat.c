@@ -649,6 +649,13 @@ compat_sys_io_submit(aio_context_t ctx_id, int nr, u32 __user *iocb)
 	return ret;
 }
 
+asmlinkage long
+compat_sys_io_ring_enter(aio_context_t ctx_id, unsigned to_submit,
+			 unsigned min_complete, unsigned flags)
+{
+	return do_io_ring_enter(ctx_id, to_submit, min_complete, flags, 1);
+}
+
 struct compat_ncp_mount_data {
 	compat_int_t version;
 	compat_uint_t ncp_fd;
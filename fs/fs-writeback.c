@@ -596,6 +596,7 @@ static long wb_writeback(struct bdi_writeback *wb,
 		.for_background		= work->for_background,
 		.range_cyclic		= work->range_cyclic,
 	};
+	unsigned long wb_start = jiffies;
 	unsigned long oldest_jif;
 	long wrote = 0;
 	struct inode *inode;
@@ -609,7 +610,7 @@ static long wb_writeback(struct bdi_writeback *wb,
 	 * XXX ERS: wb_start no longer used here, but updated in
 	 * case any out of tree user is looking at it
 	 */ 
-	wbc.wb_start = jiffies; /* livelock avoidance */
+	wbc.wb_start = wb_start; /* livelock avoidance */
 
 	oldest_jif = jiffies;
 	wbc.older_than_this = &oldest_jif;
@@ -644,6 +645,12 @@ static long wb_writeback(struct bdi_writeback *wb,
 		else
 			writeback_inodes_wb(wb, &wbc);
 		trace_wbc_writeback_written(&wbc, wb->bdi);
+
+		/*
+		 * Dirtiers no longer write back themselves; keep the
+		 * bandwidth estimate they are throttled by up to date.
+		 */
+		bdi_update_bandwidth(wb->bdi, 0, 0, 0, 0, 0, wb_start);
 		work->nr_pages -= MAX_WRITEBACK_PAGES - wbc.nr_to_write;
 		wrote += MAX_WRITEBACK_PAGES - wbc.nr_to_write;
 
@@ -328,6 +328,9 @@ void clear_inode(struct inode *inode)
 	spin_lock_irq(&inode->i_data.tree_lock);
 	BUG_ON(inode->i_data.nrpages);
 	spin_unlock_irq(&inode->i_data.tree_lock);
+	/* Pages evicted by reclaim may have left shadow entries behind */
+	if (inode->i_data.nrshadows)
+		truncate_shadow_entries(&inode->i_data, 0, ~(pgoff_t)0);
 	BUG_ON(!(inode->i_state & I_FREEING));
 	BUG_ON(inode->i_state & I_CLEAR);
 	inode_sync_wait(inode);
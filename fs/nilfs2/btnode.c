@@ -223,6 +223,12 @@ retry:
 				       (unsigned long long)newkey);
 
 		spin_lock_irq(&btnc->tree_lock);
+		/* forget the shadow entry of an evicted page */
+		if (radix_tree_exceptional_entry(radix_tree_lookup(
+				&btnc->page_tree, newkey))) {
+			radix_tree_delete(&btnc->page_tree, newkey);
+			btnc->nrshadows--;
+		}
 		err = radix_tree_insert(&btnc->page_tree, newkey, obh->b_page);
 		spin_unlock_irq(&btnc->tree_lock);
 		/*
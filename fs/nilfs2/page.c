@@ -434,6 +434,12 @@ repeat:
 			spin_unlock_irq(&smap->tree_lock);
 
 			spin_lock_irq(&dmap->tree_lock);
+			/* forget the shadow entry of an evicted page */
+			page2 = radix_tree_lookup(&dmap->page_tree, offset);
+			if (radix_tree_exceptional_entry(page2)) {
+				radix_tree_delete(&dmap->page_tree, offset);
+				dmap->nrshadows--;
+			}
 			err = radix_tree_insert(&dmap->page_tree, offset, page);
 			if (unlikely(err < 0)) {
 				WARN_ON(err == -EEXIST);
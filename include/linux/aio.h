@@ -6,6 +6,8 @@
 #include <linux/aio_abi.h>
 #include <linux/uio.h>
 #include <linux/rcupdate.h>
+#include <linux/mutex.h>
+#include <linux/percpu-refcount.h>
 
 #include <asm/atomic.h>
 
@@ -87,7 +89,7 @@ struct kioctx;
 struct kiocb {
 	struct list_head	ki_run_list;
 	unsigned long		ki_flags;
-	int			ki_users;
+	atomic_t		ki_users;
 	unsigned		ki_key;		/* id of this request */
 
 	struct file		*ki_filp;
@@ -116,14 +118,20 @@ struct kiocb {
  	unsigned long		ki_nr_segs;
  	unsigned long		ki_cur_seg;
 
-	struct list_head	ki_list;	/* the aio core uses this
-						 * for cancellation */
+	struct list_head	ki_list;	/* on active_reqs while
+						 * cancellable */
 
 	/*
 	 * If the aio_resfd field of the userspace iocb is not zero,
 	 * this is the underlying eventfd context to deliver events to.
 	 */
 	struct eventfd_ctx	*ki_eventfd;
+
+	/*
+	 * Credentials of the submitter, for operations that may be
+	 * retried from the aio workqueue on the submitter's behalf.
+	 */
+	const struct cred	*ki_cred;
 };
 
 #define is_sync_kiocb(iocb)	((iocb)->ki_key == KIOCB_SYNC_KEY)
@@ -131,7 +139,7 @@ struct kiocb {
 	do {						\
 		struct task_struct *tsk = current;	\
 		(x)->ki_flags = 0;			\
-		(x)->ki_users = 1;			\
+		atomic_set(&(x)->ki_users, 1);		\
 		(x)->ki_key = KIOCB_SYNC_KEY;		\
 		(x)->ki_filp = (filp);			\
 		(x)->ki_ctx = NULL;			\
@@ -143,26 +151,6 @@ struct kiocb {
 		init_wait((&(x)->ki_wait));             \
 	} while (0)
 
-#define AIO_RING_MAGIC			0xa10a10a1
-#define AIO_RING_COMPAT_FEATURES	1
-#define AIO_RING_INCOMPAT_FEATURES	0
-struct aio_ring {
-	unsigned	id;	/* kernel internal index number */
-	unsigned	nr;	/* number of io_events */
-	unsigned	head;
-	unsigned	tail;
-
-	unsigned	magic;
-	unsigned	compat_features;
-	unsigned	incompat_features;
-	unsigned	header_length;	/* size of aio_ring */
-
-
-	struct io_event		io_events[0];
-}; /* 128 bytes + ring size */
-
-#define aio_ring_avail(info, ring)	(((ring)->head + (info)->nr - 1 - (ring)->tail) % (info)->nr)
-
 #define AIO_RING_PAGES	8
 struct aio_ring_info {
 	unsigned long		mmap_base;
@@ -177,11 +165,29 @@ struct aio_ring_info {
 	struct page		*internal_pages[AIO_RING_PAGES];
 };
 
+struct aio_sq_info {
+	unsigned long		mmap_base;
+	unsigned long		mmap_size;
+
+	struct mutex		lock;		/* serialises io_ring_enter */
+	unsigned		nr;		/* trusted copy, 0 if no ring */
+	unsigned		head;		/* trusted copy */
+	unsigned		dropped;
+};
+
+struct kioctx_cpu;
+
 struct kioctx {
-	atomic_t		users;
+	/*
+	 * One reference for the mm's ioctx list, dropped by killing it,
+	 * plus one for each lookup.
+	 */
+	struct percpu_ref	users;
 	int			dead;
 	struct mm_struct	*mm;
 
+	struct kioctx_cpu	*cpu;
+
 	/* This needs improving */
 	unsigned long		user_id;
 	struct hlist_node	list;
@@ -190,17 +196,38 @@ struct kioctx {
 
 	spinlock_t		ctx_lock;
 
-	int			reqs_active;
-	struct list_head	active_reqs;	/* used for cancellation */
+	atomic_t		reqs_active;
+	struct list_head	active_reqs;	/* cancellable reqs */
 	struct list_head	run_list;	/* used for kicked reqs */
 
+	/*
+	 * Free event ring slots.  Submitters take them from a per-cpu
+	 * cache, which is refilled req_batch at a time from here.
+	 */
+	atomic_t		reqs_available;
+	unsigned		req_batch;
+
 	/* sys_io_setup currently limits this to an unsigned int */
 	unsigned		max_reqs;
 
 	struct aio_ring_info	ring_info;
+	struct aio_sq_info	sq_info;
+
+	/*
+	 * Serialises posting events at ring_info.tail.  completed_events
+	 * counts events posted whose slots have not been handed back to
+	 * reqs_available yet.
+	 */
+	spinlock_t		completion_lock ____cacheline_aligned_in_smp;
+	unsigned		completed_events;
 
 	struct delayed_work	wq;
 
+	/* Freeing sleeps; the last put may come from irq context */
+	struct work_struct	free_work;
+	/* Completed once freed, for whoever killed the ioctx */
+	struct completion	*free_done;
+
 	struct rcu_head		rcu_head;
 };
 
@@ -212,20 +239,30 @@ extern ssize_t wait_on_sync_kiocb(struct kiocb *iocb);
 extern int aio_put_req(struct kiocb *iocb);
 extern void kick_iocb(struct kiocb *iocb);
 extern int aio_complete(struct kiocb *iocb, long res, long res2);
+extern void kiocb_set_cancel_fn(struct kiocb *iocb,
+			int (*cancel)(struct kiocb *, struct io_event *));
 struct mm_struct;
 extern void exit_aio(struct mm_struct *mm);
 extern long do_io_submit(aio_context_t ctx_id, long nr,
 			 struct iocb __user *__user *iocbpp, bool compat);
+extern long do_io_ring_enter(aio_context_t ctx_id, unsigned to_submit,
+			     unsigned min_complete, unsigned flags,
+			     bool compat);
 #else
 static inline ssize_t wait_on_sync_kiocb(struct kiocb *iocb) { return 0; }
 static inline int aio_put_req(struct kiocb *iocb) { return 0; }
 static inline void kick_iocb(struct kiocb *iocb) { }
 static inline int aio_complete(struct kiocb *iocb, long res, long res2) { return 0; }
+static inline void kiocb_set_cancel_fn(struct kiocb *iocb,
+			int (*cancel)(struct kiocb *, struct io_event *)) { }
 struct mm_struct;
 static inline void exit_aio(struct mm_struct *mm) { }
 static inline long do_io_submit(aio_context_t ctx_id, long nr,
 				struct iocb __user * __user *iocbpp,
 				bool compat) { return 0; }
+static inline long do_io_ring_enter(aio_context_t ctx_id, unsigned to_submit,
+				    unsigned min_complete, unsigned flags,
+				    bool compat) { return 0; }
 #endif /* CONFIG_AIO */
 
 #define io_wait_to_kiocb(wait) container_of(wait, struct kiocb, ki_wait)
@@ -37,15 +37,27 @@ enum {
 	IOCB_CMD_PWRITE = 1,
 	IOCB_CMD_FSYNC = 2,
 	IOCB_CMD_FDSYNC = 3,
-	/* These two are experimental.
+	/* This one is experimental.
 	 * IOCB_CMD_PREADX = 4,
-	 * IOCB_CMD_POLL = 5,
 	 */
+	IOCB_CMD_POLL = 5,
 	IOCB_CMD_NOOP = 6,
 	IOCB_CMD_PREADV = 7,
 	IOCB_CMD_PWRITEV = 8,
+	IOCB_CMD_SENDMSG = 9,
+	IOCB_CMD_RECVMSG = 10,
 };
 
+/*
+ * IOCB_CMD_POLL takes the poll events to wait for in aio_buf and
+ * completes with the ready mask in res.
+ *
+ * IOCB_CMD_SENDMSG/IOCB_CMD_RECVMSG take a struct msghdr pointer in
+ * aio_buf and the MSG_* flags in aio_nbytes.  Unless MSG_DONTWAIT is
+ * given or the socket is non-blocking, a transfer that would block is
+ * retried once the socket becomes ready instead of failing.
+ */
+
 /*
  * Valid flags for the "aio_flags" member of the "struct iocb".
  *
@@ -104,6 +116,74 @@ struct iocb {
 	__u32	aio_resfd;
 }; /* 64 bytes */
 
+/*
+ * Event ring, mapped at the address returned as the aio_context_t by
+ * io_setup() and io_ring_setup().  The kernel writes io_events[tail]
+ * and then advances tail; a consumer reads io_events[head] and then
+ * advances head.  Both are indices in [0, nr) and the ring is empty
+ * when they are equal.
+ *
+ * With AIO_RING_COMPAT_USER_REAP set in compat_features, userspace may
+ * consume events by advancing head itself, instead of or as well as
+ * calling io_getevents().  It must read an event only after reading a
+ * tail that covers it, and must finish reading it before storing the
+ * new head.  The slots it frees are handed back to io_submit() lazily,
+ * so a submission may transiently see -EAGAIN before the kernel
+ * notices a moved head.  Concurrent consumers must serialise among
+ * themselves; io_getevents() does not lock against userspace.
+ */
+#define AIO_RING_MAGIC			0xa10a10a1
+#define AIO_RING_COMPAT_USER_REAP	(1 << 1)
+#define AIO_RING_COMPAT_FEATURES	(1 | AIO_RING_COMPAT_USER_REAP)
+#define AIO_RING_INCOMPAT_FEATURES	0
+
+struct aio_ring {
+	__u32	id;		/* kernel internal index number */
+	__u32	nr;		/* number of io_events */
+	__u32	head;		/* written by the consumer */
+	__u32	tail;		/* written by the kernel */
+
+	__u32	magic;
+	__u32	compat_features;
+	__u32	incompat_features;
+	__u32	header_length;	/* size of aio_ring */
+
+
+	struct io_event		io_events[0];
+}; /* 32 bytes + ring size */
+
+/*
+ * Submission ring created by io_ring_setup().  Userspace fills
+ * iocbs[tail & mask] and then advances tail; io_ring_enter() consumes
+ * entries from head and advances it.  head and tail are free running
+ * counters.  An entry rejected at submission time is consumed, counted
+ * in dropped and reported as the return value of io_ring_enter().
+ * Completions are posted to the event ring named by ctx_id.
+ */
+#define AIO_SQ_RING_MAGIC	0xa10a5b01
+#define AIO_SQ_RING_MAX		32768
+
+struct aio_sq_ring {
+	__u32	head;		/* written by the kernel */
+	__u32	tail;		/* written by userspace */
+	__u32	nr;		/* number of iocbs, a power of two */
+	__u32	mask;		/* nr - 1 */
+	__u32	magic;
+	__u32	header_length;	/* offset of iocbs[] */
+	__u32	dropped;	/* entries rejected at submission */
+	__u32	resv[9];
+
+	struct iocb	iocbs[0];
+}; /* 64 bytes + ring size */
+
+struct aio_ring_params {
+	__u32	sq_entries;	/* in: size of the submission ring */
+	__u32	flags;		/* in: must be zero */
+	__u64	ctx_id;		/* out: aio_context_t of the event ring */
+	__u64	sq_ring;	/* out: address of the struct aio_sq_ring */
+	__u64	resv[3];
+};
+
 #undef IFBIG
 #undef IFLITTLE
 
@@ -39,6 +39,8 @@ typedef int (congested_fn)(void *, int);
 enum bdi_stat_item {
 	BDI_RECLAIMABLE,
 	BDI_WRITEBACK,
+	BDI_DIRTIED,
+	BDI_WRITTEN,
 	NR_BDI_STAT_ITEMS
 };
 
@@ -62,6 +64,7 @@ struct backing_dev_info {
 	struct list_head bdi_list;
 	struct rcu_head rcu_head;
 	unsigned long ra_pages;	/* max readahead in PAGE_CACHE_SIZE units */
+	unsigned long io_pages;	/* optimal I/O size in PAGE_CACHE_SIZE units */
 	unsigned long state;	/* Always use atomic bitops on this */
 	unsigned int capabilities; /* Device capabilities */
 	congested_fn *congested_fn; /* Function pointer if device is md/dm */
@@ -73,6 +76,19 @@ struct backing_dev_info {
 
 	struct percpu_counter bdi_stat[NR_BDI_STAT_ITEMS];
 
+	/*
+	 * Write bandwidth and dirty throttle rate estimates, in pages per
+	 * second, refreshed every BANDWIDTH_INTERVAL under bw_lock.
+	 */
+	spinlock_t bw_lock;
+	unsigned long bw_time_stamp;	/* last time the estimates were updated */
+	unsigned long dirtied_stamp;	/* BDI_DIRTIED at bw_time_stamp */
+	unsigned long written_stamp;	/* BDI_WRITTEN at bw_time_stamp */
+	unsigned long write_bandwidth;	/* the estimated write bandwidth */
+	unsigned long avg_write_bandwidth; /* further smoothed write bw */
+	unsigned long dirty_ratelimit;	/* base rate each dirtier is held to */
+	unsigned long balanced_dirty_ratelimit; /* last balanced estimate */
+
 	struct prop_local_percpu completions;
 	int dirty_exceeded;
 
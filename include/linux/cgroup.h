@@ -16,6 +16,7 @@
 #include <linux/prio_heap.h>
 #include <linux/rwsem.h>
 #include <linux/idr.h>
+#include <linux/percpu-refcount.h>
 
 #ifdef CONFIG_CGROUPS
 
@@ -61,10 +62,13 @@ struct cgroup_subsys_state {
 	/*
 	 * State maintained by the cgroup system to allow subsystems
 	 * to be "busy". Should be accessed via css_get(),
-	 * css_tryget() and and css_put().
+	 * css_tryget() and and css_put().  Per cpu while the cgroup is
+	 * live; rmdir switches it to atomic mode to see whether the css
+	 * is still in use.  Not initialized for the root css, which is
+	 * never reference counted.
 	 */
 
-	atomic_t refcnt;
+	struct percpu_ref refcnt;
 
 	unsigned long flags;
 	/* ID for this css, if possible */
@@ -80,7 +84,7 @@ enum {
 /* Caller must verify that the css is not for root cgroup */
 static inline void __css_get(struct cgroup_subsys_state *css, int count)
 {
-	atomic_add(count, &css->refcnt);
+	percpu_ref_get_many(&css->refcnt, count);
 }
 
 /*
@@ -112,7 +116,8 @@ static inline bool css_tryget(struct cgroup_subsys_state *css)
 {
 	if (test_bit(CSS_ROOT, &css->flags))
 		return true;
-	while (!atomic_inc_not_zero(&css->refcnt)) {
+	/* Fails only while rmdir has the count at zero, see cgroup_rmdir() */
+	while (!percpu_ref_tryget(&css->refcnt)) {
 		if (test_bit(CSS_REMOVED, &css->flags))
 			return false;
 		cpu_relax();
@@ -317,12 +317,14 @@ clocksource_calc_mult_shift(struct clocksource *cs, u32 freq, u32 minsec)
 #ifdef CONFIG_GENERIC_TIME_VSYSCALL
 extern void
 update_vsyscall(struct timespec *ts, struct timespec *wtm,
-			struct clocksource *c, u32 mult);
+			struct clocksource *c, u32 mult,
+			struct timespec *raw_time, struct timespec *sleep_time);
 extern void update_vsyscall_tz(void);
 #else
 static inline void
 update_vsyscall(struct timespec *ts, struct timespec *wtm,
-			struct clocksource *c, u32 mult)
+			struct clocksource *c, u32 mult,
+			struct timespec *raw_time, struct timespec *sleep_time)
 {
 }
 
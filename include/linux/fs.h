@@ -690,6 +690,7 @@ struct address_space {
 	unsigned int		truncate_count;	/* Cover race condition with truncate */
 	/* Protected by tree_lock together with the radix tree */
 	unsigned long		nrpages;	/* number of total pages */
+	unsigned long		nrshadows;	/* number of shadow entries */
 	pgoff_t			writeback_index;/* writeback starts here */
 	const struct address_space_operations *a_ops;	/* methods */
 	unsigned long		flags;		/* error bits/gfp mask */
@@ -960,8 +961,27 @@ struct file_ra_state {
 					   there are only # of pages ahead */
 
 	unsigned int ra_pages;		/* Maximum readahead window */
+	unsigned int io_pages;		/* Optimal I/O size of the device */
 	unsigned int mmap_miss;		/* Cache miss stat for mmap accesses */
 	loff_t prev_pos;		/* Cache last read() position */
+
+	pgoff_t stride_prev;		/* Last strided chunk read or read ahead */
+	unsigned int stride;		/* Pages between strided chunks */
+	unsigned short stride_len;	/* Pages per strided chunk */
+	unsigned short stride_hits;	/* Reads seen at that stride */
+};
+
+/*
+ * Access patterns recognised by ondemand_readahead(), as reported by the
+ * mm_filemap_readahead tracepoint.
+ */
+enum readahead_pattern {
+	RA_PATTERN_INITIAL,		/* start of file or of a stream */
+	RA_PATTERN_SEQUENTIAL,		/* expected next window */
+	RA_PATTERN_MARKER,		/* hit PG_readahead, interleaved reads */
+	RA_PATTERN_CONTEXT,		/* stream found from cached history */
+	RA_PATTERN_STRIDE,		/* equally spaced chunks */
+	RA_PATTERN_RANDOM,		/* read as is */
 };
 
 /*
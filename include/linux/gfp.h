@@ -318,6 +318,42 @@ extern struct page *alloc_pages_vma(gfp_t gfp_mask, int order,
 #define alloc_pages_vma(gfp_mask, order, vma, addr, node)	\
 	alloc_pages(gfp_mask, order)
 #endif
+
+unsigned long __alloc_pages_bulk(gfp_t gfp_mask, struct zonelist *zonelist,
+				 nodemask_t *nodemask, unsigned long nr_pages,
+				 struct list_head *page_list,
+				 struct page **page_array);
+
+/*
+ * Bulk allocate order-0 pages from the given node (the current node if
+ * nid < 0).  The task's mempolicy is not consulted.
+ */
+static inline unsigned long
+alloc_pages_bulk_list_node(int nid, gfp_t gfp_mask, unsigned long nr_pages,
+			   struct list_head *list)
+{
+	if (nid < 0)
+		nid = numa_node_id();
+
+	return __alloc_pages_bulk(gfp_mask, node_zonelist(nid, gfp_mask), NULL,
+				  nr_pages, list, NULL);
+}
+
+static inline unsigned long
+alloc_pages_bulk_array_node(int nid, gfp_t gfp_mask, unsigned long nr_pages,
+			    struct page **page_array)
+{
+	if (nid < 0)
+		nid = numa_node_id();
+
+	return __alloc_pages_bulk(gfp_mask, node_zonelist(nid, gfp_mask), NULL,
+				  nr_pages, NULL, page_array);
+}
+
+#define alloc_pages_bulk_list(gfp_mask, nr_pages, list) \
+	alloc_pages_bulk_list_node(-1, gfp_mask, nr_pages, list)
+#define alloc_pages_bulk_array(gfp_mask, nr_pages, page_array) \
+	alloc_pages_bulk_array_node(-1, gfp_mask, nr_pages, page_array)
 #define alloc_page(gfp_mask) alloc_pages(gfp_mask, 0)
 #define alloc_page_vma(gfp_mask, vma, addr)			\
 	alloc_pages_vma(gfp_mask, 0, vma, addr, numa_node_id())
@@ -138,9 +138,8 @@ static inline bool mem_cgroup_disabled(void)
 }
 
 void mem_cgroup_update_file_mapped(struct page *page, int val);
-unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
-						gfp_t gfp_mask, int nid,
-						int zid);
+bool mem_cgroup_soft_reclaim_eligible(struct mem_cgroup *memcg,
+				      struct mem_cgroup *root);
 
 void mem_cgroup_split_hugepage_commit(struct page *page, struct page *head);
 
@@ -335,10 +334,10 @@ static inline void mem_cgroup_update_file_mapped(struct page *page,
 }
 
 static inline
-unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
-					    gfp_t gfp_mask, int nid, int zid)
+bool mem_cgroup_soft_reclaim_eligible(struct mem_cgroup *memcg,
+				      struct mem_cgroup *root)
 {
-	return 0;
+	return false;
 }
 
 void mem_cgroup_split_hugepage_commit(struct page *page, struct page *head)
@@ -160,6 +160,7 @@ extern pgprot_t protection_map[16];
 #define FAULT_FLAG_MKWRITE	0x04	/* Fault was mkwrite of existing pte */
 #define FAULT_FLAG_ALLOW_RETRY	0x08	/* Retry fault if blocking */
 #define FAULT_FLAG_KILLABLE	0x20	/* The fault task is in SIGKILL killable region */
+#define FAULT_FLAG_SPECULATIVE	0x40	/* Fault without mmap_sem, may fail */
 
 /*
  * This interface is used by x86 PAT code to identify a pfn mapping that is
@@ -210,6 +211,11 @@ struct vm_operations_struct {
 	void (*close)(struct vm_area_struct * area);
 	int (*fault)(struct vm_area_struct *vma, struct vm_fault *vmf);
 
+	/* map a whole HPAGE_PMD_SIZE range of the vma with a single huge
+	 * pmd; returns VM_FAULT_FALLBACK to have ->fault() map it with ptes */
+	int (*pmd_fault)(struct vm_area_struct *vma, unsigned long address,
+			 pmd_t *pmd, unsigned int flags);
+
 	/* notification that a previously read-only page is about to become
 	 * writable, if an error is returned it will cause a SIGBUS */
 	int (*page_mkwrite)(struct vm_area_struct *vma, struct vm_fault *vmf);
@@ -811,6 +817,7 @@ static inline int page_mapped(struct page *page)
 #define VM_FAULT_NOPAGE	0x0100	/* ->fault installed the pte, not return page */
 #define VM_FAULT_LOCKED	0x0200	/* ->fault locked the returned page */
 #define VM_FAULT_RETRY	0x0400	/* ->fault blocked, must retry */
+#define VM_FAULT_FALLBACK 0x0800	/* ->pmd_fault couldn't map, use ptes */
 
 #define VM_FAULT_HWPOISON_LARGE_MASK 0xf000 /* encodes hpage index for large hwpoison */
 
@@ -841,13 +848,11 @@ int shmem_lock(struct file *file, int lock, struct user_struct *user);
 struct file *shmem_file_setup(const char *name, loff_t size, unsigned long flags);
 int shmem_zero_setup(struct vm_area_struct *);
 
-#ifndef CONFIG_MMU
 extern unsigned long shmem_get_unmapped_area(struct file *file,
 					     unsigned long addr,
 					     unsigned long len,
 					     unsigned long pgoff,
 					     unsigned long flags);
-#endif
 
 extern int can_do_mlock(void);
 extern int user_shm_lock(size_t, struct user_struct *);
@@ -948,6 +953,17 @@ static inline int handle_mm_fault(struct mm_struct *mm,
 }
 #endif
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+extern int handle_speculative_fault(struct mm_struct *mm,
+				    unsigned long address, unsigned int flags);
+#else
+static inline int handle_speculative_fault(struct mm_struct *mm,
+				unsigned long address, unsigned int flags)
+{
+	return VM_FAULT_RETRY;
+}
+#endif
+
 extern int make_pages_present(unsigned long addr, unsigned long end);
 extern int access_process_vm(struct task_struct *tsk, unsigned long addr, void *buf, int len, int write);
 extern int access_remote_vm(struct mm_struct *mm, unsigned long addr,
@@ -1315,6 +1331,8 @@ extern unsigned long do_brk(unsigned long, unsigned long);
 extern void truncate_inode_pages(struct address_space *, loff_t);
 extern void truncate_inode_pages_range(struct address_space *,
 				       loff_t lstart, loff_t lend);
+extern void truncate_shadow_entries(struct address_space *,
+				    pgoff_t start, pgoff_t end);
 
 /* generic vm_area_ops exported for stackable file systems */
 extern int filemap_fault(struct vm_area_struct *, struct vm_fault *);
@@ -1375,6 +1393,64 @@ static inline struct vm_area_struct * find_vma_intersection(struct mm_struct * m
 	return vma;
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Changes to the vma fields a speculative page fault relies on go
+ * between these, with mmap_sem held for writing.
+ */
+static inline void vm_write_begin(struct vm_area_struct *vma)
+{
+	write_seqcount_begin(&vma->vm_sequence);
+}
+
+static inline void vm_write_end(struct vm_area_struct *vma)
+{
+	write_seqcount_end(&vma->vm_sequence);
+}
+
+/* A copy of a vma must not inherit the faults using the original */
+static inline void vma_init_ref(struct vm_area_struct *vma)
+{
+	atomic_set(&vma->vm_ref_count, 0);
+}
+
+/*
+ * Fail speculative page faults while page tables are moved under the
+ * vmas, for mremap.
+ */
+static inline void mm_block_speculative_faults(struct mm_struct *mm)
+{
+	mm->spf_blocked = 1;
+	smp_wmb();
+}
+
+static inline void mm_unblock_speculative_faults(struct mm_struct *mm)
+{
+	smp_wmb();
+	mm->spf_blocked = 0;
+}
+#else
+static inline void vm_write_begin(struct vm_area_struct *vma)
+{
+}
+
+static inline void vm_write_end(struct vm_area_struct *vma)
+{
+}
+
+static inline void vma_init_ref(struct vm_area_struct *vma)
+{
+}
+
+static inline void mm_block_speculative_faults(struct mm_struct *mm)
+{
+}
+
+static inline void mm_unblock_speculative_faults(struct mm_struct *mm)
+{
+}
+#endif
+
 static inline unsigned long vma_pages(struct vm_area_struct *vma)
 {
 	return (vma->vm_end - vma->vm_start) >> PAGE_SHIFT;
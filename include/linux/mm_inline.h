@@ -21,13 +21,96 @@ static inline int page_is_file_cache(struct page *page)
 	return !PageSwapBacked(page);
 }
 
+#ifdef CONFIG_LRU_GEN
+extern int lru_gen_state;
+
+static inline bool lru_gen_enabled(void)
+{
+	return ACCESS_ONCE(lru_gen_state);
+}
+
+static inline struct list_head *lru_gen_list(struct lruvec *lruvec,
+					     unsigned long seq, int file)
+{
+	return &lruvec->lrugen.lists[seq % MAX_NR_GENS][file];
+}
+
+/*
+ * Evictable pages go into a generation instead of onto the active or
+ * inactive list.  Activation promotes a page to the youngest generation
+ * and clears PG_active, everything on the generation lists is accounted
+ * as inactive.  New file pages start in the oldest generation so that
+ * streaming IO does not push out anything, new anon pages start one
+ * generation above since they have just been touched.
+ */
+static inline struct lruvec *
+lru_gen_add_page(struct zone *zone, struct page *page, enum lru_list *l,
+		 struct list_head **head)
+{
+	struct lruvec *lruvec;
+	int file = is_file_lru(*l);
+	unsigned long seq;
+
+	if (is_active_lru(*l)) {
+		ClearPageActive(page);
+		*l -= LRU_ACTIVE;
+		lruvec = mem_cgroup_lru_add_list(zone, page, *l);
+		seq = lruvec->lrugen.max_seq;
+	} else {
+		lruvec = mem_cgroup_lru_add_list(zone, page, *l);
+		seq = lruvec->lrugen.min_seq[file] + !file;
+	}
+	*head = lru_gen_list(lruvec, seq, file);
+	return lruvec;
+}
+
+/*
+ * Rotated and deactivated pages are queued for reclaim first: at the
+ * tail of the inactive list or of the oldest generation.
+ */
+static inline struct list_head *lru_inactive_list(struct lruvec *lruvec,
+						  enum lru_list l)
+{
+	int file = is_file_lru(l);
+
+	if (lru_gen_enabled())
+		return lru_gen_list(lruvec, lruvec->lrugen.min_seq[file], file);
+	return &lruvec->lists[l];
+}
+#else
+static inline bool lru_gen_enabled(void)
+{
+	return false;
+}
+
+static inline struct lruvec *
+lru_gen_add_page(struct zone *zone, struct page *page, enum lru_list *l,
+		 struct list_head **head)
+{
+	BUG();
+	return NULL;
+}
+
+static inline struct list_head *lru_inactive_list(struct lruvec *lruvec,
+						  enum lru_list l)
+{
+	return &lruvec->lists[l];
+}
+#endif
+
 static inline void
 add_page_to_lru_list(struct zone *zone, struct page *page, enum lru_list l)
 {
 	struct lruvec *lruvec;
+	struct list_head *head;
 
-	lruvec = mem_cgroup_lru_add_list(zone, page, l);
-	list_add(&page->lru, &lruvec->lists[l]);
+	if (lru_gen_enabled() && !is_unevictable_lru(l))
+		lruvec = lru_gen_add_page(zone, page, &l, &head);
+	else {
+		lruvec = mem_cgroup_lru_add_list(zone, page, l);
+		head = &lruvec->lists[l];
+	}
+	list_add(&page->lru, head);
 	__mod_zone_page_state(zone, NR_LRU_BASE + l, hpage_nr_pages(page));
 }
 
@@ -9,6 +9,7 @@
 #include <linux/prio_tree.h>
 #include <linux/rbtree.h>
 #include <linux/rwsem.h>
+#include <linux/rcupdate.h>
 #include <linux/completion.h>
 #include <linux/cpumask.h>
 #include <linux/page-debug-flags.h>
@@ -78,9 +79,12 @@ struct page {
 		pgoff_t index;		/* Our offset within mapping. */
 		void *freelist;		/* SLUB: freelist req. slab lock */
 	};
-	struct list_head lru;		/* Pageout list, eg. active_list
+	union {
+		struct list_head lru;	/* Pageout list, eg. active_list
 					 * protected by zone->lru_lock !
 					 */
+		struct page *next;	/* SLUB: next cpu partial slab */
+	};
 	/*
 	 * On machines where all RAM is mapped into kernel address space,
 	 * we can simply calculate the virtual address. On machines with
@@ -186,6 +190,16 @@ struct vm_area_struct {
 #endif
 #ifdef CONFIG_NUMA
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
+#endif
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	/*
+	 * For page faults that run without mmap_sem, see
+	 * handle_speculative_fault(): vm_sequence is bumped around changes
+	 * to the fields above, vm_ref_count counts the faults using the vma.
+	 */
+	seqcount_t vm_sequence;
+	atomic_t vm_ref_count;
+	struct rcu_head vm_rcu_head;
 #endif
 	/* reserved for Red Hat */
 	unsigned long rh_reserved[2];
@@ -305,6 +319,14 @@ struct mm_struct {
 #endif
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	pgtable_t pmd_huge_pte; /* protected by page_table_lock */
+#endif
+#ifdef CONFIG_LRU_GEN
+	/* list of mm's walked by kswapd to age pages, see mm/vmscan.c */
+	struct list_head lru_gen_list;
+#endif
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	/* mremap is moving page tables, see move_vma() */
+	int spf_blocked;
 #endif
 	/* reserved for Red Hat */
 #ifdef __GENKSYMS__
@@ -104,6 +104,8 @@ enum zone_stat_item {
 	NR_ISOLATED_ANON,	/* Temporary isolated pages from anon lru */
 	NR_ISOLATED_FILE,	/* Temporary isolated pages from file lru */
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
+	WORKINGSET_REFAULT,	/* evicted file pages faulted back in */
+	WORKINGSET_ACTIVATE,	/* refaults activated right away */
 #ifdef CONFIG_NUMA
 	NUMA_HIT,		/* allocated in intended node */
 	NUMA_MISS,		/* allocated in non intended node */
@@ -168,10 +170,51 @@ static inline int is_unevictable_lru(enum lru_list l)
 /* LRU Isolation modes. */
 typedef unsigned __bitwise__ isolate_mode_t;
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * Multi-generational LRU.  Evictable pages are sorted into generations
+ * by age rather than into an active and an inactive list: max_seq is
+ * the youngest generation, min_seq[] the oldest one for anon [0] and
+ * file [1] pages.  Reclaim evicts from min_seq[], aging opens a new
+ * max_seq.  Between MIN_NR_GENS and MAX_NR_GENS generations are live.
+ * All pages on the generation lists are accounted as inactive.
+ */
+#define MIN_NR_GENS	2
+#define MAX_NR_GENS	4
+
+struct lru_gen {
+	unsigned long max_seq;
+	unsigned long min_seq[2];
+	struct list_head lists[MAX_NR_GENS][2];
+};
+#endif
+
 struct lruvec {
 	struct list_head lists[NR_LRU_LISTS];
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen lrugen;
+#endif
 };
 
+#ifdef CONFIG_LRU_GEN
+static inline void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	int gen, file;
+
+	lrugen->max_seq = MIN_NR_GENS - 1;
+	for (file = 0; file < 2; file++) {
+		lrugen->min_seq[file] = 0;
+		for (gen = 0; gen < MAX_NR_GENS; gen++)
+			INIT_LIST_HEAD(&lrugen->lists[gen][file]);
+	}
+}
+#else
+static inline void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+}
+#endif
+
 enum zone_watermarks {
 	WMARK_MIN,
 	WMARK_LOW,
@@ -405,6 +448,8 @@ struct zone {
 	 */
 	unsigned int inactive_ratio;
 
+	/* Evictions & activations on the inactive file list */
+	atomic_long_t		inactive_age;
 
 	ZONE_PADDING(_pad2_)
 	/* Rarely used or read-mostly fields */
@@ -696,6 +741,12 @@ typedef struct pglist_data {
 	wait_queue_head_t kswapd_wait;
 	struct task_struct *kswapd;
 	int kswapd_max_order;
+#ifdef CONFIG_COMPACTION
+	int kcompactd_max_order;
+	enum zone_type kcompactd_classzone_idx;
+	wait_queue_head_t kcompactd_wait;
+	struct task_struct *kcompactd;
+#endif
 } pg_data_t;
 
 #define node_present_pages(nid)	(NODE_DATA(nid)->node_present_pages)
@@ -270,6 +270,11 @@ extern int   	     kernel_recvmsg(struct socket *sock, struct msghdr *msg,
 				    struct kvec *vec, size_t num,
 				    size_t len, int flags);
 
+extern long sock_file_sendmsg(struct file *file, struct msghdr __user *msg,
+			      unsigned flags);
+extern long sock_file_recvmsg(struct file *file, struct msghdr __user *msg,
+			      unsigned flags);
+
 extern int kernel_bind(struct socket *sock, struct sockaddr *addr,
 		       int addrlen);
 extern int kernel_listen(struct socket *sock, int backlog);
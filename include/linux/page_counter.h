@@ -0,0 +1,65 @@
+#ifndef _LINUX_PAGE_COUNTER_H
+#define _LINUX_PAGE_COUNTER_H
+
+/*
+ * Page counters
+ *
+ * A hierarchical counter of pages against a limit. Unlike struct
+ * res_counter, charging does not take a lock at any level: the count
+ * is an atomic that is speculatively raised and backed out again if
+ * it went over the limit. The watermark and failcnt are only updated
+ * opportunistically and may be slightly off under concurrency.
+ */
+
+#include <asm/atomic.h>
+#include <linux/kernel.h>
+#include <asm/page.h>
+
+struct page_counter {
+	atomic_long_t count;
+	unsigned long limit;
+	struct page_counter *parent;
+
+	/* highest count seen, for max_usage_in_bytes */
+	unsigned long watermark;
+	/* number of failed charges, for failcnt */
+	unsigned long failcnt;
+};
+
+#if BITS_PER_LONG == 32
+#define PAGE_COUNTER_MAX LONG_MAX
+#else
+#define PAGE_COUNTER_MAX (LONG_MAX / PAGE_SIZE)
+#endif
+
+static inline void page_counter_init(struct page_counter *counter,
+				     struct page_counter *parent)
+{
+	atomic_long_set(&counter->count, 0);
+	counter->limit = PAGE_COUNTER_MAX;
+	counter->parent = parent;
+	counter->watermark = 0;
+	counter->failcnt = 0;
+}
+
+static inline unsigned long page_counter_read(struct page_counter *counter)
+{
+	return atomic_long_read(&counter->count);
+}
+
+void page_counter_cancel(struct page_counter *counter, unsigned long nr_pages);
+void page_counter_charge(struct page_counter *counter, unsigned long nr_pages);
+int __must_check page_counter_try_charge(struct page_counter *counter,
+					 unsigned long nr_pages,
+					 struct page_counter **fail);
+void page_counter_uncharge(struct page_counter *counter,
+			   unsigned long nr_pages);
+int page_counter_limit(struct page_counter *counter, unsigned long limit);
+int page_counter_memparse(const char *buf, unsigned long *nr_pages);
+
+static inline void page_counter_reset_watermark(struct page_counter *counter)
+{
+	counter->watermark = page_counter_read(counter);
+}
+
+#endif /* _LINUX_PAGE_COUNTER_H */
@@ -202,11 +202,21 @@ static inline void page_unfreeze_refs(struct page *page, int count)
 
 #ifdef CONFIG_NUMA
 extern struct page *__page_cache_alloc(gfp_t gfp);
+extern unsigned long __page_cache_alloc_bulk(gfp_t gfp,
+					     unsigned long nr_pages,
+					     struct list_head *list);
 #else
 static inline struct page *__page_cache_alloc(gfp_t gfp)
 {
 	return alloc_pages(gfp, 0);
 }
+
+static inline unsigned long __page_cache_alloc_bulk(gfp_t gfp,
+						    unsigned long nr_pages,
+						    struct list_head *list)
+{
+	return alloc_pages_bulk_list(gfp, nr_pages, list);
+}
 #endif
 
 static inline struct page *page_cache_alloc(struct address_space *x)
@@ -225,10 +235,23 @@ static inline struct page *page_cache_alloc_readahead(struct address_space *x)
 				  __GFP_COLD | __GFP_NORETRY | __GFP_NOWARN);
 }
 
+static inline unsigned long
+page_cache_alloc_readahead_bulk(struct address_space *x,
+				unsigned long nr_pages, struct list_head *list)
+{
+	return __page_cache_alloc_bulk(mapping_gfp_mask(x) |
+				       __GFP_COLD | __GFP_NORETRY | __GFP_NOWARN,
+				       nr_pages, list);
+}
+
 typedef int filler_t(void *, struct page *);
 
+extern struct page * find_get_entry(struct address_space *mapping,
+				pgoff_t index);
 extern struct page * find_get_page(struct address_space *mapping,
 				pgoff_t index);
+extern struct page * find_lock_entry(struct address_space *mapping,
+				pgoff_t index);
 extern struct page * find_lock_page(struct address_space *mapping,
 				pgoff_t index);
 extern struct page * find_or_create_page(struct address_space *mapping,
@@ -411,6 +434,7 @@ void wait_for_stable_page(struct page *page);
  * Add an arbitrary waiter to a page's wait queue
  */
 extern void add_page_wait_queue(struct page *page, wait_queue_t *waiter);
+extern int wait_on_page_locked_async(struct page *page, wait_queue_t *waiter);
 
 /*
  * Fault a userspace page into pagetables.  Return non-zero on a fault.
@@ -528,7 +552,7 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				pgoff_t index, gfp_t gfp_mask);
 extern void remove_from_page_cache(struct page *page);
-extern void __remove_from_page_cache(struct page *page);
+extern void __remove_from_page_cache(struct page *page, void *shadow);
 
 /*
  * Like add_to_page_cache_locked, but used to add newly allocated pages:
@@ -0,0 +1,220 @@
+#ifndef _LINUX_PERCPU_REFCOUNT_H
+#define _LINUX_PERCPU_REFCOUNT_H
+/*
+ * Percpu refcounts
+ *
+ * A reference count for objects that are looked up and released on many
+ * cpus at once.  While the object is live, gets and puts only touch a
+ * per cpu counter, so they neither bounce a shared cacheline nor use a
+ * locked instruction.  The price is that the count cannot be read: the
+ * sum of the per cpu counters is only meaningful once the ref has been
+ * switched to atomic mode, which takes an RCU-sched grace period.
+ *
+ * The usual life cycle is percpu_ref_init(), gets and puts, then
+ * percpu_ref_kill() by the owner when it wants the object gone.  Kill
+ * drops the initial reference and switches to atomic mode; from then on
+ * percpu_ref_tryget_live() fails, and the release callback runs when the
+ * last reference is put.  Owners that need an exact count for a while
+ * without killing the ref can switch it to atomic mode and back.
+ *
+ * Gets and puts may be called from any context, including hard irq.
+ */
+
+#include <linux/kernel.h>
+#include <linux/percpu.h>
+#include <linux/rcupdate.h>
+#include <linux/types.h>
+#include <asm/atomic.h>
+#include <asm/local.h>
+
+struct percpu_ref;
+typedef void (percpu_ref_func_t)(struct percpu_ref *);
+
+/* flags in the low bits of percpu_ref->pcpu_count_ptr */
+#define __PERCPU_REF_ATOMIC		1LU
+#define __PERCPU_REF_DEAD		2LU
+#define __PERCPU_REF_ATOMIC_DEAD	(__PERCPU_REF_ATOMIC | __PERCPU_REF_DEAD)
+
+struct percpu_ref {
+	atomic_long_t		count;
+	/*
+	 * The per cpu counters, with the mode in the low bits so that one
+	 * load gives both, ordered by the address dependency.
+	 */
+	unsigned long		pcpu_count_ptr;
+	percpu_ref_func_t	*release;
+	percpu_ref_func_t	*confirm_switch;
+	struct rcu_head		rcu;
+};
+
+int percpu_ref_init(struct percpu_ref *ref, percpu_ref_func_t *release);
+void percpu_ref_exit(struct percpu_ref *ref);
+void percpu_ref_switch_to_atomic(struct percpu_ref *ref,
+				 percpu_ref_func_t *confirm_switch);
+void percpu_ref_switch_to_atomic_sync(struct percpu_ref *ref);
+void percpu_ref_switch_to_percpu(struct percpu_ref *ref);
+void percpu_ref_kill_and_confirm(struct percpu_ref *ref,
+				 percpu_ref_func_t *confirm_kill);
+
+/**
+ * percpu_ref_kill - drop the initial ref
+ * @ref: percpu_ref to kill
+ *
+ * Switches @ref to atomic mode, makes percpu_ref_tryget_live() fail and
+ * drops the reference taken by percpu_ref_init().  The release callback
+ * runs once all other references are gone.
+ */
+static inline void percpu_ref_kill(struct percpu_ref *ref)
+{
+	percpu_ref_kill_and_confirm(ref, NULL);
+}
+
+/*
+ * Internal helper.  Must be called with preemption disabled, which is
+ * what keeps a switch to atomic mode from summing the counters under us.
+ */
+static inline bool __ref_is_percpu(struct percpu_ref *ref,
+				   local_t **pcpu_countp)
+{
+	unsigned long pcpu_ptr = ACCESS_ONCE(ref->pcpu_count_ptr);
+
+	/* paired with smp_wmb() in percpu_ref_switch_to_percpu() */
+	smp_read_barrier_depends();
+
+	if (unlikely(pcpu_ptr & __PERCPU_REF_ATOMIC_DEAD))
+		return false;
+
+	*pcpu_countp = per_cpu_ptr((local_t *)pcpu_ptr, smp_processor_id());
+	return true;
+}
+
+/**
+ * percpu_ref_get_many - increment a percpu refcount
+ * @ref: percpu_ref to get
+ * @nr: number of references to get
+ *
+ * The caller must already hold a reference, or otherwise know that @ref
+ * has not reached zero.
+ */
+static inline void percpu_ref_get_many(struct percpu_ref *ref,
+				       unsigned long nr)
+{
+	local_t *pcpu_count;
+
+	rcu_read_lock_sched();
+
+	if (__ref_is_percpu(ref, &pcpu_count))
+		local_add(nr, pcpu_count);
+	else
+		atomic_long_add(nr, &ref->count);
+
+	rcu_read_unlock_sched();
+}
+
+static inline void percpu_ref_get(struct percpu_ref *ref)
+{
+	percpu_ref_get_many(ref, 1);
+}
+
+/**
+ * percpu_ref_tryget - try to increment a percpu refcount
+ * @ref: percpu_ref to try-get
+ *
+ * Fails only once the count has reached zero, which can only happen in
+ * atomic mode; use percpu_ref_tryget_live() to also refuse refs that
+ * have been killed.
+ */
+static inline bool percpu_ref_tryget(struct percpu_ref *ref)
+{
+	local_t *pcpu_count;
+	bool ret;
+
+	rcu_read_lock_sched();
+
+	if (__ref_is_percpu(ref, &pcpu_count)) {
+		local_inc(pcpu_count);
+		ret = true;
+	} else {
+		ret = atomic_long_inc_not_zero(&ref->count);
+	}
+
+	rcu_read_unlock_sched();
+
+	return ret;
+}
+
+/**
+ * percpu_ref_tryget_live - try to increment a live percpu refcount
+ * @ref: percpu_ref to try-get
+ *
+ * Fails once percpu_ref_kill() has been called.  A get racing with the
+ * kill may still succeed until the kill is confirmed.
+ */
+static inline bool percpu_ref_tryget_live(struct percpu_ref *ref)
+{
+	local_t *pcpu_count;
+	bool ret = false;
+
+	rcu_read_lock_sched();
+
+	if (__ref_is_percpu(ref, &pcpu_count)) {
+		local_inc(pcpu_count);
+		ret = true;
+	} else if (!(ACCESS_ONCE(ref->pcpu_count_ptr) & __PERCPU_REF_DEAD)) {
+		ret = atomic_long_inc_not_zero(&ref->count);
+	}
+
+	rcu_read_unlock_sched();
+
+	return ret;
+}
+
+/**
+ * percpu_ref_put_many - decrement a percpu refcount
+ * @ref: percpu_ref to put
+ * @nr: number of references to put
+ *
+ * Calls the release callback, if there is one, when the count drops to
+ * zero; that can only happen in atomic mode.
+ */
+static inline void percpu_ref_put_many(struct percpu_ref *ref,
+				       unsigned long nr)
+{
+	local_t *pcpu_count;
+
+	rcu_read_lock_sched();
+
+	if (__ref_is_percpu(ref, &pcpu_count))
+		local_sub(nr, pcpu_count);
+	else if (unlikely(atomic_long_sub_and_test(nr, &ref->count)) &&
+		 ref->release)
+		ref->release(ref);
+
+	rcu_read_unlock_sched();
+}
+
+static inline void percpu_ref_put(struct percpu_ref *ref)
+{
+	percpu_ref_put_many(ref, 1);
+}
+
+/**
+ * percpu_ref_is_zero - test whether a percpu refcount reached zero
+ * @ref: percpu_ref to test
+ *
+ * Always false in percpu mode.
+ */
+static inline bool percpu_ref_is_zero(struct percpu_ref *ref)
+{
+	local_t *pcpu_count;
+	bool ret;
+
+	rcu_read_lock_sched();
+	ret = !__ref_is_percpu(ref, &pcpu_count) &&
+	      !atomic_long_read(&ref->count);
+	rcu_read_unlock_sched();
+
+	return ret;
+}
+
+#endif /* _LINUX_PERCPU_REFCOUNT_H */
@@ -35,6 +35,12 @@
  * time callers need worry about this is when doing a lookup_slot under
  * RCU.
  *
+ * Inside the tree, pointers from a node to its child nodes carry the same
+ * bit, which tells them apart from multi-order items stored in interior
+ * nodes (see __radix_tree_insert); the extra slots of a multi-order item
+ * hold an indirect pointer to its first slot.  Lookups never return
+ * either kind.
+ *
  * Indirect pointer in fact is also used to tag the last pointer of a node
  * when it is shrunk, before we rcu free the node. See shrink code for
  * details.
@@ -196,6 +202,8 @@ static inline void radix_tree_replace_slot(void **pslot, void *item)
 	rcu_assign_pointer(*pslot, item);
 }
 
+int __radix_tree_insert(struct radix_tree_root *, unsigned long index,
+			unsigned int order, void *item);
 int radix_tree_insert(struct radix_tree_root *, unsigned long, void *);
 void *radix_tree_lookup(struct radix_tree_root *, unsigned long);
 void **radix_tree_lookup_slot(struct radix_tree_root *, unsigned long);
@@ -0,0 +1,118 @@
+#ifndef _LINUX_RHASHTABLE_H
+#define _LINUX_RHASHTABLE_H
+/*
+ * Resizable hash table with RCU lookups
+ *
+ * Objects embed a struct rhash_head and are hashed on a fixed size key
+ * stored at a fixed offset inside them.  Lookups only need
+ * rcu_read_lock(); inserts and removals take a spinlock covering a
+ * group of buckets, so writers to different parts of the table do not
+ * contend.  The table grows when it is more than 75% full and, with
+ * automatic_shrinking, shrinks when it is less than 30% full.  The
+ * resize runs from a work item and moves entries into the new table
+ * one bucket at a time, while lookups and updates carry on.
+ */
+
+#include <linux/compiler.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+#include <linux/workqueue.h>
+#include <asm/atomic.h>
+
+struct rhash_head {
+	struct rhash_head		*next;
+};
+
+/*
+ * While the table is being resized, ->future_tbl points to the new table;
+ * entries are added there, and the old buckets are emptied into it one
+ * by one.  hash_rnd stays the same across resizes.
+ */
+struct bucket_table {
+	unsigned int			size;
+	u32				hash_rnd;
+	unsigned int			locks_mask;
+	spinlock_t			*locks;
+	struct bucket_table		*future_tbl;
+
+	struct rhash_head		*buckets[0] ____cacheline_aligned_in_smp;
+};
+
+typedef u32 (*rht_hashfn_t)(const void *data, u32 len, u32 seed);
+
+/**
+ * struct rhashtable_params - hash table construction parameters
+ * @nelem_hint: expected number of elements, to size the initial table
+ * @key_len: length of the key
+ * @key_offset: offset of the key in the object
+ * @head_offset: offset of the struct rhash_head in the object
+ * @max_size: the table never grows past this many buckets (0: no limit)
+ * @min_size: nor shrinks below this many
+ * @automatic_shrinking: shrink the table when it gets sparse
+ * @hashfn: hash function for the key, jhash() when left NULL
+ */
+struct rhashtable_params {
+	size_t				nelem_hint;
+	size_t				key_len;
+	size_t				key_offset;
+	size_t				head_offset;
+	unsigned int			max_size;
+	unsigned int			min_size;
+	bool				automatic_shrinking;
+	rht_hashfn_t			hashfn;
+};
+
+/**
+ * struct rhashtable - hash table handle
+ * @tbl: bucket table
+ * @nelems: number of elements in the table
+ * @p: configuration parameters
+ * @run_work: deferred resize
+ * @mutex: serialises resizes against each other and against destroy
+ */
+struct rhashtable {
+	struct bucket_table		*tbl;
+	atomic_t			nelems;
+	struct rhashtable_params	p;
+	struct work_struct		run_work;
+	struct mutex			mutex;
+};
+
+#define rht_entry(tpos, pos, member) \
+	({ tpos = container_of(pos, typeof(*tpos), member); 1; })
+
+/**
+ * rht_for_each_entry_rcu - iterate over the objects of one bucket
+ * @tpos:	the type * to use as a loop cursor
+ * @pos:	the struct rhash_head to use as a loop cursor
+ * @tbl:	the bucket_table
+ * @hash:	the bucket index
+ * @member:	name of the rhash_head within the hashable struct
+ *
+ * Must be called under rcu_read_lock().  While the table is resized an
+ * object may show up both here and in tbl->future_tbl.
+ */
+#define rht_for_each_entry_rcu(tpos, pos, tbl, hash, member)		\
+	for (pos = rcu_dereference((tbl)->buckets[hash]);		\
+	     pos && rht_entry(tpos, pos, member);			\
+	     pos = rcu_dereference(pos->next))
+
+int rhashtable_init(struct rhashtable *ht,
+		    const struct rhashtable_params *params);
+void rhashtable_destroy(struct rhashtable *ht);
+
+void rhashtable_insert(struct rhashtable *ht, struct rhash_head *obj);
+int rhashtable_lookup_insert(struct rhashtable *ht, struct rhash_head *obj);
+int rhashtable_lookup_compare_insert(struct rhashtable *ht,
+				     struct rhash_head *obj,
+				     bool (*compare)(void *, void *),
+				     void *arg);
+int rhashtable_remove(struct rhashtable *ht, struct rhash_head *obj);
+
+void *rhashtable_lookup(struct rhashtable *ht, const void *key);
+void *rhashtable_lookup_compare(struct rhashtable *ht, const void *key,
+				bool (*compare)(void *, void *), void *arg);
+
+#endif /* _LINUX_RHASHTABLE_H */
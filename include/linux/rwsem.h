@@ -22,6 +22,11 @@ struct rw_semaphore;
 #include <asm/rwsem.h> /* use an arch-specific implementation */
 #endif
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/* rw_semaphore->owner of a sem that readers got last */
+#define RWSEM_READER_OWNED	((struct thread_info *)1UL)
+#endif
+
 /*
  * lock for reading
  */
@@ -79,6 +79,8 @@ struct  seminfo {
 #ifdef __KERNEL__
 #include <asm/atomic.h>
 #include <linux/rcupdate.h>
+#include <linux/spinlock.h>
+#include <linux/list.h>
 
 struct task_struct;
 
@@ -86,6 +88,8 @@ struct task_struct;
 struct sem {
 	int	semval;		/* current value */
 	int	sempid;		/* pid of last operation */
+	spinlock_t	lock;	/* spinlock for fine-grained semtimedop */
+	struct list_head sem_pending; /* pending single-sop operations */
 };
 
 /* One sem_array data structure for each set of semaphores in the system. */
@@ -97,6 +101,8 @@ struct sem_array {
 	struct list_head	sem_pending;	/* pending operations to be processed */
 	struct list_head	list_id;	/* undo requests on this array */
 	unsigned long		sem_nsems;	/* no. of semaphores in array */
+	int			complex_count;	/* pending complex operations */
+	int			complex_mode;	/* array-wide lock in use */
 };
 
 /* One queue for each sleeping process in the system. */
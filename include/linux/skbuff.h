@@ -499,6 +499,9 @@ static inline struct rtable *skb_rtable(const struct sk_buff *skb)
 extern void kfree_skb(struct sk_buff *skb);
 extern void consume_skb(struct sk_buff *skb);
 extern void	       __kfree_skb(struct sk_buff *skb);
+extern void napi_consume_skb(struct sk_buff *skb, int budget);
+extern void __kfree_skb_defer(struct sk_buff *skb);
+extern void __kfree_skb_flush(void);
 extern struct sk_buff *__alloc_skb(unsigned int size,
 				   gfp_t priority, int fclone, int node);
 extern struct sk_buff *build_skb(void *data);
@@ -46,6 +46,7 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 #ifdef CONFIG_COMPACTION
 		COMPACTBLOCKS, COMPACTPAGES, COMPACTPAGEFAILED,
 		COMPACTSTALL, COMPACTFAIL, COMPACTSUCCESS,
+		KCOMPACTD_WAKE,
 #endif
 #ifdef CONFIG_HUGETLB_PAGE
 		HTLB_BUDDY_PGALLOC, HTLB_BUDDY_PGALLOC_FAIL,
@@ -64,6 +65,20 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		THP_COLLAPSE_ALLOC,
 		THP_COLLAPSE_ALLOC_FAILED,
 		THP_SPLIT,
+		THP_FILE_ALLOC,
+		THP_FILE_FALLBACK,
+		THP_FILE_MAPPED,
+		THP_FILE_SPLIT_PMD,
+		THP_COLLAPSE_FILE,
+#endif
+#ifdef CONFIG_LRU_GEN
+		LRU_GEN_AGING,		/* new youngest generations opened */
+		LRU_GEN_WALK,		/* mm's walked for accessed bits */
+		LRU_GEN_PROMOTED,	/* pages promoted by the walk */
+#endif
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+		SPECULATIVE_PGFAULT,	/* faults handled without mmap_sem */
+		SPECULATIVE_PGFAULT_ABORT, /* and those redone with it */
 #endif
 		NR_VM_EVENT_ITEMS
 };
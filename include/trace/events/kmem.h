@@ -602,23 +602,6 @@ TRACE_EVENT(mm_olddata_writeout,
 	TP_printk("written=%ld", __entry->written)
 	);
 
-TRACE_EVENT(mm_balancedirty_writeout,
-
-	TP_PROTO(unsigned long written),
-
-	TP_ARGS(written),
-
-	TP_STRUCT__entry(
-		__field(unsigned long, written)
-	),
-
-	TP_fast_assign(
-		__entry->written = written;
-	),
-
-	TP_printk("written=%ld", __entry->written)
-	);
-
 TRACE_EVENT(mm_kswapd_ran,
 
 	TP_PROTO(struct pglist_data *pgdat, unsigned long reclaimed),
@@ -950,6 +933,195 @@ TRACE_EVENT(mm_vmscan_writepage,
 		__entry->sync_io)
 	);
 
+TRACE_EVENT(mm_compaction_begin,
+
+	TP_PROTO(int nid, int zid, int order, bool sync,
+		unsigned long migrate_pfn, unsigned long free_pfn),
+
+	TP_ARGS(nid, zid, order, sync, migrate_pfn, free_pfn),
+
+	TP_STRUCT__entry(
+		__field(        int,            nid             )
+		__field(        int,            zid             )
+		__field(        int,            order           )
+		__field(        bool,           sync            )
+		__field(        unsigned long,  migrate_pfn     )
+		__field(        unsigned long,  free_pfn        )
+	),
+
+	TP_fast_assign(
+		__entry->nid            = nid;
+		__entry->zid            = zid;
+		__entry->order          = order;
+		__entry->sync           = sync;
+		__entry->migrate_pfn    = migrate_pfn;
+		__entry->free_pfn       = free_pfn;
+	),
+
+	TP_printk("nid=%d zid=%d order=%d mode=%s migrate_pfn=0x%lx free_pfn=0x%lx",
+		__entry->nid,
+		__entry->zid,
+		__entry->order,
+		__entry->sync ? "sync" : "async",
+		__entry->migrate_pfn,
+		__entry->free_pfn)
+	);
+
+TRACE_EVENT(mm_compaction_end,
+
+	TP_PROTO(int nid, int zid, int order, int status,
+		unsigned long nr_migrated, unsigned long nr_failed),
+
+	TP_ARGS(nid, zid, order, status, nr_migrated, nr_failed),
+
+	TP_STRUCT__entry(
+		__field(        int,            nid             )
+		__field(        int,            zid             )
+		__field(        int,            order           )
+		__field(        int,            status          )
+		__field(        unsigned long,  nr_migrated     )
+		__field(        unsigned long,  nr_failed       )
+	),
+
+	TP_fast_assign(
+		__entry->nid            = nid;
+		__entry->zid            = zid;
+		__entry->order          = order;
+		__entry->status         = status;
+		__entry->nr_migrated    = nr_migrated;
+		__entry->nr_failed      = nr_failed;
+	),
+
+	TP_printk("nid=%d zid=%d order=%d status=%d nr_migrated=%lu nr_failed=%lu",
+		__entry->nid,
+		__entry->zid,
+		__entry->order,
+		__entry->status,
+		__entry->nr_migrated,
+		__entry->nr_failed)
+	);
+
+TRACE_EVENT(mm_compaction_kcompactd_sleep,
+
+	TP_PROTO(int nid),
+
+	TP_ARGS(nid),
+
+	TP_STRUCT__entry(
+		__field(        int,    nid     )
+	),
+
+	TP_fast_assign(
+		__entry->nid    = nid;
+	),
+
+	TP_printk("nid=%d", __entry->nid)
+	);
+
+TRACE_EVENT(mm_compaction_kcompactd_wake,
+
+	TP_PROTO(int nid, int order, int zid, bool proactive),
+
+	TP_ARGS(nid, order, zid, proactive),
+
+	TP_STRUCT__entry(
+		__field(        int,            nid             )
+		__field(        int,            order           )
+		__field(        int,            zid             )
+		__field(        bool,           proactive       )
+	),
+
+	TP_fast_assign(
+		__entry->nid            = nid;
+		__entry->order          = order;
+		__entry->zid            = zid;
+		__entry->proactive      = proactive;
+	),
+
+	TP_printk("nid=%d order=%d classzone_idx=%d proactive=%d",
+		__entry->nid,
+		__entry->order,
+		__entry->zid,
+		__entry->proactive)
+	);
+
+TRACE_EVENT(mm_compaction_wakeup_kcompactd,
+
+	TP_PROTO(int nid, int order, int zid),
+
+	TP_ARGS(nid, order, zid),
+
+	TP_STRUCT__entry(
+		__field(        int,            nid     )
+		__field(        int,            order   )
+		__field(        int,            zid     )
+	),
+
+	TP_fast_assign(
+		__entry->nid            = nid;
+		__entry->order          = order;
+		__entry->zid            = zid;
+	),
+
+	TP_printk("nid=%d order=%d classzone_idx=%d",
+		__entry->nid,
+		__entry->order,
+		__entry->zid)
+	);
+
+struct address_space;
+
+TRACE_EVENT(mm_filemap_readahead,
+
+	TP_PROTO(struct address_space *mapping, pgoff_t offset,
+		unsigned long req_size, pgoff_t start, unsigned long size,
+		unsigned long async_size, int pattern, int actual),
+
+	TP_ARGS(mapping, offset, req_size, start, size, async_size, pattern,
+		actual),
+
+	TP_STRUCT__entry(
+		__field(        dev_t,          dev             )
+		__field(        ino_t,          ino             )
+		__field(        pgoff_t,        offset          )
+		__field(        unsigned long,  req_size        )
+		__field(        pgoff_t,        start           )
+		__field(        unsigned long,  size            )
+		__field(        unsigned long,  async_size      )
+		__field(        int,            pattern         )
+		__field(        int,            actual          )
+	),
+
+	TP_fast_assign(
+		__entry->dev            = mapping->host->i_sb->s_dev;
+		__entry->ino            = mapping->host->i_ino;
+		__entry->offset         = offset;
+		__entry->req_size       = req_size;
+		__entry->start          = start;
+		__entry->size           = size;
+		__entry->async_size     = async_size;
+		__entry->pattern        = pattern;
+		__entry->actual         = actual;
+	),
+
+	TP_printk("dev=%d:%d ino=%lx pattern=%s offset=%lu req_size=%lu start=%lu size=%lu async_size=%lu actual=%d",
+		MAJOR(__entry->dev), MINOR(__entry->dev),
+		(unsigned long)__entry->ino,
+		__print_symbolic(__entry->pattern,
+			{ RA_PATTERN_INITIAL,		"initial"	},
+			{ RA_PATTERN_SEQUENTIAL,	"sequential"	},
+			{ RA_PATTERN_MARKER,		"marker"	},
+			{ RA_PATTERN_CONTEXT,		"context"	},
+			{ RA_PATTERN_STRIDE,		"stride"	},
+			{ RA_PATTERN_RANDOM,		"random"	}),
+		__entry->offset,
+		__entry->req_size,
+		__entry->start,
+		__entry->size,
+		__entry->async_size,
+		__entry->actual)
+	);
+
 #endif /* _TRACE_KMEM_H */
 
 /* This part must be outside protection */
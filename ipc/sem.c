@@ -89,7 +89,6 @@
 
 #define sem_ids(ns)	((ns)->ids[IPC_SEM_IDS])
 
-#define sem_unlock(sma)		ipc_unlock(&(sma)->sem_perm)
 #define sem_checkid(sma, semid)	ipc_checkid(&sma->sem_perm, semid)
 
 static int newary(struct ipc_namespace *, struct ipc_params *);
@@ -106,6 +105,7 @@ static int sysvipc_sem_proc_show(struct seq_file *s, void *it);
  *	sem_undo.id_next,
  *	sem_array.sem_pending{,last},
  *	sem_array.sem_undo: sem_lock() for read/write
+ *	sem.sem_pending: sem.lock, or sem_lock() in complex mode
  *	sem_undo.proc_next: only "current" is allowed to read/write that field.
  *	
  */
@@ -141,48 +141,176 @@ void __init sem_init (void)
 				IPC_SEM_IDS, sysvipc_sem_proc_show);
 }
 
+/*
+ * Locking model:
+ * Every semaphore has its own spinlock (sem->lock) in addition to the
+ * array-wide sem_perm.lock. A semtimedop() with a single sembuf only
+ * touches one semaphore, so it takes just that semaphore's lock, as long
+ * as the array is not in "complex mode". Everything else (multi-sop
+ * operations, semctl, undo processing, IPC_RMID) takes sem_perm.lock and
+ * switches the array into complex mode, which waits until all per-semaphore
+ * lock holders have left and forces newcomers onto sem_perm.lock.
+ * Complex mode is left again when the array-wide lock is dropped and no
+ * complex operation is sleeping in sma->sem_pending.
+ */
+static void sem_complexmode_enter(struct sem_array *sma)
+{
+	int i;
+
+	if (sma->complex_mode)
+		return;
+
+	sma->complex_mode = 1;
+	/*
+	 * Pairs with the per-semaphore lock in sem_lock_sops(): anyone that
+	 * acquires sem->lock after we dropped it below observes complex_mode.
+	 */
+	smp_mb();
+	for (i = 0; i < sma->sem_nsems; i++) {
+		struct sem *sem = sma->sem_base + i;
+
+		spin_lock(&sem->lock);
+		spin_unlock(&sem->lock);
+	}
+}
+
+static void sem_complexmode_tryleave(struct sem_array *sma)
+{
+	if (sma->complex_count)
+		return;
+	/* make the updates done under sem_perm.lock visible first */
+	smp_mb();
+	sma->complex_mode = 0;
+}
+
+static inline void sem_unlock(struct sem_array *sma)
+{
+	sem_complexmode_tryleave(sma);
+	ipc_unlock(&sma->sem_perm);
+}
+
 /*
  * sem_lock_(check_) routines are called in the paths where the rw_mutex
- * is not held.
+ * is not held. They take the array-wide lock.
  */
 static inline struct sem_array *sem_lock(struct ipc_namespace *ns, int id)
 {
 	struct kern_ipc_perm *ipcp = ipc_lock(&sem_ids(ns), id);
+	struct sem_array *sma;
 
 	if (IS_ERR(ipcp))
 		return (struct sem_array *)ipcp;
 
-	return container_of(ipcp, struct sem_array, sem_perm);
+	sma = container_of(ipcp, struct sem_array, sem_perm);
+	sem_complexmode_enter(sma);
+	return sma;
 }
 
 static inline struct sem_array *sem_lock_check(struct ipc_namespace *ns,
 						int id)
 {
 	struct kern_ipc_perm *ipcp = ipc_lock_check(&sem_ids(ns), id);
+	struct sem_array *sma;
 
 	if (IS_ERR(ipcp))
 		return (struct sem_array *)ipcp;
 
-	return container_of(ipcp, struct sem_array, sem_perm);
+	sma = container_of(ipcp, struct sem_array, sem_perm);
+	sem_complexmode_enter(sma);
+	return sma;
 }
 
 static inline void sem_lock_and_putref(struct sem_array *sma)
 {
 	ipc_lock_by_ptr(&sma->sem_perm);
+	sem_complexmode_enter(sma);
 	ipc_rcu_putref(sma);
 }
 
 static inline void sem_getref_and_unlock(struct sem_array *sma)
 {
 	ipc_rcu_getref(sma);
-	ipc_unlock(&(sma)->sem_perm);
+	sem_unlock(sma);
 }
 
 static inline void sem_putref(struct sem_array *sma)
 {
 	ipc_lock_by_ptr(&sma->sem_perm);
 	ipc_rcu_putref(sma);
-	ipc_unlock(&(sma)->sem_perm);
+	ipc_unlock(&sma->sem_perm);
+}
+
+/*
+ * Lookup without locking, for semtimedop(). Must be called under
+ * rcu_read_lock(); the caller then locks with sem_lock_sops().
+ */
+static inline struct sem_array *sem_obtain_object_check(struct ipc_namespace *ns,
+							int id)
+{
+	struct kern_ipc_perm *ipcp = ipc_obtain_object_check(&sem_ids(ns), id);
+
+	if (IS_ERR(ipcp))
+		return (struct sem_array *)ipcp;
+
+	return container_of(ipcp, struct sem_array, sem_perm);
+}
+
+/*
+ * sem_lock_sops - lock the part of the array needed by a semop
+ *
+ * A single-sop operation only takes the lock of the semaphore it operates
+ * on, unless the array is in complex mode. Returns the number of the
+ * semaphore that was locked, or -1 if the array-wide lock was taken.
+ * Must be called under rcu_read_lock(), the caller must check
+ * sma->sem_perm.deleted afterwards.
+ */
+static int sem_lock_sops(struct sem_array *sma, struct sembuf *sops,
+			 int nsops)
+{
+	struct sem *sem;
+
+	if (nsops != 1) {
+		spin_lock(&sma->sem_perm.lock);
+		sem_complexmode_enter(sma);
+		return -1;
+	}
+
+	sem = sma->sem_base + sops->sem_num;
+
+	if (!ACCESS_ONCE(sma->complex_mode)) {
+		spin_lock(&sem->lock);
+		if (!ACCESS_ONCE(sma->complex_mode)) {
+			/* pairs with smp_mb() in sem_complexmode_tryleave() */
+			smp_rmb();
+			return sops->sem_num;
+		}
+		spin_unlock(&sem->lock);
+	}
+
+	spin_lock(&sma->sem_perm.lock);
+	if (sma->complex_count == 0) {
+		/*
+		 * Nobody needs the array-wide lock any more: switch back to
+		 * the per-semaphore lock.
+		 */
+		spin_lock(&sem->lock);
+		sem_complexmode_tryleave(sma);
+		spin_unlock(&sma->sem_perm.lock);
+		return sops->sem_num;
+	}
+	sem_complexmode_enter(sma);
+	return -1;
+}
+
+static void sem_unlock_sops(struct sem_array *sma, int locknum)
+{
+	if (locknum == -1) {
+		sem_complexmode_tryleave(sma);
+		spin_unlock(&sma->sem_perm.lock);
+	} else {
+		struct sem *sem = sma->sem_base + locknum;
+		spin_unlock(&sem->lock);
+	}
 }
 
 static inline void sem_rmid(struct ipc_namespace *ns, struct sem_array *s)
@@ -195,7 +323,7 @@ static inline void sem_rmid(struct ipc_namespace *ns, struct sem_array *s)
  * Without the check/retry algorithm a lockless wakeup is possible:
  * - queue.status is initialized to -EINTR before blocking.
  * - wakeup is performed by
- *	* unlinking the queue entry from sma->sem_pending
+ *	* unlinking the queue entry from its pending queue
  *	* setting queue.status to IN_WAKEUP
  *	  This is the notification for the blocked thread that a
  *	  result value is imminent.
@@ -238,6 +366,7 @@ static int newary(struct ipc_namespace *ns, struct ipc_params *params)
 	int retval;
 	struct sem_array *sma;
 	int size;
+	int i;
 	key_t key = params->key;
 	int nsems = params->u.nsems;
 	int semflg = params->flg;
@@ -264,6 +393,23 @@ static int newary(struct ipc_namespace *ns, struct ipc_params *params)
 		return retval;
 	}
 
+	/*
+	 * The array is visible to sem_lock_sops() as soon as ipc_addid()
+	 * returns, so the per-semaphore state must be set up before.
+	 * complex_mode is dropped by sem_unlock() below.
+	 */
+	sma->sem_base = (struct sem *) &sma[1];
+	for (i = 0; i < nsems; i++) {
+		spin_lock_init(&sma->sem_base[i].lock);
+		INIT_LIST_HEAD(&sma->sem_base[i].sem_pending);
+	}
+	INIT_LIST_HEAD(&sma->sem_pending);
+	INIT_LIST_HEAD(&sma->list_id);
+	sma->sem_nsems = nsems;
+	sma->complex_count = 0;
+	sma->complex_mode = 1;
+	sma->sem_ctime = get_seconds();
+
 	id = ipc_addid(&sem_ids(ns), &sma->sem_perm, ns->sc_semmni);
 	if (id < 0) {
 		security_sem_free(sma);
@@ -272,11 +418,6 @@ static int newary(struct ipc_namespace *ns, struct ipc_params *params)
 	}
 	ns->used_sems += nsems;
 
-	sma->sem_base = (struct sem *) &sma[1];
-	INIT_LIST_HEAD(&sma->sem_pending);
-	INIT_LIST_HEAD(&sma->list_id);
-	sma->sem_nsems = nsems;
-	sma->sem_ctime = get_seconds();
 	sem_unlock(sma);
 
 	return sma->sem_perm.id;
@@ -398,64 +539,135 @@ undo:
 	return result;
 }
 
-/* Go through the pending queue for the indicated semaphore
- * looking for tasks that can be completed.
+/*
+ * Pending operations live on one of two kinds of queues:
+ * - single-sop operations on the queue of the semaphore they wait on
+ *   (sem->sem_pending), protected by that semaphore's lock;
+ * - complex operations on sma->sem_pending, which is only ever touched
+ *   in complex mode, i.e. with the array-wide lock held.
+ * Wait-for-zero operations are added at the head, altering operations at
+ * the tail, so that within a queue zero waiters are serviced first.
  */
-static void update_queue (struct sem_array * sma)
+static void unlink_queue(struct sem_array *sma, struct sem_queue *q)
 {
-	int error;
-	struct sem_queue * q;
+	list_del(&q->list);
+	if (q->nsops > 1)
+		sma->complex_count--;
+}
+
+static void wake_up_sem_queue(struct sem_queue *q, int error)
+{
+	/* wake up the waiting thread */
+	q->status = IN_WAKEUP;
+
+	wake_up_process(q->sleeper);
+	/* hands-off: q will disappear immediately after
+	 * writing q->status.
+	 */
+	smp_wmb();
+	q->status = error;
+}
+
+/* Go through the pending queue of the indicated semaphore (or the
+ * queue of complex operations if semnum is -1) looking for tasks that
+ * can be completed. Returns 1 if at least one operation completed.
+ */
+static int update_queue(struct sem_array *sma, int semnum)
+{
+	struct sem_queue *q;
+	struct list_head *walk;
+	struct list_head *pending_list;
+	int semop_completed = 0;
+
+	if (semnum == -1)
+		pending_list = &sma->sem_pending;
+	else
+		pending_list = &sma->sem_base[semnum].sem_pending;
+
+again:
+	walk = pending_list->next;
+	while (walk != pending_list) {
+		int error;
+
+		q = container_of(walk, struct sem_queue, list);
+		walk = walk->next;
+
+		/*
+		 * Single-sop decrements cannot succeed while the semaphore
+		 * is 0, and they queue up behind the zero waiters: nothing
+		 * else on this queue can make progress.
+		 */
+		if (semnum != -1 && sma->sem_base[semnum].semval == 0 &&
+				q->alter)
+			break;
 
-	q = list_entry(sma->sem_pending.next, struct sem_queue, list);
-	while (&q->list != &sma->sem_pending) {
 		error = try_atomic_semop(sma, q->sops, q->nsops,
 					 q->undo, q->pid);
 
 		/* Does q->sleeper still need to sleep? */
-		if (error <= 0) {
-			struct sem_queue *n;
+		if (error > 0)
+			continue;
 
-			/*
-			 * Continue scanning. The next operation
-			 * that must be checked depends on the type of the
-			 * completed operation:
-			 * - if the operation modified the array, then
-			 *   restart from the head of the queue and
-			 *   check for threads that might be waiting
-			 *   for semaphore values to become 0.
-			 * - if the operation didn't modify the array,
-			 *   then just continue.
-			 * The order of list_del() and reading ->next
-			 * is crucial: In the former case, the list_del()
-			 * must be done first [because we might be the
-			 * first entry in ->sem_pending], in the latter
-			 * case the list_del() must be done last
-			 * [because the list is invalid after the list_del()]
-			 */
-			if (q->alter) {
-				list_del(&q->list);
-				n = list_entry(sma->sem_pending.next,
-						struct sem_queue, list);
-			} else {
-				n = list_entry(q->list.next, struct sem_queue,
-						list);
-				list_del(&q->list);
-			}
+		unlink_queue(sma, q);
+		if (!error)
+			semop_completed = 1;
+		wake_up_sem_queue(q, error);
+
+		/*
+		 * If the operation modified the array, restart from the
+		 * head of the queue: threads that were waiting for a
+		 * semaphore value to become 0 may now proceed.
+		 */
+		if (!error && q->alter)
+			goto again;
+	}
+	return semop_completed;
+}
 
-			/* wake up the waiting thread */
-			q->status = IN_WAKEUP;
+/*
+ * do_smart_update - wake up the operations that a change may have unblocked
+ * @sma: semaphore array
+ * @sops: operations that modified the array, NULL if unknown
+ * @nsops: number of operations
+ *
+ * Only the queues of the semaphores that were modified have to be scanned,
+ * plus the complex queue if it is not empty. A completed complex operation
+ * can modify any semaphore, so it triggers a scan of every queue.
+ * Called with the lock returned by sem_lock_sops(), or the array-wide lock
+ * if sops is NULL.
+ */
+static void do_smart_update(struct sem_array *sma, struct sembuf *sops,
+			    int nsops)
+{
+	int i, progress;
+
+	do {
+		progress = 0;
+		if (sma->complex_count || sops == NULL) {
+			if (update_queue(sma, -1)) {
+				progress = 1;
+				sops = NULL;
+			}
+		}
 
-			wake_up_process(q->sleeper);
-			/* hands-off: q will disappear immediately after
-			 * writing q->status.
-			 */
-			smp_wmb();
-			q->status = error;
-			q = n;
+		if (sops == NULL) {
+			for (i = 0; i < sma->sem_nsems; i++)
+				if (update_queue(sma, i))
+					progress = 1;
 		} else {
-			q = list_entry(q->list.next, struct sem_queue, list);
+			for (i = 0; i < nsops; i++) {
+				struct sembuf *sop = sops + i;
+
+				if (sop->sem_op > 0 ||
+				    (sop->sem_op < 0 &&
+				     !sma->sem_base[sop->sem_num].semval))
+					if (update_queue(sma, sop->sem_num))
+						progress = 1;
+			}
 		}
-	}
+		/* completed simple operations may unblock complex ones */
+		sops = NULL;
+	} while (progress && sma->complex_count);
 }
 
 /* The following counts are associated to each semaphore:
@@ -467,42 +679,36 @@ static void update_queue (struct sem_array * sma)
  * The counts we return here are a rough approximation, but still
  * warrant that semncnt+semzcnt>0 if the task is on the pending queue.
  */
-static int count_semncnt (struct sem_array * sma, ushort semnum)
+static int count_queue(struct list_head *pending_list, ushort semnum,
+		       int count_zero)
 {
-	int semncnt;
+	int count = 0;
 	struct sem_queue * q;
 
-	semncnt = 0;
-	list_for_each_entry(q, &sma->sem_pending, list) {
+	list_for_each_entry(q, pending_list, list) {
 		struct sembuf * sops = q->sops;
 		int nsops = q->nsops;
 		int i;
 		for (i = 0; i < nsops; i++)
 			if (sops[i].sem_num == semnum
-			    && (sops[i].sem_op < 0)
+			    && (count_zero ? sops[i].sem_op == 0
+					   : sops[i].sem_op < 0)
 			    && !(sops[i].sem_flg & IPC_NOWAIT))
-				semncnt++;
+				count++;
 	}
-	return semncnt;
+	return count;
 }
 
-static int count_semzcnt (struct sem_array * sma, ushort semnum)
+static int count_semncnt (struct sem_array * sma, ushort semnum)
 {
-	int semzcnt;
-	struct sem_queue * q;
+	return count_queue(&sma->sem_base[semnum].sem_pending, semnum, 0) +
+		count_queue(&sma->sem_pending, semnum, 0);
+}
 
-	semzcnt = 0;
-	list_for_each_entry(q, &sma->sem_pending, list) {
-		struct sembuf * sops = q->sops;
-		int nsops = q->nsops;
-		int i;
-		for (i = 0; i < nsops; i++)
-			if (sops[i].sem_num == semnum
-			    && (sops[i].sem_op == 0)
-			    && !(sops[i].sem_flg & IPC_NOWAIT))
-				semzcnt++;
-	}
-	return semzcnt;
+static int count_semzcnt (struct sem_array * sma, ushort semnum)
+{
+	return count_queue(&sma->sem_base[semnum].sem_pending, semnum, 1) +
+		count_queue(&sma->sem_pending, semnum, 1);
 }
 
 static void free_un(struct rcu_head *head)
@@ -520,9 +726,11 @@ static void freeary(struct ipc_namespace *ns, struct kern_ipc_perm *ipcp)
 	struct sem_undo *un, *tu;
 	struct sem_queue *q, *tq;
 	struct sem_array *sma = container_of(ipcp, struct sem_array, sem_perm);
+	int i;
 
 	/* Free the existing undo structures for this semaphore set.  */
 	assert_spin_locked(&sma->sem_perm.lock);
+	sem_complexmode_enter(sma);
 	list_for_each_entry_safe(un, tu, &sma->list_id, list_id) {
 		list_del(&un->list_id);
 		spin_lock(&un->ulp->lock);
@@ -534,12 +742,16 @@ static void freeary(struct ipc_namespace *ns, struct kern_ipc_perm *ipcp)
 
 	/* Wake up all pending processes and let them fail with EIDRM. */
 	list_for_each_entry_safe(q, tq, &sma->sem_pending, list) {
-		list_del(&q->list);
+		unlink_queue(sma, q);
+		wake_up_sem_queue(q, -EIDRM);
+	}
+	for (i = 0; i < sma->sem_nsems; i++) {
+		struct sem *sem = sma->sem_base + i;
 
-		q->status = IN_WAKEUP;
-		wake_up_process(q->sleeper); /* doesn't sleep */
-		smp_wmb();
-		q->status = -EIDRM;	/* hands-off q */
+		list_for_each_entry_safe(q, tq, &sem->sem_pending, list) {
+			unlink_queue(sma, q);
+			wake_up_sem_queue(q, -EIDRM);
+		}
 	}
 
 	/* Remove the semaphore set from the IDR */
@@ -762,7 +974,7 @@ static int semctl_main(struct ipc_namespace *ns, int semid, int semnum,
 		}
 		sma->sem_ctime = get_seconds();
 		/* maybe some queued-up processes were waiting for this */
-		update_queue(sma);
+		do_smart_update(sma, NULL, 0);
 		err = 0;
 		goto out_unlock;
 	}
@@ -804,7 +1016,7 @@ static int semctl_main(struct ipc_namespace *ns, int semid, int semnum,
 		curr->sempid = task_tgid_vnr(current);
 		sma->sem_ctime = get_seconds();
 		/* maybe some queued-up processes were waiting for this */
-		update_queue(sma);
+		do_smart_update(sma, NULL, 0);
 		err = 0;
 		goto out_unlock;
 	}
@@ -1066,7 +1278,7 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	struct sembuf fast_sops[SEMOPM_FAST];
 	struct sembuf* sops = fast_sops, *sop;
 	struct sem_undo *un;
-	int undos = 0, alter = 0, max;
+	int undos = 0, alter = 0, max, locknum;
 	struct sem_queue queue;
 	unsigned long jiffies_left = 0;
 	struct ipc_namespace *ns;
@@ -1110,63 +1322,57 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	}
 
 	if (undos) {
+		/* On success, find_alloc_undo takes the rcu_read_lock */
 		un = find_alloc_undo(ns, semid);
 		if (IS_ERR(un)) {
 			error = PTR_ERR(un);
 			goto out_free;
 		}
-	} else
+	} else {
 		un = NULL;
+		rcu_read_lock();
+	}
 
-	sma = sem_lock_check(ns, semid);
+	sma = sem_obtain_object_check(ns, semid);
 	if (IS_ERR(sma)) {
-		if (un)
-			rcu_read_unlock();
+		rcu_read_unlock();
 		error = PTR_ERR(sma);
 		goto out_free;
 	}
 
-	/*
-	 * semid identifiers are not unique - find_alloc_undo may have
-	 * allocated an undo structure, it was invalidated by an RMID
-	 * and now a new array with received the same id. Check and fail.
-	 * This case can be detected checking un->semid. The existance of
-	 * "un" itself is guaranteed by rcu.
-	 */
-	error = -EIDRM;
-	if (un) {
-		if (un->semid == -1) {
-			rcu_read_unlock();
-			goto out_unlock_free;
-		} else {
-			/*
-			 * rcu lock can be released, "un" cannot disappear:
-			 * - sem_lock is acquired, thus IPC_RMID is
-			 *   impossible.
-			 * - exit_sem is impossible, it always operates on
-			 *   current (or a dead task).
-			 */
-
-			rcu_read_unlock();
-		}
-	}
-
 	error = -EFBIG;
 	if (max >= sma->sem_nsems)
-		goto out_unlock_free;
+		goto out_rcu_free;
 
 	error = -EACCES;
 	if (ipcperms(&sma->sem_perm, alter ? S_IWUGO : S_IRUGO))
-		goto out_unlock_free;
+		goto out_rcu_free;
 
 	error = security_sem_semop(sma, sops, nsops, alter);
 	if (error)
+		goto out_rcu_free;
+
+	locknum = sem_lock_sops(sma, sops, nsops);
+
+	error = -EIDRM;
+	if (sma->sem_perm.deleted)
+		goto out_unlock_free;
+
+	/*
+	 * semid identifiers are not unique - find_alloc_undo may have
+	 * allocated an undo structure, it was invalidated by an RMID
+	 * and now a new array with received the same id. Check and fail.
+	 * This case can be detected checking un->semid. The existance of
+	 * "un" itself is guaranteed by rcu, which we hold until the
+	 * semaphore lock is dropped.
+	 */
+	if (un && un->semid == -1)
 		goto out_unlock_free;
 
 	error = try_atomic_semop (sma, sops, nsops, un, task_tgid_vnr(current));
 	if (error <= 0) {
 		if (alter && error == 0)
-			update_queue (sma);
+			do_smart_update(sma, sops, nsops);
 		goto out_unlock_free;
 	}
 
@@ -1179,15 +1385,26 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	queue.undo = un;
 	queue.pid = task_tgid_vnr(current);
 	queue.alter = alter;
-	if (alter)
-		list_add_tail(&queue.list, &sma->sem_pending);
-	else
-		list_add(&queue.list, &sma->sem_pending);
+	if (nsops == 1) {
+		struct sem *curr = sma->sem_base + sops->sem_num;
+
+		if (alter)
+			list_add_tail(&queue.list, &curr->sem_pending);
+		else
+			list_add(&queue.list, &curr->sem_pending);
+	} else {
+		if (alter)
+			list_add_tail(&queue.list, &sma->sem_pending);
+		else
+			list_add(&queue.list, &sma->sem_pending);
+		sma->complex_count++;
+	}
 
 	queue.status = -EINTR;
 	queue.sleeper = current;
 	current->state = TASK_INTERRUPTIBLE;
-	sem_unlock(sma);
+	sem_unlock_sops(sma, locknum);
+	rcu_read_unlock();
 
 	if (timeout)
 		jiffies_left = schedule_timeout(jiffies_left);
@@ -1206,11 +1423,18 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 		goto out_free;
 	}
 
-	sma = sem_lock(ns, semid);
-	if (IS_ERR(sma)) {
+	rcu_read_lock();
+	sma = sem_obtain_object_check(ns, semid);
+	/*
+	 * If the id now refers to a smaller array, ours was removed and
+	 * freeary() has already completed our queue entry.
+	 */
+	if (IS_ERR(sma) || max >= sma->sem_nsems) {
+		rcu_read_unlock();
 		error = -EIDRM;
 		goto out_free;
 	}
+	locknum = sem_lock_sops(sma, sops, nsops);
 
 	/*
 	 * If queue.status != -EINTR we are woken up by another process
@@ -1220,15 +1444,22 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 		goto out_unlock_free;
 	}
 
+	if (sma->sem_perm.deleted) {
+		error = -EIDRM;
+		goto out_unlock_free;
+	}
+
 	/*
 	 * If an interrupt occurred we have to clean up the queue
 	 */
 	if (timeout && jiffies_left == 0)
 		error = -EAGAIN;
-	list_del(&queue.list);
+	unlink_queue(sma, &queue);
 
 out_unlock_free:
-	sem_unlock(sma);
+	sem_unlock_sops(sma, locknum);
+out_rcu_free:
+	rcu_read_unlock();
 out_free:
 	if(sops != fast_sops)
 		kfree(sops);
@@ -1354,7 +1585,7 @@ void exit_sem(struct task_struct *tsk)
 		}
 		sma->sem_otime = get_seconds();
 		/* maybe some queued-up processes were waiting for this */
-		update_queue(sma);
+		do_smart_update(sma, NULL, 0);
 		sem_unlock(sma);
 
 		call_rcu(&un->rcu, free_un);
@@ -679,6 +679,49 @@ void ipc64_perm_to_ipc_perm (struct ipc64_perm *in, struct ipc_perm *out)
 	out->seq	= in->seq;
 }
 
+/**
+ * ipc_obtain_object - Look up an ipc object without locking it
+ * @ids: IPC identifier set
+ * @id: ipc id to look for
+ *
+ * Look for an id in the ipc ids idr and return the associated ipc object.
+ * The object is not locked: the caller must hold rcu_read_lock() and is
+ * responsible for taking whatever lock protects the object and for
+ * checking ->deleted once it holds that lock.
+ */
+struct kern_ipc_perm *ipc_obtain_object(struct ipc_ids *ids, int id)
+{
+	struct kern_ipc_perm *out;
+	int lid = ipcid_to_idx(id);
+
+	out = idr_find(&ids->ipcs_idr, lid);
+	if (out == NULL)
+		return ERR_PTR(-EINVAL);
+
+	return out;
+}
+
+/**
+ * ipc_obtain_object_check - Look up an ipc object and verify its sequence
+ * @ids: IPC identifier set
+ * @id: ipc id to look for
+ *
+ * Similar to ipc_obtain_object() but also checks the ipc object
+ * sequence number. Must be called under rcu_read_lock().
+ */
+struct kern_ipc_perm *ipc_obtain_object_check(struct ipc_ids *ids, int id)
+{
+	struct kern_ipc_perm *out = ipc_obtain_object(ids, id);
+
+	if (IS_ERR(out))
+		return out;
+
+	if (ipc_checkid(out, id))
+		return ERR_PTR(-EIDRM);
+
+	return out;
+}
+
 /**
  * ipc_lock - Lock an ipc structure without rw_mutex held
  * @ids: IPC identifier set
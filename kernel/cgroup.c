@@ -841,8 +841,10 @@ static void cgroup_diput(struct dentry *dentry, struct inode *inode)
 		/*
 		 * Release the subsystem state objects.
 		 */
-		for_each_subsys(cgrp->root, ss)
+		for_each_subsys(cgrp->root, ss) {
+			percpu_ref_exit(&cgrp->subsys[ss->subsys_id]->refcnt);
 			ss->destroy(ss, cgrp);
+		}
 
 		cgrp->root->number_of_cgroups--;
 		mutex_unlock(&cgroup_mutex);
@@ -3534,18 +3536,23 @@ static int cgroup_populate_dir(struct cgroup *cgrp)
 	return 0;
 }
 
-static void init_cgroup_css(struct cgroup_subsys_state *css,
+static int init_cgroup_css(struct cgroup_subsys_state *css,
 			       struct cgroup_subsys *ss,
 			       struct cgroup *cgrp)
 {
+	int err = 0;
+
 	css->cgroup = cgrp;
-	atomic_set(&css->refcnt, 1);
 	css->flags = 0;
 	css->id = NULL;
 	if (cgrp == dummytop)
 		set_bit(CSS_ROOT, &css->flags);
+	else
+		err = percpu_ref_init(&css->refcnt, NULL);
 	BUG_ON(cgrp->subsys[ss->subsys_id]);
+	/* Attached even on failure, so that ->destroy() finds it */
 	cgrp->subsys[ss->subsys_id] = css;
+	return err;
 }
 
 static void cgroup_lock_hierarchy(struct cgroupfs_root *root)
@@ -3616,7 +3623,9 @@ static long cgroup_create(struct cgroup *parent, struct dentry *dentry,
 			err = PTR_ERR(css);
 			goto err_destroy;
 		}
-		init_cgroup_css(css, ss, cgrp);
+		err = init_cgroup_css(css, ss, cgrp);
+		if (err)
+			goto err_destroy;
 		if (ss->use_id)
 			if (alloc_css_id(ss, parent, cgrp))
 				goto err_destroy;
@@ -3653,8 +3662,12 @@ static long cgroup_create(struct cgroup *parent, struct dentry *dentry,
  err_destroy:
 
 	for_each_subsys(root, ss) {
-		if (cgrp->subsys[ss->subsys_id])
+		struct cgroup_subsys_state *css = cgrp->subsys[ss->subsys_id];
+
+		if (css) {
+			percpu_ref_exit(&css->refcnt);
 			ss->destroy(ss, cgrp);
+		}
 	}
 
 	mutex_unlock(&cgroup_mutex);
@@ -3674,41 +3687,38 @@ static int cgroup_mkdir(struct inode *dir, struct dentry *dentry, int mode)
 	return cgroup_create(c_parent, dentry, mode | S_IFDIR);
 }
 
-static int cgroup_has_css_refs(struct cgroup *cgrp)
+/*
+ * The css refcounts are per cpu while the cgroup is in use and can only
+ * be read once switched to atomic mode, which takes a grace period.
+ * rmdir switches them and leaves them atomic while it waits for the
+ * css to become unused, so that __css_put() keeps waking it up; if the
+ * rmdir fails they go back to per cpu mode.
+ */
+static void cgroup_css_refs_atomic(struct cgroup *cgrp)
 {
-	/* Check the reference count on each subsystem. Since we
-	 * already established that there are no tasks in the
-	 * cgroup, if the css refcount is also 1, then there should
-	 * be no outstanding references, so the subsystem is safe to
-	 * destroy. We scan across all subsystems rather than using
-	 * the per-hierarchy linked list of mounted subsystems since
-	 * we can be called via check_for_release() with no
-	 * synchronization other than RCU, and the subsystem linked
-	 * list isn't RCU-safe */
-	int i;
-	for (i = 0; i < CGROUP_SUBSYS_COUNT; i++) {
-		struct cgroup_subsys *ss = subsys[i];
-		struct cgroup_subsys_state *css;
-		/* Skip subsystems not in this hierarchy */
-		if (ss->root != cgrp->root)
-			continue;
-		css = cgrp->subsys[ss->subsys_id];
-		/* When called from check_for_release() it's possible
-		 * that by this point the cgroup has been removed
-		 * and the css deleted. But a false-positive doesn't
-		 * matter, since it can only happen if the cgroup
-		 * has been deleted and hence no longer needs the
-		 * release agent to be called anyway. */
-		if (css && (atomic_read(&css->refcnt) > 1))
-			return 1;
-	}
-	return 0;
+	struct cgroup_subsys *ss;
+
+	/* Start all the switches first, so they share one grace period */
+	for_each_subsys(cgrp->root, ss)
+		percpu_ref_switch_to_atomic(&cgrp->subsys[ss->subsys_id]->refcnt,
+					    NULL);
+	for_each_subsys(cgrp->root, ss)
+		percpu_ref_switch_to_atomic_sync(&cgrp->subsys[ss->subsys_id]->refcnt);
+}
+
+static void cgroup_css_refs_percpu(struct cgroup *cgrp)
+{
+	struct cgroup_subsys *ss;
+
+	for_each_subsys(cgrp->root, ss)
+		percpu_ref_switch_to_percpu(&cgrp->subsys[ss->subsys_id]->refcnt);
 }
 
 /*
  * Atomically mark all (or else none) of the cgroup's CSS objects as
  * CSS_REMOVED. Return true on success, or false if the cgroup has
- * busy subsystems. Call with cgroup_mutex held
+ * busy subsystems. Call with cgroup_mutex held, after
+ * cgroup_css_refs_atomic().
  */
 
 static int cgroup_clear_css_refs(struct cgroup *cgrp)
@@ -3719,10 +3729,11 @@ static int cgroup_clear_css_refs(struct cgroup *cgrp)
 	local_irq_save(flags);
 	for_each_subsys(cgrp->root, ss) {
 		struct cgroup_subsys_state *css = cgrp->subsys[ss->subsys_id];
-		int refcnt;
+		atomic_long_t *count = &css->refcnt.count;
+		long refcnt;
 		while (1) {
 			/* We can only remove a CSS with a refcnt==1 */
-			refcnt = atomic_read(&css->refcnt);
+			refcnt = atomic_long_read(count);
 			if (refcnt > 1) {
 				failed = true;
 				goto done;
@@ -3734,7 +3745,7 @@ static int cgroup_clear_css_refs(struct cgroup *cgrp)
 			 * css_tryget() to spin until we set the
 			 * CSS_REMOVED bits or abort
 			 */
-			if (atomic_cmpxchg(&css->refcnt, refcnt, 0) == refcnt)
+			if (atomic_long_cmpxchg(count, refcnt, 0) == refcnt)
 				break;
 			cpu_relax();
 		}
@@ -3747,8 +3758,8 @@ static int cgroup_clear_css_refs(struct cgroup *cgrp)
 			 * Restore old refcnt if we previously managed
 			 * to clear it from 1 to 0
 			 */
-			if (!atomic_read(&css->refcnt))
-				atomic_set(&css->refcnt, 1);
+			if (!atomic_long_read(&css->refcnt.count))
+				atomic_long_set(&css->refcnt.count, 1);
 		} else {
 			/* Commit the fact that the CSS is removed */
 			set_bit(CSS_REMOVED, &css->flags);
@@ -3769,12 +3780,9 @@ static int cgroup_rmdir(struct inode *unused_dir, struct dentry *dentry)
 	/* the vfs holds both inode->i_mutex already */
 again:
 	mutex_lock(&cgroup_mutex);
-	if (atomic_read(&cgrp->count) != 0) {
-		mutex_unlock(&cgroup_mutex);
-		return -EBUSY;
-	}
-	if (!list_empty(&cgrp->children)) {
+	if (atomic_read(&cgrp->count) != 0 || !list_empty(&cgrp->children)) {
 		mutex_unlock(&cgroup_mutex);
+		cgroup_css_refs_percpu(cgrp);
 		return -EBUSY;
 	}
 	mutex_unlock(&cgroup_mutex);
@@ -3797,14 +3805,18 @@ again:
 	ret = cgroup_call_pre_destroy(cgrp);
 	if (ret) {
 		clear_bit(CGRP_WAIT_ON_RMDIR, &cgrp->flags);
+		cgroup_css_refs_percpu(cgrp);
 		return ret;
 	}
 
+	cgroup_css_refs_atomic(cgrp);
+
 	mutex_lock(&cgroup_mutex);
 	parent = cgrp->parent;
 	if (atomic_read(&cgrp->count) || !list_empty(&cgrp->children)) {
 		clear_bit(CGRP_WAIT_ON_RMDIR, &cgrp->flags);
 		mutex_unlock(&cgroup_mutex);
+		cgroup_css_refs_percpu(cgrp);
 		return -EBUSY;
 	}
 	prepare_to_wait(&cgroup_rmdir_waitq, &wait, TASK_INTERRUPTIBLE);
@@ -3818,8 +3830,10 @@ again:
 			schedule();
 		finish_wait(&cgroup_rmdir_waitq, &wait);
 		clear_bit(CGRP_WAIT_ON_RMDIR, &cgrp->flags);
-		if (signal_pending(current))
+		if (signal_pending(current)) {
+			cgroup_css_refs_percpu(cgrp);
 			return -EINTR;
+		}
 		goto again;
 	}
 	/* NO css_tryget() can success after here. */
@@ -4390,7 +4404,7 @@ static void check_for_release(struct cgroup *cgrp)
 	/* All of these checks rely on RCU to keep the cgroup
 	 * structure alive */
 	if (cgroup_is_releasable(cgrp) && !atomic_read(&cgrp->count)
-	    && list_empty(&cgrp->children) && !cgroup_has_css_refs(cgrp)) {
+	    && list_empty(&cgrp->children)) {
 		/* Control Group is currently removeable. If it's not
 		 * already queued for a userspace notification, queue
 		 * it now */
@@ -4411,18 +4425,16 @@ static void check_for_release(struct cgroup *cgrp)
 void __css_put(struct cgroup_subsys_state *css, int count)
 {
 	struct cgroup *cgrp = css->cgroup;
-	int val;
 	rcu_read_lock();
-	val = atomic_sub_return(count, &css->refcnt);
-	if (val == 1) {
-		if (notify_on_release(cgrp)) {
-			set_bit(CGRP_RELEASABLE, &cgrp->flags);
-			check_for_release(cgrp);
-		}
+	percpu_ref_put_many(&css->refcnt, count);
+	/*
+	 * A waiting rmdir has switched the count to atomic mode, whose
+	 * put is a full barrier; recheck the count there rather than
+	 * here, where it cannot be read cheaply.
+	 */
+	if (unlikely(test_bit(CGRP_WAIT_ON_RMDIR, &cgrp->flags)))
 		cgroup_wakeup_rmdir_waiter(cgrp);
-	}
 	rcu_read_unlock();
-	WARN_ON_ONCE(val < 1);
 }
 
 /*
@@ -54,13 +54,13 @@
  * id and the timer.  The external interface is:
  *
  * void *idr_find(struct idr *idp, int id);           to find timer_id <id>
- * int idr_get_new(struct idr *idp, void *ptr);       to get a new id and
+ * int idr_alloc(struct idr *idp, void *ptr, ...);    to get a new id and
  *                                                    related it to <ptr>
  * void idr_remove(struct idr *idp, int id);          to release <id>
  * void idr_init(struct idr *idp);                    to initialize <idp>
  *                                                    which we supply.
- * The idr_get_new *may* call slab for more memory so it must not be
- * called under a spin lock.  Likewise idr_remore may release memory
+ * The idr_alloc under the spin lock takes its memory from the per cpu
+ * buffer filled by idr_preload.  Likewise idr_remore may release memory
  * (but it may be ok to do this under a lock...).
  * idr_find is just a memory look up and is quite fast.  A -1 return
  * indicates that the requested id does not exist.
@@ -190,6 +190,21 @@ static int posix_get_monotonic_raw(clockid_t which_clock, struct timespec *tp)
 }
 
 
+/*
+ * Get monotonic time including time spent in suspend
+ */
+static int posix_get_boottime(const clockid_t which_clock, struct timespec *tp)
+{
+	get_monotonic_boottime(tp);
+	return 0;
+}
+
+static int posix_get_boottime_res(const clockid_t which_clock,
+				  struct timespec *tp)
+{
+	return hrtimer_get_res(CLOCK_MONOTONIC, tp);
+}
+
 static int posix_get_realtime_coarse(clockid_t which_clock, struct timespec *tp)
 {
 	*tp = current_kernel_time();
@@ -247,12 +262,17 @@ static __init int init_posix_timers(void)
 		.clock_getres	= posix_get_coarse_res,
 		.clock_get	= posix_get_monotonic_coarse,
 	};
+	struct k_clock clock_boottime = {
+		.clock_getres	= posix_get_boottime_res,
+		.clock_get	= posix_get_boottime,
+	};
 
 	posix_timers_register_clock(CLOCK_REALTIME, &clock_realtime);
 	posix_timers_register_clock(CLOCK_MONOTONIC, &clock_monotonic);
 	posix_timers_register_clock(CLOCK_MONOTONIC_RAW, &clock_monotonic_raw);
 	posix_timers_register_clock(CLOCK_REALTIME_COARSE, &clock_realtime_coarse);
 	posix_timers_register_clock(CLOCK_MONOTONIC_COARSE, &clock_monotonic_coarse);
+	posix_timers_register_clock(CLOCK_BOOTTIME, &clock_boottime);
 
 	posix_timers_cache = kmem_cache_create("posix_timers_cache",
 					sizeof (struct k_itimer), 0, SLAB_PANIC,
@@ -527,17 +547,13 @@ SYSCALL_DEFINE3(timer_create, const clockid_t, which_clock,
 		return -EAGAIN;
 
 	spin_lock_init(&new_timer->it_lock);
- retry:
-	if (unlikely(!idr_pre_get(&posix_timers_id, GFP_KERNEL))) {
-		error = -EAGAIN;
-		goto out;
-	}
+
+	idr_preload(GFP_KERNEL);
 	spin_lock_irq(&idr_lock);
-	error = idr_get_new(&posix_timers_id, new_timer, &new_timer_id);
+	error = idr_alloc(&posix_timers_id, new_timer, 0, 0, GFP_NOWAIT);
 	spin_unlock_irq(&idr_lock);
-	if (error) {
-		if (error == -EAGAIN)
-			goto retry;
+	idr_preload_end();
+	if (error < 0) {
 		/*
 		 * Weird looking, but we return EAGAIN if the IDR is
 		 * full (proper POSIX return value for this)
@@ -545,6 +561,8 @@ SYSCALL_DEFINE3(timer_create, const clockid_t, which_clock,
 		error = -EAGAIN;
 		goto out;
 	}
+	new_timer_id = error;
+	error = 0;
 
 	it_id_set = IT_ID_SET;
 	new_timer->it_id = (timer_t) new_timer_id;
@@ -6131,10 +6131,14 @@ EXPORT_SYMBOL(schedule);
 
 #ifdef CONFIG_SMP
 /*
+ * Spin while *@ownerp stays @owner and @owner keeps running.  Returns 1
+ * if the lock was released, 0 if the owner went to sleep, we need to
+ * reschedule, or the lock changed hands.
+ *
  * Look out! "owner" is an entirely speculative pointer
  * access and not reliable.
  */
-int mutex_spin_on_owner(struct mutex *lock, struct thread_info *owner)
+static int spin_on_owner(struct thread_info **ownerp, struct thread_info *owner)
 {
 	unsigned int cpu;
 	struct rq *rq;
@@ -6174,13 +6178,13 @@ int mutex_spin_on_owner(struct mutex *lock, struct thread_info *owner)
 		/*
 		 * Owner changed, break to re-assess state.
 		 */
-		if (lock->owner != owner) {
+		if (*ownerp != owner) {
 			/*
 			 * If the lock has switched to a different owner,
 			 * we likely have heavy contention. Return 0 to quit
 			 * optimistic spinning and not contend further:
 			 */
-			if (lock->owner)
+			if (*ownerp)
 				return 0;
 			break;
 		}
@@ -6196,6 +6200,22 @@ int mutex_spin_on_owner(struct mutex *lock, struct thread_info *owner)
 
 	return 1;
 }
+
+int mutex_spin_on_owner(struct mutex *lock, struct thread_info *owner)
+{
+	return spin_on_owner(&lock->owner, owner);
+}
+
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * A sem that readers got last has RWSEM_READER_OWNED as its owner, which
+ * counts as a different owner: we don't know when readers will be done.
+ */
+int rwsem_spin_on_owner(struct rw_semaphore *sem, struct thread_info *owner)
+{
+	return spin_on_owner(&sem->owner, owner);
+}
+#endif
 #endif
 
 #ifdef CONFIG_PREEMPT
@@ -195,7 +195,8 @@ static void timekeeping_update(bool clearntp)
 	}
 	update_rt_offset();
 	update_vsyscall(&timekeeper.xtime, &timekeeper.wall_to_monotonic,
-			 timekeeper.clock, timekeeper.mult);
+			 timekeeper.clock, timekeeper.mult,
+			 &timekeeper.raw_time, &timekeeper.total_sleep_time);
 }
 
 
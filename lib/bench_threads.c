@@ -0,0 +1,114 @@
+/*
+ * Kthread harness of the lib/ scaling benchmarks
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/err.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+#include "bench_threads.h"
+
+struct bench_threads {
+	void			(*fn)(void *data);
+	void			*data;
+	atomic_t		ready;
+	atomic_t		go;
+	atomic_t		running;
+	struct completion	done;
+};
+
+static int bench_thread(void *arg)
+{
+	struct bench_threads *bt = arg;
+
+	atomic_inc(&bt->ready);
+	while (!atomic_read(&bt->go))
+		cpu_relax();
+
+	bt->fn(bt->data);
+
+	if (atomic_dec_and_test(&bt->running))
+		complete(&bt->done);
+
+	/* bt lives on the stack of bench_threads_run(), which stops us */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+s64 bench_threads_run(int nr, void (*fn)(void *data), void *data,
+		      const char *name)
+{
+	struct bench_threads bt = {
+		.fn	= fn,
+		.data	= data,
+		.ready	= ATOMIC_INIT(0),
+		.go	= ATOMIC_INIT(0),
+		.running = ATOMIC_INIT(nr),
+	};
+	struct task_struct **tasks;
+	ktime_t start;
+	s64 ns;
+	int cpu, i = 0;
+
+	if (nr <= 0 || nr > num_online_cpus())
+		return -EINVAL;
+
+	tasks = kcalloc(nr, sizeof(*tasks), GFP_KERNEL);
+	if (!tasks)
+		return -ENOMEM;
+	init_completion(&bt.done);
+
+	for_each_online_cpu(cpu) {
+		if (i == nr)
+			break;
+		tasks[i] = kthread_create(bench_thread, &bt, "%s/%d",
+					  name, cpu);
+		if (IS_ERR(tasks[i])) {
+			ns = PTR_ERR(tasks[i]);
+
+			/* let the ones already created run to the end */
+			atomic_sub(nr - i, &bt.running);
+			atomic_set(&bt.go, 1);
+			while (i--)
+				kthread_stop(tasks[i]);
+			goto out;
+		}
+		kthread_bind(tasks[i], cpu);
+		wake_up_process(tasks[i]);
+		i++;
+	}
+
+	while (atomic_read(&bt.ready) < nr)
+		schedule_timeout_uninterruptible(1);
+
+	start = ktime_get();
+	atomic_set(&bt.go, 1);
+	wait_for_completion(&bt.done);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	for (i = 0; i < nr; i++)
+		kthread_stop(tasks[i]);
+out:
+	kfree(tasks);
+	return ns;
+}
+EXPORT_SYMBOL_GPL(bench_threads_run);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Kthread harness of the scaling benchmarks");
@@ -0,0 +1,12 @@
+#ifndef _LIB_BENCH_THREADS_H
+#define _LIB_BENCH_THREADS_H
+
+/*
+ * Run @fn(@data) on @nr kthreads, each bound to its own online cpu and
+ * all started at once.  Returns the nanoseconds from the start until
+ * the last one returned, or a negative errno.
+ */
+extern s64 bench_threads_run(int nr, void (*fn)(void *data), void *data,
+			     const char *name);
+
+#endif /* _LIB_BENCH_THREADS_H */
@@ -35,10 +35,16 @@
 #include <linux/string.h>
 #include <linux/idr.h>
 #include <linux/spinlock.h>
+#include <linux/percpu.h>
+#include <linux/hardirq.h>
 
 static struct kmem_cache *idr_layer_cache;
 static DEFINE_SPINLOCK(simple_ida_lock);
 
+/* Layers preallocated by idr_preload(), linked through ary[0] */
+static DEFINE_PER_CPU(struct idr_layer *, idr_preload_head);
+static DEFINE_PER_CPU(int, idr_preload_cnt);
+
 static struct idr_layer *get_from_free_list(struct idr *idp)
 {
 	struct idr_layer *p;
@@ -54,6 +60,40 @@ static struct idr_layer *get_from_free_list(struct idr *idp)
 	return(p);
 }
 
+/**
+ * idr_layer_alloc - allocate a new idr_layer
+ * @gfp_mask: allocation mask
+ * @layer_idr: optional idr to allocate from
+ *
+ * Users of the old idr_pre_get() interface pass their idr and take the
+ * layer from its free list, under idr->lock.  idr_alloc() passes NULL:
+ * the layer comes from the slab, or failing that from this cpu's
+ * idr_preload() buffer, without touching any lock of the idr.
+ */
+static struct idr_layer *idr_layer_alloc(gfp_t gfp_mask, struct idr *layer_idr)
+{
+	struct idr_layer *new;
+
+	if (layer_idr)
+		return get_from_free_list(layer_idr);
+
+	new = kmem_cache_zalloc(idr_layer_cache, gfp_mask | __GFP_NOWARN);
+	if (new || in_interrupt())
+		return new;
+
+	/*
+	 * The preload buffer is only stable with preemption disabled,
+	 * which idr_preload() or the caller's lock guarantees.
+	 */
+	new = __get_cpu_var(idr_preload_head);
+	if (new) {
+		__get_cpu_var(idr_preload_head) = new->ary[0];
+		__get_cpu_var(idr_preload_cnt)--;
+		new->ary[0] = NULL;
+	}
+	return new;
+}
+
 static void idr_layer_rcu_free(struct rcu_head *head)
 {
 	struct idr_layer *layer;
@@ -132,7 +172,8 @@ int idr_pre_get(struct idr *idp, gfp_t gfp_mask)
 }
 EXPORT_SYMBOL(idr_pre_get);
 
-static int sub_alloc(struct idr *idp, int *starting_id, struct idr_layer **pa)
+static int sub_alloc(struct idr *idp, int *starting_id, struct idr_layer **pa,
+		     gfp_t gfp_mask, struct idr *layer_idr)
 {
 	int n, m, sh;
 	struct idr_layer *p, *new;
@@ -186,7 +227,7 @@ static int sub_alloc(struct idr *idp, int *starting_id, struct idr_layer **pa)
 		 * Create the layer below if it is missing.
 		 */
 		if (!p->ary[m]) {
-			new = get_from_free_list(idp);
+			new = idr_layer_alloc(gfp_mask, layer_idr);
 			if (!new)
 				return -1;
 			new->layer = l-1;
@@ -202,7 +243,8 @@ static int sub_alloc(struct idr *idp, int *starting_id, struct idr_layer **pa)
 }
 
 static int idr_get_empty_slot(struct idr *idp, int starting_id,
-			      struct idr_layer **pa)
+			      struct idr_layer **pa, gfp_t gfp_mask,
+			      struct idr *layer_idr)
 {
 	struct idr_layer *p, *new;
 	int layers, v, id;
@@ -213,7 +255,7 @@ build_up:
 	p = idp->top;
 	layers = idp->layers;
 	if (unlikely(!p)) {
-		if (!(p = get_from_free_list(idp)))
+		if (!(p = idr_layer_alloc(gfp_mask, layer_idr)))
 			return -1;
 		p->layer = 0;
 		layers = 1;
@@ -232,7 +274,7 @@ build_up:
 			p->layer++;
 			continue;
 		}
-		if (!(new = get_from_free_list(idp))) {
+		if (!(new = idr_layer_alloc(gfp_mask, layer_idr))) {
 			/*
 			 * The allocation failed.  If we built part of
 			 * the structure tear it down.
@@ -256,28 +298,32 @@ build_up:
 	}
 	rcu_assign_pointer(idp->top, p);
 	idp->layers = layers;
-	v = sub_alloc(idp, &id, pa);
+	v = sub_alloc(idp, &id, pa, gfp_mask, layer_idr);
 	if (v == IDR_NEED_TO_GROW)
 		goto build_up;
 	return(v);
 }
 
+/*
+ * Install the user pointer in the empty slot found by
+ * idr_get_empty_slot() and mark the slot full.
+ */
+static void idr_fill_slot(void *ptr, int id, struct idr_layer **pa)
+{
+	rcu_assign_pointer(pa[0]->ary[id & IDR_MASK],
+			(struct idr_layer *)ptr);
+	pa[0]->count++;
+	idr_mark_full(pa, id);
+}
+
 static int idr_get_new_above_int(struct idr *idp, void *ptr, int starting_id)
 {
 	struct idr_layer *pa[MAX_LEVEL];
 	int id;
 
-	id = idr_get_empty_slot(idp, starting_id, pa);
-	if (id >= 0) {
-		/*
-		 * Successfully found an empty slot.  Install the user
-		 * pointer and mark the slot full.
-		 */
-		rcu_assign_pointer(pa[0]->ary[id & IDR_MASK],
-				(struct idr_layer *)ptr);
-		pa[0]->count++;
-		idr_mark_full(pa, id);
-	}
+	id = idr_get_empty_slot(idp, starting_id, pa, 0, idp);
+	if (id >= 0)
+		idr_fill_slot(ptr, id, pa);
 
 	return id;
 }
@@ -345,6 +391,92 @@ int idr_get_new(struct idr *idp, void *ptr, int *id)
 }
 EXPORT_SYMBOL(idr_get_new);
 
+/**
+ * idr_preload - preload for idr_alloc()
+ * @gfp_mask: allocation mask to use for preloading
+ *
+ * Fill this cpu's buffer of idr layers, so that a following idr_alloc()
+ * under the caller's lock can't fail for lack of memory.  Unlike
+ * idr_pre_get() the buffer is shared by all idrs and filled without
+ * taking any idr's lock.
+ *
+ * On return preemption is disabled; the caller must call
+ * idr_preload_end() once done with idr_alloc().  A failed preload is
+ * not reported; idr_alloc() returns -ENOMEM if it runs out.
+ */
+void idr_preload(gfp_t gfp_mask)
+{
+	/*
+	 * idr_alloc() is likely to succeed without the preload buffer,
+	 * so don't warn about failures to fill it from atomic context.
+	 */
+	WARN_ON_ONCE(in_interrupt());
+	might_sleep_if(gfp_mask & __GFP_WAIT);
+
+	preempt_disable();
+
+	/*
+	 * The buffer is only touched with preemption disabled, so the
+	 * cpu may change while we sleep in the allocator; re-read the
+	 * per cpu variables after each allocation.
+	 */
+	while (__get_cpu_var(idr_preload_cnt) < MAX_LEVEL) {
+		struct idr_layer *new;
+
+		preempt_enable();
+		new = kmem_cache_zalloc(idr_layer_cache, gfp_mask);
+		preempt_disable();
+		if (!new)
+			break;
+
+		new->ary[0] = __get_cpu_var(idr_preload_head);
+		__get_cpu_var(idr_preload_head) = new;
+		__get_cpu_var(idr_preload_cnt)++;
+	}
+}
+EXPORT_SYMBOL(idr_preload);
+
+/**
+ * idr_alloc - allocate new idr entry
+ * @idp: the (initialized) idr
+ * @ptr: pointer to be associated with the new id
+ * @start: the minimum id (inclusive)
+ * @end: the maximum id (exclusive, <= 0 for max)
+ * @gfp_mask: memory allocation flags
+ *
+ * Allocate an id in [start, end) and associate it with @ptr.  Returns
+ * the new id, -ENOMEM if memory allocation failed or -ENOSPC if no free
+ * id was found.
+ *
+ * The caller serializes idr_alloc() against other changes of @idp, and
+ * typically brackets it with idr_preload() and idr_preload_end() so
+ * that @gfp_mask can be GFP_NOWAIT under its lock.  Lookups with
+ * idr_find() may run concurrently under rcu_read_lock().
+ */
+int idr_alloc(struct idr *idp, void *ptr, int start, int end, gfp_t gfp_mask)
+{
+	int max = end > 0 ? end - 1 : INT_MAX;
+	struct idr_layer *pa[MAX_LEVEL];
+	int id;
+
+	might_sleep_if(gfp_mask & __GFP_WAIT);
+
+	if (WARN_ON_ONCE(start < 0))
+		return -EINVAL;
+	if (unlikely(max < start))
+		return -ENOSPC;
+
+	id = idr_get_empty_slot(idp, start, pa, gfp_mask, NULL);
+	if (unlikely(id < 0))
+		return id == -1 ? -ENOMEM : -ENOSPC;
+	if (unlikely(id > max))
+		return -ENOSPC;
+
+	idr_fill_slot(ptr, id, pa);
+	return id;
+}
+EXPORT_SYMBOL(idr_alloc);
+
 static void idr_remove_warning(int id)
 {
 	printk(KERN_WARNING
@@ -780,7 +912,7 @@ int ida_get_new_above(struct ida *ida, int starting_id, int *p_id)
 
  restart:
 	/* get vacant slot */
-	t = idr_get_empty_slot(&ida->idr, idr_id, pa);
+	t = idr_get_empty_slot(&ida->idr, idr_id, pa, 0, &ida->idr);
 	if (t < 0)
 		return _idr_rc_to_errno(t);
 
@@ -0,0 +1,203 @@
+/*
+ * Percpu refcounts
+ *
+ * In percpu mode the atomic counter carries PERCPU_COUNT_BIAS on top of
+ * the initial reference, so puts that land there while a switch is in
+ * flight can never take it to zero.  Switching to atomic mode sets the
+ * ATOMIC flag, which sends new gets and puts to the atomic counter, and
+ * waits for an RCU-sched grace period, after which nobody can still be
+ * updating a per cpu counter.  The per cpu counters are then added to
+ * the atomic counter, the bias is removed, and the atomic counter holds
+ * the exact count from then on.
+ */
+
+#include <linux/bug.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/percpu-refcount.h>
+
+#define PERCPU_COUNT_BIAS	(1LU << (BITS_PER_LONG - 1))
+
+static DECLARE_WAIT_QUEUE_HEAD(percpu_ref_switch_waitq);
+
+static local_t *percpu_count_ptr(struct percpu_ref *ref)
+{
+	return (local_t *)(ref->pcpu_count_ptr & ~__PERCPU_REF_ATOMIC_DEAD);
+}
+
+/**
+ * percpu_ref_init - initialize a percpu refcount
+ * @ref: percpu_ref to initialize
+ * @release: function called when the count drops to zero, may be NULL
+ *
+ * Initializes @ref in percpu mode with a count of 1.  If it fails, @ref
+ * is left dead in atomic mode, and it is still safe to call
+ * percpu_ref_exit() on it.
+ *
+ * Note that @release must not sleep - it may be called from RCU
+ * callback context by percpu_ref_kill().
+ */
+int percpu_ref_init(struct percpu_ref *ref, percpu_ref_func_t *release)
+{
+	local_t *pcpu_count;
+
+	ref->release = release;
+	ref->confirm_switch = NULL;
+
+	pcpu_count = alloc_percpu(local_t);
+	if (!pcpu_count) {
+		atomic_long_set(&ref->count, 0);
+		ref->pcpu_count_ptr = __PERCPU_REF_ATOMIC_DEAD;
+		return -ENOMEM;
+	}
+
+	atomic_long_set(&ref->count, 1 + PERCPU_COUNT_BIAS);
+	ref->pcpu_count_ptr = (unsigned long)pcpu_count;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(percpu_ref_init);
+
+/**
+ * percpu_ref_exit - undo percpu_ref_init()
+ * @ref: percpu_ref to exit
+ *
+ * Frees the per cpu counters.  Nobody may use @ref afterwards, except
+ * for RCU readers whose percpu_ref_tryget_live() is bound to fail.
+ */
+void percpu_ref_exit(struct percpu_ref *ref)
+{
+	local_t *pcpu_count = percpu_count_ptr(ref);
+
+	if (pcpu_count) {
+		free_percpu(pcpu_count);
+		ref->pcpu_count_ptr = __PERCPU_REF_ATOMIC_DEAD;
+	}
+}
+EXPORT_SYMBOL_GPL(percpu_ref_exit);
+
+static void percpu_ref_switch_to_atomic_rcu(struct rcu_head *rcu)
+{
+	struct percpu_ref *ref = container_of(rcu, struct percpu_ref, rcu);
+	local_t *pcpu_count = percpu_count_ptr(ref);
+	unsigned long count = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		count += local_read(per_cpu_ptr(pcpu_count, cpu));
+
+	atomic_long_add((long)count - PERCPU_COUNT_BIAS, &ref->count);
+
+	WARN_ONCE(atomic_long_read(&ref->count) <= 0,
+		  "percpu ref <= 0 (%ld) after switching to atomic",
+		  atomic_long_read(&ref->count));
+
+	ref->confirm_switch(ref);
+	ref->confirm_switch = NULL;
+	wake_up_all(&percpu_ref_switch_waitq);
+
+	/* drop the ref taken in percpu_ref_switch_to_atomic() */
+	percpu_ref_put(ref);
+}
+
+static void percpu_ref_noop_confirm_switch(struct percpu_ref *ref)
+{
+}
+
+/**
+ * percpu_ref_switch_to_atomic - switch a percpu refcount to atomic mode
+ * @ref: percpu_ref to switch
+ * @confirm_switch: optional callback, run once the switch is done
+ *
+ * From the return of this function gets and puts go to the atomic
+ * counter, but the count only becomes exact after a grace period, when
+ * @confirm_switch is called from RCU callback context.  If @ref is
+ * already in atomic mode, @confirm_switch is called right away.
+ *
+ * The caller is responsible for serialising mode switches of @ref.
+ */
+void percpu_ref_switch_to_atomic(struct percpu_ref *ref,
+				 percpu_ref_func_t *confirm_switch)
+{
+	if (ref->pcpu_count_ptr & __PERCPU_REF_ATOMIC) {
+		if (confirm_switch)
+			confirm_switch(ref);
+		return;
+	}
+
+	ref->pcpu_count_ptr |= __PERCPU_REF_ATOMIC;
+
+	/* keep @ref alive until the per cpu counts have been collected */
+	ref->confirm_switch = confirm_switch ?: percpu_ref_noop_confirm_switch;
+	percpu_ref_get(ref);
+	call_rcu_sched(&ref->rcu, percpu_ref_switch_to_atomic_rcu);
+}
+EXPORT_SYMBOL_GPL(percpu_ref_switch_to_atomic);
+
+/**
+ * percpu_ref_switch_to_atomic_sync - switch to atomic mode and wait
+ * @ref: percpu_ref to switch
+ *
+ * Like percpu_ref_switch_to_atomic(), but sleeps until the count is
+ * exact, including when a switch started elsewhere is still in flight.
+ */
+void percpu_ref_switch_to_atomic_sync(struct percpu_ref *ref)
+{
+	percpu_ref_switch_to_atomic(ref, NULL);
+	wait_event(percpu_ref_switch_waitq, !ref->confirm_switch);
+}
+EXPORT_SYMBOL_GPL(percpu_ref_switch_to_atomic_sync);
+
+/**
+ * percpu_ref_switch_to_percpu - switch a percpu refcount back to percpu mode
+ * @ref: percpu_ref to switch
+ *
+ * Waits for a switch to atomic mode still in flight.  Does nothing if
+ * @ref is in percpu mode already; must not be called once @ref has been
+ * killed.
+ */
+void percpu_ref_switch_to_percpu(struct percpu_ref *ref)
+{
+	local_t *pcpu_count = percpu_count_ptr(ref);
+	int cpu;
+
+	might_sleep();
+	wait_event(percpu_ref_switch_waitq, !ref->confirm_switch);
+
+	if (!(ref->pcpu_count_ptr & __PERCPU_REF_ATOMIC))
+		return;
+	if (WARN_ON_ONCE(ref->pcpu_count_ptr & __PERCPU_REF_DEAD))
+		return;
+
+	atomic_long_add(PERCPU_COUNT_BIAS, &ref->count);
+
+	for_each_possible_cpu(cpu)
+		local_set(per_cpu_ptr(pcpu_count, cpu), 0);
+
+	/* zeroed counters before anybody uses them again */
+	smp_wmb();
+	ref->pcpu_count_ptr &= ~__PERCPU_REF_ATOMIC;
+}
+EXPORT_SYMBOL_GPL(percpu_ref_switch_to_percpu);
+
+/**
+ * percpu_ref_kill_and_confirm - drop the initial ref and schedule confirmation
+ * @ref: percpu_ref to kill
+ * @confirm_kill: optional confirmation callback
+ *
+ * Equivalent to percpu_ref_kill(), but also calls @confirm_kill once
+ * percpu_ref_tryget_live() is guaranteed to fail everywhere, from RCU
+ * callback context.  The caller must not kill @ref more than once.
+ */
+void percpu_ref_kill_and_confirm(struct percpu_ref *ref,
+				 percpu_ref_func_t *confirm_kill)
+{
+	WARN_ONCE(ref->pcpu_count_ptr & __PERCPU_REF_DEAD,
+		  "percpu_ref_kill() called more than once\n");
+
+	ref->pcpu_count_ptr |= __PERCPU_REF_DEAD;
+	percpu_ref_switch_to_atomic(ref, confirm_kill);
+	percpu_ref_put(ref);
+}
+EXPORT_SYMBOL_GPL(percpu_ref_kill_and_confirm);
@@ -0,0 +1,110 @@
+/*
+ * Percpu refcount microbenchmark
+ *
+ * Runs get/put pairs on one shared reference from 1, 2, 4, ... threads,
+ * each bound to its own cpu, first on an atomic_t and then on a
+ * percpu_ref, and prints the aggregate throughput.  The atomic counter
+ * stops scaling as soon as a second cpu bounces its cacheline; the
+ * percpu_ref should scale with the number of cpus.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <linux/cpumask.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/percpu-refcount.h>
+#include <linux/sched.h>
+
+#include "bench_threads.h"
+
+static int loops = 1000000;
+module_param(loops, int, 0444);
+MODULE_PARM_DESC(loops, "Number of get/put pairs per thread");
+
+static struct percpu_ref bench_ref;
+static atomic_t bench_atomic;
+
+static void bench_atomic_loop(void *data)
+{
+	int i;
+
+	for (i = 0; i < loops; i++) {
+		atomic_inc(&bench_atomic);
+		atomic_dec(&bench_atomic);
+		if (!(i & 0xffff))
+			cond_resched();
+	}
+}
+
+static void bench_percpu_loop(void *data)
+{
+	int i;
+
+	for (i = 0; i < loops; i++) {
+		percpu_ref_get(&bench_ref);
+		percpu_ref_put(&bench_ref);
+		if (!(i & 0xffff))
+			cond_resched();
+	}
+}
+
+/* Returns get/put pairs per microsecond, or a negative errno */
+static long bench_run(int nr, bool percpu)
+{
+	s64 ns;
+
+	ns = bench_threads_run(nr, percpu ? bench_percpu_loop :
+					    bench_atomic_loop,
+			       NULL, "percpu_ref_bench");
+	if (ns < 0)
+		return ns;
+
+	return div64_u64((u64)loops * nr * 1000, ns ?: 1);
+}
+
+static int __init percpu_ref_bench_init(void)
+{
+	long atomic, percpu;
+	int nr, err;
+
+	if (loops <= 0)
+		return -EINVAL;
+
+	err = percpu_ref_init(&bench_ref, NULL);
+	if (err)
+		return err;
+
+	printk(KERN_INFO "percpu_ref_bench: %d get/put pairs per thread, "
+	       "pairs/usec\n", loops);
+	printk(KERN_INFO "percpu_ref_bench: %7s %10s %10s\n",
+	       "threads", "atomic_t", "percpu_ref");
+
+	for (nr = 1; nr <= num_online_cpus(); nr <<= 1) {
+		atomic = bench_run(nr, false);
+		percpu = bench_run(nr, true);
+		if (atomic < 0 || percpu < 0) {
+			err = atomic < 0 ? atomic : percpu;
+			break;
+		}
+		printk(KERN_INFO "percpu_ref_bench: %7d %10ld %10ld\n",
+		       nr, atomic, percpu);
+	}
+
+	percpu_ref_kill(&bench_ref);
+	/* No release callback; just let the switch to atomic finish */
+	rcu_barrier_sched();
+	percpu_ref_exit(&bench_ref);
+	if (err)
+		return err;
+
+	/* The results are in the log; don't stay loaded */
+	return -EAGAIN;
+}
+
+module_init(percpu_ref_bench_init);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Percpu refcount microbenchmark");
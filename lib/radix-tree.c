@@ -93,6 +93,53 @@ static inline void *indirect_to_ptr(void *ptr)
 	return (void *)((unsigned long)ptr & ~RADIX_TREE_INDIRECT_PTR);
 }
 
+/*
+ * A multi-order entry covering more than one slot of @node keeps the item
+ * in its first slot; the following slots hold an indirect pointer to that
+ * first slot.  Child node pointers are indirect too, but never point into
+ * the parent's own slots array.
+ */
+static inline int is_sibling_entry(struct radix_tree_node *node, void *entry)
+{
+	void **ptr = indirect_to_ptr(entry);
+
+	return radix_tree_is_indirect_ptr(entry) &&
+		ptr >= node->slots && ptr < node->slots + RADIX_TREE_MAP_SIZE;
+}
+
+static inline unsigned int sibling_offset(struct radix_tree_node *node,
+		void *entry)
+{
+	return (void **)indirect_to_ptr(entry) - node->slots;
+}
+
+/*
+ * Does slot entry @entry of @node point to a child node, rather than to
+ * an item (possibly a multi-order one) or a sibling?  Bottom level slots
+ * only ever hold items: an indirect bit there is the retry marker left by
+ * radix_tree_shrink.
+ */
+static inline int radix_tree_is_node(struct radix_tree_node *node, void *entry)
+{
+	return node->height > 1 && radix_tree_is_indirect_ptr(entry) &&
+		!is_sibling_entry(node, entry);
+}
+
+/*
+ * Number of slots of @node taken by the entry whose first slot is @offset.
+ */
+static unsigned int entry_slots(struct radix_tree_node *node,
+		unsigned int offset)
+{
+	void *sibling = ptr_to_indirect(&node->slots[offset]);
+	unsigned int nr = 1;
+
+	while (offset + nr < RADIX_TREE_MAP_SIZE &&
+	       node->slots[offset + nr] == sibling)
+		nr++;
+	return nr;
+}
+
 static inline gfp_t root_gfp_mask(struct radix_tree_root *root)
 {
 	return root->gfp_mask & __GFP_BITS_MASK;
@@ -275,8 +322,11 @@ static int radix_tree_extend(struct radix_tree_root *root, unsigned long index)
 		if (!(node = radix_tree_node_alloc(root)))
 			return -ENOMEM;
 
-		/* Increase the height.  */
-		node->slots[0] = indirect_to_ptr(root->rnode);
+		/*
+		 * Increase the height.  An old root node stays an indirect
+		 * pointer in its new parent's slot.
+		 */
+		node->slots[0] = root->rnode;
 
 		/* Propagate the aggregated tag info into the new root */
 		for (tag = 0; tag < RADIX_TREE_MAX_TAGS; tag++) {
@@ -296,26 +346,44 @@ out:
 }
 
 /**
- *	radix_tree_insert    -    insert into a radix tree
+ *	__radix_tree_insert    -    insert into a radix tree
  *	@root:		radix tree root
  *	@index:		index key
+ *	@order:		key covers the 2^order indices around index
  *	@item:		item to insert
  *
- *	Insert an item into the radix tree at position @index.
+ *	Insert an item into the radix tree covering the naturally aligned
+ *	range of 2^@order indices starting at @index.  A lookup of any index
+ *	in that range finds @item; gang lookups return it once.
+ *
+ *	The entry is stored in the node whose slots span no more than 2^@order
+ *	indices; when @order is not a multiple of RADIX_TREE_MAP_SHIFT it takes
+ *	several consecutive slots of that node, so a huge page costs a handful
+ *	of slots instead of a bottom level node per 64 subpages.
  */
-int radix_tree_insert(struct radix_tree_root *root,
-			unsigned long index, void *item)
+int __radix_tree_insert(struct radix_tree_root *root, unsigned long index,
+			unsigned int order, void *item)
 {
 	struct radix_tree_node *node = NULL, *slot;
+	unsigned long last = index;
 	unsigned int height, shift;
+	unsigned int i, nr;
 	int offset;
 	int error;
 
 	BUG_ON(radix_tree_is_indirect_ptr(item));
+	BUG_ON(order >= RADIX_TREE_INDEX_BITS);
+	BUG_ON(index & ((1UL << order) - 1));
 
-	/* Make sure the tree is high enough.  */
-	if (index > radix_tree_maxindex(root->height)) {
-		error = radix_tree_extend(root, index);
+	/*
+	 * Make sure the tree is high enough: it must reach the end of the
+	 * range, and its top node must span more than the entry, which
+	 * cannot live in root->rnode itself.
+	 */
+	if (order)
+		last |= ((1UL << order) - 1) | (1UL << order);
+	if (last > radix_tree_maxindex(root->height)) {
+		error = radix_tree_extend(root, last);
 		if (error)
 			return error;
 	}
@@ -333,36 +401,70 @@ int radix_tree_insert(struct radix_tree_root *root,
 				return -ENOMEM;
 			slot->height = height;
 			if (node) {
-				rcu_assign_pointer(node->slots[offset], slot);
+				rcu_assign_pointer(node->slots[offset],
+						   ptr_to_indirect(slot));
 				node->count++;
 			} else
 				rcu_assign_pointer(root->rnode, ptr_to_indirect(slot));
 		}
 
-		/* Go a level down */
 		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
 		node = slot;
+		if (shift <= order)
+			break;
+
+		/* Go a level down, unless a bigger entry covers @index */
 		slot = node->slots[offset];
+		if (slot && !radix_tree_is_node(node, slot))
+			return -EEXIST;
+		slot = indirect_to_ptr(slot);
 		shift -= RADIX_TREE_MAP_SHIFT;
 		height--;
 	}
 
-	if (slot != NULL)
-		return -EEXIST;
-
-	if (node) {
-		node->count++;
-		rcu_assign_pointer(node->slots[offset], item);
-		BUG_ON(tag_get(node, 0, offset));
-		BUG_ON(tag_get(node, 1, offset));
-	} else {
+	if (!node) {
+		if (root->rnode)
+			return -EEXIST;
 		rcu_assign_pointer(root->rnode, item);
 		BUG_ON(root_tag_get(root, 0));
 		BUG_ON(root_tag_get(root, 1));
+		return 0;
 	}
 
+	nr = 1U << (order - shift);
+	for (i = 0; i < nr; i++)
+		if (node->slots[offset + i] != NULL)
+			return -EEXIST;
+
+	/*
+	 * Siblings go in first: a lockless lookup following one to a still
+	 * empty first slot just sees no item.
+	 */
+	for (i = 1; i < nr; i++)
+		rcu_assign_pointer(node->slots[offset + i],
+				   ptr_to_indirect(&node->slots[offset]));
+	node->count += nr;
+	rcu_assign_pointer(node->slots[offset], item);
+	BUG_ON(tag_get(node, 0, offset));
+	BUG_ON(tag_get(node, 1, offset));
+
 	return 0;
 }
+EXPORT_SYMBOL(__radix_tree_insert);
+
+/**
+ *	radix_tree_insert    -    insert into a radix tree
+ *	@root:		radix tree root
+ *	@index:		index key
+ *	@item:		item to insert
+ *
+ *	Insert an item into the radix tree at position @index.
+ */
+int radix_tree_insert(struct radix_tree_root *root,
+			unsigned long index, void *item)
+{
+	return __radix_tree_insert(root, index, 0, item);
+}
 EXPORT_SYMBOL(radix_tree_insert);
 
 /*
@@ -373,7 +475,8 @@ static void *radix_tree_lookup_element(struct radix_tree_root *root,
 				unsigned long index, int is_slot)
 {
 	unsigned int height, shift;
-	struct radix_tree_node *node, **slot;
+	struct radix_tree_node *node;
+	void **slot, *entry;
 
 	node = rcu_dereference(root->rnode);
 	if (node == NULL)
@@ -392,18 +495,31 @@ static void *radix_tree_lookup_element(struct radix_tree_root *root,
 
 	shift = (height-1) * RADIX_TREE_MAP_SHIFT;
 
-	do {
-		slot = (struct radix_tree_node **)
-			(node->slots + ((index>>shift) & RADIX_TREE_MAP_MASK));
-		node = rcu_dereference(*slot);
-		if (node == NULL)
+	for ( ; ; ) {
+		slot = node->slots + ((index>>shift) & RADIX_TREE_MAP_MASK);
+		entry = rcu_dereference(*slot);
+		if (entry == NULL)
 			return NULL;
 
+		if (is_sibling_entry(node, entry)) {
+			/*
+			 * Part of a multi-order entry.  If its first slot no
+			 * longer holds an item we raced with a delete.
+			 */
+			slot = indirect_to_ptr(entry);
+			entry = rcu_dereference(*slot);
+			if (entry == NULL || radix_tree_is_indirect_ptr(entry))
+				return NULL;
+			break;
+		}
+		if (!radix_tree_is_node(node, entry))
+			break;
+
+		node = indirect_to_ptr(entry);
 		shift -= RADIX_TREE_MAP_SHIFT;
-		height--;
-	} while (height > 0);
+	}
 
-	return is_slot ? (void *)slot : indirect_to_ptr(node);
+	return is_slot ? (void *)slot : indirect_to_ptr(entry);
 }
 
 /**
@@ -460,31 +576,39 @@ void *radix_tree_tag_set(struct radix_tree_root *root,
 			unsigned long index, unsigned int tag)
 {
 	unsigned int height, shift;
-	struct radix_tree_node *slot;
+	struct radix_tree_node *node;
+	void *entry;
 
 	height = root->height;
 	BUG_ON(index > radix_tree_maxindex(height));
 
-	slot = indirect_to_ptr(root->rnode);
+	entry = root->rnode;
 	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
 
 	while (height > 0) {
 		int offset;
 
+		node = indirect_to_ptr(entry);
 		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
-		if (!tag_get(slot, tag, offset))
-			tag_set(slot, tag, offset);
-		slot = slot->slots[offset];
-		BUG_ON(slot == NULL);
+		entry = node->slots[offset];
+		if (is_sibling_entry(node, entry)) {
+			offset = sibling_offset(node, entry);
+			entry = node->slots[offset];
+		}
+		BUG_ON(entry == NULL);
+		if (!tag_get(node, tag, offset))
+			tag_set(node, tag, offset);
+		if (!radix_tree_is_node(node, entry))
+			break;
 		shift -= RADIX_TREE_MAP_SHIFT;
 		height--;
 	}
 
 	/* set the root's tag bit */
-	if (slot && !root_tag_get(root, tag))
+	if (entry && !root_tag_get(root, tag))
 		root_tag_set(root, tag);
 
-	return slot;
+	return entry;
 }
 EXPORT_SYMBOL(radix_tree_tag_set);
 
@@ -510,7 +634,8 @@ void *radix_tree_tag_clear(struct radix_tree_root *root,
 	 * since the "list" is null terminated.
 	 */
 	struct radix_tree_path path[RADIX_TREE_MAX_PATH + 1], *pathp = path;
-	struct radix_tree_node *slot = NULL;
+	struct radix_tree_node *node;
+	void *entry = NULL;
 	unsigned int height, shift;
 
 	height = root->height;
@@ -519,24 +644,31 @@ void *radix_tree_tag_clear(struct radix_tree_root *root,
 
 	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
 	pathp->node = NULL;
-	slot = indirect_to_ptr(root->rnode);
+	entry = root->rnode;
 
 	while (height > 0) {
 		int offset;
 
-		if (slot == NULL)
+		if (entry == NULL)
 			goto out;
 
+		node = indirect_to_ptr(entry);
 		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+		entry = node->slots[offset];
+		if (is_sibling_entry(node, entry)) {
+			offset = sibling_offset(node, entry);
+			entry = node->slots[offset];
+		}
 		pathp[1].offset = offset;
-		pathp[1].node = slot;
-		slot = slot->slots[offset];
+		pathp[1].node = node;
 		pathp++;
+		if (!radix_tree_is_node(node, entry))
+			break;
 		shift -= RADIX_TREE_MAP_SHIFT;
 		height--;
 	}
 
-	if (slot == NULL)
+	if (entry == NULL)
 		goto out;
 
 	while (pathp->node) {
@@ -553,7 +685,7 @@ void *radix_tree_tag_clear(struct radix_tree_root *root,
 		root_tag_clear(root, tag);
 
 out:
-	return slot;
+	return entry;
 }
 EXPORT_SYMBOL(radix_tree_tag_clear);
 
@@ -573,6 +705,7 @@ int radix_tree_tag_get(struct radix_tree_root *root,
 {
 	unsigned int height, shift;
 	struct radix_tree_node *node;
+	void *entry;
 	int saw_unset_tag = 0;
 
 	/* check the root's tag bit */
@@ -596,10 +729,14 @@ int radix_tree_tag_get(struct radix_tree_root *root,
 	for ( ; ; ) {
 		int offset;
 
-		if (node == NULL)
-			return 0;
-
 		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+		entry = rcu_dereference(node->slots[offset]);
+		if (entry == NULL)
+			return 0;
+		if (is_sibling_entry(node, entry)) {
+			offset = sibling_offset(node, entry);
+			entry = rcu_dereference(node->slots[offset]);
+		}
 
 		/*
 		 * This is just a debug check.  Later, we can bale as soon as
@@ -607,15 +744,14 @@ int radix_tree_tag_get(struct radix_tree_root *root,
 		 */
 		if (!tag_get(node, tag, offset))
 			saw_unset_tag = 1;
-		if (height == 1) {
+		if (!radix_tree_is_node(node, entry)) {
 			int ret = tag_get(node, tag, offset);
 
 			BUG_ON(ret && saw_unset_tag);
 			return !!ret;
 		}
-		node = rcu_dereference(node->slots[offset]);
+		node = indirect_to_ptr(entry);
 		shift -= RADIX_TREE_MAP_SHIFT;
-		height--;
 	}
 }
 EXPORT_SYMBOL(radix_tree_tag_get);
@@ -686,29 +822,42 @@ unsigned long radix_tree_range_tag_if_tagged(struct radix_tree_root *root,
 	path[height - 1].node = NULL;
 
 	for (;;) {
+		void *entry;
 		int offset;
 
 		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
-		if (!slot->slots[offset])
+		entry = slot->slots[offset];
+		if (!entry)
 			goto next;
+		if (is_sibling_entry(slot, entry)) {
+			/*
+			 * The rest of a multi-order entry: only look at it
+			 * when the range starts inside the entry, else it
+			 * was handled at its first slot already.
+			 */
+			if (index != *first_indexp)
+				goto next;
+			offset = sibling_offset(slot, entry);
+			entry = slot->slots[offset];
+		}
 		if (!tag_get(slot, iftag, offset))
 			goto next;
-		if (height > 1) {
+		if (radix_tree_is_node(slot, entry)) {
 			/* Go down one level */
 			height--;
 			shift -= RADIX_TREE_MAP_SHIFT;
 			path[height - 1].node = slot;
 			path[height - 1].offset = offset;
-			slot = slot->slots[offset];
+			slot = indirect_to_ptr(entry);
 			continue;
 		}
 
-		/* tag the leaf */
+		/* tag the leaf, or a multi-order entry in an interior node */
 		tagged++;
 		tag_set(slot, settag, offset);
 
 		/* walk back up the path tagging interior nodes */
-		pathp = &path[0];
+		pathp = &path[height - 1];
 		while (pathp->node) {
 			/* stop if we find a node with the tag already set */
 			if (tag_get(pathp->node, settag, pathp->offset))
@@ -830,16 +979,30 @@ __lookup(struct radix_tree_node *slot, void ***results, unsigned long *indices,
 	unsigned int nr_found = 0;
 	unsigned int shift, height;
 	unsigned long i;
+	void *entry;
 
 	height = slot->height;
 	if (height == 0)
 		goto out;
 	shift = (height-1) * RADIX_TREE_MAP_SHIFT;
 
-	for ( ; height > 1; height--) {
+	for ( ; ; height--) {
 		i = (index >> shift) & RADIX_TREE_MAP_MASK;
+		entry = rcu_dereference(slot->slots[i]);
+		if (is_sibling_entry(slot, entry)) {
+			/* @index is inside a multi-order entry: return it */
+			i = sibling_offset(slot, entry);
+			index = (((index >> shift) & ~RADIX_TREE_MAP_MASK) | i)
+				<< shift;
+			if (height > 1)
+				goto found_entry;
+		}
+		if (height == 1)
+			break;
+
 		for (;;) {
-			if (slot->slots[i] != NULL)
+			entry = slot->slots[i];
+			if (entry != NULL && !is_sibling_entry(slot, entry))
 				break;
 			index &= ~((1UL << shift) - 1);
 			index += 1UL << shift;
@@ -850,25 +1013,40 @@ __lookup(struct radix_tree_node *slot, void ***results, unsigned long *indices,
 				goto out;
 		}
 
-		shift -= RADIX_TREE_MAP_SHIFT;
-		slot = rcu_dereference(slot->slots[i]);
-		if (slot == NULL)
+		entry = rcu_dereference(slot->slots[i]);
+		if (entry == NULL)
 			goto out;
+		if (!radix_tree_is_node(slot, entry))
+			goto found_entry;
+
+		shift -= RADIX_TREE_MAP_SHIFT;
+		slot = indirect_to_ptr(entry);
 	}
 
 	/* Bottom level: grab some items */
-	for (i = index & RADIX_TREE_MAP_MASK; i < RADIX_TREE_MAP_SIZE; i++) {
-		if (slot->slots[i]) {
+	for ( ; i < RADIX_TREE_MAP_SIZE; i++) {
+		entry = slot->slots[i];
+		if (entry && !is_sibling_entry(slot, entry)) {
 			results[nr_found] = &(slot->slots[i]);
 			if (indices)
 				indices[nr_found] = index;
 			if (++nr_found == max_items) {
-				index++;
+				index += entry_slots(slot, i);
 				goto out;
 			}
 		}
 		index++;
 	}
+	goto out;
+
+found_entry:
+	/* A multi-order entry spanning one or more slots of an interior node */
+	results[0] = &(slot->slots[i]);
+	if (indices)
+		indices[0] = index & ~((1UL << shift) - 1);
+	nr_found = 1;
+	index &= ~((1UL << shift) - 1);
+	index += (unsigned long)entry_slots(slot, i) << shift;
 out:
 	*next_index = index;
 	return nr_found;
@@ -1027,6 +1205,17 @@ __lookup_tag(struct radix_tree_node *slot, void ***results, unsigned long index,
 
 	while (height > 0) {
 		unsigned long i = (index >> shift) & RADIX_TREE_MAP_MASK ;
+		void *entry = rcu_dereference(slot->slots[i]);
+
+		/*
+		 * The tags of a multi-order entry live in its first slot, so
+		 * start there if @index lands in one of the others.
+		 */
+		if (is_sibling_entry(slot, entry)) {
+			i = sibling_offset(slot, entry);
+			index = (((index >> shift) & ~RADIX_TREE_MAP_MASK) | i)
+				<< shift;
+		}
 
 		for (;;) {
 			if (tag_get(slot, tag, i))
@@ -1057,17 +1246,30 @@ __lookup_tag(struct radix_tree_node *slot, void ***results, unsigned long index,
 				 * lookup ->slots[x] without a lock (ie. can't
 				 * rely on its value remaining the same).
 				 */
-				if (slot->slots[j]) {
+				entry = slot->slots[j];
+				if (entry && !is_sibling_entry(slot, entry)) {
 					results[nr_found++] = &(slot->slots[j]);
-					if (nr_found == max_items)
+					if (nr_found == max_items) {
+						index += entry_slots(slot, j) - 1;
 						goto out;
+					}
 				}
 			}
+			break;
 		}
-		shift -= RADIX_TREE_MAP_SHIFT;
-		slot = rcu_dereference(slot->slots[i]);
-		if (slot == NULL)
+
+		entry = rcu_dereference(slot->slots[i]);
+		if (entry == NULL || is_sibling_entry(slot, entry))
 			break;
+		if (!radix_tree_is_node(slot, entry)) {
+			/* A tagged multi-order entry in an interior node */
+			results[nr_found++] = &(slot->slots[i]);
+			index &= ~((1UL << shift) - 1);
+			index += (unsigned long)entry_slots(slot, i) << shift;
+			goto out;
+		}
+		shift -= RADIX_TREE_MAP_SHIFT;
+		slot = indirect_to_ptr(entry);
 	}
 out:
 	*next_index = index;
@@ -1215,6 +1417,7 @@ static unsigned long __locate(struct radix_tree_node *slot, void *item,
 {
 	unsigned int shift, height;
 	unsigned long i;
+	void *entry;
 
 	height = slot->height;
 	shift = (height-1) * RADIX_TREE_MAP_SHIFT;
@@ -1233,10 +1436,20 @@ static unsigned long __locate(struct radix_tree_node *slot, void *item,
 				goto out;
 		}
 
-		shift -= RADIX_TREE_MAP_SHIFT;
-		slot = rcu_dereference(slot->slots[i]);
-		if (slot == NULL)
+		entry = rcu_dereference(slot->slots[i]);
+		if (!radix_tree_is_node(slot, entry)) {
+			/* A multi-order entry, or a sibling slot of one */
+			index &= ~((1UL << shift) - 1);
+			if (entry == item) {
+				*found_index = index;
+				index = 0;
+			} else
+				index += 1UL << shift;
 			goto out;
+		}
+
+		shift -= RADIX_TREE_MAP_SHIFT;
+		slot = indirect_to_ptr(entry);
 	}
 
 	/* Bottom level: check items */
@@ -1319,6 +1532,10 @@ static inline void radix_tree_shrink(struct radix_tree_root *root)
 			break;
 		if (!to_free->slots[0])
 			break;
+		/* Only an order 0 item at index 0 can live in root->rnode */
+		if (root->height > 1 &&
+		    !radix_tree_is_indirect_ptr(to_free->slots[0]))
+			break;
 
 		/*
 		 * We don't need rcu_assign_pointer(), since we are simply
@@ -1328,8 +1545,6 @@ static inline void radix_tree_shrink(struct radix_tree_root *root)
 		 * one (root->rnode) as far as dependent read barriers go.
 		 */
 		newptr = to_free->slots[0];
-		if (root->height > 1)
-			newptr = ptr_to_indirect(newptr);
 		root->rnode = newptr;
 		root->height--;
 
@@ -1364,7 +1579,9 @@ static inline void radix_tree_shrink(struct radix_tree_root *root)
  *	@root:		radix tree root
  *	@index:		index key
  *
- *	Remove the item at @index from the radix tree rooted at @root.
+ *	Remove the item at @index from the radix tree rooted at @root.  If it
+ *	is a multi-order entry, the whole entry goes, whichever of its indices
+ *	@index is.
  *
  *	Returns the address of the deleted item, or NULL if it was not present.
  */
@@ -1375,9 +1592,9 @@ void *radix_tree_delete(struct radix_tree_root *root, unsigned long index)
 	 * since the "list" is null terminated.
 	 */
 	struct radix_tree_path path[RADIX_TREE_MAX_PATH + 1], *pathp = path;
-	struct radix_tree_node *slot = NULL;
-	struct radix_tree_node *to_free;
-	unsigned int height, shift;
+	struct radix_tree_node *node, *to_free;
+	void *entry = NULL;
+	unsigned int height, shift, nr;
 	int tag;
 	int offset;
 
@@ -1385,31 +1602,34 @@ void *radix_tree_delete(struct radix_tree_root *root, unsigned long index)
 	if (index > radix_tree_maxindex(height))
 		goto out;
 
-	slot = root->rnode;
+	entry = root->rnode;
 	if (height == 0) {
 		root_tag_clear_all(root);
 		root->rnode = NULL;
 		goto out;
 	}
-	slot = indirect_to_ptr(slot);
 
 	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
 	pathp->node = NULL;
 
 	do {
-		if (slot == NULL)
+		if (entry == NULL)
 			goto out;
 
 		pathp++;
+		node = indirect_to_ptr(entry);
 		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+		entry = node->slots[offset];
+		if (is_sibling_entry(node, entry)) {
+			offset = sibling_offset(node, entry);
+			entry = node->slots[offset];
+		}
 		pathp->offset = offset;
-		pathp->node = slot;
-		slot = slot->slots[offset];
+		pathp->node = node;
 		shift -= RADIX_TREE_MAP_SHIFT;
-		height--;
-	} while (height > 0);
+	} while (radix_tree_is_node(node, entry));
 
-	if (slot == NULL)
+	if (entry == NULL)
 		goto out;
 
 	/*
@@ -1421,10 +1641,17 @@ void *radix_tree_delete(struct radix_tree_root *root, unsigned long index)
 	}
 
 	to_free = NULL;
+	nr = entry_slots(pathp->node, pathp->offset);
 	/* Now free the nodes we do not need anymore */
 	while (pathp->node) {
+		unsigned int i;
+
+		/* The first slot goes first, so stale siblings lead nowhere */
 		pathp->node->slots[pathp->offset] = NULL;
-		pathp->node->count--;
+		for (i = 1; i < nr; i++)
+			pathp->node->slots[pathp->offset + i] = NULL;
+		pathp->node->count -= nr;
+		nr = 1;
 		/*
 		 * Queue the node for deferred freeing after the
 		 * last reference to it disappears (set NULL, above).
@@ -1450,7 +1677,7 @@ void *radix_tree_delete(struct radix_tree_root *root, unsigned long index)
 		radix_tree_node_free(to_free);
 
 out:
-	return slot;
+	return entry;
 }
 EXPORT_SYMBOL(radix_tree_delete);
 
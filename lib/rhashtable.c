@@ -0,0 +1,619 @@
+/*
+ * Resizable hash table with RCU lookups
+ *
+ * Lookups walk a bucket chain under rcu_read_lock() only.  Inserts and
+ * removals lock the bucket through an array of spinlocks, each of which
+ * covers a group of buckets, so updates on different cpus mostly take
+ * different locks.
+ *
+ * Resizing is done by a work item.  It allocates the new table, hangs it
+ * off the old one as ->future_tbl and then empties the old buckets into
+ * it one at a time, under the old bucket's lock.  From the moment
+ * ->future_tbl is visible, inserts go into the new table, so every
+ * entry is either still in its old bucket or already in the new table.
+ * Entries are moved from the tail of the old chain, and only unlinked
+ * from it after they are reachable from the new bucket; a lookup that
+ * misses in the old table retries in ->future_tbl and so never loses an
+ * entry that is being moved.  Once all buckets are moved, ht->tbl is
+ * switched over and the old table freed after a grace period.
+ */
+
+#include <linux/bug.h>
+#include <linux/cpumask.h>
+#include <linux/err.h>
+#include <linux/jhash.h>
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+#include <linux/rhashtable.h>
+
+#define HASH_DEFAULT_SIZE	64U
+#define HASH_MIN_SIZE		4U
+#define BUCKET_LOCKS_PER_CPU	128U
+
+static void *rht_obj(const struct rhashtable *ht, const struct rhash_head *he)
+{
+	return (char *)he - ht->p.head_offset;
+}
+
+static u32 rht_key_hash(const struct rhashtable *ht,
+			const struct bucket_table *tbl, const void *key)
+{
+	return ht->p.hashfn(key, ht->p.key_len, tbl->hash_rnd);
+}
+
+static u32 rht_head_hash(const struct rhashtable *ht,
+			 const struct bucket_table *tbl,
+			 const struct rhash_head *he)
+{
+	return rht_key_hash(ht, tbl, (char *)rht_obj(ht, he) + ht->p.key_offset);
+}
+
+/*
+ * The seed is shared by a table and its ->future_tbl, so one hash value
+ * indexes both.
+ */
+static inline unsigned int rht_bucket_index(const struct bucket_table *tbl,
+					    u32 hash)
+{
+	return hash & (tbl->size - 1);
+}
+
+static inline spinlock_t *rht_bucket_lock(const struct bucket_table *tbl,
+					  unsigned int hash)
+{
+	return &tbl->locks[hash & tbl->locks_mask];
+}
+
+static void rht_free(void *p)
+{
+	if (is_vmalloc_addr(p))
+		vfree(p);
+	else
+		kfree(p);
+}
+
+static void bucket_table_free(struct bucket_table *tbl)
+{
+	if (tbl->locks)
+		rht_free(tbl->locks);
+	rht_free(tbl);
+}
+
+static int alloc_bucket_locks(struct bucket_table *tbl)
+{
+	unsigned int i, size;
+#ifdef CONFIG_PROVE_LOCKING
+	unsigned int nr_pcpus = 2;
+#else
+	unsigned int nr_pcpus = num_possible_cpus();
+#endif
+
+	nr_pcpus = min(nr_pcpus, 32U);
+	size = roundup_pow_of_two(nr_pcpus * BUCKET_LOCKS_PER_CPU);
+
+	/* Never more than one lock per two buckets */
+	size = max(min(size, tbl->size >> 1), 1U);
+
+	tbl->locks = kmalloc(size * sizeof(spinlock_t),
+			     GFP_KERNEL | __GFP_NOWARN);
+	if (!tbl->locks)
+		tbl->locks = vmalloc(size * sizeof(spinlock_t));
+	if (!tbl->locks)
+		return -ENOMEM;
+
+	for (i = 0; i < size; i++)
+		spin_lock_init(&tbl->locks[i]);
+	tbl->locks_mask = size - 1;
+
+	return 0;
+}
+
+static struct bucket_table *bucket_table_alloc(unsigned int nbuckets)
+{
+	struct bucket_table *tbl;
+	size_t size;
+
+	size = sizeof(*tbl) + nbuckets * sizeof(tbl->buckets[0]);
+	tbl = kzalloc(size, GFP_KERNEL | __GFP_NOWARN);
+	if (!tbl)
+		tbl = vzalloc(size);
+	if (!tbl)
+		return NULL;
+
+	tbl->size = nbuckets;
+	if (alloc_bucket_locks(tbl) < 0) {
+		bucket_table_free(tbl);
+		return NULL;
+	}
+
+	return tbl;
+}
+
+static bool rht_grow_above_75(const struct rhashtable *ht,
+			      const struct bucket_table *tbl)
+{
+	return atomic_read(&ht->nelems) > tbl->size / 4 * 3 &&
+	       (!ht->p.max_size || tbl->size < ht->p.max_size);
+}
+
+static bool rht_shrink_below_30(const struct rhashtable *ht,
+				const struct bucket_table *tbl)
+{
+	return ht->p.automatic_shrinking &&
+	       atomic_read(&ht->nelems) < tbl->size * 3 / 10 &&
+	       tbl->size > ht->p.min_size;
+}
+
+/*
+ * Move the last entry of an old bucket to the new table.  Called with the
+ * old bucket locked; returns -ENOENT once the bucket is empty.
+ */
+static int rhashtable_rehash_one(struct rhashtable *ht,
+				 struct bucket_table *old_tbl,
+				 struct bucket_table *new_tbl,
+				 unsigned int old_hash)
+{
+	struct rhash_head *entry, **pprev = &old_tbl->buckets[old_hash];
+	spinlock_t *new_lock;
+	unsigned int new_hash;
+
+	entry = *pprev;
+	if (!entry)
+		return -ENOENT;
+
+	/*
+	 * Taking the tail means nothing in the old chain sits behind the
+	 * entry, so pointing its ->next into the new bucket hides nothing
+	 * from a reader still walking the old chain.
+	 */
+	while (entry->next) {
+		pprev = &entry->next;
+		entry = entry->next;
+	}
+
+	new_hash = rht_bucket_index(new_tbl, rht_head_hash(ht, new_tbl, entry));
+	new_lock = rht_bucket_lock(new_tbl, new_hash);
+
+	spin_lock_nested(new_lock, SINGLE_DEPTH_NESTING);
+	entry->next = new_tbl->buckets[new_hash];
+	rcu_assign_pointer(new_tbl->buckets[new_hash], entry);
+	spin_unlock(new_lock);
+
+	/*
+	 * Reachable from the new bucket before it leaves the old one; pairs
+	 * with the smp_rmb() in __rhashtable_lookup().
+	 */
+	smp_wmb();
+	*pprev = NULL;
+
+	return 0;
+}
+
+static void rhashtable_rehash_chain(struct rhashtable *ht,
+				    struct bucket_table *old_tbl,
+				    unsigned int old_hash)
+{
+	spinlock_t *old_lock = rht_bucket_lock(old_tbl, old_hash);
+
+	spin_lock_bh(old_lock);
+	while (!rhashtable_rehash_one(ht, old_tbl, old_tbl->future_tbl,
+				      old_hash))
+		;
+	spin_unlock_bh(old_lock);
+}
+
+static int rhashtable_rehash(struct rhashtable *ht, unsigned int size)
+{
+	struct bucket_table *old_tbl = ht->tbl;
+	struct bucket_table *new_tbl;
+	unsigned int hash;
+
+	new_tbl = bucket_table_alloc(size);
+	if (!new_tbl)
+		return -ENOMEM;
+	new_tbl->hash_rnd = old_tbl->hash_rnd;
+
+	/*
+	 * An update that locks an old bucket after we have moved it is
+	 * ordered after this store by the bucket lock and so inserts into
+	 * the new table.  One that got there first inserts into the old
+	 * bucket, which we then move.
+	 */
+	rcu_assign_pointer(old_tbl->future_tbl, new_tbl);
+
+	for (hash = 0; hash < old_tbl->size; hash++) {
+		rhashtable_rehash_chain(ht, old_tbl, hash);
+		cond_resched();
+	}
+
+	rcu_assign_pointer(ht->tbl, new_tbl);
+
+	/* Wait for lookups and updates that still see the old table */
+	synchronize_rcu();
+	bucket_table_free(old_tbl);
+
+	return 0;
+}
+
+static void rht_deferred_worker(struct work_struct *work)
+{
+	struct rhashtable *ht = container_of(work, struct rhashtable, run_work);
+	struct bucket_table *tbl;
+	unsigned int nelems, size;
+
+	mutex_lock(&ht->mutex);
+	for (;;) {
+		tbl = ht->tbl;
+		nelems = atomic_read(&ht->nelems);
+
+		if (rht_grow_above_75(ht, tbl)) {
+			/* Go straight to the final size after a burst */
+			size = tbl->size * 2;
+			while (size / 4 * 3 < nelems &&
+			       (!ht->p.max_size || size < ht->p.max_size))
+				size *= 2;
+		} else if (rht_shrink_below_30(ht, tbl)) {
+			size = roundup_pow_of_two(max(nelems * 3 / 2, 1U));
+			size = max(size, ht->p.min_size);
+			if (size >= tbl->size)
+				break;
+		} else
+			break;
+
+		if (ht->p.max_size)
+			size = min(size, ht->p.max_size);
+		if (rhashtable_rehash(ht, size))
+			break;
+	}
+	mutex_unlock(&ht->mutex);
+}
+
+static bool rht_bucket_find(struct rhashtable *ht, struct bucket_table *tbl,
+			    unsigned int hash,
+			    bool (*compare)(void *, void *), void *arg)
+{
+	struct rhash_head *he;
+
+	for (he = tbl->buckets[hash]; he; he = he->next)
+		if (compare(rht_obj(ht, he), arg))
+			return true;
+	return false;
+}
+
+struct rht_key_arg {
+	const struct rhashtable	*ht;
+	const void		*key;
+};
+
+static bool rht_key_compare(void *obj, void *arg)
+{
+	struct rht_key_arg *x = arg;
+
+	return !memcmp((char *)obj + x->ht->p.key_offset, x->key,
+		       x->ht->p.key_len);
+}
+
+static int __rhashtable_insert(struct rhashtable *ht, struct rhash_head *obj,
+			       bool (*compare)(void *, void *), void *arg)
+{
+	struct bucket_table *tbl, *new_tbl;
+	spinlock_t *lock, *new_lock = NULL;
+	unsigned int hash, new_hash = 0;
+	int err = 0;
+	u32 h;
+
+	rcu_read_lock();
+	tbl = rcu_dereference(ht->tbl);
+	h = rht_head_hash(ht, tbl, obj);
+	hash = rht_bucket_index(tbl, h);
+	lock = rht_bucket_lock(tbl, hash);
+
+	spin_lock_bh(lock);
+	new_tbl = tbl->future_tbl;
+	if (new_tbl) {
+		new_hash = rht_bucket_index(new_tbl, h);
+		new_lock = rht_bucket_lock(new_tbl, new_hash);
+		spin_lock_nested(new_lock, SINGLE_DEPTH_NESTING);
+	}
+
+	if (compare &&
+	    (rht_bucket_find(ht, tbl, hash, compare, arg) ||
+	     (new_tbl && rht_bucket_find(ht, new_tbl, new_hash, compare, arg)))) {
+		err = -EEXIST;
+		goto out;
+	}
+
+	if (new_tbl) {
+		tbl = new_tbl;
+		hash = new_hash;
+	}
+
+	obj->next = tbl->buckets[hash];
+	rcu_assign_pointer(tbl->buckets[hash], obj);
+
+	atomic_inc(&ht->nelems);
+	if (rht_grow_above_75(ht, tbl))
+		schedule_work(&ht->run_work);
+
+out:
+	if (new_lock)
+		spin_unlock(new_lock);
+	spin_unlock_bh(lock);
+	rcu_read_unlock();
+
+	return err;
+}
+
+/**
+ * rhashtable_insert - insert an object into the hash table
+ * @ht:		hash table
+ * @obj:	pointer to the rhash_head embedded in the object
+ *
+ * Does not check for an object with the same key; use
+ * rhashtable_lookup_insert() for that.  Takes a bucket lock with bottom
+ * halves disabled, so must not be called with interrupts off.  Grows the
+ * table in the background once it is more than 75% full.
+ */
+void rhashtable_insert(struct rhashtable *ht, struct rhash_head *obj)
+{
+	__rhashtable_insert(ht, obj, NULL, NULL);
+}
+EXPORT_SYMBOL_GPL(rhashtable_insert);
+
+/**
+ * rhashtable_lookup_insert - insert an object unless its key is present
+ * @ht:		hash table
+ * @obj:	pointer to the rhash_head embedded in the object
+ *
+ * The check and the insert are done under the bucket lock, so two racing
+ * callers cannot both add the same key.  Returns 0 or -EEXIST.
+ */
+int rhashtable_lookup_insert(struct rhashtable *ht, struct rhash_head *obj)
+{
+	struct rht_key_arg arg = {
+		.ht	= ht,
+		.key	= (char *)rht_obj(ht, obj) + ht->p.key_offset,
+	};
+
+	return __rhashtable_insert(ht, obj, rht_key_compare, &arg);
+}
+EXPORT_SYMBOL_GPL(rhashtable_lookup_insert);
+
+/**
+ * rhashtable_lookup_compare_insert - insert unless a matching object exists
+ * @ht:		hash table
+ * @obj:	pointer to the rhash_head embedded in the object
+ * @compare:	returns true for an object that clashes with @obj
+ * @arg:	second argument to @compare
+ *
+ * Like rhashtable_lookup_insert(), for tables where equal keys do not
+ * necessarily mean equal objects.  Only objects hashing to the same
+ * bucket as @obj are passed to @compare, which is called under the
+ * bucket lock.  Returns 0 or -EEXIST.
+ */
+int rhashtable_lookup_compare_insert(struct rhashtable *ht,
+				     struct rhash_head *obj,
+				     bool (*compare)(void *, void *),
+				     void *arg)
+{
+	return __rhashtable_insert(ht, obj, compare, arg);
+}
+EXPORT_SYMBOL_GPL(rhashtable_lookup_compare_insert);
+
+static int rht_unlink(struct bucket_table *tbl, unsigned int hash,
+		      struct rhash_head *obj)
+{
+	struct rhash_head **pprev;
+
+	for (pprev = &tbl->buckets[hash]; *pprev; pprev = &(*pprev)->next) {
+		if (*pprev == obj) {
+			rcu_assign_pointer(*pprev, obj->next);
+			return 0;
+		}
+	}
+	return -ENOENT;
+}
+
+/**
+ * rhashtable_remove - remove an object from the hash table
+ * @ht:		hash table
+ * @obj:	pointer to the rhash_head embedded in the object
+ *
+ * Returns 0, or -ENOENT if @obj was not in the table.  Lookups may still
+ * find the object until a grace period has passed, so it must not be
+ * freed or reinserted before that.  With automatic_shrinking the table
+ * shrinks in the background once it is less than 30% full.
+ */
+int rhashtable_remove(struct rhashtable *ht, struct rhash_head *obj)
+{
+	struct bucket_table *tbl, *new_tbl;
+	spinlock_t *lock, *new_lock;
+	unsigned int hash;
+	int err;
+	u32 h;
+
+	rcu_read_lock();
+	tbl = rcu_dereference(ht->tbl);
+	h = rht_head_hash(ht, tbl, obj);
+	hash = rht_bucket_index(tbl, h);
+	lock = rht_bucket_lock(tbl, hash);
+
+	spin_lock_bh(lock);
+	err = rht_unlink(tbl, hash, obj);
+	new_tbl = tbl->future_tbl;
+	if (err && new_tbl) {
+		hash = rht_bucket_index(new_tbl, h);
+		new_lock = rht_bucket_lock(new_tbl, hash);
+		spin_lock_nested(new_lock, SINGLE_DEPTH_NESTING);
+		err = rht_unlink(new_tbl, hash, obj);
+		spin_unlock(new_lock);
+	}
+
+	if (!err) {
+		atomic_dec(&ht->nelems);
+		if (rht_shrink_below_30(ht, new_tbl ?: tbl))
+			schedule_work(&ht->run_work);
+	}
+	spin_unlock_bh(lock);
+	rcu_read_unlock();
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(rhashtable_remove);
+
+static void *__rhashtable_lookup(struct rhashtable *ht, const void *key,
+				 bool (*compare)(void *, void *), void *arg)
+{
+	struct bucket_table *tbl;
+	struct rhash_head *he;
+	unsigned int hash;
+	u32 h;
+
+	tbl = rcu_dereference(ht->tbl);
+	h = rht_key_hash(ht, tbl, key);
+restart:
+	hash = rht_bucket_index(tbl, h);
+	for (he = rcu_dereference(tbl->buckets[hash]); he;
+	     he = rcu_dereference(he->next)) {
+		if (compare(rht_obj(ht, he), arg))
+			return rht_obj(ht, he);
+	}
+
+	/* Not here; it may have just been moved to the new table */
+	smp_rmb();
+	tbl = rcu_dereference(tbl->future_tbl);
+	if (tbl)
+		goto restart;
+
+	return NULL;
+}
+
+/**
+ * rhashtable_lookup - look up an object by key
+ * @ht:		hash table
+ * @key:	pointer to the key
+ *
+ * Must be called under rcu_read_lock(); the object returned is only
+ * guaranteed to stay around until rcu_read_unlock() unless the caller
+ * takes a reference on it.  Returns NULL if there is no such object.
+ */
+void *rhashtable_lookup(struct rhashtable *ht, const void *key)
+{
+	struct rht_key_arg arg = {
+		.ht	= ht,
+		.key	= key,
+	};
+
+	return __rhashtable_lookup(ht, key, rht_key_compare, &arg);
+}
+EXPORT_SYMBOL_GPL(rhashtable_lookup);
+
+/**
+ * rhashtable_lookup_compare - look up an object with a custom match
+ * @ht:		hash table
+ * @key:	pointer to the key, used to find the bucket
+ * @compare:	returns true for the object wanted
+ * @arg:	second argument to @compare
+ *
+ * Same rules as rhashtable_lookup().
+ */
+void *rhashtable_lookup_compare(struct rhashtable *ht, const void *key,
+				bool (*compare)(void *, void *), void *arg)
+{
+	return __rhashtable_lookup(ht, key, compare, arg);
+}
+EXPORT_SYMBOL_GPL(rhashtable_lookup_compare);
+
+static unsigned int rounded_hashtable_size(const struct rhashtable_params *p)
+{
+	unsigned int size;
+
+	if (!p->nelem_hint)
+		size = HASH_DEFAULT_SIZE;
+	else
+		size = roundup_pow_of_two(p->nelem_hint * 4 / 3);
+
+	size = max(size, p->min_size);
+	if (p->max_size)
+		size = min(size, p->max_size);
+	return size;
+}
+
+/**
+ * rhashtable_init - initialize a new hash table
+ * @ht:		hash table to initialize
+ * @params:	configuration parameters
+ *
+ * The key is @params->key_len bytes at @params->key_offset inside each
+ * object, and the struct rhash_head at @params->head_offset.  The
+ * initial size comes from @params->nelem_hint; @params->max_size and
+ * @params->min_size, if set, must be powers of two.
+ *
+ *	struct test_obj {
+ *		int			key;
+ *		void			*my_member;
+ *		struct rhash_head	node;
+ *	};
+ *
+ *	struct rhashtable_params params = {
+ *		.head_offset = offsetof(struct test_obj, node),
+ *		.key_offset = offsetof(struct test_obj, key),
+ *		.key_len = sizeof(int),
+ *	};
+ */
+int rhashtable_init(struct rhashtable *ht,
+		    const struct rhashtable_params *params)
+{
+	struct bucket_table *tbl;
+
+	if (!params->key_len ||
+	    (params->max_size && !is_power_of_2(params->max_size)) ||
+	    (params->min_size && !is_power_of_2(params->min_size)))
+		return -EINVAL;
+
+	memset(ht, 0, sizeof(*ht));
+	mutex_init(&ht->mutex);
+	memcpy(&ht->p, params, sizeof(*params));
+
+	if (!ht->p.hashfn)
+		ht->p.hashfn = jhash;
+	ht->p.min_size = max(ht->p.min_size, HASH_MIN_SIZE);
+
+	tbl = bucket_table_alloc(rounded_hashtable_size(&ht->p));
+	if (!tbl)
+		return -ENOMEM;
+	get_random_bytes(&tbl->hash_rnd, sizeof(tbl->hash_rnd));
+
+	atomic_set(&ht->nelems, 0);
+	ht->tbl = tbl;
+	INIT_WORK(&ht->run_work, rht_deferred_worker);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(rhashtable_init);
+
+/**
+ * rhashtable_destroy - free the hash table
+ * @ht:		hash table
+ *
+ * Waits for a pending resize and frees the bucket table.  The objects
+ * are not touched; the caller must have removed or otherwise disposed of
+ * them and must make sure no inserts or removals run concurrently.
+ */
+void rhashtable_destroy(struct rhashtable *ht)
+{
+	cancel_work_sync(&ht->run_work);
+
+	mutex_lock(&ht->mutex);
+	bucket_table_free(ht->tbl);
+	ht->tbl = NULL;
+	mutex_unlock(&ht->mutex);
+}
+EXPORT_SYMBOL_GPL(rhashtable_destroy);
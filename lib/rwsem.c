@@ -5,6 +5,7 @@
  */
 #include <linux/rwsem.h>
 #include <linux/sched.h>
+#include <linux/mutex.h>
 #include <linux/init.h>
 #include <linux/module.h>
 
@@ -24,16 +25,29 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	sem->count = RWSEM_UNLOCKED_VALUE;
 	spin_lock_init(&sem->wait_lock);
 	INIT_LIST_HEAD(&sem->wait_list);
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	sem->owner = NULL;
+	sem->spinners = NULL;
+#endif
 }
 
 EXPORT_SYMBOL(__init_rwsem);
 
+enum rwsem_waiter_type {
+	RWSEM_WAITING_FOR_WRITE,
+	RWSEM_WAITING_FOR_READ
+};
+
 struct rwsem_waiter {
 	struct list_head list;
 	struct task_struct *task;
-	unsigned int flags;
-#define RWSEM_WAITING_FOR_READ	0x00000001
-#define RWSEM_WAITING_FOR_WRITE	0x00000002
+	enum rwsem_waiter_type type;
+};
+
+enum rwsem_wake_type {
+	RWSEM_WAKE_ANY,		/* Wake whatever's at head of wait list */
+	RWSEM_WAKE_READERS,	/* Wake readers only */
+	RWSEM_WAKE_READ_OWNED	/* Waker thread holds the read lock */
 };
 
 /*
@@ -44,61 +58,57 @@ struct rwsem_waiter {
  *   - there must be someone on the queue
  * - the spinlock must be held by the caller
  * - woken process blocks are discarded from the list after having task zeroed
- * - writers are only woken if downgrading is false
+ * - writers are only woken if wake_type is RWSEM_WAKE_ANY
+ *
+ * The waiting part of count is RWSEM_WAITING_BIAS once, for as long as
+ * the wait list is not empty.  A writer at the front of the queue is only
+ * woken up: it takes the lock itself, and another writer that comes
+ * along in the meantime may steal it first.  Readers are granted the
+ * lock here, before they're woken up.
  */
-static inline struct rw_semaphore *
-__rwsem_do_wake(struct rw_semaphore *sem, int downgrading)
+static struct rw_semaphore *
+__rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
 {
 	struct rwsem_waiter *waiter;
 	struct task_struct *tsk;
 	struct list_head *next;
-	signed long oldcount, woken, loop;
-
-	if (downgrading)
-		goto dont_wake_writers;
-
-	/* if we came through an up_xxxx() call, we only only wake someone up
-	 * if we can transition the active part of the count from 0 -> 1
-	 */
- try_again:
-	oldcount = rwsem_atomic_update(RWSEM_ACTIVE_BIAS, sem)
-						- RWSEM_ACTIVE_BIAS;
-	if (oldcount & RWSEM_ACTIVE_MASK)
-		goto undo;
+	signed long oldcount, woken, loop, adjustment;
 
 	waiter = list_entry(sem->wait_list.next, struct rwsem_waiter, list);
+	if (waiter->type == RWSEM_WAITING_FOR_WRITE) {
+		if (wake_type == RWSEM_WAKE_ANY)
+			/* Wake writer at the front of the queue, but do not
+			 * grant it the lock yet as we want other writers
+			 * to be able to steal it.  Readers, on the other hand,
+			 * will block as they will notice the queued writer.
+			 */
+			wake_up_process(waiter->task);
+		goto out;
+	}
 
-	/* try to grant a single write lock if there's a writer at the front
-	 * of the queue - note we leave the 'active part' of the count
-	 * incremented by 1 and the waiting part incremented by 0x00010000
-	 */
-	if (!(waiter->flags & RWSEM_WAITING_FOR_WRITE))
-		goto readers_only;
-
-	/* We must be careful not to touch 'waiter' after we set ->task = NULL.
-	 * It is an allocated on the waiter's stack and may become invalid at
-	 * any time after that point (due to a wakeup from another source).
+	/* Writers might steal the lock before we grant it to the next reader.
+	 * We prefer to do the first reader grant before counting readers
+	 * so we can bail out early if a writer stole the lock.
 	 */
-	list_del(&waiter->list);
-	tsk = waiter->task;
-	smp_mb();
-	waiter->task = NULL;
-	wake_up_process(tsk);
-	put_task_struct(tsk);
-	goto out;
-
-	/* don't want to wake any writers */
- dont_wake_writers:
-	waiter = list_entry(sem->wait_list.next, struct rwsem_waiter, list);
-	if (waiter->flags & RWSEM_WAITING_FOR_WRITE)
-		goto out;
+	adjustment = 0;
+	if (wake_type != RWSEM_WAKE_READ_OWNED) {
+		adjustment = RWSEM_ACTIVE_READ_BIAS;
+ try_reader_grant:
+		oldcount = rwsem_atomic_update(adjustment, sem) - adjustment;
+		if (unlikely(oldcount < RWSEM_WAITING_BIAS)) {
+			/* A writer stole the lock. Undo our reader grant. */
+			if (rwsem_atomic_update(-adjustment, sem) &
+						RWSEM_ACTIVE_MASK)
+				goto out;
+			/* Last active locker left. Retry waking readers. */
+			goto try_reader_grant;
+		}
+	}
 
-	/* grant an infinite number of read locks to the readers at the front
-	 * of the queue
-	 * - note we increment the 'active part' of the count by the number of
-	 *   readers before waking any processes up
+	/* Grant an infinite number of read locks to the readers at the front
+	 * of the queue.  Note we increment the 'active part' of the count by
+	 * the number of readers before waking any processes up.
 	 */
- readers_only:
 	woken = 0;
 	do {
 		woken++;
@@ -109,18 +119,19 @@ __rwsem_do_wake(struct rw_semaphore *sem, int downgrading)
 		waiter = list_entry(waiter->list.next,
 					struct rwsem_waiter, list);
 
-	} while (waiter->flags & RWSEM_WAITING_FOR_READ);
+	} while (waiter->type != RWSEM_WAITING_FOR_WRITE);
 
-	loop = woken;
-	woken *= RWSEM_ACTIVE_BIAS - RWSEM_WAITING_BIAS;
-	if (!downgrading)
-		/* we'd already done one increment earlier */
-		woken -= RWSEM_ACTIVE_BIAS;
+	adjustment = woken * RWSEM_ACTIVE_READ_BIAS - adjustment;
+	if (waiter->type != RWSEM_WAITING_FOR_WRITE)
+		/* hit end of list above */
+		adjustment -= RWSEM_WAITING_BIAS;
 
-	rwsem_atomic_add(woken, sem);
+	if (adjustment)
+		rwsem_atomic_add(adjustment, sem);
 
 	next = sem->wait_list.next;
-	for (; loop > 0; loop--) {
+	loop = woken;
+	do {
 		waiter = list_entry(next, struct rwsem_waiter, list);
 		next = waiter->list.next;
 		tsk = waiter->task;
@@ -128,56 +139,250 @@ __rwsem_do_wake(struct rw_semaphore *sem, int downgrading)
 		waiter->task = NULL;
 		wake_up_process(tsk);
 		put_task_struct(tsk);
-	}
+	} while (--loop);
 
 	sem->wait_list.next = next;
 	next->prev = &sem->wait_list;
 
  out:
 	return sem;
+}
 
-	/* undo the change to the active count, but check for a transition
-	 * 1->0 */
- undo:
-	if (rwsem_atomic_update(-RWSEM_ACTIVE_BIAS, sem) & RWSEM_ACTIVE_MASK)
-		goto out;
-	goto try_again;
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * Optimistic spinning
+ *
+ * Like a mutex, a contended rwsem is usually released soon when its
+ * owner is running on another cpu, and spinning until then is much
+ * cheaper than going to sleep and being woken up again.  Spinners queue
+ * up on an MCS lock, so that only the one at its head polls the owner
+ * and the count.  A spinning writer takes the lock as soon as there are
+ * no active lockers, ahead of sleeping waiters.  A spinning reader only
+ * takes it as long as nobody is waiting, so that readers can't starve
+ * queued writers.
+ *
+ * Readers can't be tracked, so nobody spins on a sem that readers got
+ * last (owner RWSEM_READER_OWNED).
+ */
+struct rwsem_spinner {
+	struct rwsem_spinner *next;
+	int locked;		/* 1 if we're at the head of the queue */
+};
+
+static void rwsem_spinner_lock(struct rw_semaphore *sem,
+			       struct rwsem_spinner *node)
+{
+	struct rwsem_spinner *prev;
+
+	node->locked = 0;
+	node->next = NULL;
+
+	prev = xchg(&sem->spinners, node);
+	if (likely(prev == NULL))
+		return;
+
+	ACCESS_ONCE(prev->next) = node;
+	/* Wait until the previous spinner hands the head over to us */
+	while (!ACCESS_ONCE(node->locked))
+		arch_mutex_cpu_relax();
+	smp_rmb();
+}
+
+static void rwsem_spinner_unlock(struct rw_semaphore *sem,
+				 struct rwsem_spinner *node)
+{
+	struct rwsem_spinner *next = ACCESS_ONCE(node->next);
+
+	if (likely(!next)) {
+		/* Release the queue if we're the last one in it */
+		if (cmpxchg(&sem->spinners, node, NULL) == node)
+			return;
+		/* Wait until the next spinner has linked itself in */
+		while (!(next = ACCESS_ONCE(node->next)))
+			arch_mutex_cpu_relax();
+	}
+	smp_wmb();
+	ACCESS_ONCE(next->locked) = 1;
+}
+
+/* Take the write lock if there are no active lockers, waiters or not */
+static inline int rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
+{
+	rwsem_count_t old, count = ACCESS_ONCE(sem->count);
+
+	while (count == 0 || count == RWSEM_WAITING_BIAS) {
+		old = cmpxchg(&sem->count, count,
+			      count + RWSEM_ACTIVE_WRITE_BIAS);
+		if (old == count)
+			return 1;
+		count = old;
+	}
+	return 0;
+}
+
+/* Take a read lock if it's free or read locked, and nobody is waiting */
+static inline int rwsem_try_read_lock_unqueued(struct rw_semaphore *sem)
+{
+	rwsem_count_t old, count = ACCESS_ONCE(sem->count);
+
+	while (count >= 0) {
+		old = cmpxchg(&sem->count, count,
+			      count + RWSEM_ACTIVE_READ_BIAS);
+		if (old == count)
+			return 1;
+		count = old;
+	}
+	return 0;
+}
+
+static inline int rwsem_can_spin(struct rw_semaphore *sem)
+{
+	/*
+	 * If we hold the BKL, don't spin: the owner of the sem might be
+	 * waiting on us to release it.
+	 */
+	if (current->lock_depth >= 0)
+		return 0;
+
+	return ACCESS_ONCE(sem->owner) != RWSEM_READER_OWNED;
+}
+
+static inline int rwsem_can_spin_read(struct rw_semaphore *sem)
+{
+	return rwsem_can_spin(sem) && list_empty(&sem->wait_list);
 }
 
 /*
- * wait for a lock to be granted
+ * Spin for the sem as long as its owner is running.  Returns 1 with the
+ * sem held, 0 if the caller has to queue up and sleep.
  */
-static struct rw_semaphore __sched *
-rwsem_down_failed_common(struct rw_semaphore *sem,
-			struct rwsem_waiter *waiter, signed long adjustment)
+static int rwsem_optimistic_spin(struct rw_semaphore *sem,
+				 enum rwsem_waiter_type type)
 {
+	struct rwsem_spinner node;
+	struct thread_info *owner;
+	int taken = 0;
+
+	preempt_disable();
+
+	if (!rwsem_can_spin(sem))
+		goto done;
+
+	rwsem_spinner_lock(sem, &node);
+
+	for (;;) {
+		/*
+		 * If there's an owner, wait for it to either release the
+		 * sem or go to sleep.
+		 */
+		owner = ACCESS_ONCE(sem->owner);
+		if (owner == RWSEM_READER_OWNED)
+			break;
+		if (owner && !rwsem_spin_on_owner(sem, owner))
+			break;
+
+		if (type == RWSEM_WAITING_FOR_WRITE) {
+			taken = rwsem_try_write_lock_unqueued(sem);
+		} else {
+			/* a reader must not jump the queue */
+			if (!list_empty(&sem->wait_list))
+				break;
+			taken = rwsem_try_read_lock_unqueued(sem);
+		}
+		if (taken)
+			break;
+
+		/*
+		 * When there's no owner, we might have preempted between the
+		 * owner acquiring the lock and setting the owner field. If
+		 * we're an RT task that will live-lock because we won't let
+		 * the owner complete.
+		 */
+		if (!owner && (need_resched() || rt_task(current)))
+			break;
+
+		/*
+		 * The cpu_relax() call is a compiler barrier which forces
+		 * everything in this loop to be re-loaded. We don't need
+		 * memory barriers as we'll eventually observe the right
+		 * values at the cost of a few extra spins.
+		 */
+		arch_mutex_cpu_relax();
+	}
+
+	rwsem_spinner_unlock(sem, &node);
+done:
+	preempt_enable();
+	return taken;
+}
+#else
+static inline int rwsem_can_spin_read(struct rw_semaphore *sem)
+{
+	return 0;
+}
+
+static inline int rwsem_optimistic_spin(struct rw_semaphore *sem,
+					enum rwsem_waiter_type type)
+{
+	return 0;
+}
+#endif
+
+/*
+ * wait for the read lock to be granted
+ */
+asmregparm struct rw_semaphore __sched *
+rwsem_down_read_failed(struct rw_semaphore *sem)
+{
+	signed long count, adjustment = -RWSEM_ACTIVE_READ_BIAS;
+	struct rwsem_waiter waiter;
 	struct task_struct *tsk = current;
-	signed long count;
 
-	set_task_state(tsk, TASK_UNINTERRUPTIBLE);
+	/*
+	 * Spinning needs our read bias out of the count, so that it can
+	 * tell a free sem from one that's read locked.
+	 */
+	if (rwsem_can_spin_read(sem)) {
+		rwsem_atomic_update(-RWSEM_ACTIVE_READ_BIAS, sem);
+		adjustment = 0;
+		if (rwsem_optimistic_spin(sem, RWSEM_WAITING_FOR_READ))
+			return sem;
+	}
 
 	/* set up my own style of waitqueue */
-	spin_lock_irq(&sem->wait_lock);
-	waiter->task = tsk;
+	waiter.task = tsk;
+	waiter.type = RWSEM_WAITING_FOR_READ;
 	get_task_struct(tsk);
 
-	list_add_tail(&waiter->list, &sem->wait_list);
-
-	/* we're now waiting on the lock, but no longer actively read-locking */
-	count = rwsem_atomic_update(adjustment, sem);
-
-	/* if there are no active locks, wake the front queued process(es) up */
-	if (!(count & RWSEM_ACTIVE_MASK))
-		sem = __rwsem_do_wake(sem, 0);
+	spin_lock_irq(&sem->wait_lock);
+	if (list_empty(&sem->wait_list))
+		adjustment += RWSEM_WAITING_BIAS;
+	list_add_tail(&waiter.list, &sem->wait_list);
+
+	/* we're now waiting on the lock, but no longer actively locking */
+	if (adjustment)
+		count = rwsem_atomic_update(adjustment, sem);
+	else
+		count = ACCESS_ONCE(sem->count);
+
+	/* If there are no active locks, wake the front queued process(es).
+	 *
+	 * If there are no writers and we are first in the queue,
+	 * wake our own waiter to join the existing active readers !
+	 */
+	if (count == RWSEM_WAITING_BIAS ||
+	    (count > RWSEM_WAITING_BIAS &&
+	     list_is_singular(&sem->wait_list)))
+		sem = __rwsem_do_wake(sem, RWSEM_WAKE_ANY);
 
 	spin_unlock_irq(&sem->wait_lock);
 
 	/* wait to be given the lock */
 	for (;;) {
-		if (!waiter->task)
+		set_task_state(tsk, TASK_UNINTERRUPTIBLE);
+		if (!waiter.task)
 			break;
 		schedule();
-		set_task_state(tsk, TASK_UNINTERRUPTIBLE);
 	}
 
 	tsk->state = TASK_RUNNING;
@@ -186,29 +391,87 @@ rwsem_down_failed_common(struct rw_semaphore *sem,
 }
 
 /*
- * wait for the read lock to be granted
+ * Try to take the write lock as the waiter at the front of the queue.
+ * Called with the wait_lock held.
  */
-asmregparm struct rw_semaphore __sched *
-rwsem_down_read_failed(struct rw_semaphore *sem)
+static inline int rwsem_try_write_lock(signed long count,
+				       struct rw_semaphore *sem)
 {
-	struct rwsem_waiter waiter;
-
-	waiter.flags = RWSEM_WAITING_FOR_READ;
-	rwsem_down_failed_common(sem, &waiter,
-				RWSEM_WAITING_BIAS - RWSEM_ACTIVE_BIAS);
-	return sem;
+	/*
+	 * Only take the lock if there are no active lockers; if others
+	 * are still waiting, keep the waiting bias for them.
+	 */
+	if (count != RWSEM_WAITING_BIAS ||
+	    cmpxchg(&sem->count, RWSEM_WAITING_BIAS,
+		    RWSEM_ACTIVE_WRITE_BIAS) != RWSEM_WAITING_BIAS)
+		return 0;
+
+	if (!list_is_singular(&sem->wait_list))
+		rwsem_atomic_add(RWSEM_WAITING_BIAS, sem);
+	return 1;
 }
 
 /*
- * wait for the write lock to be granted
+ * wait until we successfully acquire the write lock
  */
 asmregparm struct rw_semaphore __sched *
 rwsem_down_write_failed(struct rw_semaphore *sem)
 {
+	signed long count;
 	struct rwsem_waiter waiter;
+	struct task_struct *tsk = current;
+	int waiting = 1;
+
+	/* undo the write bias from down_write, stop actively locking */
+	count = rwsem_atomic_update(-RWSEM_ACTIVE_WRITE_BIAS, sem);
+
+	/* spin and steal the lock if its owner is running */
+	if (rwsem_optimistic_spin(sem, RWSEM_WAITING_FOR_WRITE))
+		return sem;
+
+	/* set up my own style of waitqueue */
+	waiter.task = tsk;
+	waiter.type = RWSEM_WAITING_FOR_WRITE;
 
-	waiter.flags = RWSEM_WAITING_FOR_WRITE;
-	rwsem_down_failed_common(sem, &waiter, -RWSEM_ACTIVE_BIAS);
+	spin_lock_irq(&sem->wait_lock);
+
+	/* account for this before adding a new element to the list */
+	if (list_empty(&sem->wait_list))
+		waiting = 0;
+
+	list_add_tail(&waiter.list, &sem->wait_list);
+
+	if (waiting) {
+		count = ACCESS_ONCE(sem->count);
+
+		/* If there were already threads queued before us and there
+		 * are no active writers, the lock must be read owned; so we
+		 * try to wake any read locks that were queued ahead of us.
+		 */
+		if (count > RWSEM_WAITING_BIAS)
+			sem = __rwsem_do_wake(sem, RWSEM_WAKE_READERS);
+	} else
+		count = rwsem_atomic_update(RWSEM_WAITING_BIAS, sem);
+
+	/* wait until we successfully acquire the lock */
+	set_task_state(tsk, TASK_UNINTERRUPTIBLE);
+	for (;;) {
+		if (rwsem_try_write_lock(count, sem))
+			break;
+		spin_unlock_irq(&sem->wait_lock);
+
+		/* Block until there are no active lockers. */
+		do {
+			schedule();
+			set_task_state(tsk, TASK_UNINTERRUPTIBLE);
+		} while ((count = sem->count) & RWSEM_ACTIVE_MASK);
+
+		spin_lock_irq(&sem->wait_lock);
+	}
+
+	list_del(&waiter.list);
+	spin_unlock_irq(&sem->wait_lock);
+	tsk->state = TASK_RUNNING;
 
 	return sem;
 }
@@ -225,7 +488,7 @@ asmregparm struct rw_semaphore *rwsem_wake(struct rw_semaphore *sem)
 
 	/* do nothing if list empty */
 	if (!list_empty(&sem->wait_list))
-		sem = __rwsem_do_wake(sem, 0);
+		sem = __rwsem_do_wake(sem, RWSEM_WAKE_ANY);
 
 	spin_unlock_irqrestore(&sem->wait_lock, flags);
 
@@ -245,7 +508,7 @@ asmregparm struct rw_semaphore *rwsem_downgrade_wake(struct rw_semaphore *sem)
 
 	/* do nothing if list empty */
 	if (!list_empty(&sem->wait_list))
-		sem = __rwsem_do_wake(sem, 1);
+		sem = __rwsem_do_wake(sem, RWSEM_WAKE_READ_OWNED);
 
 	spin_unlock_irqrestore(&sem->wait_lock, flags);
 
@@ -0,0 +1,160 @@
+/*
+ * Spinlock scaling benchmark
+ *
+ * Takes one shared lock from 1, 2, 4, ... threads, each bound to its own
+ * cpu, and prints the aggregate lock/unlock throughput, first for the
+ * kernel's spinlock_t (queued, ticket or unfair, depending on the config
+ * and spinlock-type=) and then for a plain ticket lock built here, so
+ * that both scaling curves come out of one run.  Each critical section
+ * updates a few shared cachelines, and the totals are checked at the
+ * end of every run.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <linux/cpumask.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+
+#include "bench_threads.h"
+
+static int loops = 200000;
+module_param(loops, int, 0444);
+MODULE_PARM_DESC(loops, "Number of lock/unlock pairs per thread");
+
+static int hold = 2;
+module_param(hold, int, 0444);
+MODULE_PARM_DESC(hold, "Shared cachelines written in each critical section");
+
+static int gap;
+module_param(gap, int, 0444);
+MODULE_PARM_DESC(gap, "cpu_relax() calls between unlock and the next lock");
+
+#define MAX_HOLD	8
+
+static DEFINE_SPINLOCK(bench_lock);
+
+/*
+ * The ticket lock to compare against: take a ticket with xadd, spin
+ * until it is served.  Ordering is that of x86, where a load is an
+ * acquire and a store a release.
+ */
+static struct {
+	atomic_t	next;
+	unsigned int	owner;
+} ____cacheline_aligned_in_smp bench_ticket;
+
+static void ticket_lock(void)
+{
+	unsigned int ticket = atomic_add_return(1, &bench_ticket.next) - 1;
+
+	while (ACCESS_ONCE(bench_ticket.owner) != ticket)
+		cpu_relax();
+	barrier();
+}
+
+static void ticket_unlock(void)
+{
+	barrier();
+	ACCESS_ONCE(bench_ticket.owner) = bench_ticket.owner + 1;
+}
+
+static struct {
+	unsigned long	count;
+} ____cacheline_aligned_in_smp bench_data[MAX_HOLD];
+
+static void bench_loop(void *data)
+{
+	bool ticket = data != NULL;
+	int i, j;
+
+	for (i = 0; i < loops; i++) {
+		if (ticket) {
+			preempt_disable();
+			ticket_lock();
+		} else {
+			spin_lock(&bench_lock);
+		}
+
+		for (j = 0; j < hold; j++)
+			bench_data[j].count++;
+
+		if (ticket) {
+			ticket_unlock();
+			preempt_enable();
+		} else {
+			spin_unlock(&bench_lock);
+		}
+
+		for (j = 0; j < gap; j++)
+			cpu_relax();
+		if (!(i & 0xffff))
+			cond_resched();
+	}
+}
+
+/* Returns lock/unlock pairs per microsecond, or a negative errno */
+static long bench_run(int nr, bool ticket)
+{
+	s64 ns;
+	int i;
+
+	memset(bench_data, 0, sizeof(bench_data));
+
+	ns = bench_threads_run(nr, bench_loop, ticket ? &bench_ticket : NULL,
+			       "spinlock_bench");
+	if (ns < 0)
+		return ns;
+
+	for (i = 0; i < hold; i++) {
+		if (bench_data[i].count != (unsigned long)loops * nr) {
+			printk(KERN_ERR "spinlock_bench: %s lost updates: "
+			       "%lu of %lu\n", ticket ? "ticket" : "spinlock_t",
+			       bench_data[i].count, (unsigned long)loops * nr);
+			return -EINVAL;
+		}
+	}
+
+	return div64_u64((u64)loops * nr * 1000, ns ?: 1);
+}
+
+static int __init spinlock_bench_init(void)
+{
+	long spin, ticket;
+	int nr, err = 0;
+
+	if (loops <= 0 || hold < 0 || hold > MAX_HOLD || gap < 0)
+		return -EINVAL;
+
+	printk(KERN_INFO "spinlock_bench: %d lock/unlock pairs per thread, "
+	       "hold %d gap %d, pairs/usec\n", loops, hold, gap);
+	printk(KERN_INFO "spinlock_bench: %7s %10s %10s\n",
+	       "threads", "spinlock_t", "ticket");
+
+	for (nr = 1; nr <= num_online_cpus(); nr <<= 1) {
+		spin = bench_run(nr, false);
+		ticket = bench_run(nr, true);
+		if (spin < 0 || ticket < 0) {
+			err = spin < 0 ? spin : ticket;
+			break;
+		}
+		printk(KERN_INFO "spinlock_bench: %7d %10ld %10ld\n",
+		       nr, spin, ticket);
+	}
+
+	if (err)
+		return err;
+
+	/* The results are in the log; don't stay loaded */
+	return -EAGAIN;
+}
+
+module_init(spinlock_bench_init);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Spinlock scaling benchmark");
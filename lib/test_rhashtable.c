@@ -0,0 +1,234 @@
+/*
+ * Resizable hash table self test and microbenchmark
+ *
+ * Fills a table that starts out small, so that it has to grow several
+ * times, and prints the cost per insert, lookup and remove.  Then it
+ * keeps half of the keys in the table while a kernel thread looks them
+ * up over and over, and churns the other half in and out, which makes
+ * the table grow and shrink under the reader.  A lookup of a stable key
+ * must never fail, whatever state the resize is in.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <linux/err.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/rcupdate.h>
+#include <linux/rhashtable.h>
+#include <linux/sched.h>
+#include <linux/vmalloc.h>
+
+static int entries = 50000;
+module_param(entries, int, 0444);
+MODULE_PARM_DESC(entries, "Number of objects in the table");
+
+static int rounds = 10;
+module_param(rounds, int, 0444);
+MODULE_PARM_DESC(rounds, "Grow/shrink cycles under the concurrent reader");
+
+struct test_obj {
+	int			value;
+	struct rhash_head	node;
+};
+
+static const struct rhashtable_params test_params = {
+	.nelem_hint		= 8,
+	.key_offset		= offsetof(struct test_obj, value),
+	.key_len		= sizeof(int),
+	.head_offset		= offsetof(struct test_obj, node),
+	.automatic_shrinking	= true,
+};
+
+static struct rhashtable ht;
+static struct test_obj *objs;
+static atomic_t reader_misses;
+
+static int lookup_range(int first, int last)
+{
+	struct test_obj *obj;
+	int key, misses = 0;
+
+	rcu_read_lock();
+	for (key = first; key < last; key++) {
+		obj = rhashtable_lookup(&ht, &key);
+		if (!obj || obj->value != key)
+			misses++;
+	}
+	rcu_read_unlock();
+	return misses;
+}
+
+static int reader_thread(void *unused)
+{
+	while (!kthread_should_stop()) {
+		atomic_add(lookup_range(0, entries / 2), &reader_misses);
+		cond_resched();
+	}
+	return 0;
+}
+
+static int insert_range(int first, int last)
+{
+	int i, err;
+
+	for (i = first; i < last; i++) {
+		err = rhashtable_lookup_insert(&ht, &objs[i].node);
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
+static int remove_range(int first, int last)
+{
+	int i, err;
+
+	for (i = first; i < last; i++) {
+		err = rhashtable_remove(&ht, &objs[i].node);
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
+static u64 per_entry(ktime_t start)
+{
+	return div64_u64(ktime_to_ns(ktime_sub(ktime_get(), start)), entries);
+}
+
+static int test_rht_basic(void)
+{
+	u64 insert, lookup, remove;
+	ktime_t start;
+	int err, key;
+
+	start = ktime_get();
+	err = insert_range(0, entries);
+	insert = per_entry(start);
+	if (err)
+		return err;
+
+	/* Lookups during the resize are tested below; time a settled table */
+	flush_work(&ht.run_work);
+
+	start = ktime_get();
+	if (lookup_range(0, entries)) {
+		printk(KERN_ERR "test_rhashtable: lookup failed\n");
+		return -EINVAL;
+	}
+	lookup = per_entry(start);
+
+	key = entries;
+	rcu_read_lock();
+	if (rhashtable_lookup(&ht, &key)) {
+		rcu_read_unlock();
+		printk(KERN_ERR "test_rhashtable: found a missing key\n");
+		return -EINVAL;
+	}
+	rcu_read_unlock();
+
+	if (rhashtable_lookup_insert(&ht, &objs[0].node) != -EEXIST) {
+		printk(KERN_ERR "test_rhashtable: duplicate key inserted\n");
+		return -EINVAL;
+	}
+
+	printk(KERN_INFO "test_rhashtable: %d entries in %u buckets\n",
+	       atomic_read(&ht.nelems), ht.tbl->size);
+
+	start = ktime_get();
+	err = remove_range(0, entries);
+	remove = per_entry(start);
+	if (err)
+		return err;
+	flush_work(&ht.run_work);
+
+	printk(KERN_INFO "test_rhashtable: ns/op insert %llu lookup %llu "
+	       "remove %llu, %u buckets left\n",
+	       (unsigned long long)insert, (unsigned long long)lookup,
+	       (unsigned long long)remove, ht.tbl->size);
+
+	/* Removed objects may still be seen by lookups until now */
+	synchronize_rcu();
+	return 0;
+}
+
+static int test_rht_concurrent(void)
+{
+	struct task_struct *reader;
+	int half = entries / 2;
+	int i, err;
+
+	err = insert_range(0, half);
+	if (err)
+		return err;
+
+	atomic_set(&reader_misses, 0);
+	reader = kthread_run(reader_thread, NULL, "test_rhashtable");
+	if (IS_ERR(reader))
+		return PTR_ERR(reader);
+
+	for (i = 0; i < rounds && !err; i++) {
+		err = insert_range(half, entries);
+		if (!err)
+			err = remove_range(half, entries);
+		synchronize_rcu();
+	}
+
+	kthread_stop(reader);
+	flush_work(&ht.run_work);
+
+	if (!err)
+		err = remove_range(0, half);
+	synchronize_rcu();
+	if (err)
+		return err;
+
+	printk(KERN_INFO "test_rhashtable: %d rounds, %d lookup misses\n",
+	       rounds, atomic_read(&reader_misses));
+	return atomic_read(&reader_misses) ? -EINVAL : 0;
+}
+
+static int __init test_rht_init(void)
+{
+	int i, err;
+
+	if (entries < 2 || rounds < 0)
+		return -EINVAL;
+
+	objs = vmalloc(entries * sizeof(*objs));
+	if (!objs)
+		return -ENOMEM;
+	for (i = 0; i < entries; i++)
+		objs[i].value = i;
+
+	err = rhashtable_init(&ht, &test_params);
+	if (err)
+		goto out;
+
+	err = test_rht_basic();
+	if (!err)
+		err = test_rht_concurrent();
+	if (err)
+		synchronize_rcu();
+
+	rhashtable_destroy(&ht);
+out:
+	vfree(objs);
+	if (err) {
+		printk(KERN_ERR "test_rhashtable: FAILED (%d)\n", err);
+		return err;
+	}
+
+	/* The results are in the log; don't stay loaded */
+	return -EAGAIN;
+}
+
+module_init(test_rht_init);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Resizable hash table test and benchmark");
@@ -14,6 +14,10 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/cpu.h>
+#include <trace/events/kmem.h>
 #include "internal.h"
 
 /*
@@ -47,8 +51,85 @@ struct compact_control {
 
 	int compact_mode;
 	bool contended;
+	bool proactive;			/* kcompactd proactive run */
 };
 
+/*
+ * Order used for the fragmentation score: proactive compaction aims to keep
+ * pageblock sized (i.e. huge page sized) free blocks available.
+ */
+#define COMPACTION_HPAGE_ORDER	pageblock_order
+
+/* Interval between proactive compaction checks by kcompactd */
+#define KCOMPACTD_PROACTIVE_INTERVAL_MSEC	500
+
+/*
+ * Tunable for proactive compaction. It determines how aggressively the
+ * kernel should compact memory in the background. It takes values in the
+ * range [0, 100]; 0 disables proactive compaction.
+ */
+int sysctl_compaction_proactiveness = 20;
+
+static inline bool kswapd_is_running(pg_data_t *pgdat)
+{
+	return pgdat->kswapd && (pgdat->kswapd->state == TASK_RUNNING);
+}
+
+/*
+ * A zone's fragmentation score is the external fragmentation wrt
+ * COMPACTION_HPAGE_ORDER scaled by the zone's share of the node. It
+ * returns a value in the range [0, 100].
+ */
+static unsigned int fragmentation_score_zone(struct zone *zone)
+{
+	u64 score;
+
+	score = (u64)zone->present_pages * extfrag_for_order(zone,
+						COMPACTION_HPAGE_ORDER);
+	return div64_u64(score, zone->zone_pgdat->node_present_pages + 1);
+}
+
+/*
+ * The per-node fragmentation score is the sum of its zones' scores, so
+ * that a small zone (e.g. ZONE_DMA) has little say in whether the node as
+ * a whole is considered fragmented. It returns a value in [0, 100].
+ */
+static unsigned int fragmentation_score_node(pg_data_t *pgdat)
+{
+	unsigned int score = 0;
+	int zoneid;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+		score += fragmentation_score_zone(zone);
+	}
+
+	return score;
+}
+
+/*
+ * Proactive compaction starts once the node score exceeds the high
+ * watermark and stops once it drops below the low watermark.
+ */
+static unsigned int fragmentation_score_wmark(bool low)
+{
+	unsigned int wmark_low;
+
+	wmark_low = max(100U - sysctl_compaction_proactiveness, 5U);
+	return low ? wmark_low : min(wmark_low + 10, 100U);
+}
+
+static bool should_proactive_compact_node(pg_data_t *pgdat)
+{
+	if (!sysctl_compaction_proactiveness || kswapd_is_running(pgdat))
+		return false;
+
+	return fragmentation_score_node(pgdat) > fragmentation_score_wmark(false);
+}
+
 static unsigned long release_freepages(struct list_head *freelist)
 {
 	struct page *page, *next;
@@ -637,6 +718,24 @@ static int compact_finished(struct zone *zone,
 		return COMPACT_COMPLETE;
 	}
 
+	/*
+	 * Proactive compaction is done once the zone is no longer
+	 * fragmented, and yields to kswapd which needs the free pages.
+	 * The zone's own fragmentation counts here, not its weighted
+	 * share of the node score, or a zone much smaller than its node
+	 * would always look done.
+	 */
+	if (cc->proactive) {
+		if (kswapd_is_running(zone->zone_pgdat))
+			return COMPACT_PARTIAL;
+
+		if (extfrag_for_order(zone, COMPACTION_HPAGE_ORDER) <=
+				fragmentation_score_wmark(true))
+			return COMPACT_PARTIAL;
+
+		return COMPACT_CONTINUE;
+	}
+
 	/*
 	 * order == -1 is expected when compacting via
 	 * /proc/sys/vm/compact_memory
@@ -718,6 +817,7 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 	int ret;
 	unsigned long start_pfn = zone->zone_start_pfn;
 	unsigned long end_pfn = zone->zone_start_pfn + zone->spanned_pages;
+	unsigned long nr_migrated = 0, nr_failed = 0;
 
 	ret = compaction_suitable(zone, cc->order);
 	switch (ret) {
@@ -745,18 +845,22 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 	 * Setup to move all movable pages to the end of the zone. Used cached
 	 * information on where the scanners should start but check that it
 	 * is initialised by ensuring the values are within zone boundaries.
+	 * Proactive compaction always covers the whole zone.
 	 */
 	cc->migrate_pfn = zone->compact_cached_migrate_pfn;
 	cc->free_pfn = zone->compact_cached_free_pfn;
-	if (cc->free_pfn < start_pfn || cc->free_pfn > end_pfn) {
+	if (cc->proactive || cc->free_pfn < start_pfn || cc->free_pfn > end_pfn) {
 		cc->free_pfn = end_pfn & ~(pageblock_nr_pages-1);
 		zone->compact_cached_free_pfn = cc->free_pfn;
 	}
-	if (cc->migrate_pfn < start_pfn || cc->migrate_pfn > end_pfn) {
+	if (cc->proactive || cc->migrate_pfn < start_pfn || cc->migrate_pfn > end_pfn) {
 		cc->migrate_pfn = start_pfn;
 		zone->compact_cached_migrate_pfn = cc->migrate_pfn;
 	}
 
+	trace_mm_compaction_begin(zone_to_nid(zone), zone_idx(zone), cc->order,
+				  cc->sync, cc->migrate_pfn, cc->free_pfn);
+
 	migrate_prep_local();
 
 	while ((ret = compact_finished(zone, cc)) == COMPACT_CONTINUE) {
@@ -783,6 +887,8 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 		count_vm_events(COMPACTPAGES, nr_migrate - nr_remaining);
 		if (nr_remaining)
 			count_vm_events(COMPACTPAGEFAILED, nr_remaining);
+		nr_migrated += nr_migrate - nr_remaining;
+		nr_failed += nr_remaining;
 
 		/* Release LRU pages not migrated */
 		if (!list_empty(&cc->migratepages)) {
@@ -796,6 +902,9 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 	cc->nr_freepages -= release_freepages(&cc->freepages);
 	VM_BUG_ON(cc->nr_freepages != 0);
 
+	trace_mm_compaction_end(zone_to_nid(zone), zone_idx(zone), cc->order,
+				ret, nr_migrated, nr_failed);
+
 	return ret;
 }
 
@@ -967,3 +1076,296 @@ void compaction_unregister_node(struct node *node)
 	return sysdev_remove_file(&node->sysdev, &attr_compact);
 }
 #endif /* CONFIG_SYSFS && CONFIG_NUMA */
+
+static inline bool kcompactd_work_requested(pg_data_t *pgdat)
+{
+	return pgdat->kcompactd_max_order > 0 || kthread_should_stop();
+}
+
+static bool kcompactd_node_suitable(pg_data_t *pgdat)
+{
+	int zoneid;
+	struct zone *zone;
+	enum zone_type classzone_idx = pgdat->kcompactd_classzone_idx;
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (compaction_suitable(zone, pgdat->kcompactd_max_order) ==
+					COMPACT_CONTINUE)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Background compaction on behalf of kswapd: compact the zones of the node
+ * up to the requested classzone for the highest order kswapd reclaimed
+ * for. Migration is async so that kcompactd never stalls on page locks or
+ * writeback, and zones where compaction recently failed stay deferred.
+ */
+static void kcompactd_do_work(pg_data_t *pgdat)
+{
+	int zoneid;
+	struct zone *zone;
+	struct compact_control cc = {
+		.order = pgdat->kcompactd_max_order,
+		.migratetype = MIGRATE_MOVABLE,
+		.sync = false,
+	};
+	enum zone_type classzone_idx = pgdat->kcompactd_classzone_idx;
+
+	trace_mm_compaction_kcompactd_wake(pgdat->node_id, cc.order,
+					   classzone_idx, false);
+	count_vm_event(KCOMPACTD_WAKE);
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		int status;
+
+		zone = &pgdat->node_zones[zoneid];
+		if (!populated_zone(zone))
+			continue;
+
+		if (compaction_deferred(zone))
+			continue;
+
+		if (compaction_suitable(zone, cc.order) != COMPACT_CONTINUE)
+			continue;
+
+		cc.nr_freepages = 0;
+		cc.nr_migratepages = 0;
+		cc.contended = false;
+		cc.zone = zone;
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		if (kthread_should_stop())
+			return;
+		status = compact_zone(zone, &cc);
+
+		if (zone_watermark_ok(zone, cc.order, low_wmark_pages(zone),
+				      0, 0)) {
+			zone->compact_considered = 0;
+			zone->compact_defer_shift = 0;
+		} else if (status == COMPACT_COMPLETE) {
+			/*
+			 * The whole zone was scanned without producing a
+			 * page of the requested order: back off like direct
+			 * compaction does.
+			 */
+			defer_compaction(zone);
+		}
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+	}
+
+	/*
+	 * Regardless of success, we are done until woken up next. But remember
+	 * the requested order/classzone_idx in case it was higher than the
+	 * one we just compacted for.
+	 */
+	if (pgdat->kcompactd_max_order <= cc.order)
+		pgdat->kcompactd_max_order = 0;
+	if (pgdat->kcompactd_classzone_idx <= classzone_idx)
+		pgdat->kcompactd_classzone_idx = 0;
+}
+
+/*
+ * Compact the whole node until its fragmentation score drops below the
+ * low watermark.
+ */
+static void proactive_compact_node(pg_data_t *pgdat)
+{
+	int zoneid;
+	struct zone *zone;
+	struct compact_control cc = {
+		.order = -1,
+		.migratetype = MIGRATE_MOVABLE,
+		.sync = false,
+		.ignore_skip_hint = true,
+		.proactive = true,
+	};
+
+	trace_mm_compaction_kcompactd_wake(pgdat->node_id, cc.order,
+					   pgdat->nr_zones - 1, true);
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		zone = &pgdat->node_zones[zoneid];
+		if (!populated_zone(zone))
+			continue;
+
+		cc.nr_freepages = 0;
+		cc.nr_migratepages = 0;
+		cc.contended = false;
+		cc.zone = zone;
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		if (kthread_should_stop())
+			return;
+		compact_zone(zone, &cc);
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+	}
+}
+
+void wakeup_kcompactd(pg_data_t *pgdat, int order, int classzone_idx)
+{
+	if (!order)
+		return;
+
+	if (pgdat->kcompactd_max_order < order)
+		pgdat->kcompactd_max_order = order;
+
+	if (pgdat->kcompactd_classzone_idx < classzone_idx)
+		pgdat->kcompactd_classzone_idx = classzone_idx;
+
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+
+	if (!kcompactd_node_suitable(pgdat))
+		return;
+
+	trace_mm_compaction_wakeup_kcompactd(pgdat->node_id, order,
+					     classzone_idx);
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+/*
+ * The background compaction daemon, started as a kernel thread
+ * from the init process.
+ *
+ * It is woken by kswapd once it has reclaimed enough for a high-order
+ * request, and otherwise wakes up periodically to compact the node
+ * proactively when its fragmentation score is above the watermark set by
+ * vm.compaction_proactiveness.
+ */
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t *)p;
+	struct task_struct *tsk = current;
+	long default_timeout = msecs_to_jiffies(KCOMPACTD_PROACTIVE_INTERVAL_MSEC);
+	long timeout = default_timeout;
+	unsigned int proactive_defer = 0;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(tsk, cpumask);
+
+	set_freezable();
+
+	pgdat->kcompactd_max_order = 0;
+	pgdat->kcompactd_classzone_idx = 0;
+
+	while (!kthread_should_stop()) {
+		unsigned int prev_score, score;
+
+		trace_mm_compaction_kcompactd_sleep(pgdat->node_id);
+		timeout = wait_event_freezable_timeout(pgdat->kcompactd_wait,
+				kcompactd_work_requested(pgdat), timeout);
+
+		if (kthread_should_stop())
+			break;
+
+		if (timeout > 0) {
+			/*
+			 * Woken by kswapd. Keep what is left of the timeout so
+			 * the proactive checks stay periodic.
+			 */
+			kcompactd_do_work(pgdat);
+			continue;
+		}
+
+		/* kcompactd wait timeout */
+		timeout = default_timeout;
+		if (!should_proactive_compact_node(pgdat))
+			continue;
+
+		/*
+		 * Proactive compaction that made no progress last time is
+		 * deferred for 1 << COMPACT_MAX_DEFER_SHIFT intervals, so
+		 * that unmovable fragmentation does not keep us busy.
+		 */
+		if (proactive_defer) {
+			proactive_defer--;
+			continue;
+		}
+
+		prev_score = fragmentation_score_node(pgdat);
+		proactive_compact_node(pgdat);
+		score = fragmentation_score_node(pgdat);
+
+		proactive_defer = score < prev_score ?
+				0 : 1 << COMPACT_MAX_DEFER_SHIFT;
+	}
+
+	return 0;
+}
+
+/*
+ * This kcompactd start function will be called by init and node-hot-add.
+ * On node-hot-add, kcompactd will moved to proper cpus if cpus are hot-added.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		printk(KERN_ERR "Failed to start kcompactd on node %d\n", nid);
+		ret = PTR_ERR(pgdat->kcompactd);
+		pgdat->kcompactd = NULL;
+	}
+	return ret;
+}
+
+/*
+ * It's optimal to keep kcompactd on the same CPUs as their memory, but
+ * not required for correctness. So if the last cpu in a node goes away,
+ * we get changed to run anywhere: as the first one comes back, restore
+ * their cpu bindings.
+ */
+static int __devinit kcompactd_cpu_callback(struct notifier_block *nfb,
+					    unsigned long action, void *hcpu)
+{
+	int nid;
+
+	if (action == CPU_ONLINE || action == CPU_ONLINE_FROZEN) {
+		for_each_node_state(nid, N_HIGH_MEMORY) {
+			pg_data_t *pgdat = NODE_DATA(nid);
+			const struct cpumask *mask;
+
+			mask = cpumask_of_node(pgdat->node_id);
+
+			if (!pgdat->kcompactd)
+				continue;
+
+			if (cpumask_any_and(cpu_online_mask, mask) < nr_cpu_ids)
+				/* One of our CPUs online: restore mask */
+				set_cpus_allowed_ptr(pgdat->kcompactd, mask);
+		}
+	}
+	return NOTIFY_OK;
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	hotcpu_notifier(kcompactd_cpu_callback, 0);
+	return 0;
+}
+
+module_init(kcompactd_init)
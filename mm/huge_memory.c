@@ -17,6 +17,10 @@
 #include <linux/khugepaged.h>
 #include <linux/freezer.h>
 #include <linux/mman.h>
+#include <linux/pagemap.h>
+#include <linux/migrate.h>
+#include <linux/shmem_fs.h>
+#include <linux/file.h>
 #include <asm/tlb.h>
 #include <asm/pgalloc.h>
 #include "internal.h"
@@ -307,6 +311,9 @@ static struct attribute *hugepage_attr[] = {
 	&defrag_attr.attr,
 #ifdef CONFIG_DEBUG_VM
 	&debug_cow_attr.attr,
+#endif
+#ifdef CONFIG_SHMEM
+	&shmem_enabled_attr.attr,
 #endif
 	NULL,
 };
@@ -717,6 +724,103 @@ out:
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+/*
+ * Map HPAGE_PMD_NR naturally aligned pagecache pages with a single
+ * huge pmd.  The pages stay independent order-0 pages in the
+ * pagecache (each one is looked up, truncated and reclaimed on its
+ * own), they only have to be physically contiguous and 2M aligned for
+ * the mapping to be huge.  The caller is responsible for having
+ * populated the range, we only look it up.
+ */
+int do_huge_pmd_file_page(struct mm_struct *mm, struct vm_area_struct *vma,
+			  unsigned long address, pmd_t *pmd,
+			  unsigned int flags)
+{
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	struct page **pages;
+	pgtable_t pgtable;
+	pgoff_t pgoff, size;
+	int i, nr, locked = 0, mapped = 0;
+	int ret = VM_FAULT_FALLBACK;
+
+	if (!(vma->vm_flags & VM_SHARED) || vma->vm_flags & VM_NONLINEAR)
+		goto out;
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end)
+		goto out;
+	pgoff = linear_page_index(vma, haddr);
+	if (pgoff & (HPAGE_PMD_NR - 1))
+		goto out;
+
+	pages = kmalloc(sizeof(struct page *) * HPAGE_PMD_NR, GFP_KERNEL);
+	if (unlikely(!pages))
+		goto out;
+
+	nr = find_get_pages_contig(mapping, pgoff, HPAGE_PMD_NR, pages);
+	if (nr != HPAGE_PMD_NR ||
+	    page_to_pfn(pages[0]) & (HPAGE_PMD_NR - 1))
+		goto out_put;
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (pages[i] != pages[0] + i || PageCompound(pages[i]))
+			goto out_put;
+	}
+	for (locked = 0; locked < HPAGE_PMD_NR; locked++) {
+		struct page *page = pages[locked];
+
+		if (!trylock_page(page))
+			goto out_unlock;
+		if (unlikely(page->mapping != mapping ||
+			     !PageUptodate(page))) {
+			unlock_page(page);
+			goto out_unlock;
+		}
+	}
+	size = (i_size_read(mapping->host) + PAGE_CACHE_SIZE - 1) >>
+		PAGE_CACHE_SHIFT;
+	if (pgoff + HPAGE_PMD_NR > size)
+		goto out_unlock;
+
+	pgtable = pte_alloc_one(mm, haddr);
+	if (unlikely(!pgtable)) {
+		ret = VM_FAULT_OOM;
+		goto out_unlock;
+	}
+
+	spin_lock(&mm->page_table_lock);
+	ret = 0;
+	if (unlikely(!pmd_none(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		pte_free(mm, pgtable);
+	} else {
+		pmd_t entry;
+		entry = mk_pmd(pages[0], vma->vm_page_prot);
+		entry = pmd_mkhuge(pmd_mkyoung(entry));
+		if (flags & FAULT_FLAG_WRITE)
+			entry = maybe_pmd_mkwrite(pmd_mkdirty(entry), vma);
+		for (i = 0; i < HPAGE_PMD_NR; i++)
+			page_add_file_rmap(pages[i]);
+		set_pmd_at(mm, haddr, pmd, entry);
+		prepare_pmd_huge_pte(pgtable, mm);
+		add_mm_counter(mm, file_rss, HPAGE_PMD_NR);
+		mm->nr_ptes++;
+		spin_unlock(&mm->page_table_lock);
+		count_vm_event(THP_FILE_MAPPED);
+		/* the pagecache references are now the mapping references */
+		mapped = 1;
+	}
+
+out_unlock:
+	while (--locked >= 0)
+		unlock_page(pages[locked]);
+out_put:
+	if (!mapped)
+		for (i = 0; i < nr; i++)
+			page_cache_release(pages[i]);
+	kfree(pages);
+out:
+	return ret;
+}
+
 int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		  pmd_t *dst_pmd, pmd_t *src_pmd, unsigned long addr,
 		  struct vm_area_struct *vma)
@@ -750,6 +854,21 @@ int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		goto out;
 	}
 	src_page = pmd_page(pmd);
+	if (!PageAnon(src_page)) {
+		int i;
+
+		/* shared pagecache pmd: no COW, just share the pages */
+		for (i = 0; i < HPAGE_PMD_NR; i++) {
+			get_page(src_page + i);
+			page_dup_rmap(src_page + i);
+		}
+		add_mm_counter(dst_mm, file_rss, HPAGE_PMD_NR);
+		set_pmd_at(dst_mm, addr, dst_pmd, pmd_mkold(pmd));
+		prepare_pmd_huge_pte(pgtable, dst_mm);
+		dst_mm->nr_ptes++;
+		ret = 0;
+		goto out_unlock;
+	}
 	VM_BUG_ON(!PageHead(src_page));
 	get_page(src_page);
 	page_dup_rmap(src_page);
@@ -877,6 +996,36 @@ out_free_pages:
 	goto out;
 }
 
+/*
+ * Write fault on a read-only pagecache pmd of a shared mapping: there
+ * is nothing to copy, the pmd just becomes writable and dirty.  If the
+ * vma isn't writable (a forced write through ptrace) break the pmd up
+ * and let the pte fault path do the COW.
+ */
+static int do_huge_pmd_file_wp_page(struct mm_struct *mm,
+				    struct vm_area_struct *vma,
+				    unsigned long address, pmd_t *pmd,
+				    pmd_t orig_pmd)
+{
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	int ret = 0;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_same(*pmd, orig_pmd)))
+		goto out_unlock;
+	if (vma->vm_flags & VM_WRITE) {
+		pmd_t entry;
+		entry = pmd_mkyoung(pmd_mkwrite(pmd_mkdirty(orig_pmd)));
+		if (pmdp_set_access_flags(vma, haddr, pmd, entry,  1))
+			update_mmu_cache(vma, address, entry);
+		ret |= VM_FAULT_WRITE;
+	} else
+		__split_huge_file_pmd(vma, haddr, pmd);
+out_unlock:
+	spin_unlock(&mm->page_table_lock);
+	return ret;
+}
+
 int do_huge_pmd_wp_page(struct mm_struct *mm, struct vm_area_struct *vma,
 			unsigned long address, pmd_t *pmd, pmd_t orig_pmd)
 {
@@ -884,6 +1033,9 @@ int do_huge_pmd_wp_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	struct page *page, *new_page;
 	unsigned long haddr;
 
+	if (vma->vm_ops)
+		return do_huge_pmd_file_wp_page(mm, vma, address, pmd,
+						orig_pmd);
 	VM_BUG_ON(!vma->anon_vma);
 	spin_lock(&mm->page_table_lock);
 	if (unlikely(!pmd_same(*pmd, orig_pmd)))
@@ -971,7 +1123,7 @@ struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 		goto out;
 
 	page = pmd_page(*pmd);
-	VM_BUG_ON(!PageHead(page));
+	VM_BUG_ON(PageAnon(page) && !PageHead(page));
 	if (flags & FOLL_TOUCH) {
 		pmd_t _pmd;
 		/*
@@ -986,7 +1138,7 @@ struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 		set_pmd_at(mm, addr & HPAGE_PMD_MASK, pmd, _pmd);
 	}
 	page += (addr & ~HPAGE_PMD_MASK) >> PAGE_SHIFT;
-	VM_BUG_ON(!PageCompound(page));
+	VM_BUG_ON(PageAnon(page) && !PageCompound(page));
 	if (flags & FOLL_GET)
 		get_page_foll(page);
 
@@ -994,8 +1146,37 @@ out:
 	return page;
 }
 
+static void zap_huge_file_pmd(struct mmu_gather *tlb,
+			      struct vm_area_struct *vma,
+			      pmd_t *pmd, unsigned long addr)
+{
+	struct mm_struct *mm = tlb->mm;
+	struct page *page;
+	pgtable_t pgtable;
+	pmd_t orig_pmd;
+	int i;
+
+	pgtable = get_pmd_huge_pte(mm);
+	orig_pmd = pmdp_get_and_clear(mm, addr, pmd);
+	page = pmd_page(orig_pmd);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (pmd_dirty(orig_pmd))
+			set_page_dirty(page + i);
+		if (pmd_young(orig_pmd) &&
+		    likely(!VM_SequentialReadHint(vma)))
+			mark_page_accessed(page + i);
+		page_remove_rmap(page + i);
+	}
+	add_mm_counter(mm, file_rss, -HPAGE_PMD_NR);
+	mm->nr_ptes--;
+	spin_unlock(&mm->page_table_lock);
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		tlb_remove_page(tlb, page + i);
+	pte_free(mm, pgtable);
+}
+
 int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
-		 pmd_t *pmd)
+		 pmd_t *pmd, unsigned long addr)
 {
 	int ret = 0;
 
@@ -1005,6 +1186,9 @@ int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
 			spin_unlock(&tlb->mm->page_table_lock);
 			wait_split_huge_page(vma->anon_vma,
 					     pmd);
+		} else if (!PageAnon(pmd_page(*pmd))) {
+			zap_huge_file_pmd(tlb, vma, pmd, addr);
+			ret = 1;
 		} else {
 			struct page *page;
 			pgtable_t pgtable;
@@ -1166,6 +1350,39 @@ out:
 	return ret;
 }
 
+/*
+ * Like page_check_address_pmd() for a pagecache page mapped by a huge
+ * pmd: @page is any of the HPAGE_PMD_NR pages behind the pmd. Returns
+ * with the page_table_lock held if the pmd was found.
+ */
+pmd_t *page_check_file_pmd(struct page *page, struct mm_struct *mm,
+			   unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return NULL;
+
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return NULL;
+
+	pmd = pmd_offset(pud, address);
+	if (!pmd_trans_huge(*pmd))
+		return NULL;
+
+	spin_lock(&mm->page_table_lock);
+	if (likely(pmd_trans_huge(*pmd)) &&
+	    pmd_page(*pmd) + ((address & ~HPAGE_PMD_MASK) >> PAGE_SHIFT) ==
+	    page)
+		return pmd;
+	spin_unlock(&mm->page_table_lock);
+	return NULL;
+}
+
 static int __split_huge_page_splitting(struct page *page,
 				       struct vm_area_struct *vma,
 				       unsigned long address)
@@ -1440,31 +1657,30 @@ out:
 	return ret;
 }
 
-int hugepage_madvise(unsigned long *vm_flags, int advice)
+int hugepage_madvise(struct vm_area_struct *vma,
+		     unsigned long *vm_flags, int advice)
 {
+	unsigned long bad_flags = VM_PFNMAP | VM_IO | VM_DONTEXPAND |
+		VM_RESERVED | VM_HUGETLB | VM_INSERTPAGE |
+		VM_MIXEDMAP | VM_SAO;
+
+	/*
+	 * Be somewhat over-protective like KSM for now! Shared
+	 * mappings are only allowed if the pagecache can map them
+	 * with huge pmds.
+	 */
+	if (!vma->vm_ops || !vma->vm_ops->pmd_fault)
+		bad_flags |= VM_SHARED | VM_MAYSHARE;
+
 	switch (advice) {
 	case MADV_HUGEPAGE:
-		/*
-		 * Be somewhat over-protective like KSM for now!
-		 */
-		if (*vm_flags & (VM_HUGEPAGE |
-				 VM_SHARED   | VM_MAYSHARE   |
-				 VM_PFNMAP   | VM_IO      | VM_DONTEXPAND |
-				 VM_RESERVED | VM_HUGETLB | VM_INSERTPAGE |
-				 VM_MIXEDMAP | VM_SAO))
+		if (*vm_flags & (VM_HUGEPAGE | bad_flags))
 			return -EINVAL;
 		*vm_flags &= ~VM_NOHUGEPAGE;
 		*vm_flags |= VM_HUGEPAGE;
 		break;
 	case MADV_NOHUGEPAGE:
-		/*
-		 * Be somewhat over-protective like KSM for now!
-		 */
-		if (*vm_flags & (VM_NOHUGEPAGE |
-				 VM_SHARED   | VM_MAYSHARE   |
-				 VM_PFNMAP   | VM_IO      | VM_DONTEXPAND |
-				 VM_RESERVED | VM_HUGETLB | VM_INSERTPAGE |
-				 VM_MIXEDMAP | VM_SAO))
+		if (*vm_flags & (VM_NOHUGEPAGE | bad_flags))
 			return -EINVAL;
 		*vm_flags &= ~VM_HUGEPAGE;
 		*vm_flags |= VM_NOHUGEPAGE;
@@ -1474,8 +1690,95 @@ int hugepage_madvise(unsigned long *vm_flags, int advice)
 	return 0;
 }
 
-void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
+/*
+ * Replace a pagecache huge pmd with a pte table mapping the same
+ * pages. Nothing has to happen to the pages themselves, they were
+ * never compound, so this is done entirely under the page_table_lock
+ * without going through the pmd_trans_splitting state.
+ */
+void __split_huge_file_pmd(struct vm_area_struct *vma, unsigned long haddr,
+			   pmd_t *pmd)
 {
+	struct mm_struct *mm = vma->vm_mm;
+	struct page *page = pmd_page(*pmd);
+	pgtable_t pgtable;
+	pmd_t _pmd = {0};
+	unsigned long addr;
+	int i;
+
+	VM_BUG_ON(spin_can_lock(&mm->page_table_lock));
+	VM_BUG_ON(haddr & ~HPAGE_PMD_MASK);
+	VM_BUG_ON(PageAnon(page));
+
+	pgtable = get_pmd_huge_pte(mm);
+	pmd_populate(mm, &_pmd, pgtable);
+
+	for (i = 0, addr = haddr; i < HPAGE_PMD_NR;
+	     i++, addr += PAGE_SIZE) {
+		pte_t *pte, entry;
+		entry = mk_pte(page + i, vma->vm_page_prot);
+		if (pmd_write(*pmd))
+			entry = pte_mkwrite(entry);
+		else
+			entry = pte_wrprotect(entry);
+		if (pmd_dirty(*pmd))
+			entry = pte_mkdirty(entry);
+		if (!pmd_young(*pmd))
+			entry = pte_mkold(entry);
+		pte = pte_offset_map(&_pmd, addr);
+		BUG_ON(!pte_none(*pte));
+		set_pte_at(mm, addr, pte, entry);
+		pte_unmap(pte);
+	}
+
+	smp_wmb(); /* make pte visible before pmd */
+	/* see the comment about Erratum 383 in __split_huge_page_map() */
+	set_pmd_at(mm, haddr, pmd, pmd_mknotpresent(*pmd));
+	flush_tlb_range(vma, haddr, haddr + HPAGE_PMD_SIZE);
+	pmd_populate(mm, pmd, pgtable);
+	count_vm_event(THP_FILE_SPLIT_PMD);
+}
+
+/*
+ * rmap walkers operating on a single pte of a pagecache page call
+ * this first, as page_check_address() doesn't look into huge pmds.
+ * Caller holds the i_mmap_lock, not necessarily the mmap_sem.
+ */
+void split_huge_file_pmd_address(struct vm_area_struct *vma,
+				 unsigned long address)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return;
+
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return;
+
+	pmd = pmd_offset(pud, address);
+	if (!pmd_trans_huge(*pmd))
+		return;
+
+	spin_lock(&mm->page_table_lock);
+	if (likely(pmd_trans_huge(*pmd)))
+		__split_huge_file_pmd(vma, address & HPAGE_PMD_MASK, pmd);
+	spin_unlock(&mm->page_table_lock);
+}
+
+/*
+ * Split the huge pmd mapping address in vma.  Truncation of a tmpfs
+ * file gets here without the mmap_sem of the vma's mm, only with the
+ * i_mmap_lock, so the vma must come from the caller.
+ */
+void __split_huge_page_pmd(struct vm_area_struct *vma, unsigned long address,
+			   pmd_t *pmd)
+{
+	struct mm_struct *mm = vma->vm_mm;
 	struct page *page;
 
 	spin_lock(&mm->page_table_lock);
@@ -1484,6 +1787,11 @@ void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
 		return;
 	}
 	page = pmd_page(*pmd);
+	if (!PageAnon(page)) {
+		__split_huge_file_pmd(vma, address & HPAGE_PMD_MASK, pmd);
+		spin_unlock(&mm->page_table_lock);
+		return;
+	}
 	VM_BUG_ON(!page_count(page));
 	get_page(page);
 	spin_unlock(&mm->page_table_lock);
@@ -1494,6 +1802,24 @@ void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
 	BUG_ON(pmd_trans_huge(*pmd));
 }
 
+/*
+ * For page table walkers that don't know the vma.  They hold the
+ * mmap_sem, so the vma mapping a huge pmd can be looked up.
+ */
+void split_huge_page_pmd_mm(struct mm_struct *mm, unsigned long address,
+			    pmd_t *pmd)
+{
+	struct vm_area_struct *vma;
+
+	if (likely(!pmd_trans_huge(*pmd)))
+		return;
+
+	VM_BUG_ON(!rwsem_is_locked(&mm->mmap_sem));
+	vma = find_vma(mm, address);
+	BUG_ON(!vma || vma->vm_start > address);
+	split_huge_page_pmd(vma, address, pmd);
+}
+
 static int __init khugepaged_slab_init(void)
 {
 	mm_slot_cache = kmem_cache_create("khugepaged_mm_slot",
@@ -1610,15 +1936,23 @@ int __khugepaged_enter(struct mm_struct *mm)
 int khugepaged_enter_vma_merge(struct vm_area_struct *vma)
 {
 	unsigned long hstart, hend;
+	if (vma->vm_ops) {
+		/* khugepaged only works on pagecache it can map huge */
+		if (!vma->vm_ops->pmd_fault || !(vma->vm_flags & VM_SHARED) ||
+		    !shmem_huge_enabled(vma))
+			return 0;
+		hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
+		hend = vma->vm_end & HPAGE_PMD_MASK;
+		if (hstart < hend)
+			return khugepaged_enter_file(vma);
+		return 0;
+	}
 	if (!vma->anon_vma)
 		/*
 		 * Not yet faulted in so we will register later in the
 		 * page fault if needed.
 		 */
 		return 0;
-	if (vma->vm_ops)
-		/* khugepaged not yet working on file or special mappings */
-		return 0;
 	/*
 	 * If is_pfn_mapping() is true is_learn_pfn_mapping() must be
 	 * true too, verify it here.
@@ -2041,6 +2375,307 @@ out:
 	return ret;
 }
 
+static int khugepaged_file_vma(struct vm_area_struct *vma)
+{
+	if (!vma->vm_file || !(vma->vm_flags & VM_SHARED) ||
+	    vma->vm_flags & (VM_NONLINEAR | VM_NOHUGEPAGE))
+		return 0;
+	return shmem_huge_enabled(vma);
+}
+
+struct pagecache_collapse {
+	struct page *hpage;
+	pgoff_t start;
+	DECLARE_BITMAP(used, HPAGE_PMD_NR);
+};
+
+/*
+ * migrate_pages() callback: every page of the range goes to its slot
+ * in the new block. A slot is handed out only once, if migration has
+ * to retry a page the collapse is given up.
+ */
+static struct page *pagecache_collapse_new_page(struct page *page,
+						unsigned long private,
+						int **result)
+{
+	struct pagecache_collapse *cc = (struct pagecache_collapse *)private;
+	unsigned long i = page->index - cc->start;
+
+	if (i >= HPAGE_PMD_NR || test_and_set_bit(i, cc->used))
+		return NULL;
+	return cc->hpage + i;
+}
+
+/*
+ * Make the HPAGE_PMD_NR pagecache pages at @start physically
+ * contiguous and naturally aligned by migrating them into a freshly
+ * allocated block, split into order-0 pages like the ones the
+ * filesystem allocates itself. Returns 1 if the range is contiguous
+ * afterwards.
+ */
+static int khugepaged_collapse_pagecache(struct address_space *mapping,
+					 pgoff_t start)
+{
+	struct pagecache_collapse cc;
+	struct page **pages, *hpage;
+	LIST_HEAD(pagelist);
+	int i, nr, isolated, ret = 0;
+
+	pages = kmalloc(sizeof(struct page *) * HPAGE_PMD_NR, GFP_KERNEL);
+	if (unlikely(!pages))
+		return 0;
+
+	nr = find_get_pages_contig(mapping, start, HPAGE_PMD_NR, pages);
+	if (nr != HPAGE_PMD_NR)
+		goto out_put;
+	ret = !(page_to_pfn(pages[0]) & (HPAGE_PMD_NR - 1));
+	for (i = 1; ret && i < HPAGE_PMD_NR; i++)
+		ret = pages[i] == pages[0] + i;
+	if (ret)
+		goto out_put;
+
+	hpage = alloc_pages_exact_node(page_to_nid(pages[0]),
+				alloc_hugepage_gfpmask(khugepaged_defrag(), 0) &
+				~__GFP_COMP, HPAGE_PMD_ORDER);
+	if (unlikely(!hpage)) {
+		count_vm_event(THP_COLLAPSE_ALLOC_FAILED);
+		goto out_put;
+	}
+	count_vm_event(THP_COLLAPSE_ALLOC);
+	split_page(hpage, HPAGE_PMD_ORDER);
+
+	lru_add_drain();
+	for (isolated = 0; isolated < HPAGE_PMD_NR; isolated++) {
+		struct page *page = pages[isolated];
+
+		if (page->mapping != mapping || isolate_lru_page(page))
+			break;
+		list_add_tail(&page->lru, &pagelist);
+		inc_zone_page_state(page, NR_ISOLATED_ANON +
+				    page_is_file_cache(page));
+	}
+	/* migration wants only the pagecache and isolation references */
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		page_cache_release(pages[i]);
+	nr = 0;
+
+	cc.hpage = hpage;
+	cc.start = start;
+	bitmap_zero(cc.used, HPAGE_PMD_NR);
+	if (isolated == HPAGE_PMD_NR)
+		ret = !migrate_pages(&pagelist, pagecache_collapse_new_page,
+				     (unsigned long)&cc, false,
+				     MIGRATE_SYNC_LIGHT);
+	else
+		putback_lru_pages(&pagelist);
+
+	/* slots migration never asked for are still ours */
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		if (!test_bit(i, cc.used))
+			put_page(hpage + i);
+	if (ret)
+		count_vm_event(THP_COLLAPSE_FILE);
+out_put:
+	for (i = 0; i < nr; i++)
+		page_cache_release(pages[i]);
+	kfree(pages);
+	return ret;
+}
+
+/*
+ * Replace the pte table mapping a contiguous pagecache range with a
+ * huge pmd. The pte table is kept as the deposited pgtable for the
+ * eventual split. Called with the mmap_sem held for writing.
+ */
+static int collapse_file_pmd(struct mm_struct *mm,
+			     struct vm_area_struct *vma,
+			     unsigned long address)
+{
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	pgoff_t pgoff = linear_page_index(vma, address);
+	struct page **pages;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd, _pmd;
+	pte_t *pte;
+	pgtable_t pgtable;
+	spinlock_t *ptl;
+	pgoff_t size;
+	int i, nr, locked = 0, nr_none = 0, young = 0, ret = 0;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return 0;
+
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return 0;
+
+	pmd = pmd_offset(pud, address);
+	/* pmd can't go away or become huge under us */
+	if (!pmd_present(*pmd) || pmd_trans_huge(*pmd))
+		return 0;
+
+	pages = kmalloc(sizeof(struct page *) * HPAGE_PMD_NR, GFP_KERNEL);
+	if (unlikely(!pages))
+		return 0;
+
+	nr = find_get_pages_contig(mapping, pgoff, HPAGE_PMD_NR, pages);
+	if (nr != HPAGE_PMD_NR ||
+	    page_to_pfn(pages[0]) & (HPAGE_PMD_NR - 1))
+		goto out_put;
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		if (pages[i] != pages[0] + i)
+			goto out_put;
+	/* the page locks keep truncation and the rmap walkers away */
+	for (locked = 0; locked < HPAGE_PMD_NR; locked++) {
+		struct page *page = pages[locked];
+
+		if (!trylock_page(page))
+			goto out_unlock;
+		if (unlikely(page->mapping != mapping ||
+			     !PageUptodate(page))) {
+			unlock_page(page);
+			goto out_unlock;
+		}
+	}
+	size = (i_size_read(mapping->host) + PAGE_CACHE_SIZE - 1) >>
+		PAGE_CACHE_SHIFT;
+	if (pgoff + HPAGE_PMD_NR > size)
+		goto out_unlock;
+
+	spin_lock(&mapping->i_mmap_lock);
+	pte = pte_offset_map(pmd, address);
+	ptl = pte_lockptr(mm, pmd);
+
+	spin_lock(&mm->page_table_lock);
+	/* see collapse_huge_page() */
+	_pmd = pmdp_clear_flush_notify(vma, address, pmd);
+	spin_unlock(&mm->page_table_lock);
+
+	spin_lock(ptl);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		pte_t pteval = pte[i];
+
+		if (!pte_none(pteval) &&
+		    (!pte_present(pteval) ||
+		     pte_pfn(pteval) != page_to_pfn(pages[i])))
+			break;
+	}
+	if (i < HPAGE_PMD_NR) {
+		spin_unlock(ptl);
+		pte_unmap(pte);
+		spin_lock(&mm->page_table_lock);
+		BUG_ON(!pmd_none(*pmd));
+		set_pmd_at(mm, address, pmd, _pmd);
+		spin_unlock(&mm->page_table_lock);
+		spin_unlock(&mapping->i_mmap_lock);
+		goto out_unlock;
+	}
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		pte_t pteval = pte[i];
+
+		if (pte_none(pteval)) {
+			/* the huge pmd maps this page too */
+			get_page(pages[i]);
+			page_add_file_rmap(pages[i]);
+			nr_none++;
+			continue;
+		}
+		if (pte_dirty(pteval))
+			set_page_dirty(pages[i]);
+		if (pte_young(pteval))
+			young = 1;
+		pte_clear(mm, address + i * PAGE_SIZE, pte + i);
+	}
+	spin_unlock(ptl);
+	pte_unmap(pte);
+
+	pgtable = pmd_pgtable(_pmd);
+	_pmd = pmd_mkhuge(mk_pmd(pages[0], vma->vm_page_prot));
+	if (young)
+		_pmd = pmd_mkyoung(_pmd);
+
+	spin_lock(&mm->page_table_lock);
+	BUG_ON(!pmd_none(*pmd));
+	set_pmd_at(mm, address, pmd, _pmd);
+	update_mmu_cache(vma, address, _pmd);
+	prepare_pmd_huge_pte(pgtable, mm);
+	add_mm_counter(mm, file_rss, nr_none);
+	spin_unlock(&mm->page_table_lock);
+	spin_unlock(&mapping->i_mmap_lock);
+	ret = 1;
+
+out_unlock:
+	while (--locked >= 0)
+		unlock_page(pages[locked]);
+out_put:
+	for (i = 0; i < nr; i++)
+		page_cache_release(pages[i]);
+	kfree(pages);
+	return ret;
+}
+
+/*
+ * Scan one HPAGE_PMD_SIZE range of a shared pagecache mapping that is
+ * still mapped by ptes: make its pages contiguous if needed, then map
+ * them with a huge pmd. Returns 1 if the mmap_sem has been released.
+ */
+static int khugepaged_scan_file_pmd(struct mm_struct *mm,
+				    struct vm_area_struct *vma,
+				    unsigned long address)
+{
+	struct address_space *mapping;
+	struct file *file;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+	pgoff_t pgoff;
+
+	VM_BUG_ON(address & ~HPAGE_PMD_MASK);
+
+	pgoff = linear_page_index(vma, address);
+	if (pgoff & (HPAGE_PMD_NR - 1))
+		return 0;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return 0;
+
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return 0;
+
+	/* a none pmd is left to the pmd_fault of the next access */
+	pmd = pmd_offset(pud, address);
+	if (!pmd_present(*pmd) || pmd_trans_huge(*pmd))
+		return 0;
+
+	file = vma->vm_file;
+	get_file(file);
+	mapping = file->f_mapping;
+	up_read(&mm->mmap_sem);
+
+	if (khugepaged_collapse_pagecache(mapping, pgoff)) {
+		down_write(&mm->mmap_sem);
+		if (unlikely(khugepaged_test_exit(mm)))
+			goto out_up_write;
+		vma = find_vma(mm, address);
+		if (!vma || vma->vm_file != file ||
+		    address < vma->vm_start ||
+		    address + HPAGE_PMD_SIZE > vma->vm_end ||
+		    linear_page_index(vma, address) != pgoff ||
+		    !khugepaged_file_vma(vma))
+			goto out_up_write;
+		if (collapse_file_pmd(mm, vma, address))
+			khugepaged_pages_collapsed++;
+out_up_write:
+		up_write(&mm->mmap_sem);
+	}
+	fput(file);
+	return 1;
+}
+
 static void collect_mm_slot(struct mm_slot *mm_slot)
 {
 	struct mm_struct *mm = mm_slot->mm;
@@ -2102,24 +2737,27 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			break;
 		}
 
-		if (!(vma->vm_flags & VM_HUGEPAGE) &&
-		    !khugepaged_always()) {
+		if (vma->vm_ops && vma->vm_ops->pmd_fault) {
+			if (!khugepaged_file_vma(vma))
+				goto skip;
+		} else if (!(vma->vm_flags & VM_HUGEPAGE) &&
+			   !khugepaged_always()) {
 		skip:
 			progress++;
 			continue;
+		} else {
+			if (!vma->anon_vma || vma->vm_ops)
+				goto skip;
+			if (is_vma_temporary_stack(vma))
+				goto skip;
+			/*
+			 * If is_pfn_mapping() is true is_learn_pfn_mapping()
+			 * must be true too, verify it here.
+			 */
+			VM_BUG_ON(is_linear_pfn_mapping(vma) ||
+				  vma->vm_flags & VM_NO_THP);
 		}
 
-		if (!vma->anon_vma || vma->vm_ops)
-			goto skip;
-		if (is_vma_temporary_stack(vma))
-			goto skip;
-		/*
-		 * If is_pfn_mapping() is true is_learn_pfn_mapping()
-		 * must be true too, verify it here.
-		 */
-		VM_BUG_ON(is_linear_pfn_mapping(vma) ||
-			  vma->vm_flags & VM_NO_THP);
-
 		hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
 		hend = vma->vm_end & HPAGE_PMD_MASK;
 		if (hstart >= hend)
@@ -2139,9 +2777,13 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			VM_BUG_ON(khugepaged_scan.address < hstart ||
 				  khugepaged_scan.address + HPAGE_PMD_SIZE >
 				  hend);
-			ret = khugepaged_scan_pmd(mm, vma,
-						  khugepaged_scan.address,
-						  hpage);
+			if (vma->vm_ops)
+				ret = khugepaged_scan_file_pmd(mm, vma,
+						khugepaged_scan.address);
+			else
+				ret = khugepaged_scan_pmd(mm, vma,
+						khugepaged_scan.address,
+						hpage);
 			/* move to next address */
 			khugepaged_scan.address += HPAGE_PMD_SIZE;
 			progress += HPAGE_PMD_NR;
@@ -2336,9 +2978,10 @@ static int khugepaged(void *none)
 	return 0;
 }
 
-static void split_huge_page_address(struct mm_struct *mm,
+static void split_huge_page_address(struct vm_area_struct *vma,
 				    unsigned long address)
 {
+	struct mm_struct *mm = vma->vm_mm;
 	pgd_t *pgd;
 	pud_t *pud;
 	pmd_t *pmd;
@@ -2360,7 +3003,7 @@ static void split_huge_page_address(struct mm_struct *mm,
 	 * Caller holds the mmap_sem write mode, so a huge pmd cannot
 	 * materialize from under us.
 	 */
-	split_huge_page_pmd(mm, pmd);
+	split_huge_page_pmd(vma, address, pmd);
 }
 
 void __vma_adjust_trans_huge(struct vm_area_struct *vma,
@@ -2376,7 +3019,7 @@ void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 	if (start & ~HPAGE_PMD_MASK &&
 	    (start & HPAGE_PMD_MASK) >= vma->vm_start &&
 	    (start & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= vma->vm_end)
-		split_huge_page_address(vma->vm_mm, start);
+		split_huge_page_address(vma, start);
 
 	/*
 	 * If the new end address isn't hpage aligned and it could
@@ -2386,7 +3029,7 @@ void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 	if (end & ~HPAGE_PMD_MASK &&
 	    (end & HPAGE_PMD_MASK) >= vma->vm_start &&
 	    (end & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= vma->vm_end)
-		split_huge_page_address(vma->vm_mm, end);
+		split_huge_page_address(vma, end);
 
 	/*
 	 * If we're also updating the vma->vm_next->vm_start, if the new
@@ -2400,6 +3043,6 @@ void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 		if (nstart & ~HPAGE_PMD_MASK &&
 		    (nstart & HPAGE_PMD_MASK) >= next->vm_start &&
 		    (nstart & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= next->vm_end)
-			split_huge_page_address(next->vm_mm, nstart);
+			split_huge_page_address(next, nstart);
 	}
 }
@@ -16,6 +16,12 @@
 void free_pgtables(struct mmu_gather *tlb, struct vm_area_struct *start_vma,
 		unsigned long floor, unsigned long ceiling);
 
+void put_vma(struct vm_area_struct *vma);
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+struct vm_area_struct *get_vma_speculative(struct mm_struct *mm,
+		unsigned long addr, unsigned int *seq);
+#endif
+
 static inline void set_page_count(struct page *page, int v)
 {
 	atomic_set(&page->_count, v);
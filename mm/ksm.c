@@ -89,6 +89,13 @@
  *
  * If the merge_across_nodes tunable is unset, then KSM maintains multiple
  * stable trees and multiple unstable trees: one of each for each NUMA node.
+ *
+ * A ksm page is shared by at most max_page_sharing rmap_items, so that the
+ * rmap walks of reclaim and migration stay bounded even for pages like the
+ * zero page which may be mapped by millions of ptes. When the stable tree
+ * node of some content is full, further copies of that content are merged
+ * into duplicate ksm pages, chained off the stable tree node rather than
+ * linked into the tree themselves.
  */
 
 /**
@@ -124,10 +131,14 @@ struct ksm_scan {
 /**
  * struct stable_node - node of the stable rbtree
  * @node: rb node of this ksm page in the stable tree
- * @head: (overlaying parent) &migrate_nodes indicates temporarily on that list
+ * @head: (overlaying parent) &migrate_nodes indicates temporarily on that list,
+ *	&stable_node_dups indicates chained as a duplicate off a tree node
  * @list: linked into migrate_nodes, pending placement in the proper node tree
+ * @hlist_dup: linked into the @dups of the stable tree node with this content
  * @hlist: hlist head of rmap_items using this ksm page
+ * @dups: hlist head of duplicate ksm pages, when this node is full
  * @kpfn: page frame number of this ksm page (perhaps temporarily on wrong nid)
+ * @rmap_hlist_len: number of rmap_items on @hlist
  * @nid: NUMA node id of stable tree in which linked (may not match kpfn)
  */
 struct stable_node {
@@ -135,11 +146,16 @@ struct stable_node {
 		struct rb_node node;	/* when node of stable tree */
 		struct {		/* when listed for migration */
 			struct list_head *head;
-			struct list_head list;
+			union {
+				struct list_head list;
+				struct hlist_node hlist_dup;
+			};
 		};
 	};
 	struct hlist_head hlist;
+	struct hlist_head dups;
 	unsigned long kpfn;
+	unsigned int rmap_hlist_len;
 #ifdef CONFIG_NUMA
 	int nid;
 #endif
@@ -190,6 +206,9 @@ static struct rb_root *root_unstable_tree = one_unstable_tree;
 /* Recently migrated nodes of stable tree, pending proper placement */
 static LIST_HEAD(migrate_nodes);
 
+/* Only its address is used: the @head of stable_nodes chained as dups */
+static LIST_HEAD(stable_node_dups);
+
 #define MM_SLOTS_HASH_HEADS 1024
 static struct hlist_head *mm_slots_hash;
 
@@ -216,12 +235,38 @@ static unsigned long ksm_pages_unshared;
 /* The number of rmap_items in use: to calculate pages_volatile */
 static unsigned long ksm_rmap_items;
 
+/* The number of duplicate ksm pages chained off stable tree nodes */
+static unsigned long ksm_stable_node_dups;
+
+/* Maximum number of page slots sharing one ksm page */
+static unsigned int ksm_max_page_sharing = 256;
+
 /* Number of pages ksmd should scan in one batch */
 static unsigned int ksm_thread_pages_to_scan = 100;
 
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Set when ksmd adapts pages_to_scan to how much it has been merging */
+static unsigned int ksm_auto_scan;
+
+/* Bounds within which ksmd adapts pages_to_scan */
+static unsigned int ksm_auto_min_pages_to_scan = 100;
+static unsigned int ksm_auto_max_pages_to_scan = 10000;
+
+/* Page slots merged by the current batch */
+static unsigned long ksm_batch_merged;
+
+/* Decaying average of page slots merged per 10000 scanned */
+static unsigned int ksm_scan_yield;
+
+/*
+ * Scan yields (in 1/100th of a percent) above which ksmd doubles, and
+ * below which it halves, pages_to_scan when auto_scan is set.
+ */
+#define KSM_AUTO_YIELD_HIGH	100
+#define KSM_AUTO_YIELD_LOW	10
+
 #ifdef CONFIG_NUMA
 /* Zeroed when merging across nodes is not allowed */
 static unsigned int ksm_merge_across_nodes = 1;
@@ -509,6 +554,43 @@ static inline int get_kpfn_nid(unsigned long kpfn)
 	return ksm_merge_across_nodes ? 0 : pfn_to_nid(kpfn);
 }
 
+static inline bool is_stable_node_dup(struct stable_node *stable_node)
+{
+	return stable_node->head == &stable_node_dups;
+}
+
+/*
+ * Take a stable tree node out of its tree, or out of the chain of the tree
+ * node it is a duplicate of.  When a tree node goes, its place and its
+ * chain of duplicates are handed over to @new (a node from migrate_nodes,
+ * already taken off that list by the caller), or else to its first dup.
+ */
+static void stable_node_unlink(struct stable_node *stable_node,
+			       struct stable_node *new)
+{
+	struct rb_root *root = root_stable_tree + NUMA(stable_node->nid);
+
+	if (is_stable_node_dup(stable_node)) {
+		hlist_del(&stable_node->hlist_dup);
+		ksm_stable_node_dups--;
+		return;
+	}
+
+	if (!new && !hlist_empty(&stable_node->dups)) {
+		new = hlist_entry(stable_node->dups.first,
+				  struct stable_node, hlist_dup);
+		hlist_del(&new->hlist_dup);
+		ksm_stable_node_dups--;
+	}
+
+	if (new) {
+		rb_replace_node(&stable_node->node, &new->node, root);
+		hlist_move_list(&stable_node->dups, &new->dups);
+		DO_NUMA(new->nid = stable_node->nid);
+	} else
+		rb_erase(&stable_node->node, root);
+}
+
 static void remove_node_from_stable_tree(struct stable_node *stable_node)
 {
 	struct rmap_item *rmap_item;
@@ -527,8 +609,7 @@ static void remove_node_from_stable_tree(struct stable_node *stable_node)
 	if (stable_node->head == &migrate_nodes)
 		list_del(&stable_node->list);
 	else
-		rb_erase(&stable_node->node,
-			 root_stable_tree + NUMA(stable_node->nid));
+		stable_node_unlink(stable_node, NULL);
 	free_stable_node(stable_node);
 }
 
@@ -640,6 +721,7 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 			goto out;
 
 		hlist_del(&rmap_item->hlist);
+		stable_node->rmap_hlist_len--;
 		unlock_page(page);
 		put_page(page);
 
@@ -1151,6 +1233,35 @@ static struct page *try_to_merge_two_pages(struct rmap_item *rmap_item,
 	return err ? NULL : page;
 }
 
+/*
+ * stable_node_dup_search - find a duplicate ksm page with room for another
+ * rmap_item, among those chained off a full stable tree node.
+ *
+ * This function returns the ksm page of that duplicate, NULL otherwise.
+ */
+static struct page *stable_node_dup_search(struct stable_node *chain)
+{
+	struct stable_node *dup;
+	struct hlist_node *hlist, *hnext;
+	struct page *tree_page;
+
+	hlist_for_each_entry_safe(dup, hlist, hnext, &chain->dups, hlist_dup) {
+		if (dup->rmap_hlist_len >= ksm_max_page_sharing)
+			continue;
+		if (get_kpfn_nid(dup->kpfn) != NUMA(dup->nid))
+			continue;
+
+		cond_resched();
+		/* A stale dup is removed from the chain by get_ksm_page */
+		tree_page = get_ksm_page(dup, true);
+		if (tree_page) {
+			unlock_page(tree_page);
+			return tree_page;
+		}
+	}
+	return NULL;
+}
+
 /*
  * stable_tree_search - search for page inside the stable tree
  *
@@ -1216,7 +1327,19 @@ again:
 					put_page(tree_page);
 					goto replace;
 				}
-				return tree_page;
+				if (stable_node->rmap_hlist_len <
+						ksm_max_page_sharing)
+					return tree_page;
+				put_page(tree_page);
+				/*
+				 * This ksm page is shared as widely as we
+				 * allow: a migrated ksm page of the same
+				 * content is chained as one of its dups,
+				 * anything else must merge into a dup.
+				 */
+				if (page_node)
+					goto chain;
+				return stable_node_dup_search(stable_node);
 			}
 			/*
 			 * There is now a place for page_node, but the tree may
@@ -1241,16 +1364,24 @@ again:
 replace:
 	if (page_node) {
 		list_del(&page_node->list);
-		DO_NUMA(page_node->nid = nid);
-		rb_replace_node(&stable_node->node, &page_node->node, root);
+		stable_node_unlink(stable_node, page_node);
 		get_page(page);
 	} else {
-		rb_erase(&stable_node->node, root);
+		stable_node_unlink(stable_node, NULL);
 		page = NULL;
 	}
 	stable_node->head = &migrate_nodes;
 	list_add(&stable_node->list, stable_node->head);
 	return page;
+
+chain:
+	list_del(&page_node->list);
+	DO_NUMA(page_node->nid = nid);
+	page_node->head = &stable_node_dups;
+	hlist_add_head(&page_node->hlist_dup, &stable_node->dups);
+	ksm_stable_node_dups++;
+	get_page(page);
+	return page;
 }
 
 /*
@@ -1268,6 +1399,7 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 	struct rb_node **new;
 	struct rb_node *parent = NULL;
 	struct stable_node *stable_node;
+	struct stable_node *chain = NULL;
 
 	kpfn = page_to_pfn(kpage);
 	nid = get_kpfn_nid(kpfn);
@@ -1294,11 +1426,14 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 			new = &parent->rb_right;
 		else {
 			/*
-			 * It is not a bug that stable_tree_search() didn't
-			 * find this node: because at that time our page was
-			 * not yet write-protected, so may have changed since.
+			 * stable_tree_search() didn't give us this node either
+			 * because it and all its dups are shared as widely as
+			 * we allow, or because at that time our page was not
+			 * yet write-protected, so may have changed since.
+			 * Either way, chain kpage as another dup of it.
 			 */
-			return NULL;
+			chain = stable_node;
+			break;
 		}
 	}
 
@@ -1307,11 +1442,19 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 		return NULL;
 
 	INIT_HLIST_HEAD(&stable_node->hlist);
+	INIT_HLIST_HEAD(&stable_node->dups);
 	stable_node->kpfn = kpfn;
+	stable_node->rmap_hlist_len = 0;
 	set_page_stable_node(kpage, stable_node);
 	DO_NUMA(stable_node->nid = nid);
-	rb_link_node(&stable_node->node, parent, new);
-	rb_insert_color(&stable_node->node, root);
+	if (chain) {
+		stable_node->head = &stable_node_dups;
+		hlist_add_head(&stable_node->hlist_dup, &chain->dups);
+		ksm_stable_node_dups++;
+	} else {
+		rb_link_node(&stable_node->node, parent, new);
+		rb_insert_color(&stable_node->node, root);
+	}
 
 	return stable_node;
 }
@@ -1408,10 +1551,12 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 	rmap_item->head = stable_node;
 	rmap_item->address |= STABLE_FLAG;
 	hlist_add_head(&rmap_item->hlist, &stable_node->hlist);
+	stable_node->rmap_hlist_len++;
 
-	if (rmap_item->hlist.next)
+	if (rmap_item->hlist.next) {
 		ksm_pages_sharing++;
-	else
+		ksm_batch_merged++;
+	} else
 		ksm_pages_shared++;
 }
 
@@ -1437,8 +1582,7 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	if (stable_node) {
 		if (stable_node->head != &migrate_nodes &&
 		    get_kpfn_nid(stable_node->kpfn) != NUMA(stable_node->nid)) {
-			rb_erase(&stable_node->node,
-				 root_stable_tree + NUMA(stable_node->nid));
+			stable_node_unlink(stable_node, NULL);
 			stable_node->head = &migrate_nodes;
 			list_add(&stable_node->list, stable_node->head);
 		}
@@ -1698,19 +1842,58 @@ next_mm:
 /**
  * ksm_do_scan  - the ksm scanner main worker function.
  * @scan_npages - number of pages we want to scan before we return.
+ *
+ * Returns the number of pages actually scanned.
  */
-static void ksm_do_scan(unsigned int scan_npages)
+static unsigned int ksm_do_scan(unsigned int scan_npages)
 {
 	struct rmap_item *rmap_item;
 	struct page *uninitialized_var(page);
+	unsigned int scanned = 0;
 
-	while (scan_npages-- && likely(!freezing(current))) {
+	while (scanned < scan_npages && likely(!freezing(current))) {
 		cond_resched();
 		rmap_item = scan_get_next_rmap_item(&page);
 		if (!rmap_item)
-			return;
+			break;
 		cmp_and_merge_page(page, rmap_item);
 		put_page(page);
+		scanned++;
+	}
+	return scanned;
+}
+
+/*
+ * Scanning at a fixed rate either wastes cpu on memory that has nothing
+ * left to merge, or leaves duplicates unmerged for long when there is.
+ * With auto_scan set, ksmd follows the merge yield of recent batches:
+ * doubling pages_to_scan while more than 1% of scanned pages are being
+ * merged, halving it while fewer than 0.1% are.
+ */
+static void ksm_auto_tune(unsigned int scanned)
+{
+	unsigned int yield;
+
+	if (!scanned)
+		return;
+
+	yield = min_t(unsigned long, ksm_batch_merged * 10000 / scanned, 10000);
+	ksm_batch_merged = 0;
+	ksm_scan_yield = (ksm_scan_yield * 3 + yield) / 4;
+
+	if (!ksm_auto_scan)
+		return;
+
+	if (ksm_scan_yield >= KSM_AUTO_YIELD_HIGH) {
+		if (ksm_thread_pages_to_scan < ksm_auto_max_pages_to_scan / 2)
+			ksm_thread_pages_to_scan *= 2;
+		else
+			ksm_thread_pages_to_scan = ksm_auto_max_pages_to_scan;
+	} else if (ksm_scan_yield < KSM_AUTO_YIELD_LOW) {
+		if (ksm_thread_pages_to_scan / 2 > ksm_auto_min_pages_to_scan)
+			ksm_thread_pages_to_scan /= 2;
+		else
+			ksm_thread_pages_to_scan = ksm_auto_min_pages_to_scan;
 	}
 }
 
@@ -1728,7 +1911,7 @@ static int ksm_scan_thread(void *nothing)
 		mutex_lock(&ksm_thread_mutex);
 		wait_while_offlining();
 		if (ksmd_should_run())
-			ksm_do_scan(ksm_thread_pages_to_scan);
+			ksm_auto_tune(ksm_do_scan(ksm_thread_pages_to_scan));
 		mutex_unlock(&ksm_thread_mutex);
 
 		try_to_freeze();
@@ -2101,8 +2284,9 @@ static void wait_while_offlining(void)
 static void ksm_check_stable_tree(unsigned long start_pfn,
 				  unsigned long end_pfn)
 {
-	struct stable_node *stable_node;
+	struct stable_node *stable_node, *dup;
 	struct list_head *this, *next;
+	struct hlist_node *hlist, *hnext;
 	struct rb_node *node;
 	int nid;
 
@@ -2110,6 +2294,12 @@ static void ksm_check_stable_tree(unsigned long start_pfn,
 		node = rb_first(root_stable_tree + nid);
 		while (node) {
 			stable_node = rb_entry(node, struct stable_node, node);
+			hlist_for_each_entry_safe(dup, hlist, hnext,
+						  &stable_node->dups, hlist_dup) {
+				if (dup->kpfn >= start_pfn &&
+				    dup->kpfn < end_pfn)
+					remove_node_from_stable_tree(dup);
+			}
 			if (stable_node->kpfn >= start_pfn &&
 			    stable_node->kpfn < end_pfn) {
 				/*
@@ -2237,6 +2427,99 @@ static ssize_t pages_to_scan_store(struct kobject *kobj,
 }
 KSM_ATTR(pages_to_scan);
 
+static ssize_t auto_scan_show(struct kobject *kobj,
+			      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_auto_scan);
+}
+
+static ssize_t auto_scan_store(struct kobject *kobj,
+			       struct kobj_attribute *attr,
+			       const char *buf, size_t count)
+{
+	int err;
+	unsigned long knob;
+
+	err = strict_strtoul(buf, 10, &knob);
+	if (err || knob > 1)
+		return -EINVAL;
+
+	ksm_auto_scan = knob;
+
+	return count;
+}
+KSM_ATTR(auto_scan);
+
+static ssize_t pages_to_scan_min_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_auto_min_pages_to_scan);
+}
+
+static ssize_t pages_to_scan_min_store(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       const char *buf, size_t count)
+{
+	int err;
+	unsigned long nr_pages;
+
+	err = strict_strtoul(buf, 10, &nr_pages);
+	if (err || !nr_pages || nr_pages > ksm_auto_max_pages_to_scan)
+		return -EINVAL;
+
+	ksm_auto_min_pages_to_scan = nr_pages;
+
+	return count;
+}
+KSM_ATTR(pages_to_scan_min);
+
+static ssize_t pages_to_scan_max_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_auto_max_pages_to_scan);
+}
+
+static ssize_t pages_to_scan_max_store(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       const char *buf, size_t count)
+{
+	int err;
+	unsigned long nr_pages;
+
+	err = strict_strtoul(buf, 10, &nr_pages);
+	if (err || nr_pages < ksm_auto_min_pages_to_scan || nr_pages > UINT_MAX)
+		return -EINVAL;
+
+	ksm_auto_max_pages_to_scan = nr_pages;
+
+	return count;
+}
+KSM_ATTR(pages_to_scan_max);
+
+static ssize_t max_page_sharing_show(struct kobject *kobj,
+				     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_max_page_sharing);
+}
+
+static ssize_t max_page_sharing_store(struct kobject *kobj,
+				      struct kobj_attribute *attr,
+				      const char *buf, size_t count)
+{
+	int err;
+	unsigned long knob;
+
+	err = strict_strtoul(buf, 10, &knob);
+	/* One rmap_item would make the ksm page pointless */
+	if (err || knob < 2 || knob > UINT_MAX)
+		return -EINVAL;
+
+	ksm_max_page_sharing = knob;
+
+	return count;
+}
+KSM_ATTR(max_page_sharing);
+
 static ssize_t run_show(struct kobject *kobj, struct kobj_attribute *attr,
 			char *buf)
 {
@@ -2390,15 +2673,27 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t stable_node_dups_show(struct kobject *kobj,
+				     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_stable_node_dups);
+}
+KSM_ATTR_RO(stable_node_dups);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
+	&auto_scan_attr.attr,
+	&pages_to_scan_min_attr.attr,
+	&pages_to_scan_max_attr.attr,
+	&max_page_sharing_attr.attr,
 	&run_attr.attr,
 	&pages_shared_attr.attr,
 	&pages_sharing_attr.attr,
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&stable_node_dups_attr.attr,
 #ifdef CONFIG_NUMA
 	&merge_across_nodes_attr.attr,
 #endif
@@ -17,7 +17,7 @@
  * GNU General Public License for more details.
  */
 
-#include <linux/res_counter.h>
+#include <linux/page_counter.h>
 #include <linux/memcontrol.h>
 #include <linux/cgroup.h>
 #include <linux/mm.h>
@@ -30,7 +30,6 @@
 #include <linux/rcupdate.h>
 #include <linux/limits.h>
 #include <linux/mutex.h>
-#include <linux/rbtree.h>
 #include <linux/slab.h>
 #include <linux/swap.h>
 #include <linux/swapops.h>
@@ -59,8 +58,6 @@ static int really_do_swap_account __initdata = 1; /* for remember boot option*/
 #define do_swap_account		(0)
 #endif
 
-#define SOFTLIMIT_EVENTS_THRESH (1000)
-
 /*
  * Statistics for memory cgroup.
  */
@@ -73,7 +70,6 @@ enum mem_cgroup_stat_index {
 	MEM_CGROUP_STAT_FILE_MAPPED,  /* # of pages charged as file rss */
 	MEM_CGROUP_STAT_PGPGIN_COUNT,	/* # of pages paged in */
 	MEM_CGROUP_STAT_PGPGOUT_COUNT,	/* # of pages paged out */
-	MEM_CGROUP_STAT_EVENTS,	/* sum of pagein + pageout for internal use */
 	MEM_CGROUP_STAT_SWAPOUT, /* # of pages, swapped out */
 
 	MEM_CGROUP_STAT_NSTATS,
@@ -87,20 +83,6 @@ struct mem_cgroup_stat {
 	struct mem_cgroup_stat_cpu cpustat[0];
 };
 
-static inline void
-__mem_cgroup_stat_reset_safe(struct mem_cgroup_stat_cpu *stat,
-				enum mem_cgroup_stat_index idx)
-{
-	stat->count[idx] = 0;
-}
-
-static inline s64
-__mem_cgroup_stat_read_local(struct mem_cgroup_stat_cpu *stat,
-				enum mem_cgroup_stat_index idx)
-{
-	return stat->count[idx];
-}
-
 /*
  * For accounting under irq disable, no need for increment preempt count.
  */
@@ -120,15 +102,6 @@ static s64 mem_cgroup_read_stat(struct mem_cgroup_stat *stat,
 	return ret;
 }
 
-static s64 mem_cgroup_local_usage(struct mem_cgroup_stat *stat)
-{
-	s64 ret;
-
-	ret = mem_cgroup_read_stat(stat, MEM_CGROUP_STAT_CACHE);
-	ret += mem_cgroup_read_stat(stat, MEM_CGROUP_STAT_RSS);
-	return ret;
-}
-
 struct mem_cgroup_reclaim_iter {
 	/* css_id of the last scanned hierarchy member */
 	int position;
@@ -146,10 +119,6 @@ struct mem_cgroup_per_zone {
 	struct mem_cgroup_reclaim_iter reclaim_iter[DEF_PRIORITY + 1];
 
 	struct zone_reclaim_stat reclaim_stat;
-	struct rb_node		tree_node;	/* RB tree node */
-	unsigned long long	usage_in_excess;/* Set to the value by which */
-						/* the soft limit is exceeded*/
-	bool			on_tree;
 	struct mem_cgroup	*mem;		/* Back pointer, we cannot */
 						/* use container_of	   */
 };
@@ -164,26 +133,6 @@ struct mem_cgroup_lru_info {
 	struct mem_cgroup_per_node *nodeinfo[MAX_NUMNODES];
 };
 
-/*
- * Cgroups above their limits are maintained in a RB-Tree, independent of
- * their hierarchy representation
- */
-
-struct mem_cgroup_tree_per_zone {
-	struct rb_root rb_root;
-	spinlock_t lock;
-};
-
-struct mem_cgroup_tree_per_node {
-	struct mem_cgroup_tree_per_zone rb_tree_per_zone[MAX_NR_ZONES];
-};
-
-struct mem_cgroup_tree {
-	struct mem_cgroup_tree_per_node *rb_tree_per_node[MAX_NUMNODES];
-};
-
-static struct mem_cgroup_tree soft_limit_tree __read_mostly;
-
 /* for OOM */
 struct mem_cgroup_eventfd_list {
 	struct list_head list;
@@ -208,11 +157,15 @@ struct mem_cgroup {
 	/*
 	 * the counter to account for memory usage
 	 */
-	struct res_counter res;
+	struct page_counter memory;
 	/*
 	 * the counter to account for mem+swap usage.
 	 */
-	struct res_counter memsw;
+	struct page_counter memsw;
+	/*
+	 * soft limit of memory usage, in pages
+	 */
+	unsigned long soft_limit;
 	/*
 	 * Per cgroup active and inactive list, similar to the
 	 * per zone LRU lists.
@@ -240,7 +193,7 @@ struct mem_cgroup {
 	/* OOM-Killer disable */
 	int		oom_kill_disable;
 
-	/* set when res.limit == memsw.limit */
+	/* set when memory.limit == memsw.limit */
 	bool		memsw_is_minimum;
 
 	/* For oom notifier event fd */
@@ -296,11 +249,10 @@ static bool move_file(void)
 }
 
 /*
- * Maximum loops in mem_cgroup_hierarchical_reclaim(), used for soft
- * limit reclaim to prevent infinite loops, if they ever occur.
+ * Maximum loops in mem_cgroup_reclaim(), to prevent infinite loops,
+ * if they ever occur.
  */
 #define	MEM_CGROUP_MAX_RECLAIM_LOOPS		(100)
-#define	MEM_CGROUP_MAX_SOFT_LIMIT_RECLAIM_LOOPS	(2)
 
 enum charge_type {
 	MEM_CGROUP_CHARGE_TYPE_CACHE = 0,
@@ -320,6 +272,14 @@ enum charge_type {
 #define PCGF_ACCT	(1UL << PCG_ACCT)
 
 /* for encoding cft->private value on file */
+enum {
+	RES_USAGE,
+	RES_MAX_USAGE,
+	RES_LIMIT,
+	RES_FAILCNT,
+	RES_SOFT_LIMIT,
+};
+
 #define _MEM			(0)
 #define _MEMSWAP		(1)
 #define _OOM_TYPE		(2)
@@ -362,184 +322,38 @@ page_cgroup_zoneinfo(struct mem_cgroup *mem, struct page *page)
 	return mem_cgroup_zoneinfo(mem, nid, zid);
 }
 
-static struct mem_cgroup_tree_per_zone *
-soft_limit_tree_node_zone(int nid, int zid)
-{
-	return &soft_limit_tree.rb_tree_per_node[nid]->rb_tree_per_zone[zid];
-}
-
-static struct mem_cgroup_tree_per_zone *
-soft_limit_tree_from_page(struct page *page)
-{
-	int nid = page_to_nid(page);
-	int zid = page_zonenum(page);
-
-	return &soft_limit_tree.rb_tree_per_node[nid]->rb_tree_per_zone[zid];
-}
-
-static void
-__mem_cgroup_insert_exceeded(struct mem_cgroup *mem,
-				struct mem_cgroup_per_zone *mz,
-				struct mem_cgroup_tree_per_zone *mctz,
-				unsigned long long new_usage_in_excess)
-{
-	struct rb_node **p = &mctz->rb_root.rb_node;
-	struct rb_node *parent = NULL;
-	struct mem_cgroup_per_zone *mz_node;
-
-	if (mz->on_tree)
-		return;
-
-	mz->usage_in_excess = new_usage_in_excess;
-	if (!mz->usage_in_excess)
-		return;
-	while (*p) {
-		parent = *p;
-		mz_node = rb_entry(parent, struct mem_cgroup_per_zone,
-					tree_node);
-		if (mz->usage_in_excess < mz_node->usage_in_excess)
-			p = &(*p)->rb_left;
-		/*
-		 * We can't avoid mem cgroups that are over their soft
-		 * limit by the same amount
-		 */
-		else if (mz->usage_in_excess >= mz_node->usage_in_excess)
-			p = &(*p)->rb_right;
-	}
-	rb_link_node(&mz->tree_node, parent, p);
-	rb_insert_color(&mz->tree_node, &mctz->rb_root);
-	mz->on_tree = true;
-}
-
-static void
-__mem_cgroup_remove_exceeded(struct mem_cgroup *mem,
-				struct mem_cgroup_per_zone *mz,
-				struct mem_cgroup_tree_per_zone *mctz)
-{
-	if (!mz->on_tree)
-		return;
-	rb_erase(&mz->tree_node, &mctz->rb_root);
-	mz->on_tree = false;
-}
-
-static void
-mem_cgroup_remove_exceeded(struct mem_cgroup *mem,
-				struct mem_cgroup_per_zone *mz,
-				struct mem_cgroup_tree_per_zone *mctz)
-{
-	spin_lock(&mctz->lock);
-	__mem_cgroup_remove_exceeded(mem, mz, mctz);
-	spin_unlock(&mctz->lock);
-}
-
-static bool mem_cgroup_soft_limit_check(struct mem_cgroup *mem)
-{
-	bool ret = false;
-	int cpu;
-	s64 val;
-	struct mem_cgroup_stat_cpu *cpustat;
-
-	cpu = get_cpu();
-	cpustat = &mem->stat.cpustat[cpu];
-	val = __mem_cgroup_stat_read_local(cpustat, MEM_CGROUP_STAT_EVENTS);
-	if (unlikely(val > SOFTLIMIT_EVENTS_THRESH)) {
-		__mem_cgroup_stat_reset_safe(cpustat, MEM_CGROUP_STAT_EVENTS);
-		ret = true;
-	}
-	put_cpu();
-	return ret;
-}
-
-static void mem_cgroup_update_tree(struct mem_cgroup *mem, struct page *page)
-{
-	unsigned long long excess;
-	struct mem_cgroup_per_zone *mz;
-	struct mem_cgroup_tree_per_zone *mctz;
-	int nid = page_to_nid(page);
-	int zid = page_zonenum(page);
-	mctz = soft_limit_tree_from_page(page);
-
-	/*
-	 * Necessary to update all ancestors when hierarchy is used.
-	 * because their event counter is not touched.
-	 */
-	for (; mem; mem = parent_mem_cgroup(mem)) {
-		mz = mem_cgroup_zoneinfo(mem, nid, zid);
-		excess = res_counter_soft_limit_excess(&mem->res);
-		/*
-		 * We have to update the tree if mz is on RB-tree or
-		 * mem is over its softlimit.
-		 */
-		if (excess || mz->on_tree) {
-			spin_lock(&mctz->lock);
-			/* if on-tree, remove it */
-			if (mz->on_tree)
-				__mem_cgroup_remove_exceeded(mem, mz, mctz);
-			/*
-			 * Insert again. mz->usage_in_excess will be updated.
-			 * If excess is 0, no tree ops.
-			 */
-			__mem_cgroup_insert_exceeded(mem, mz, mctz, excess);
-			spin_unlock(&mctz->lock);
-		}
-	}
-}
-
-static void mem_cgroup_remove_from_trees(struct mem_cgroup *mem)
-{
-	int node, zone;
-	struct mem_cgroup_per_zone *mz;
-	struct mem_cgroup_tree_per_zone *mctz;
-
-	for_each_node_state(node, N_POSSIBLE) {
-		for (zone = 0; zone < MAX_NR_ZONES; zone++) {
-			mz = mem_cgroup_zoneinfo(mem, node, zone);
-			mctz = soft_limit_tree_node_zone(node, zone);
-			mem_cgroup_remove_exceeded(mem, mz, mctz);
-		}
-	}
-}
-
-static inline unsigned long mem_cgroup_get_excess(struct mem_cgroup *mem)
+/*
+ * Number of pages by which the memcg's usage exceeds its soft limit,
+ * or 0 if it is within it.
+ */
+static unsigned long soft_limit_excess(struct mem_cgroup *mem)
 {
-	return res_counter_soft_limit_excess(&mem->res) >> PAGE_SHIFT;
-}
+	unsigned long nr_pages = page_counter_read(&mem->memory);
+	unsigned long soft_limit = ACCESS_ONCE(mem->soft_limit);
 
-static struct mem_cgroup_per_zone *
-__mem_cgroup_largest_soft_limit_node(struct mem_cgroup_tree_per_zone *mctz)
-{
-	struct rb_node *rightmost = NULL;
-	struct mem_cgroup_per_zone *mz;
-
-retry:
-	mz = NULL;
-	rightmost = rb_last(&mctz->rb_root);
-	if (!rightmost)
-		goto done;		/* Nothing to reclaim from */
-
-	mz = rb_entry(rightmost, struct mem_cgroup_per_zone, tree_node);
-	/*
-	 * Remove the node now but someone else can add it back,
-	 * we will to add it back at the end of reclaim to its correct
-	 * position in the tree.
-	 */
-	__mem_cgroup_remove_exceeded(mz->mem, mz, mctz);
-	if (!res_counter_soft_limit_excess(&mz->mem->res) ||
-		!css_tryget(&mz->mem->css))
-		goto retry;
-done:
-	return mz;
+	if (nr_pages <= soft_limit)
+		return 0;
+	return nr_pages - soft_limit;
 }
 
-static struct mem_cgroup_per_zone *
-mem_cgroup_largest_soft_limit_node(struct mem_cgroup_tree_per_zone *mctz)
+/**
+ * mem_cgroup_soft_reclaim_eligible - should soft limit reclaim scan a memcg
+ * @memcg: the memcg about to be scanned
+ * @root: the root of the hierarchy under reclaim, NULL for global reclaim
+ *
+ * Returns true if @memcg or one of its ancestors up to @root is above
+ * its soft limit.
+ */
+bool mem_cgroup_soft_reclaim_eligible(struct mem_cgroup *memcg,
+				      struct mem_cgroup *root)
 {
-	struct mem_cgroup_per_zone *mz;
-
-	spin_lock(&mctz->lock);
-	mz = __mem_cgroup_largest_soft_limit_node(mctz);
-	spin_unlock(&mctz->lock);
-	return mz;
+	do {
+		if (soft_limit_excess(memcg))
+			return true;
+		if (memcg == root)
+			break;
+	} while ((memcg = parent_mem_cgroup(memcg)));
+	return false;
 }
 
 static void mem_cgroup_swap_statistics(struct mem_cgroup *mem,
@@ -578,7 +392,6 @@ static void mem_cgroup_charge_statistics(struct mem_cgroup *mem,
 	else
 		__mem_cgroup_stat_add_safe(cpustat,
 				MEM_CGROUP_STAT_PGPGOUT_COUNT, 1);
-	__mem_cgroup_stat_add_safe(cpustat, MEM_CGROUP_STAT_EVENTS, 1);
 	put_cpu();
 }
 
@@ -1105,28 +918,37 @@ mem_cgroup_get_reclaim_stat_from_page(struct page *page)
 	return &mz->reclaim_stat;
 }
 
-#define mem_cgroup_from_res_counter(counter, member)	\
+#define mem_cgroup_from_counter(counter, member)	\
 	container_of(counter, struct mem_cgroup, member)
 
 static bool mem_cgroup_check_under_limit(struct mem_cgroup *mem)
 {
-	if (do_swap_account) {
-		if (res_counter_check_under_limit(&mem->res) &&
-			res_counter_check_under_limit(&mem->memsw))
-			return true;
-	} else
-		if (res_counter_check_under_limit(&mem->res))
-			return true;
-	return false;
+	if (page_counter_read(&mem->memory) >= ACCESS_ONCE(mem->memory.limit))
+		return false;
+	if (do_swap_account &&
+	    page_counter_read(&mem->memsw) >= ACCESS_ONCE(mem->memsw.limit))
+		return false;
+	return true;
 }
 
-static bool mem_cgroup_check_room(struct mem_cgroup *mem, unsigned long room)
+/*
+ * Returns true if at least @nr_pages can still be charged to @mem
+ * without hitting its limit.
+ */
+static bool mem_cgroup_check_room(struct mem_cgroup *mem,
+				  unsigned long nr_pages)
 {
-	if (!res_counter_check_room(&mem->res, room))
+	unsigned long count, limit;
+
+	count = page_counter_read(&mem->memory);
+	limit = ACCESS_ONCE(mem->memory.limit);
+	if (count > limit || limit - count < nr_pages)
 		return false;
 	if (!do_swap_account)
 		return true;
-	return res_counter_check_room(&mem->memsw, room);
+	count = page_counter_read(&mem->memsw);
+	limit = ACCESS_ONCE(mem->memsw.limit);
+	return count <= limit && limit - count >= nr_pages;
 }
 
 static unsigned int get_swappiness(struct mem_cgroup *memcg)
@@ -1201,15 +1023,15 @@ void mem_cgroup_print_oom_info(struct mem_cgroup *memcg, struct task_struct *p)
 	printk(KERN_CONT " as a result of limit of %s\n", memcg_name);
 done:
 
-	printk(KERN_INFO "memory: usage %llukB, limit %llukB, failcnt %llu\n",
-		res_counter_read_u64(&memcg->res, RES_USAGE) >> 10,
-		res_counter_read_u64(&memcg->res, RES_LIMIT) >> 10,
-		res_counter_read_u64(&memcg->res, RES_FAILCNT));
+	printk(KERN_INFO "memory: usage %llukB, limit %llukB, failcnt %lu\n",
+		(u64)page_counter_read(&memcg->memory) << (PAGE_SHIFT - 10),
+		(u64)memcg->memory.limit << (PAGE_SHIFT - 10),
+		memcg->memory.failcnt);
 	printk(KERN_INFO "memory+swap: usage %llukB, limit %llukB, "
-		"failcnt %llu\n",
-		res_counter_read_u64(&memcg->memsw, RES_USAGE) >> 10,
-		res_counter_read_u64(&memcg->memsw, RES_LIMIT) >> 10,
-		res_counter_read_u64(&memcg->memsw, RES_FAILCNT));
+		"failcnt %lu\n",
+		(u64)page_counter_read(&memcg->memsw) << (PAGE_SHIFT - 10),
+		(u64)memcg->memsw.limit << (PAGE_SHIFT - 10),
+		memcg->memsw.failcnt);
 }
 
 /*
@@ -1233,7 +1055,7 @@ u64 mem_cgroup_get_limit(struct mem_cgroup *memcg)
 {
 	u64 limit;
 
-	limit = res_counter_read_u64(&memcg->res, RES_LIMIT);
+	limit = (u64)memcg->memory.limit << PAGE_SHIFT;
 
 	/*
 	 * Do not consider swap space if we cannot swap due to swappiness
@@ -1242,7 +1064,7 @@ u64 mem_cgroup_get_limit(struct mem_cgroup *memcg)
 		u64 memsw;
 
 		limit += total_swap_pages << PAGE_SHIFT;
-		memsw = res_counter_read_u64(&memcg->memsw, RES_LIMIT);
+		memsw = (u64)memcg->memsw.limit << PAGE_SHIFT;
 
 		/*
 		 * If memsw is finite and limits the amount of swap space
@@ -1291,58 +1113,6 @@ static unsigned long mem_cgroup_reclaim(struct mem_cgroup *memcg,
 	return total;
 }
 
-static int mem_cgroup_soft_reclaim(struct mem_cgroup *root_mem,
-				   struct zone *zone,
-				   gfp_t gfp_mask)
-{
-	struct mem_cgroup *victim = NULL;
-	int total = 0;
-	int loop = 0;
-	unsigned long excess = mem_cgroup_get_excess(root_mem);
-	struct mem_cgroup_reclaim_cookie reclaim = {
-		.zone = zone,
-		.priority = 0,
-	};
-
-	while (1) {
-		victim = mem_cgroup_iter(root_mem, victim, &reclaim);
-		if (!victim) {
-			loop++;
-			if (loop >= 2) {
-				/*
-				 * If we have not been able to reclaim
-				 * anything, it might because there are
-				 * no reclaimable pages under this hierarchy
-				 */
-				if (!total)
-					break;
-				/*
-				 * We want to do more targetted reclaim.
-				 * excess >> 2 is not to excessive so as to
-				 * reclaim too much, nor too less that we keep
-				 * coming back to reclaim from this cgroup
-				 */
-				if (total >= (excess >> 2) ||
-					(loop > MEM_CGROUP_MAX_RECLAIM_LOOPS))
-					break;
-			}
-			continue;
-		}
-		if (!mem_cgroup_local_usage(&victim->stat)) {
-			/* this cgroup's local usage == 0 */
-			continue;
-		}
-
-		total += mem_cgroup_shrink_node_zone(victim, gfp_mask, false,
-						get_swappiness(victim), zone,
-						zone->zone_pgdat->node_id);
-		if (res_counter_check_under_soft_limit(&root_mem->res))
-			break;
-	}
-	mem_cgroup_iter_break(root_mem, victim);
-	return total;
-}
-
 /*
  * Check OOM-Killer is already running under our hierarchy.
  * If someone is running, return false.
@@ -1557,49 +1327,72 @@ done:
  * size of first charge trial. "32" comes from vmscan.c's magic value.
  * TODO: maybe necessary to use big numbers in big irons.
  */
-#define CHARGE_SIZE	(32 * PAGE_SIZE)
+#define CHARGE_BATCH	32U
+/*
+ * Number of memcgs that can have charges stocked on a cpu at the same
+ * time, so that tasks of nested or sibling groups sharing a cpu do not
+ * keep draining each other's stock.
+ */
+#define MEMCG_NR_STOCK	4
 struct memcg_stock_pcp {
-	struct mem_cgroup *cached; /* this never be root cgroup */
-	int charge;
+	struct mem_cgroup *cached[MEMCG_NR_STOCK]; /* never the root cgroup */
+	unsigned int nr_pages[MEMCG_NR_STOCK];
+	unsigned int next;	/* slot to recycle when all are in use */
 	struct work_struct work;
 };
 static DEFINE_PER_CPU(struct memcg_stock_pcp, memcg_stock);
 static atomic_t memcg_drain_count;
 
 /*
- * Try to consume stocked charge on this cpu. If success, PAGE_SIZE is consumed
- * from local stock and true is returned. If the stock is 0 or charges from a
- * cgroup which is not current target, returns false. This stock will be
- * refilled.
+ * Try to consume stocked charge on this cpu. If success, one page is consumed
+ * from local stock and true is returned. If there is no stock for this
+ * cgroup on this cpu, returns false. This stock will be refilled.
  */
 static bool consume_stock(struct mem_cgroup *mem)
 {
 	struct memcg_stock_pcp *stock;
-	bool ret = true;
+	bool ret = false;
+	int i;
 
 	stock = &get_cpu_var(memcg_stock);
-	if (mem == stock->cached && stock->charge)
-		stock->charge -= PAGE_SIZE;
-	else /* need to call res_counter_charge */
-		ret = false;
+	for (i = 0; i < MEMCG_NR_STOCK; i++) {
+		if (stock->cached[i] == mem && stock->nr_pages[i]) {
+			stock->nr_pages[i]--;
+			ret = true;
+			break;
+		}
+	}
 	put_cpu_var(memcg_stock);
 	return ret;
 }
 
 /*
- * Returns stocks cached in percpu to res_counter and reset cached information.
+ * Returns the charges cached in one percpu slot to the page counters and
+ * resets it.
  */
-static void drain_stock(struct memcg_stock_pcp *stock)
+static void drain_stock_slot(struct memcg_stock_pcp *stock, int i)
 {
-	struct mem_cgroup *old = stock->cached;
+	struct mem_cgroup *old = stock->cached[i];
 
-	if (stock->charge) {
-		res_counter_uncharge(&old->res, stock->charge);
+	if (stock->nr_pages[i]) {
+		page_counter_uncharge(&old->memory, stock->nr_pages[i]);
 		if (do_swap_account)
-			res_counter_uncharge(&old->memsw, stock->charge);
+			page_counter_uncharge(&old->memsw, stock->nr_pages[i]);
 	}
-	stock->cached = NULL;
-	stock->charge = 0;
+	stock->cached[i] = NULL;
+	stock->nr_pages[i] = 0;
+}
+
+/*
+ * Returns stocks cached in percpu to the page counters and reset cached
+ * information.
+ */
+static void drain_stock(struct memcg_stock_pcp *stock)
+{
+	int i;
+
+	for (i = 0; i < MEMCG_NR_STOCK; i++)
+		drain_stock_slot(stock, i);
 }
 
 /*
@@ -1613,26 +1406,38 @@ static void drain_local_stock(struct work_struct *dummy)
 }
 
 /*
- * Cache charges(val) which is from res_counter, to local per_cpu area.
- * This will be consumed by consumt_stock() function, later.
+ * Cache charges(nr_pages) which are from the page counters, to local
+ * per_cpu area. This will be consumed by consume_stock() function, later.
+ * If all slots are taken by other cgroups, they are recycled round-robin.
  */
-static void refill_stock(struct mem_cgroup *mem, int val)
+static void refill_stock(struct mem_cgroup *mem, unsigned int nr_pages)
 {
 	struct memcg_stock_pcp *stock = &get_cpu_var(memcg_stock);
+	int i, slot = -1;
 
-	if (stock->cached != mem) { /* reset if necessary */
-		drain_stock(stock);
-		stock->cached = mem;
+	for (i = 0; i < MEMCG_NR_STOCK; i++) {
+		if (stock->cached[i] == mem) {
+			slot = i;
+			break;
+		}
+		if (slot < 0 && !stock->cached[i])
+			slot = i;
+	}
+	if (slot < 0) { /* recycle if necessary */
+		slot = stock->next;
+		stock->next = (slot + 1) % MEMCG_NR_STOCK;
+		drain_stock_slot(stock, slot);
 	}
-	stock->charge += val;
+	stock->cached[slot] = mem;
+	stock->nr_pages[slot] += nr_pages;
 	put_cpu_var(memcg_stock);
 }
 
 /*
  * Tries to drain stocked charges in other cpus. This function is asynchronous
  * and just put a work per cpu for draining localy on each cpu. Caller can
- * expects some charges will be back to res_counter later but cannot wait for
- * it.
+ * expects some charges will be back to the page counters later but cannot
+ * wait for it.
  */
 static void drain_all_stock_async(void)
 {
@@ -1688,10 +1493,11 @@ static int __mem_cgroup_try_charge(struct mm_struct *mm,
 				   gfp_t gfp_mask, struct mem_cgroup **memcg,
 				   bool oom, struct page *page, int page_size)
 {
-	unsigned int batch = max_t(unsigned int, CHARGE_SIZE, page_size);
+	unsigned int nr_pages = page_size >> PAGE_SHIFT;
+	unsigned int batch = max(CHARGE_BATCH, nr_pages);
 	struct mem_cgroup *mem, *mem_over_limit;
 	int nr_retries = MEM_CGROUP_RECLAIM_RETRIES;
-	struct res_counter *fail_res;
+	struct page_counter *counter;
 
 	/*
 	 * Unlike gloval-vm's OOM-kill, we're not in memory shortage
@@ -1716,7 +1522,7 @@ again:
 		VM_BUG_ON(css_is_removed(&mem->css));
 		if (mem_cgroup_is_root(mem))
 			goto done;
-		if (page_size == PAGE_SIZE && consume_stock(mem))
+		if (nr_pages == 1 && consume_stock(mem))
 			goto done;
 		css_get(&mem->css);
 	} else {
@@ -1739,7 +1545,7 @@ again:
 			rcu_read_unlock();
 			goto done;
 		}
-		if (page_size == PAGE_SIZE && consume_stock(mem)) {
+		if (nr_pages == 1 && consume_stock(mem)) {
 			/*
 			 * It seems dagerous to access memcg without css_get().
 			 * But considering how consume_stok works, it's not
@@ -1763,26 +1569,27 @@ again:
 		int ret = 0;
 		unsigned long flags = 0;
 
-		ret = res_counter_charge(&mem->res, batch, &fail_res);
+		ret = page_counter_try_charge(&mem->memory, batch, &counter);
 		if (likely(!ret)) {
 			if (!do_swap_account)
 				break;
-			ret = res_counter_charge(&mem->memsw, batch, &fail_res);
+			ret = page_counter_try_charge(&mem->memsw, batch,
+						      &counter);
 			if (likely(!ret))
 				break;
 			/* mem+swap counter fails */
-			res_counter_uncharge(&mem->res, batch);
+			page_counter_uncharge(&mem->memory, batch);
 			flags |= MEM_CGROUP_RECLAIM_NOSWAP;
-			mem_over_limit = mem_cgroup_from_res_counter(fail_res,
-									memsw);
+			mem_over_limit = mem_cgroup_from_counter(counter,
+								 memsw);
 		} else
 			/* mem counter fails */
-			mem_over_limit = mem_cgroup_from_res_counter(fail_res,
-									res);
+			mem_over_limit = mem_cgroup_from_counter(counter,
+								 memory);
 
 		/* reduce request size and retry */
-		if (batch == CHARGE_SIZE) {
-			batch = PAGE_SIZE;
+		if (batch > nr_pages) {
+			batch = nr_pages;
 			continue;
 		}
 		if (!(gfp_mask & __GFP_WAIT))
@@ -1790,7 +1597,7 @@ again:
 
 		mem_cgroup_reclaim(mem_over_limit, gfp_mask, flags);
 
-		if (mem_cgroup_check_room(mem_over_limit, page_size))
+		if (mem_cgroup_check_room(mem_over_limit, nr_pages))
 			continue;
 		/* try to avoid oom while someone is moving charge */
 		if (mc.moving_task && current != mc.moving_task) {
@@ -1847,15 +1654,9 @@ again:
                 }
 
 	}
-	if (batch == CHARGE_SIZE)
-		refill_stock(mem, batch - PAGE_SIZE);
+	if (batch > nr_pages)
+		refill_stock(mem, batch - nr_pages);
 	css_put(&mem->css);
-	/*
-	 * Insert ancestor (and ancestor's ancestors), to softlimit RB-tree.
-	 * if they exceeds softlimit.
-	 */
-	if (page && mem_cgroup_soft_limit_check(mem))
-		mem_cgroup_update_tree(mem, page);
 done:
 	*memcg = mem;
 	return 0;
@@ -1877,9 +1678,9 @@ static void __mem_cgroup_cancel_charge(struct mem_cgroup *mem,
 							unsigned long count)
 {
 	if (!mem_cgroup_is_root(mem)) {
-		res_counter_uncharge(&mem->res, PAGE_SIZE * count);
+		page_counter_uncharge(&mem->memory, count);
 		if (do_swap_account)
-			res_counter_uncharge(&mem->memsw, PAGE_SIZE * count);
+			page_counter_uncharge(&mem->memsw, count);
 	}
 }
 
@@ -2296,7 +2097,7 @@ __mem_cgroup_commit_charge_swapin(struct page *page, struct mem_cgroup *ptr,
 			 * calling css_tryget
 			 */
 			if (!mem_cgroup_is_root(memcg))
-				res_counter_uncharge(&memcg->memsw, PAGE_SIZE);
+				page_counter_uncharge(&memcg->memsw, 1);
 			mem_cgroup_swap_statistics(memcg, false);
 			mem_cgroup_put(memcg);
 		}
@@ -2338,7 +2139,7 @@ __do_uncharge(struct mem_cgroup *mem, const enum charge_type ctype, int page_siz
 	batch = &current->memcg_batch;
 	/*
 	 * In usual, we do css_get() when we remember memcg pointer.
-	 * But in this case, we keep res->usage until end of a series of
+	 * But in this case, we keep memory usage until end of a series of
 	 * uncharges. Then, it's ok to ignore memcg's refcnt.
 	 */
 	if (!batch->memcg)
@@ -2359,20 +2160,20 @@ __do_uncharge(struct mem_cgroup *mem, const enum charge_type ctype, int page_siz
 
 	/*
 	 * In typical case, batch->memcg == mem. This means we can
-	 * merge a series of uncharges to an uncharge of res_counter.
-	 * If not, we uncharge res_counter ony by one.
+	 * merge a series of uncharges to an uncharge of the page counter.
+	 * If not, we uncharge the page counter ony by one.
 	 */
 	if (batch->memcg != mem)
 		goto direct_uncharge;
 	/* remember freed charge and uncharge it later */
-	batch->bytes += page_size;
+	batch->nr_pages++;
 	if (uncharge_memsw)
-		batch->memsw_bytes += page_size;
+		batch->memsw_nr_pages++;
 	return;
 direct_uncharge:
-	res_counter_uncharge(&mem->res, page_size);
+	page_counter_uncharge(&mem->memory, page_size >> PAGE_SHIFT);
 	if (uncharge_memsw)
-		res_counter_uncharge(&mem->memsw, page_size);
+		page_counter_uncharge(&mem->memsw, page_size >> PAGE_SHIFT);
 	if (unlikely(batch->memcg != mem))
 		memcg_oom_recover(mem);
 	return;
@@ -2442,11 +2243,9 @@ __mem_cgroup_uncharge_common(struct page *page, enum charge_type ctype)
 	 */
 	unlock_page_cgroup(pc);
 	/*
-	 * even after unlock, we have memcg->res.usage here and this memcg
+	 * even after unlock, we have memcg->memory usage here and this memcg
 	 * will never be freed.
 	 */
-	if (mem_cgroup_soft_limit_check(mem))
-		mem_cgroup_update_tree(mem, page);
 	if (do_swap_account && ctype == MEM_CGROUP_CHARGE_TYPE_SWAPOUT) {
 		mem_cgroup_swap_statistics(mem, true);
 		mem_cgroup_get(mem);
@@ -2529,8 +2328,8 @@ void mem_cgroup_uncharge_start(void)
 	/* We can do nest. */
 	if (current->memcg_batch.do_batch == 1) {
 		current->memcg_batch.memcg = NULL;
-		current->memcg_batch.bytes = 0;
-		current->memcg_batch.memsw_bytes = 0;
+		current->memcg_batch.nr_pages = 0;
+		current->memcg_batch.memsw_nr_pages = 0;
 	}
 }
 
@@ -2551,10 +2350,11 @@ void mem_cgroup_uncharge_end(void)
 	 * This "batch->memcg" is valid without any css_get/put etc...
 	 * bacause we hide charges behind us.
 	 */
-	if (batch->bytes)
-		res_counter_uncharge(&batch->memcg->res, batch->bytes);
-	if (batch->memsw_bytes)
-		res_counter_uncharge(&batch->memcg->memsw, batch->memsw_bytes);
+	if (batch->nr_pages)
+		page_counter_uncharge(&batch->memcg->memory, batch->nr_pages);
+	if (batch->memsw_nr_pages)
+		page_counter_uncharge(&batch->memcg->memsw,
+				      batch->memsw_nr_pages);
 	memcg_oom_recover(batch->memcg);
 	/* forget this pointer (for sanity check) */
 	batch->memcg = NULL;
@@ -2607,7 +2407,7 @@ void mem_cgroup_uncharge_swap(swp_entry_t ent)
 		 * This memcg can be obsolete one. We avoid calling css_tryget
 		 */
 		if (!mem_cgroup_is_root(memcg))
-			res_counter_uncharge(&memcg->memsw, PAGE_SIZE);
+			page_counter_uncharge(&memcg->memsw, 1);
 		mem_cgroup_swap_statistics(memcg, false);
 		mem_cgroup_put(memcg);
 	}
@@ -2619,14 +2419,14 @@ void mem_cgroup_uncharge_swap(swp_entry_t ent)
  * @entry: swap entry to be moved
  * @from:  mem_cgroup which the entry is moved from
  * @to:  mem_cgroup which the entry is moved to
- * @need_fixup: whether we should fixup res_counters and refcounts.
+ * @need_fixup: whether we should fixup page counters and refcounts.
  *
  * It succeeds only when the swap_cgroup's record for this entry is the same
  * as the mem_cgroup's id of @from.
  *
  * Returns 0 on success, -EINVAL on failure.
  *
- * The caller must have charged to @to, IOW, called res_counter_charge() about
+ * The caller must have charged to @to, IOW, called page_counter_charge() about
  * both res and memsw, and called css_get().
  */
 static int mem_cgroup_move_swap_account(swp_entry_t entry,
@@ -2642,7 +2442,7 @@ static int mem_cgroup_move_swap_account(swp_entry_t entry,
 		mem_cgroup_swap_statistics(to, true);
 		/*
 		 * This function is only called from task migration context now.
-		 * It postpones res_counter and refcount handling till the end
+		 * It postpones page counter and refcount handling till the end
 		 * of task migration(mem_cgroup_clear_mc()) for performance
 		 * improvement. But we cannot postpone mem_cgroup_get(to)
 		 * because if the process that has been moved to @to does
@@ -2651,14 +2451,14 @@ static int mem_cgroup_move_swap_account(swp_entry_t entry,
 		mem_cgroup_get(to);
 		if (need_fixup) {
 			if (!mem_cgroup_is_root(from))
-				res_counter_uncharge(&from->memsw, PAGE_SIZE);
+				page_counter_uncharge(&from->memsw, 1);
 			mem_cgroup_put(from);
 			/*
-			 * we charged both to->res and to->memsw, so we should
-			 * uncharge to->res.
+			 * we charged both to->memory and to->memsw, so we
+			 * should uncharge to->memory.
 			 */
 			if (!mem_cgroup_is_root(to))
-				res_counter_uncharge(&to->res, PAGE_SIZE);
+				page_counter_uncharge(&to->memory, 1);
 		}
 		return 0;
 	}
@@ -2866,14 +2666,14 @@ void mem_cgroup_print_bad_page(struct page *page)
 static DEFINE_MUTEX(set_limit_mutex);
 
 static int mem_cgroup_resize_limit(struct mem_cgroup *memcg,
-				unsigned long long val)
+				unsigned long val)
 {
 	int retry_count;
 	int progress;
-	u64 memswlimit, memlimit;
+	unsigned long memswlimit, memlimit;
 	int ret = 0;
 	int children = mem_cgroup_count_children(memcg);
-	u64 curusage, oldusage;
+	unsigned long curusage, oldusage;
 	int enlarge;
 
 	/*
@@ -2883,7 +2683,7 @@ static int mem_cgroup_resize_limit(struct mem_cgroup *memcg,
 	 */
 	retry_count = MEM_CGROUP_RECLAIM_RETRIES * children;
 
-	oldusage = res_counter_read_u64(&memcg->res, RES_USAGE);
+	oldusage = page_counter_read(&memcg->memory);
 
 	enlarge = 0;
 	while (retry_count) {
@@ -2894,21 +2694,21 @@ static int mem_cgroup_resize_limit(struct mem_cgroup *memcg,
 		/*
 		 * Rather than hide all in some function, I do this in
 		 * open coded manner. You see what this really does.
-		 * We have to guarantee mem->res.limit < mem->memsw.limit.
+		 * We have to guarantee mem->memory.limit < mem->memsw.limit.
 		 */
 		mutex_lock(&set_limit_mutex);
-		memswlimit = res_counter_read_u64(&memcg->memsw, RES_LIMIT);
+		memswlimit = memcg->memsw.limit;
 		if (memswlimit < val) {
 			ret = -EINVAL;
 			mutex_unlock(&set_limit_mutex);
 			break;
 		}
 
-		memlimit = res_counter_read_u64(&memcg->res, RES_LIMIT);
+		memlimit = memcg->memory.limit;
 		if (memlimit < val)
 			enlarge = 1;
 
-		ret = res_counter_set_limit(&memcg->res, val);
+		ret = page_counter_limit(&memcg->memory, val);
 		if (!ret) {
 			if (memswlimit == val)
 				memcg->memsw_is_minimum = true;
@@ -2922,7 +2722,7 @@ static int mem_cgroup_resize_limit(struct mem_cgroup *memcg,
 
 		progress = mem_cgroup_reclaim(memcg, GFP_KERNEL,
 					      MEM_CGROUP_RECLAIM_SHRINK);
-		curusage = res_counter_read_u64(&memcg->res, RES_USAGE);
+		curusage = page_counter_read(&memcg->memory);
 		/* Usage is reduced ? */
   		if (curusage >= oldusage)
 			retry_count--;
@@ -2936,17 +2736,17 @@ static int mem_cgroup_resize_limit(struct mem_cgroup *memcg,
 }
 
 static int mem_cgroup_resize_memsw_limit(struct mem_cgroup *memcg,
-					unsigned long long val)
+					unsigned long val)
 {
 	int retry_count;
-	u64 memlimit, memswlimit, oldusage, curusage;
+	unsigned long memlimit, memswlimit, oldusage, curusage;
 	int children = mem_cgroup_count_children(memcg);
 	int ret = -EBUSY;
 	int enlarge = 0;
 
 	/* see mem_cgroup_resize_res_limit */
  	retry_count = children * MEM_CGROUP_RECLAIM_RETRIES;
-	oldusage = res_counter_read_u64(&memcg->memsw, RES_USAGE);
+	oldusage = page_counter_read(&memcg->memsw);
 	while (retry_count) {
 		if (signal_pending(current)) {
 			ret = -EINTR;
@@ -2955,19 +2755,19 @@ static int mem_cgroup_resize_memsw_limit(struct mem_cgroup *memcg,
 		/*
 		 * Rather than hide all in some function, I do this in
 		 * open coded manner. You see what this really does.
-		 * We have to guarantee mem->res.limit < mem->memsw.limit.
+		 * We have to guarantee mem->memory.limit < mem->memsw.limit.
 		 */
 		mutex_lock(&set_limit_mutex);
-		memlimit = res_counter_read_u64(&memcg->res, RES_LIMIT);
+		memlimit = memcg->memory.limit;
 		if (memlimit > val) {
 			ret = -EINVAL;
 			mutex_unlock(&set_limit_mutex);
 			break;
 		}
-		memswlimit = res_counter_read_u64(&memcg->memsw, RES_LIMIT);
+		memswlimit = memcg->memsw.limit;
 		if (memswlimit < val)
 			enlarge = 1;
-		ret = res_counter_set_limit(&memcg->memsw, val);
+		ret = page_counter_limit(&memcg->memsw, val);
 		if (!ret) {
 			if (memlimit == val)
 				memcg->memsw_is_minimum = true;
@@ -2982,7 +2782,7 @@ static int mem_cgroup_resize_memsw_limit(struct mem_cgroup *memcg,
 		mem_cgroup_reclaim(memcg, GFP_KERNEL,
 				   MEM_CGROUP_RECLAIM_NOSWAP |
 				   MEM_CGROUP_RECLAIM_SHRINK);
-		curusage = res_counter_read_u64(&memcg->memsw, RES_USAGE);
+		curusage = page_counter_read(&memcg->memsw);
 		/* Usage is reduced ? */
 		if (curusage >= oldusage)
 			retry_count--;
@@ -2994,95 +2794,6 @@ static int mem_cgroup_resize_memsw_limit(struct mem_cgroup *memcg,
 	return ret;
 }
 
-unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
-						gfp_t gfp_mask, int nid,
-						int zid)
-{
-	unsigned long nr_reclaimed = 0;
-	struct mem_cgroup_per_zone *mz, *next_mz = NULL;
-	unsigned long reclaimed;
-	int loop = 0;
-	struct mem_cgroup_tree_per_zone *mctz;
-	unsigned long long excess;
-
-	if (order > 0)
-		return 0;
-
-	mctz = soft_limit_tree_node_zone(nid, zid);
-	/*
-	 * This loop can run a while, specially if mem_cgroup's continuously
-	 * keep exceeding their soft limit and putting the system under
-	 * pressure
-	 */
-	do {
-		if (next_mz)
-			mz = next_mz;
-		else
-			mz = mem_cgroup_largest_soft_limit_node(mctz);
-		if (!mz)
-			break;
-
-		reclaimed = mem_cgroup_soft_reclaim(mz->mem, zone, gfp_mask);
-		nr_reclaimed += reclaimed;
-		spin_lock(&mctz->lock);
-
-		/*
-		 * If we failed to reclaim anything from this memory cgroup
-		 * it is time to move on to the next cgroup
-		 */
-		next_mz = NULL;
-		if (!reclaimed) {
-			do {
-				/*
-				 * Loop until we find yet another one.
-				 *
-				 * By the time we get the soft_limit lock
-				 * again, someone might have aded the
-				 * group back on the RB tree. Iterate to
-				 * make sure we get a different mem.
-				 * mem_cgroup_largest_soft_limit_node returns
-				 * NULL if no other cgroup is present on
-				 * the tree
-				 */
-				next_mz =
-				__mem_cgroup_largest_soft_limit_node(mctz);
-				if (next_mz == mz) {
-					css_put(&next_mz->mem->css);
-					next_mz = NULL;
-				} else /* next_mz == NULL or other memcg */
-					break;
-			} while (1);
-		}
-		__mem_cgroup_remove_exceeded(mz->mem, mz, mctz);
-		excess = res_counter_soft_limit_excess(&mz->mem->res);
-		/*
-		 * One school of thought says that we should not add
-		 * back the node to the tree if reclaim returns 0.
-		 * But our reclaim could return 0, simply because due
-		 * to priority we are exposing a smaller subset of
-		 * memory to reclaim from. Consider this as a longer
-		 * term TODO.
-		 */
-		/* If excess == 0, no tree ops */
-		__mem_cgroup_insert_exceeded(mz->mem, mz, mctz, excess);
-		spin_unlock(&mctz->lock);
-		css_put(&mz->mem->css);
-		loop++;
-		/*
-		 * Could not reclaim anything and there are no more
-		 * mem cgroups to try or we seem to be looping without
-		 * reclaiming anything.
-		 */
-		if (!nr_reclaimed &&
-			(next_mz == NULL ||
-			loop > MEM_CGROUP_MAX_SOFT_LIMIT_RECLAIM_LOOPS))
-			break;
-	} while (!nr_reclaimed);
-	if (next_mz)
-		css_put(&next_mz->mem->css);
-	return nr_reclaimed;
-}
-
 /*
  * This routine traverse page_cgroup in given list and drop them all.
  * *And* this routine doesn't reclaim page itself, just removes page_cgroup.
@@ -3101,6 +2812,11 @@ static int mem_cgroup_force_empty_list(struct mem_cgroup *mem,
 	mz = mem_cgroup_zoneinfo(mem, node, zid);
 	list = &mz->lruvec.lists[lru];
 
+	/* pages sitting in generations are moved like everybody else */
+	spin_lock_irqsave(&zone->lru_lock, flags);
+	lru_gen_drain_lruvec(&mz->lruvec);
+	spin_unlock_irqrestore(&zone->lru_lock, flags);
+
 	loop = MEM_CGROUP_ZSTAT(mz, lru);
 	/* give some margin against EBUSY etc...*/
 	loop += 256;
@@ -3191,7 +2907,7 @@ move_account:
 			goto try_to_free;
 		cond_resched();
 	/* "ret" should also be checked to ensure all lists are empty. */
-	} while (mem->res.usage > 0 || ret);
+	} while (page_counter_read(&mem->memory) > 0 || ret);
 out:
 	css_put(&mem->css);
 	return ret;
@@ -3206,7 +2922,7 @@ try_to_free:
 	lru_add_drain_all();
 	/* try to free all pages in this cgroup */
 	shrink = 1;
-	while (nr_retries && mem->res.usage > 0) {
+	while (nr_retries && page_counter_read(&mem->memory) > 0) {
 		int progress;
 
 		if (signal_pending(current)) {
@@ -3293,9 +3009,10 @@ static inline u64 mem_cgroup_usage(struct mem_cgroup *mem, bool swap)
 
 	if (!mem_cgroup_is_root(mem)) {
 		if (!swap)
-			return res_counter_read_u64(&mem->res, RES_USAGE);
+			val = page_counter_read(&mem->memory);
 		else
-			return res_counter_read_u64(&mem->memsw, RES_USAGE);
+			val = page_counter_read(&mem->memsw);
+		return val << PAGE_SHIFT;
 	}
 
 	val = mem_cgroup_get_recursive_idx_stat(mem, MEM_CGROUP_STAT_CACHE);
@@ -3311,29 +3028,37 @@ static inline u64 mem_cgroup_usage(struct mem_cgroup *mem, bool swap)
 static u64 mem_cgroup_read(struct cgroup *cont, struct cftype *cft)
 {
 	struct mem_cgroup *mem = mem_cgroup_from_cont(cont);
-	u64 val;
+	struct page_counter *counter;
 	int type, name;
 
 	type = MEMFILE_TYPE(cft->private);
 	name = MEMFILE_ATTR(cft->private);
 	switch (type) {
 	case _MEM:
-		if (name == RES_USAGE)
-			val = mem_cgroup_usage(mem, false);
-		else
-			val = res_counter_read_u64(&mem->res, name);
+		counter = &mem->memory;
 		break;
 	case _MEMSWAP:
-		if (name == RES_USAGE)
-			val = mem_cgroup_usage(mem, true);
-		else
-			val = res_counter_read_u64(&mem->memsw, name);
+		counter = &mem->memsw;
 		break;
 	default:
 		BUG();
-		break;
 	}
-	return val;
+
+	switch (name) {
+	case RES_USAGE:
+		return mem_cgroup_usage(mem, type == _MEMSWAP);
+	case RES_LIMIT:
+		return (u64)counter->limit << PAGE_SHIFT;
+	case RES_MAX_USAGE:
+		return (u64)counter->watermark << PAGE_SHIFT;
+	case RES_FAILCNT:
+		return counter->failcnt;
+	case RES_SOFT_LIMIT:
+		return (u64)mem->soft_limit << PAGE_SHIFT;
+	default:
+		BUG();
+	}
+	return 0;
 }
 /*
  * The user of this function is...
@@ -3344,7 +3069,7 @@ static int mem_cgroup_write(struct cgroup *cont, struct cftype *cft,
 {
 	struct mem_cgroup *memcg = mem_cgroup_from_cont(cont);
 	int type, name;
-	unsigned long long val;
+	unsigned long nr_pages;
 	int ret;
 
 	type = MEMFILE_TYPE(cft->private);
@@ -3356,16 +3081,16 @@ static int mem_cgroup_write(struct cgroup *cont, struct cftype *cft,
 			break;
 		}
 		/* This function does all necessary parse...reuse it */
-		ret = res_counter_memparse_write_strategy(buffer, &val);
+		ret = page_counter_memparse(buffer, &nr_pages);
 		if (ret)
 			break;
 		if (type == _MEM)
-			ret = mem_cgroup_resize_limit(memcg, val);
+			ret = mem_cgroup_resize_limit(memcg, nr_pages);
 		else
-			ret = mem_cgroup_resize_memsw_limit(memcg, val);
+			ret = mem_cgroup_resize_memsw_limit(memcg, nr_pages);
 		break;
 	case RES_SOFT_LIMIT:
-		ret = res_counter_memparse_write_strategy(buffer, &val);
+		ret = page_counter_memparse(buffer, &nr_pages);
 		if (ret)
 			break;
 		/*
@@ -3373,9 +3098,10 @@ static int mem_cgroup_write(struct cgroup *cont, struct cftype *cft,
 		 * of semantics, for now, we support soft limits for
 		 * control without swap
 		 */
-		if (type == _MEM)
-			ret = res_counter_set_soft_limit(&memcg->res, val);
-		else
+		if (type == _MEM) {
+			memcg->soft_limit = nr_pages;
+			ret = 0;
+		} else
 			ret = -EINVAL;
 		break;
 	default:
@@ -3389,10 +3115,10 @@ static void memcg_get_hierarchical_limit(struct mem_cgroup *memcg,
 		unsigned long long *mem_limit, unsigned long long *memsw_limit)
 {
 	struct cgroup *cgroup;
-	unsigned long long min_limit, min_memsw_limit, tmp;
+	unsigned long min_limit, min_memsw_limit;
 
-	min_limit = res_counter_read_u64(&memcg->res, RES_LIMIT);
-	min_memsw_limit = res_counter_read_u64(&memcg->memsw, RES_LIMIT);
+	min_limit = memcg->memory.limit;
+	min_memsw_limit = memcg->memsw.limit;
 	cgroup = memcg->css.cgroup;
 	if (!memcg->use_hierarchy)
 		goto out;
@@ -3402,14 +3128,12 @@ static void memcg_get_hierarchical_limit(struct mem_cgroup *memcg,
 		memcg = mem_cgroup_from_cont(cgroup);
 		if (!memcg->use_hierarchy)
 			break;
-		tmp = res_counter_read_u64(&memcg->res, RES_LIMIT);
-		min_limit = min(min_limit, tmp);
-		tmp = res_counter_read_u64(&memcg->memsw, RES_LIMIT);
-		min_memsw_limit = min(min_memsw_limit, tmp);
+		min_limit = min(min_limit, memcg->memory.limit);
+		min_memsw_limit = min(min_memsw_limit, memcg->memsw.limit);
 	}
 out:
-	*mem_limit = min_limit;
-	*memsw_limit = min_memsw_limit;
+	*mem_limit = (unsigned long long)min_limit << PAGE_SHIFT;
+	*memsw_limit = (unsigned long long)min_memsw_limit << PAGE_SHIFT;
 	return;
 }
 
@@ -3424,15 +3148,15 @@ static int mem_cgroup_reset(struct cgroup *cont, unsigned int event)
 	switch (name) {
 	case RES_MAX_USAGE:
 		if (type == _MEM)
-			res_counter_reset_max(&mem->res);
+			page_counter_reset_watermark(&mem->memory);
 		else
-			res_counter_reset_max(&mem->memsw);
+			page_counter_reset_watermark(&mem->memsw);
 		break;
 	case RES_FAILCNT:
 		if (type == _MEM)
-			res_counter_reset_failcnt(&mem->res);
+			mem->memory.failcnt = 0;
 		else
-			res_counter_reset_failcnt(&mem->memsw);
+			mem->memsw.failcnt = 0;
 		break;
 	}
 
@@ -3894,8 +3618,7 @@ static int alloc_mem_cgroup_per_zone_info(struct mem_cgroup *mem, int node)
 		mz = &pn->zoneinfo[zone];
 		for_each_lru(l)
 			INIT_LIST_HEAD(&mz->lruvec.lists[l]);
-		mz->usage_in_excess = 0;
-		mz->on_tree = false;
+		lru_gen_init_lruvec(&mz->lruvec);
 		mz->mem = mem;
 	}
 	return 0;
@@ -3942,7 +3665,6 @@ static void __mem_cgroup_free(struct mem_cgroup *mem)
 {
 	int node;
 
-	mem_cgroup_remove_from_trees(mem);
 	free_css_id(&mem_cgroup_subsys, &mem->css);
 
 	for_each_node_state(node, N_POSSIBLE)
@@ -3979,9 +3701,9 @@ static void mem_cgroup_put(struct mem_cgroup *mem)
  */
 static struct mem_cgroup *parent_mem_cgroup(struct mem_cgroup *mem)
 {
-	if (!mem->res.parent)
+	if (!mem->memory.parent)
 		return NULL;
-	return mem_cgroup_from_res_counter(mem->res.parent, res);
+	return mem_cgroup_from_counter(mem->memory.parent, memory);
 }
 
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR_SWAP
@@ -3996,31 +3718,6 @@ static void __init enable_swap_cgroup(void)
 }
 #endif
 
-static int mem_cgroup_soft_limit_tree_init(void)
-{
-	struct mem_cgroup_tree_per_node *rtpn;
-	struct mem_cgroup_tree_per_zone *rtpz;
-	int tmp, node, zone;
-
-	for_each_node_state(node, N_POSSIBLE) {
-		tmp = node;
-		if (!node_state(node, N_NORMAL_MEMORY))
-			tmp = -1;
-		rtpn = kzalloc_node(sizeof(*rtpn), GFP_KERNEL, tmp);
-		if (!rtpn)
-			return 1;
-
-		soft_limit_tree.rb_tree_per_node[node] = rtpn;
-
-		for (zone = 0; zone < MAX_NR_ZONES; zone++) {
-			rtpz = &rtpn->rb_tree_per_zone[zone];
-			rtpz->rb_root = RB_ROOT;
-			spin_lock_init(&rtpz->lock);
-		}
-	}
-	return 0;
-}
-
 static struct cgroup_subsys_state * __ref
 mem_cgroup_create(struct cgroup_subsys *ss, struct cgroup *cont)
 {
@@ -4042,8 +3739,6 @@ mem_cgroup_create(struct cgroup_subsys *ss, struct cgroup *cont)
 		enable_swap_cgroup();
 		parent = NULL;
 		root_mem_cgroup = mem;
-		if (mem_cgroup_soft_limit_tree_init())
-			goto free_out;
 		for_each_possible_cpu(cpu) {
 			struct memcg_stock_pcp *stock =
 						&per_cpu(memcg_stock, cpu);
@@ -4058,19 +3753,20 @@ mem_cgroup_create(struct cgroup_subsys *ss, struct cgroup *cont)
 	}
 
 	if (parent && parent->use_hierarchy) {
-		res_counter_init(&mem->res, &parent->res);
-		res_counter_init(&mem->memsw, &parent->memsw);
+		page_counter_init(&mem->memory, &parent->memory);
+		page_counter_init(&mem->memsw, &parent->memsw);
 		/*
 		 * We increment refcnt of the parent to ensure that we can
-		 * safely access it on res_counter_charge/uncharge.
+		 * safely access it on page_counter_charge/uncharge.
 		 * This refcnt will be decremented when freeing this
 		 * mem_cgroup(see mem_cgroup_put).
 		 */
 		mem_cgroup_get(parent);
 	} else {
-		res_counter_init(&mem->res, NULL);
-		res_counter_init(&mem->memsw, NULL);
+		page_counter_init(&mem->memory, NULL);
+		page_counter_init(&mem->memsw, NULL);
 	}
+	mem->soft_limit = PAGE_COUNTER_MAX;
 	spin_lock_init(&mem->reclaim_param_lock);
 	INIT_LIST_HEAD(&mem->oom_notify);
 
@@ -4130,18 +3826,18 @@ static int mem_cgroup_do_precharge(unsigned long count)
 	}
 	/* try to charge at once */
 	if (count > 1) {
-		struct res_counter *dummy;
+		struct page_counter *dummy;
 		/*
 		 * "mem" cannot be under rmdir() because we've already checked
 		 * by cgroup_lock_live_cgroup() that it is not removed and we
 		 * are still under the same cgroup_mutex. So we can postpone
 		 * css_get().
 		 */
-		if (res_counter_charge(&mem->res, PAGE_SIZE * count, &dummy))
+		if (page_counter_try_charge(&mem->memory, count, &dummy))
 			goto one_by_one;
-		if (do_swap_account && res_counter_charge(&mem->memsw,
-						PAGE_SIZE * count, &dummy)) {
-			res_counter_uncharge(&mem->res, PAGE_SIZE * count);
+		if (do_swap_account &&
+		    page_counter_try_charge(&mem->memsw, count, &dummy)) {
+			page_counter_uncharge(&mem->memory, count);
 			goto one_by_one;
 		}
 		mc.precharge += count;
@@ -4259,16 +3955,20 @@ static struct page *mc_handle_file_pte(struct vm_area_struct *vma,
 		pgoff = pte_to_pgoff(ptent);
 
 	/* page is moved even if it's not RSS of this task(page-faulted). */
-	page = find_get_page(mapping, pgoff);
-
 #ifdef CONFIG_SWAP
 	/* shmem/tmpfs may report page out on swap: account for that too. */
-	if (radix_tree_exceptional_entry(page)) {
-		swp_entry_t swap = radix_to_swp_entry(page);
-		if (do_swap_account)
-			*entry = swap;
-		page = find_get_page(&swapper_space, swap.val);
-	}
+	if (mapping_cap_swap_backed(mapping)) {
+		page = find_get_entry(mapping, pgoff);
+		if (radix_tree_exceptional_entry(page)) {
+			swp_entry_t swap = radix_to_swp_entry(page);
+			if (do_swap_account)
+				*entry = swap;
+			page = find_get_page(&swapper_space, swap.val);
+		}
+	} else
+		page = find_get_page(mapping, pgoff);
+#else
+	page = find_get_page(mapping, pgoff);
 #endif
 	return page;
 }
@@ -4323,7 +4023,7 @@ static int mem_cgroup_count_precharge_pte_range(pmd_t *pmd,
 	pte_t *pte;
 	spinlock_t *ptl;
 
-	split_huge_page_pmd(walk->mm, pmd);
+	split_huge_page_pmd(vma, addr, pmd);
 	if (pmd_trans_unstable(pmd))
 		return 0;
 
@@ -4387,17 +4087,15 @@ static void mem_cgroup_clear_mc(void)
 	if (mc.moved_swap) {
 		/* uncharge swap account from the old cgroup */
 		if (!mem_cgroup_is_root(mc.from))
-			res_counter_uncharge(&mc.from->memsw,
-						PAGE_SIZE * mc.moved_swap);
+			page_counter_uncharge(&mc.from->memsw, mc.moved_swap);
 		__mem_cgroup_put(mc.from, mc.moved_swap);
 
 		if (!mem_cgroup_is_root(mc.to)) {
 			/*
-			 * we charged both to->res and to->memsw, so we should
-			 * uncharge to->res.
+			 * we charged both to->memory and to->memsw, so we
+			 * should uncharge to->memory.
 			 */
-			res_counter_uncharge(&mc.to->res,
-						PAGE_SIZE * mc.moved_swap);
+			page_counter_uncharge(&mc.to->memory, mc.moved_swap);
 		}
 		/* we've already done mem_cgroup_get(mc.to) */
 
@@ -4481,7 +4179,7 @@ static int mem_cgroup_move_charge_pte_range(pmd_t *pmd,
 	pte_t *pte;
 	spinlock_t *ptl;
 
-	split_huge_page_pmd(walk->mm, pmd);
+	split_huge_page_pmd(vma, addr, pmd);
 	if (pmd_trans_unstable(pmd))
 		return 0;
 
@@ -945,9 +945,14 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 		next = pmd_addr_end(addr, end);
 		if (pmd_trans_huge(*pmd)) {
 			if (next-addr != HPAGE_PMD_SIZE) {
-				VM_BUG_ON(!rwsem_is_locked(&tlb->mm->mmap_sem));
-				split_huge_page_pmd(vma->vm_mm, pmd);
-			} else if (zap_huge_pmd(tlb, vma, pmd)) {
+				/*
+				 * Truncation of a file zaps without the
+				 * mmap_sem, only anon vmas need it here.
+				 */
+				VM_BUG_ON(!vma->vm_ops &&
+					  !rwsem_is_locked(&tlb->mm->mmap_sem));
+				split_huge_page_pmd(vma, addr, pmd);
+			} else if (zap_huge_pmd(tlb, vma, pmd, addr)) {
 				(*zap_work)--;
 				continue;
 			}
@@ -1237,7 +1242,7 @@ struct page *follow_page(struct vm_area_struct *vma, unsigned long address,
 	}
 	if (pmd_trans_huge(*pmd)) {
 		if (flags & FOLL_SPLIT) {
-			split_huge_page_pmd(mm, pmd);
+			split_huge_page_pmd(vma, address, pmd);
 			goto split_fallthrough;
 		}
 		spin_lock(&mm->page_table_lock);
@@ -2848,14 +2853,82 @@ static inline int check_stack_guard_page(struct vm_area_struct *vma, unsigned lo
 	return 0;
 }
 
+/*
+ * Map and lock the pte to install a new page at.  For a speculative
+ * fault, @seq is the sequence count the vma was looked up with, and
+ * nothing but the vma being unchanged keeps the page tables around.
+ * Page tables are only freed after a TLB flush IPI, so check the vma
+ * and take the pte lock with interrupts disabled.  Returns NULL if the
+ * vma has changed, and the fault has to be redone under mmap_sem.
+ */
+static pte_t *pte_map_lock(struct mm_struct *mm, struct vm_area_struct *vma,
+		pmd_t *pmd, unsigned long address, unsigned int flags,
+		unsigned int seq, spinlock_t **ptlp)
+{
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	spinlock_t *ptl;
+	pmd_t pmdval;
+	pte_t *pte;
+
+	if (!(flags & FAULT_FLAG_SPECULATIVE))
+		return pte_offset_map_lock(mm, pmd, address, ptlp);
+
+again:
+	local_irq_disable();
+	if (read_seqcount_retry(&vma->vm_sequence, seq) ||
+	    ACCESS_ONCE(mm->spf_blocked))
+		goto fail;
+
+	/* khugepaged may have collapsed the page table meanwhile */
+	pmdval = *pmd;
+	barrier();
+	if (pmd_none(pmdval) || pmd_trans_huge(pmdval) ||
+	    unlikely(pmd_bad(pmdval)))
+		goto fail;
+
+	/*
+	 * Don't spin on the lock with interrupts disabled: its holder may
+	 * be waiting for us to take a TLB flush IPI.
+	 */
+	ptl = pte_lockptr(mm, &pmdval);
+	pte = pte_offset_map(&pmdval, address);
+	if (!spin_trylock(ptl)) {
+		pte_unmap(pte);
+		local_irq_enable();
+		cpu_relax();
+		goto again;
+	}
+
+	/*
+	 * Once we hold the pte lock, the vma can only change with the
+	 * lock taken again to zap or move our pte.
+	 */
+	if (read_seqcount_retry(&vma->vm_sequence, seq)) {
+		pte_unmap_unlock(pte, ptl);
+		goto fail;
+	}
+	local_irq_enable();
+	*ptlp = ptl;
+	return pte;
+
+fail:
+	local_irq_enable();
+	return NULL;
+#else
+	return pte_offset_map_lock(mm, pmd, address, ptlp);
+#endif
+}
+
 /*
  * We enter with non-exclusive mmap_sem (to exclude vma changes,
  * but allow concurrent faults), and pte mapped but not yet locked.
  * We return with mmap_sem still held, but pte unmapped and unlocked.
+ * A speculative fault, without mmap_sem, returns VM_FAULT_RETRY if the
+ * vma changed meanwhile.
  */
 static int do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		unsigned long address, pte_t *page_table, pmd_t *pmd,
-		unsigned int flags)
+		unsigned int flags, unsigned int seq)
 {
 	struct page *page;
 	spinlock_t *ptl;
@@ -2871,7 +2944,10 @@ static int do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	if (!(flags & FAULT_FLAG_WRITE)) {
 		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
 						vma->vm_page_prot));
-		page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+		page_table = pte_map_lock(mm, vma, pmd, address, flags, seq,
+					  &ptl);
+		if (!page_table)
+			return VM_FAULT_RETRY;
 		if (!pte_none(*page_table))
 			goto unlock;
 		goto setpte;
@@ -2893,7 +2969,12 @@ static int do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	if (vma->vm_flags & VM_WRITE)
 		entry = pte_mkwrite(pte_mkdirty(entry));
 
-	page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+	page_table = pte_map_lock(mm, vma, pmd, address, flags, seq, &ptl);
+	if (!page_table) {
+		mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+		return VM_FAULT_RETRY;
+	}
 	if (!pte_none(*page_table))
 		goto release;
 
@@ -2929,10 +3010,12 @@ oom:
  * We enter with non-exclusive mmap_sem (to exclude vma changes,
  * but allow concurrent faults), and pte neither mapped nor locked.
  * We return with mmap_sem still held, but pte unmapped and unlocked.
+ * A speculative fault, without mmap_sem, returns VM_FAULT_RETRY if the
+ * vma changed meanwhile.
  */
 static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
-		unsigned long address, pmd_t *pmd,
-		pgoff_t pgoff, unsigned int flags, pte_t orig_pte)
+		unsigned long address, pmd_t *pmd, pgoff_t pgoff,
+		unsigned int flags, pte_t orig_pte, unsigned int seq)
 {
 	pte_t *page_table;
 	spinlock_t *ptl;
@@ -3033,7 +3116,7 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 
 	}
 
-	page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+	page_table = pte_map_lock(mm, vma, pmd, address, flags, seq, &ptl);
 
 	/*
 	 * This silly early PAGE_DIRTY setting removes a race
@@ -3046,7 +3129,7 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	 * handle that later.
 	 */
 	/* Only go through if we didn't race with anybody else... */
-	if (likely(pte_same(*page_table, orig_pte))) {
+	if (likely(page_table && pte_same(*page_table, orig_pte))) {
 		flush_icache_page(vma, page);
 		entry = mk_pte(page, vma->vm_page_prot);
 		if (flags & FAULT_FLAG_WRITE)
@@ -3067,6 +3150,8 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 		/* no need to invalidate: a not-present page won't be cached */
 		update_mmu_cache(vma, address, entry);
 	} else {
+		if (!page_table)
+			ret = VM_FAULT_RETRY;
 		if (charged)
 			mem_cgroup_uncharge_page(page);
 		if (anon)
@@ -3075,7 +3160,8 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 			anon = 1; /* no anon but release faulted_page */
 	}
 
-	pte_unmap_unlock(page_table, ptl);
+	if (page_table)
+		pte_unmap_unlock(page_table, ptl);
 
 out:
 	if (dirty_page) {
@@ -3119,13 +3205,13 @@ unwritable_page:
 
 static int do_linear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 		unsigned long address, pte_t *page_table, pmd_t *pmd,
-		unsigned int flags, pte_t orig_pte)
+		unsigned int flags, pte_t orig_pte, unsigned int seq)
 {
 	pgoff_t pgoff = (((address & PAGE_MASK)
 			- vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
 
 	pte_unmap(page_table);
-	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
+	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte, seq);
 }
 
 /*
@@ -3157,7 +3243,7 @@ static int do_nonlinear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	}
 
 	pgoff = pte_to_pgoff(orig_pte);
-	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
+	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte, 0);
 }
 
 /*
@@ -3186,10 +3272,10 @@ int handle_pte_fault(struct mm_struct *mm,
 			if (vma->vm_ops) {
 				if (likely(vma->vm_ops->fault))
 					return do_linear_fault(mm, vma, address,
-						pte, pmd, flags, entry);
+						pte, pmd, flags, entry, 0);
 			}
 			return do_anonymous_page(mm, vma, address,
-						 pte, pmd, flags);
+						 pte, pmd, flags, 0);
 		}
 		if (pte_file(entry))
 			return do_nonlinear_fault(mm, vma, address,
@@ -3252,10 +3338,18 @@ retry:
 	pmd = pmd_alloc(mm, pud, address);
 	if (!pmd)
 		return VM_FAULT_OOM;
-	if (pmd_none(*pmd) && transparent_hugepage_enabled(vma)) {
-		if (!vma->vm_ops)
-			return do_huge_pmd_anonymous_page(mm, vma, address,
-							  pmd, flags);
+	if (pmd_none(*pmd)) {
+		if (!vma->vm_ops) {
+			if (transparent_hugepage_enabled(vma))
+				return do_huge_pmd_anonymous_page(mm, vma,
+							address, pmd, flags);
+		} else if (vma->vm_ops->pmd_fault) {
+			int ret;
+
+			ret = vma->vm_ops->pmd_fault(vma, address, pmd, flags);
+			if (!(ret & VM_FAULT_FALLBACK))
+				return ret;
+		}
 	} else {
 		pmd_t orig_pmd = *pmd;
 		int ret;
@@ -3302,6 +3396,151 @@ retry:
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Which vmas a speculative fault can handle: the ones whose faults
+ * don't need anything but the vma itself, nothing that takes or drops
+ * mmap_sem, grows the vma, or fills a hole in the pte level page tables
+ * other than with a new anonymous page or a page cache page.
+ */
+#define VM_NO_SPECULATE	(VM_HUGETLB | VM_IO | VM_PFNMAP | VM_MIXEDMAP | \
+			 VM_NONLINEAR | VM_GROWSDOWN | VM_GROWSUP | \
+			 VM_INSERTPAGE)
+
+static bool vma_can_speculate(struct vm_area_struct *vma,
+			      unsigned int flags)
+{
+	unsigned long vm_flags = vma->vm_flags;
+
+	if (vm_flags & VM_NO_SPECULATE)
+		return false;
+
+	/* Leave the permission errors to the fault handler */
+	if (flags & FAULT_FLAG_WRITE) {
+		if (!(vm_flags & VM_WRITE))
+			return false;
+	} else if (!(vm_flags & (VM_READ | VM_EXEC | VM_WRITE)))
+		return false;
+
+	/* An mbind() may free the policy under the page allocator */
+	if (vma_policy(vma))
+		return false;
+
+	if (vma->vm_ops) {
+		/*
+		 * Only page cache backed mappings: the vma keeps the file
+		 * around, and filemap_fault() needs nothing else.  Writes
+		 * to shared mappings go through ->page_mkwrite and dirty
+		 * accounting, leave them to the slow path.
+		 */
+		if (vma->vm_ops->fault != filemap_fault ||
+		    vma->vm_ops->close)
+			return false;
+		if ((flags & FAULT_FLAG_WRITE) && (vm_flags & VM_SHARED))
+			return false;
+	}
+
+	/*
+	 * Setting up the anon_vma of a vma changes it and has to be done
+	 * under mmap_sem, by the first write fault.
+	 */
+	if ((flags & FAULT_FLAG_WRITE) && !vma->anon_vma)
+		return false;
+
+	return true;
+}
+
+/*
+ * Handle a page fault of the current task without mmap_sem, so that it
+ * isn't held up by, and doesn't hold up, another thread of the process
+ * that has mmap_sem for writing to map, unmap or mprotect memory.
+ *
+ * The vma is looked up under RCU and pinned with a reference, and the
+ * fault only installs a pte once it holds the pte lock and has checked
+ * that the vma's sequence count hasn't changed since.  Only faults on
+ * pte_none() entries below existing page tables are handled; anything
+ * else, or a vma that changed, returns VM_FAULT_RETRY to have the fault
+ * handled with mmap_sem as usual, as do faults that end in an error.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags)
+{
+	struct vm_area_struct *vma;
+	unsigned int seq;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd, pmdval;
+	pte_t *pte, entry;
+	int ret = VM_FAULT_RETRY;
+
+	flags &= ~(FAULT_FLAG_ALLOW_RETRY | FAULT_FLAG_KILLABLE);
+	flags |= FAULT_FLAG_SPECULATIVE;
+
+	if (ACCESS_ONCE(mm->spf_blocked))
+		goto out;
+
+	vma = get_vma_speculative(mm, address, &seq);
+	if (!vma)
+		goto out;
+	if (!vma_can_speculate(vma, flags))
+		goto out_put;
+
+	/*
+	 * Walk the page tables with interrupts disabled, as gup_fast()
+	 * does, so that they can't be freed under us.  Don't allocate any
+	 * nor deal with huge pmds, the slow path does that.
+	 */
+	local_irq_disable();
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		goto out_walk;
+	pud = pud_offset(pgd, address);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		goto out_walk;
+	pmd = pmd_offset(pud, address);
+	pmdval = *pmd;
+	barrier();
+	if (pmd_none(pmdval) || pmd_trans_huge(pmdval) ||
+	    unlikely(pmd_bad(pmdval)))
+		goto out_walk;
+	pte = pte_offset_map(&pmdval, address);
+	entry = *pte;
+	barrier();
+	local_irq_enable();
+
+	if (!pte_none(entry)) {
+		pte_unmap(pte);
+		goto out_put;
+	}
+
+	__set_current_state(TASK_RUNNING);
+
+	if (vma->vm_ops)
+		ret = do_linear_fault(mm, vma, address, pte, pmd,
+				      flags, entry, seq);
+	else
+		ret = do_anonymous_page(mm, vma, address, pte, pmd,
+					flags, seq);
+	if (ret & (VM_FAULT_ERROR | VM_FAULT_RETRY))
+		ret = VM_FAULT_RETRY;
+	else {
+		count_vm_event(PGFAULT);
+		count_vm_event(SPECULATIVE_PGFAULT);
+	}
+
+out_put:
+	put_vma(vma);
+out:
+	if (ret & VM_FAULT_RETRY)
+		count_vm_event(SPECULATIVE_PGFAULT_ABORT);
+	return ret;
+
+out_walk:
+	local_irq_enable();
+	goto out_put;
+}
+#endif
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
@@ -250,6 +250,36 @@ void unlink_file_vma(struct vm_area_struct *vma)
 	}
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+static void vma_free_rcu(struct rcu_head *head)
+{
+	kmem_cache_free(vm_area_cachep,
+			container_of(head, struct vm_area_struct, vm_rcu_head));
+}
+#endif
+
+/*
+ * Free a vm structure that has been unlinked from its mm.  Speculative
+ * page faults may still hold references to it (vm_ref_count drops to -1
+ * with the last one), and get_vma_speculative() may still be looking at
+ * it until the end of an RCU grace period.
+ */
+void put_vma(struct vm_area_struct *vma)
+{
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	if (!atomic_add_negative(-1, &vma->vm_ref_count))
+		return;
+#endif
+	if (vma->vm_file)
+		fput(vma->vm_file);
+	mpol_put(vma_policy(vma));
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	call_rcu(&vma->vm_rcu_head, vma_free_rcu);
+#else
+	kmem_cache_free(vm_area_cachep, vma);
+#endif
+}
+
 /*
  * Close a vm structure and free it, returning the next.
  */
@@ -260,13 +290,9 @@ static struct vm_area_struct *remove_vma(struct vm_area_struct *vma)
 	might_sleep();
 	if (vma->vm_ops && vma->vm_ops->close)
 		vma->vm_ops->close(vma);
-	if (vma->vm_file) {
-		fput(vma->vm_file);
-		if (vma->vm_flags & VM_EXECUTABLE)
-			removed_exe_file_vma(vma->vm_mm);
-	}
-	mpol_put(vma_policy(vma));
-	kmem_cache_free(vm_area_cachep, vma);
+	if (vma->vm_file && (vma->vm_flags & VM_EXECUTABLE))
+		removed_exe_file_vma(vma->vm_mm);
+	put_vma(vma);
 	return next;
 }
 
@@ -441,6 +467,10 @@ __vma_link_list(struct mm_struct *mm, struct vm_area_struct *vma,
 void __vma_link_rb(struct mm_struct *mm, struct vm_area_struct *vma,
 		struct rb_node **rb_link, struct rb_node *rb_parent)
 {
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	/* get_vma_speculative() may find it as soon as it's linked */
+	smp_wmb();
+#endif
 	rb_link_node(&vma->vm_rb, rb_parent, rb_link);
 	rb_insert_color(&vma->vm_rb, &mm->mm_rb);
 }
@@ -526,6 +556,7 @@ __vma_unlink(struct mm_struct *mm, struct vm_area_struct *vma,
 	if (next)
 		next->vm_prev = prev;
 	rb_erase(&vma->vm_rb, &mm->mm_rb);
+	RB_CLEAR_NODE(&vma->vm_rb);
 	if (mm->mmap_cache == vma)
 		mm->mmap_cache = prev;
 	if (vma->vm_flags & VM_EXEC)
@@ -644,6 +675,10 @@ again:			remove_next = 1 + (end > next->vm_end);
 			vma_prio_tree_remove(next, root);
 	}
 
+	vm_write_begin(vma);
+	if (adjust_next || remove_next)
+		vm_write_begin(next);
+
 	vma->vm_start = start;
 	vma->vm_end = end;
 	vma->vm_pgoff = pgoff;
@@ -676,22 +711,22 @@ again:			remove_next = 1 + (end > next->vm_end);
 		__insert_vm_struct(mm, insert);
 	}
 
+	if (adjust_next || remove_next)
+		vm_write_end(next);
+	vm_write_end(vma);
+
 	if (anon_vma)
 		anon_vma_unlock(anon_vma);
 	if (mapping)
 		spin_unlock(&mapping->i_mmap_lock);
 
 	if (remove_next) {
-		if (file) {
-			fput(file);
-			if (next->vm_flags & VM_EXECUTABLE)
-				removed_exe_file_vma(mm);
-		}
+		if (file && (next->vm_flags & VM_EXECUTABLE))
+			removed_exe_file_vma(mm);
 		if (next->anon_vma)
 			anon_vma_merge(vma, next);
 		mm->map_count--;
-		mpol_put(vma_policy(next));
-		kmem_cache_free(vm_area_cachep, next);
+		put_vma(next);
 		/*
 		 * In mprotect's case 6 (see comments on vma_merge),
 		 * we must remove another next too. It would clutter
@@ -1644,6 +1679,16 @@ get_unmapped_area_prot(struct file *file, unsigned long addr, unsigned long len,
 
 	if (file && file->f_op && file->f_op->get_unmapped_area)
 		get_area = file->f_op->get_unmapped_area;
+#if defined(CONFIG_TRANSPARENT_HUGEPAGE) && defined(CONFIG_SHMEM)
+	else if (!file && !exec && (flags & MAP_SHARED)) {
+		/*
+		 * mmap_region() will call shmem_zero_setup() to create a file,
+		 * so use shmem's get_unmapped_area in case it can be huge.
+		 */
+		pgoff = 0;
+		get_area = shmem_get_unmapped_area;
+	}
+#endif
 	addr = get_area(file, addr, len, pgoff, flags);
 	if (IS_ERR_VALUE(addr))
 		return addr;
@@ -1769,6 +1814,77 @@ struct vm_area_struct *find_vma(struct mm_struct *mm, unsigned long addr)
 
 EXPORT_SYMBOL(find_vma);
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * The rbtree isn't meant to be walked locklessly: a walk racing with a
+ * rebalance may take a wrong turn or even go round in circles.  A wrong
+ * result is caught by the checks in get_vma_speculative(), and a walk
+ * gives up after more steps than any rbtree that fits in memory needs.
+ */
+#define SPECULATIVE_WALK_MAX	(2 * BITS_PER_LONG)
+
+/*
+ * Look up the vma containing @addr without mmap_sem, for a speculative
+ * page fault.  Returns it with a reference held, to be dropped with
+ * put_vma(), and its sequence count in *@seq: what was read from the
+ * vma is only good as long as read_seqcount_retry() agrees.  Returns
+ * NULL if there's no such vma, or if it's being changed.
+ */
+struct vm_area_struct *get_vma_speculative(struct mm_struct *mm,
+		unsigned long addr, unsigned int *seq)
+{
+	struct vm_area_struct *vma;
+	int steps = 0;
+
+	rcu_read_lock();
+	vma = ACCESS_ONCE(mm->mmap_cache);
+	if (!(vma && vma->vm_end > addr && vma->vm_start <= addr)) {
+		struct rb_node *rb_node;
+
+		rb_node = ACCESS_ONCE(mm->mm_rb.rb_node);
+		vma = NULL;
+
+		while (rb_node && ++steps <= SPECULATIVE_WALK_MAX) {
+			struct vm_area_struct *vma_tmp;
+
+			vma_tmp = rb_entry(rb_node,
+					struct vm_area_struct, vm_rb);
+
+			if (vma_tmp->vm_end > addr) {
+				if (vma_tmp->vm_start <= addr) {
+					vma = vma_tmp;
+					break;
+				}
+				rb_node = ACCESS_ONCE(rb_node->rb_left);
+			} else
+				rb_node = ACCESS_ONCE(rb_node->rb_right);
+		}
+		if (!vma)
+			goto out;
+	}
+
+	/*
+	 * vmas never overlap, so one that is still linked and covers addr
+	 * while its sequence count is stable is the right one.
+	 */
+	*seq = raw_seqcount_begin(&vma->vm_sequence);
+	if (RB_EMPTY_NODE(&vma->vm_rb) ||
+	    vma->vm_start > addr || vma->vm_end <= addr ||
+	    !atomic_add_unless(&vma->vm_ref_count, 1, -1)) {
+		vma = NULL;
+		goto out;
+	}
+	if (read_seqcount_retry(&vma->vm_sequence, *seq)) {
+		rcu_read_unlock();
+		put_vma(vma);
+		return NULL;
+	}
+out:
+	rcu_read_unlock();
+	return vma;
+}
+#endif
+
 /* Same as find_vma, but also return a pointer to the previous VMA in *pprev. */
 struct vm_area_struct *
 find_vma_prev(struct mm_struct *mm, unsigned long addr,
@@ -2087,7 +2203,10 @@ detach_vmas_to_be_unmapped(struct mm_struct *mm, struct vm_area_struct *vma,
 	insertion_point = (prev ? &prev->vm_next : &mm->mmap);
 	vma->vm_prev = NULL;
 	do {
+		vm_write_begin(vma);
 		rb_erase(&vma->vm_rb, &mm->mm_rb);
+		RB_CLEAR_NODE(&vma->vm_rb);
+		vm_write_end(vma);
 		mm->map_count--;
 		tail_vma = vma;
 		vma = vma->vm_next;
@@ -2127,6 +2246,7 @@ static int __split_vma(struct mm_struct * mm, struct vm_area_struct * vma,
 	*new = *vma;
 
 	INIT_LIST_HEAD(&new->anon_vma_chain);
+	vma_init_ref(new);
 
 	if (new_below)
 		new->vm_end = addr;
@@ -2534,6 +2654,7 @@ struct vm_area_struct *copy_vma(struct vm_area_struct **vmap,
 			if (IS_ERR(pol))
 				goto out_free_vma;
 			INIT_LIST_HEAD(&new_vma->anon_vma_chain);
+			vma_init_ref(new_vma);
 			if (anon_vma_clone(new_vma, vma))
 				goto out_free_mempol;
 			vma_set_policy(new_vma, pol);
@@ -2361,6 +2361,153 @@ __alloc_pages_nodemask(gfp_t gfp_mask, unsigned int order,
 }
 EXPORT_SYMBOL(__alloc_pages_nodemask);
 
+/*
+ * __alloc_pages_bulk - Allocate a number of order-0 pages to a list or array
+ * @gfp_mask: GFP flags for the allocation
+ * @zonelist: zonelist to allocate from
+ * @nodemask: set of nodes to allocate from, may be NULL
+ * @nr_pages: The number of pages desired on the list or array
+ * @page_list: Optional list to store the allocated pages
+ * @page_array: Optional array to store the pages
+ *
+ * This is a batched version of the page allocator that attempts to
+ * allocate nr_pages quickly.  Pages are taken from the per-cpu lists of
+ * the first zone with enough free pages, all inside one irq-disabled
+ * section; an empty per-cpu list is refilled from the buddy lists with
+ * rmqueue_bulk().  If no page can be had that way, a single page is
+ * allocated through the regular path, which may reclaim.
+ *
+ * For lists, nr_pages is the number of pages that should be allocated.
+ *
+ * For arrays, only NULL elements are populated with pages and nr_pages
+ * is the maximum number of pages that will be stored in the array.
+ *
+ * Returns the number of pages on the list or array.
+ */
+unsigned long __alloc_pages_bulk(gfp_t gfp_mask, struct zonelist *zonelist,
+				 nodemask_t *nodemask, unsigned long nr_pages,
+				 struct list_head *page_list,
+				 struct page **page_array)
+{
+	enum zone_type high_zoneidx = gfp_zone(gfp_mask);
+	int migratetype = allocflags_to_migratetype(gfp_mask);
+	int cold = !!(gfp_mask & __GFP_COLD);
+	struct zone *preferred_zone, *zone;
+	struct per_cpu_pages *pcp;
+	struct list_head *list;
+	struct zoneref *z;
+	unsigned long flags;
+	unsigned long nr_populated = 0, nr_account = 0;
+	struct page *page;
+	int cpu;
+
+	/* Skip populated array elements. */
+	while (page_array && nr_populated < nr_pages &&
+	       page_array[nr_populated])
+		nr_populated++;
+
+	/* Already populated array? */
+	if (unlikely(nr_populated == nr_pages))
+		return nr_populated;
+
+	/* Use the single page allocator for one page. */
+	if (nr_pages - nr_populated == 1)
+		goto failed;
+
+	gfp_mask &= gfp_allowed_mask;
+
+	if (should_fail_alloc_page(gfp_mask, 0))
+		goto failed;
+
+	if (unlikely(!zonelist->_zonerefs->zone))
+		goto failed;
+
+	get_mems_allowed();
+	first_zones_zonelist(zonelist, high_zoneidx, nodemask, &preferred_zone);
+	if (!preferred_zone)
+		goto failed_mems;
+
+	/*
+	 * Find the first zone that can take the whole batch above the low
+	 * watermark; leave anything harder to the regular allocator.
+	 */
+	for_each_zone_zonelist_nodemask(zone, z, zonelist,
+					high_zoneidx, nodemask) {
+		if (!cpuset_zone_allowed_softwall(zone,
+						  gfp_mask | __GFP_HARDWALL))
+			continue;
+		if (zone_watermark_ok(zone, 0, low_wmark_pages(zone) + nr_pages,
+				      zone_idx(preferred_zone), ALLOC_WMARK_LOW))
+			break;
+	}
+	if (!zone)
+		goto failed_mems;
+
+	cpu = get_cpu();
+	pcp = &zone_pcp(zone, cpu)->pcp;
+	list = &pcp->lists[migratetype];
+	local_irq_save(flags);
+	while (nr_populated < nr_pages) {
+		/* Skip existing pages */
+		if (page_array && page_array[nr_populated]) {
+			nr_populated++;
+			continue;
+		}
+
+		if (list_empty(list)) {
+			pcp->count += rmqueue_bulk(zone, 0, pcp->batch, list,
+						   migratetype, cold);
+			if (unlikely(list_empty(list)))
+				break;
+		}
+
+		if (cold)
+			page = list_entry(list->prev, struct page, lru);
+		else
+			page = list_entry(list->next, struct page, lru);
+		list_del(&page->lru);
+		pcp->count--;
+		nr_account++;
+		zone_statistics(preferred_zone, zone, gfp_mask);
+
+		/* A bad page is leaked, as buffered_rmqueue() does. */
+		if (prep_new_page(page, 0, gfp_mask))
+			continue;
+		if (kmemcheck_enabled)
+			kmemcheck_pagealloc_alloc(page, 0, gfp_mask);
+		trace_mm_page_alloc(page, 0, gfp_mask, migratetype);
+
+		if (page_list)
+			list_add(&page->lru, page_list);
+		else
+			page_array[nr_populated] = page;
+		nr_populated++;
+	}
+	__count_zone_vm_events(PGALLOC, zone, nr_account);
+	local_irq_restore(flags);
+	put_cpu();
+	put_mems_allowed();
+
+	if (nr_account)
+		return nr_populated;
+	goto failed;
+
+failed_mems:
+	put_mems_allowed();
+failed:
+	page = __alloc_pages_nodemask(gfp_mask, 0, zonelist, nodemask);
+	if (page) {
+		if (page_list)
+			list_add(&page->lru, page_list);
+		else
+			page_array[nr_populated] = page;
+		nr_populated++;
+	}
+
+	return nr_populated;
+}
+EXPORT_SYMBOL(__alloc_pages_bulk);
+
 /*
  * Common helper functions.
  */
@@ -4315,6 +4462,9 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 	pgdat->nr_zones = 0;
 	init_waitqueue_head(&pgdat->kswapd_wait);
 	pgdat->kswapd_max_order = 0;
+#ifdef CONFIG_COMPACTION
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+#endif
 	pgdat_page_cgroup_init(pgdat);
 	
 	for (j = 0; j < MAX_NR_ZONES; j++) {
@@ -4376,6 +4526,7 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 			INIT_LIST_HEAD(&zone->lruvec.lists[l]);
 			zone->reclaim_stat.nr_saved_scan[l] = 0;
 		}
+		lru_gen_init_lruvec(&zone->lruvec);
 		zone->reclaim_stat.recent_rotated[0] = 0;
 		zone->reclaim_stat.recent_rotated[1] = 0;
 		zone->reclaim_stat.recent_scanned[0] = 0;
@@ -0,0 +1,97 @@
+/*
+ * Page allocator microbenchmark
+ *
+ * Times order-0 allocations through alloc_pages() one page at a time
+ * against alloc_pages_bulk_list() for a range of batch sizes, and prints
+ * the cost per page.  The pages are freed again with __free_page() in
+ * both cases, so they cycle through the per-cpu lists and the numbers
+ * compare the per-call overhead of the two interfaces.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+
+#include <linux/gfp.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+
+static int loops = 100000;
+module_param(loops, int, 0444);
+MODULE_PARM_DESC(loops, "Number of batches allocated and freed per test");
+
+#define MAX_BATCH	256
+
+static struct page *pages[MAX_BATCH];
+
+static u64 bench_single(int batch)
+{
+	ktime_t start;
+	int i, j, n;
+
+	start = ktime_get();
+	for (i = 0; i < loops; i++) {
+		for (n = 0; n < batch; n++) {
+			pages[n] = alloc_page(GFP_KERNEL);
+			if (!pages[n])
+				break;
+		}
+		for (j = 0; j < n; j++)
+			__free_page(pages[j]);
+		cond_resched();
+	}
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static u64 bench_bulk(int batch)
+{
+	struct page *page, *next;
+	LIST_HEAD(list);
+	ktime_t start;
+	int i;
+
+	start = ktime_get();
+	for (i = 0; i < loops; i++) {
+		alloc_pages_bulk_list(GFP_KERNEL, batch, &list);
+		list_for_each_entry_safe(page, next, &list, lru) {
+			list_del(&page->lru);
+			__free_page(page);
+		}
+		cond_resched();
+	}
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static int __init page_alloc_bench_init(void)
+{
+	u64 single, bulk, nr;
+	int batch;
+
+	if (loops <= 0)
+		return -EINVAL;
+
+	printk(KERN_INFO "page_alloc_bench: %d loops, ns/page\n", loops);
+	printk(KERN_INFO "page_alloc_bench: %6s %10s %10s\n",
+	       "batch", "single", "bulk");
+
+	for (batch = 1; batch <= MAX_BATCH; batch <<= 1) {
+		nr = (u64)loops * batch;
+		single = div64_u64(bench_single(batch), nr);
+		bulk = div64_u64(bench_bulk(batch), nr);
+		printk(KERN_INFO "page_alloc_bench: %6d %10llu %10llu\n",
+		       batch, (unsigned long long)single,
+		       (unsigned long long)bulk);
+	}
+
+	/* The results are in the log; don't stay loaded */
+	return -EAGAIN;
+}
+
+module_init(page_alloc_bench_init);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Page allocator microbenchmark");
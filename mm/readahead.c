@@ -16,6 +16,7 @@
 #include <linux/task_io_accounting_ops.h>
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
+#include <trace/events/kmem.h>
 
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
@@ -25,6 +26,7 @@ void
 file_ra_state_init(struct file_ra_state *ra, struct address_space *mapping)
 {
 	ra->ra_pages = mapping->backing_dev_info->ra_pages;
+	ra->io_pages = mapping->backing_dev_info->io_pages;
 	ra->prev_pos = -1;
 }
 EXPORT_SYMBOL_GPL(file_ra_state_init);
@@ -149,6 +151,8 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	struct page *page;
 	unsigned long end_index;	/* The last page we want to read */
 	LIST_HEAD(page_pool);
+	LIST_HEAD(spare_pages);
+	unsigned long nr_spare = 0;
 	int page_idx;
 	int ret = 0;
 	loff_t isize = i_size_read(inode);
@@ -159,7 +163,9 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	end_index = ((isize - 1) >> PAGE_CACHE_SHIFT);
 
 	/*
-	 * Preallocate as many pages as we will need.
+	 * Preallocate as many pages as we will need, a batch at a time
+	 * from the bulk allocator.  The batch is kept small so that few
+	 * pages are wasted when parts of the range are already cached.
 	 */
 	for (page_idx = 0; page_idx < nr_to_read; page_idx++) {
 		pgoff_t page_offset = offset + page_idx;
@@ -170,12 +176,23 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		rcu_read_lock();
 		page = radix_tree_lookup(&mapping->page_tree, page_offset);
 		rcu_read_unlock();
-		if (page)
+		if (page && !radix_tree_exceptional_entry(page))
 			continue;
 
-		page = page_cache_alloc_readahead(mapping);
-		if (!page)
-			break;
+		if (!nr_spare) {
+			unsigned long nr = min_t(unsigned long, PAGEVEC_SIZE,
+						 nr_to_read - page_idx);
+
+			nr = min_t(unsigned long, nr,
+				   end_index - page_offset + 1);
+			nr_spare = page_cache_alloc_readahead_bulk(mapping, nr,
+								   &spare_pages);
+			if (!nr_spare)
+				break;
+		}
+		page = list_to_page(&spare_pages);
+		list_del(&page->lru);
+		nr_spare--;
 		page->index = page_offset;
 		list_add(&page->lru, &page_pool);
 		if (page_idx == nr_to_read - lookahead_size)
@@ -191,6 +208,13 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	if (ret)
 		read_pages(mapping, filp, &page_pool, ret);
 	BUG_ON(!list_empty(&page_pool));
+
+	/* Allocated for offsets that turned out to be cached */
+	while (!list_empty(&spare_pages)) {
+		page = list_to_page(&spare_pages);
+		list_del(&page->lru);
+		page_cache_release(page);
+	}
 out:
 	return ret;
 }
@@ -238,6 +262,17 @@ unsigned long max_sane_readahead(unsigned long nr)
 		+ node_page_state(numa_node_id(), NR_FREE_PAGES)) / 2);
 }
 
+/*
+ * The largest readahead window for @ra: a device which prefers large
+ * requests (e.g. the stripe width of a RAID array) gets at least two of
+ * them, so that the async part of the window is a whole request too.
+ */
+static unsigned long ra_max_pages(struct file_ra_state *ra)
+{
+	return max_sane_readahead(max_t(unsigned long, ra->ra_pages,
+					2 * ra->io_pages));
+}
+
 /*
  * Submit IO for the read-ahead request in file_ra_state.
  */
@@ -382,6 +417,86 @@ static int try_context_readahead(struct address_space *mapping,
 	return 1;
 }
 
+/*
+ * Strided reads: an application reading chunks of stride_len pages, each
+ * stride pages after the last, e.g. a columnar scan reading every Nth block
+ * of a file.  The history is the start of the last chunk read (or read
+ * ahead) and how many reads in a row have been the same distance apart.
+ */
+#define STRIDE_MIN_HITS		2	/* 4 equally spaced reads make a stride */
+
+static inline bool ra_stride_active(struct file_ra_state *ra)
+{
+	return ra->stride_hits >= STRIDE_MIN_HITS;
+}
+
+/*
+ * Read ahead @nr chunks of the stride, from the one at @index on.  The
+ * first page of the middle chunk is marked PG_readahead, so that the
+ * reader reaching it triggers the next batch while the rest is in flight.
+ */
+static int stride_readahead(struct address_space *mapping,
+			    struct file_ra_state *ra, struct file *filp,
+			    pgoff_t index, unsigned long nr)
+{
+	unsigned long i;
+	int actual = 0;
+
+	for (i = 0; i < nr; i++) {
+		actual += __do_page_cache_readahead(mapping, filp, index,
+				ra->stride_len, i == nr / 2 ? ra->stride_len : 0);
+		ra->stride_prev = index;
+		index += ra->stride;
+	}
+	return actual;
+}
+
+/*
+ * Record a non-sequential read of @req_size pages at @offset in the stride
+ * history, and once it has been seen at a constant distance often enough,
+ * read ahead the chunks to come: as many as make up a readahead window.
+ *
+ * Returns the number of pages submitted, or -1 if this is not a stride.
+ */
+static int try_stride_readahead(struct address_space *mapping,
+				struct file_ra_state *ra, struct file *filp,
+				pgoff_t offset, unsigned long req_size,
+				unsigned long max)
+{
+	unsigned long nr;
+	int actual;
+
+	if (offset > ra->stride_prev &&
+	    offset - ra->stride_prev == ra->stride &&
+	    req_size == ra->stride_len) {
+		if (ra->stride_hits < USHRT_MAX)
+			ra->stride_hits++;
+	} else {
+		ra->stride_hits = 0;
+		ra->stride_len = 0;
+		ra->stride = 0;
+		/* Chunks must leave a gap, else it is a sequential read */
+		if (offset > ra->stride_prev &&
+		    offset - ra->stride_prev > req_size &&
+		    offset - ra->stride_prev <= UINT_MAX &&
+		    req_size <= min_t(unsigned long, max, USHRT_MAX)) {
+			ra->stride = offset - ra->stride_prev;
+			ra->stride_len = req_size;
+		}
+	}
+	ra->stride_prev = offset;
+
+	if (!ra_stride_active(ra))
+		return -1;
+
+	nr = max(max / ra->stride_len, 2UL);
+	actual = stride_readahead(mapping, ra, filp, offset, nr);
+	trace_mm_filemap_readahead(mapping, offset, req_size, offset,
+				   nr * ra->stride_len, ra->stride_len,
+				   RA_PATTERN_STRIDE, actual);
+	return actual;
+}
+
 /*
  * A minimal readahead algorithm for trivial sequential/random reads.
  */
@@ -391,7 +506,9 @@ ondemand_readahead(struct address_space *mapping,
 		   bool hit_readahead_marker, pgoff_t offset,
 		   unsigned long req_size)
 {
-	unsigned long max = max_sane_readahead(ra->ra_pages);
+	unsigned long max = ra_max_pages(ra);
+	int pattern = RA_PATTERN_INITIAL;
+	int actual;
 
 	/*
 	 * start of file
@@ -408,9 +525,27 @@ ondemand_readahead(struct address_space *mapping,
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
+		pattern = RA_PATTERN_SEQUENTIAL;
 		goto readit;
 	}
 
+	/*
+	 * Hit the marker in a chunk read ahead for a strided reader:
+	 * keep the next batch of chunks coming.
+	 */
+	if (hit_readahead_marker && ra_stride_active(ra) &&
+	    offset <= ra->stride_prev &&
+	    (ra->stride_prev - offset) % ra->stride == 0) {
+		unsigned long nr = max(max / ra->stride_len, 2UL);
+		pgoff_t start = ra->stride_prev + ra->stride;
+
+		actual = stride_readahead(mapping, ra, filp, start, nr);
+		trace_mm_filemap_readahead(mapping, offset, req_size, start,
+					   nr * ra->stride_len, ra->stride_len,
+					   RA_PATTERN_STRIDE, actual);
+		return actual;
+	}
+
 	/*
 	 * Hit a marked page without valid readahead state.
 	 * E.g. interleaved reads.
@@ -432,6 +567,7 @@ ondemand_readahead(struct address_space *mapping,
 		ra->size += req_size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
+		pattern = RA_PATTERN_MARKER;
 		goto readit;
 	}
 
@@ -451,18 +587,34 @@ ondemand_readahead(struct address_space *mapping,
 	 * Query the page cache and look for the traces(cached history pages)
 	 * that a sequential stream would leave behind.
 	 */
-	if (try_context_readahead(mapping, ra, offset, req_size, max))
+	if (try_context_readahead(mapping, ra, offset, req_size, max)) {
+		pattern = RA_PATTERN_CONTEXT;
 		goto readit;
+	}
+
+	/*
+	 * Chunks at a constant distance from each other: read ahead the
+	 * chunks to come rather than only the one asked for.
+	 */
+	actual = try_stride_readahead(mapping, ra, filp, offset, req_size, max);
+	if (actual >= 0)
+		return actual;
 
 	/*
 	 * standalone, small random read
 	 * Read as is, and do not pollute the readahead state.
 	 */
-	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
+	actual = __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
+	trace_mm_filemap_readahead(mapping, offset, req_size, offset,
+				   req_size, 0, RA_PATTERN_RANDOM, actual);
+	return actual;
 
 initial_readahead:
 	ra->start = offset;
 	ra->size = get_init_ra_size(req_size, max);
+	/* Start out with at least one request of the device's preferred size */
+	if (ra->size < min_t(unsigned long, ra->io_pages, max))
+		ra->size = min_t(unsigned long, ra->io_pages, max);
 	ra->async_size = ra->size > req_size ? ra->size - req_size : ra->size;
 
 readit:
@@ -476,7 +628,10 @@ readit:
 		ra->size += ra->async_size;
 	}
 
-	return ra_submit(ra, mapping, filp);
+	actual = ra_submit(ra, mapping, filp);
+	trace_mm_filemap_readahead(mapping, offset, req_size, ra->start,
+				   ra->size, ra->async_size, pattern, actual);
+	return actual;
 }
 
 /**
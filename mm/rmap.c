@@ -471,6 +471,8 @@ int page_mapped_in_vma(struct page *page, struct vm_area_struct *vma)
 	address = vma_address(page, vma);
 	if (address == -EFAULT)		/* out of vma range */
 		return 0;
+	if (!PageAnon(page))
+		split_huge_file_pmd_address(vma, address);
 	pte = page_check_address(page, vma->vm_mm, address, &ptl, 1);
 	if (!pte)			/* the page is not in this mm */
 		return 0;
@@ -489,10 +491,9 @@ int page_referenced_one(struct page *page, struct vm_area_struct *vma,
 {
 	struct mm_struct *mm = vma->vm_mm;
 	int referenced = 0;
+	pmd_t *pmd;
 
 	if (unlikely(PageTransHuge(page))) {
-		pmd_t *pmd;
-
 		spin_lock(&mm->page_table_lock);
 		/*
 		 * rmap might return false positives; we must filter
@@ -516,6 +517,30 @@ int page_referenced_one(struct page *page, struct vm_area_struct *vma,
 		if (pmdp_clear_flush_young_notify(vma, address, pmd))
 			referenced++;
 		spin_unlock(&mm->page_table_lock);
+	} else if (!PageAnon(page) &&
+		   (pmd = page_check_file_pmd(page, mm, address))) {
+		unsigned long haddr = address & HPAGE_PMD_MASK;
+
+		if (vma->vm_flags & VM_LOCKED) {
+			spin_unlock(&mm->page_table_lock);
+			*mapcount = 0;	/* break early from loop */
+			*vm_flags |= VM_LOCKED;
+			goto out;
+		}
+
+		/*
+		 * All the pages behind a pagecache huge pmd share its
+		 * accessed bit: only the first one ages it, the others
+		 * just sample it.
+		 */
+		if (haddr == address) {
+			if (pmdp_clear_flush_young_notify(vma, haddr, pmd))
+				referenced++;
+		} else if (pmd_young(*pmd))
+			referenced++;
+		spin_unlock(&mm->page_table_lock);
+		if (referenced && unlikely(VM_SequentialReadHint(vma)))
+			referenced = 0;
 	} else {
 		pte_t *pte;
 		spinlock_t *ptl;
@@ -722,6 +747,7 @@ static int page_mkclean_one(struct page *page, struct vm_area_struct *vma,
 	spinlock_t *ptl;
 	int ret = 0;
 
+	split_huge_file_pmd_address(vma, address);
 	pte = page_check_address(page, mm, address, &ptl, 1);
 	if (!pte)
 		goto out;
@@ -1024,6 +1050,8 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	spinlock_t *ptl;
 	int ret = SWAP_AGAIN;
 
+	if (!PageAnon(page))
+		split_huge_file_pmd_address(vma, address);
 	pte = page_check_address(page, mm, address, &ptl, 0);
 	if (!pte)
 		goto out;
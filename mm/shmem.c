@@ -64,6 +64,7 @@ static struct vfsmount *shm_mnt;
 #include <linux/highmem.h>
 #include <linux/seq_file.h>
 #include <linux/magic.h>
+#include <linux/khugepaged.h>
 
 #include <asm/uaccess.h>
 #include <asm/pgtable.h>
@@ -80,8 +81,38 @@ enum sgp_type {
 	SGP_CACHE,	/* don't exceed i_size, may allocate page */
 	SGP_DIRTY,	/* like SGP_CACHE, but set new page dirty */
 	SGP_WRITE,	/* may exceed i_size, may allocate page */
+	SGP_HUGE,	/* like SGP_CACHE, huge pages preferred */
+	SGP_NOHUGE,	/* like SGP_CACHE, huge pages not wanted */
 };
 
+/*
+ * Values for the huge= mount option of tmpfs:
+ *
+ * SHMEM_HUGE_NEVER:
+ *	never allocate huge pages;
+ * SHMEM_HUGE_ALWAYS:
+ *	try to allocate a huge page whenever a page is instantiated;
+ * SHMEM_HUGE_WITHIN_SIZE:
+ *	only when the whole huge page lies within i_size,
+ *	or when madvise(MADV_HUGEPAGE) asks for it;
+ * SHMEM_HUGE_ADVISE:
+ *	only for mappings which madvise(MADV_HUGEPAGE).
+ *
+ * Two more may be written to /sys/kernel/mm/transparent_hugepage/shmem_enabled
+ * but are not mount options:
+ *
+ * SHMEM_HUGE_DENY:
+ *	disable huge pages on all mounts, for emergency use;
+ * SHMEM_HUGE_FORCE:
+ *	enable huge pages on all mounts regardless of option, for testing.
+ */
+#define SHMEM_HUGE_NEVER	0
+#define SHMEM_HUGE_ALWAYS	1
+#define SHMEM_HUGE_WITHIN_SIZE	2
+#define SHMEM_HUGE_ADVISE	3
+#define SHMEM_HUGE_DENY		(-1)
+#define SHMEM_HUGE_FORCE	(-2)
+
 #ifdef CONFIG_TMPFS
 static unsigned long shmem_default_max_blocks(void)
 {
@@ -139,6 +170,12 @@ static inline int shmem_acct_block(unsigned long flags)
 		security_vm_enough_memory_kern(VM_ACCT(PAGE_CACHE_SIZE)) : 0;
 }
 
+static inline int shmem_acct_blocks(unsigned long flags, long pages)
+{
+	return (flags & VM_NORESERVE) ?
+		security_vm_enough_memory_kern(pages * VM_ACCT(PAGE_CACHE_SIZE)) : 0;
+}
+
 static inline void shmem_unacct_blocks(unsigned long flags, long pages)
 {
 	if (flags & VM_NORESERVE)
@@ -789,6 +826,23 @@ static struct page *shmem_alloc_page(gfp_t gfp,
 	 */
 	return alloc_page_vma(gfp, &pvma, 0);
 }
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, pgoff_t hindex)
+{
+	struct vm_area_struct pvma;
+
+	/* Create a pseudo vma that just contains the policy */
+	pvma.vm_start = 0;
+	/* Bias interleave by inode number to distribute better across nodes */
+	pvma.vm_pgoff = hindex + info->vfs_inode.i_ino;
+	pvma.vm_ops = NULL;
+	pvma.vm_policy = mpol_shared_policy_lookup(&info->policy, hindex);
+
+	return alloc_pages_vma(gfp, HPAGE_PMD_ORDER, &pvma, 0, numa_node_id());
+}
+#endif
 #else /* !CONFIG_NUMA */
 #ifdef CONFIG_TMPFS
 static inline void shmem_show_mpol(struct seq_file *seq, struct mempolicy *mpol)
@@ -807,6 +861,14 @@ static inline struct page *shmem_alloc_page(gfp_t gfp,
 {
 	return alloc_page(gfp);
 }
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static inline struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, pgoff_t hindex)
+{
+	return alloc_pages(gfp, HPAGE_PMD_ORDER);
+}
+#endif
 #endif /* CONFIG_NUMA */
 
 #if !defined(CONFIG_NUMA) || !defined(CONFIG_TMPFS)
@@ -816,6 +878,224 @@ static inline struct mempolicy *shmem_get_sbmpol(struct shmem_sb_info *sbinfo)
 }
 #endif
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Huge pages on tmpfs: an HPAGE_PMD_ORDER block is allocated for the
+ * aligned range around a missing page and inserted into the page cache
+ * as HPAGE_PMD_NR ordinary pages.  Truncation, hole punching, swapout
+ * and migration keep working on those one page at a time; only the
+ * mapping is huge, see shmem_pmd_fault() and do_huge_pmd_file_page().
+ */
+static int shmem_huge __read_mostly;
+
+static int shmem_parse_huge(const char *str)
+{
+	if (!strcmp(str, "never"))
+		return SHMEM_HUGE_NEVER;
+	if (!strcmp(str, "always"))
+		return SHMEM_HUGE_ALWAYS;
+	if (!strcmp(str, "within_size"))
+		return SHMEM_HUGE_WITHIN_SIZE;
+	if (!strcmp(str, "advise"))
+		return SHMEM_HUGE_ADVISE;
+	if (!strcmp(str, "deny"))
+		return SHMEM_HUGE_DENY;
+	if (!strcmp(str, "force"))
+		return SHMEM_HUGE_FORCE;
+	return -EINVAL;
+}
+
+static const char *shmem_format_huge(int huge)
+{
+	switch (huge) {
+	case SHMEM_HUGE_NEVER:
+		return "never";
+	case SHMEM_HUGE_ALWAYS:
+		return "always";
+	case SHMEM_HUGE_WITHIN_SIZE:
+		return "within_size";
+	case SHMEM_HUGE_ADVISE:
+		return "advise";
+	case SHMEM_HUGE_DENY:
+		return "deny";
+	case SHMEM_HUGE_FORCE:
+		return "force";
+	default:
+		VM_BUG_ON(1);
+		return "bad_val";
+	}
+}
+
+static bool shmem_should_alloc_huge(struct inode *inode, pgoff_t index,
+				    enum sgp_type sgp)
+{
+	pgoff_t hindex = round_down(index, HPAGE_PMD_NR);
+	loff_t i_size;
+
+	if (!S_ISREG(inode->i_mode) || !has_transparent_hugepage())
+		return false;
+	if (shmem_huge == SHMEM_HUGE_FORCE)
+		return sgp != SGP_READ;
+	if (shmem_huge == SHMEM_HUGE_DENY ||
+	    sgp == SGP_READ || sgp == SGP_NOHUGE)
+		return false;
+
+	switch (SHMEM_SB(inode->i_sb)->huge) {
+	case SHMEM_HUGE_ALWAYS:
+		return true;
+	case SHMEM_HUGE_WITHIN_SIZE:
+		i_size = round_up(i_size_read(inode), PAGE_CACHE_SIZE);
+		if ((i_size >> PAGE_CACHE_SHIFT) >= hindex + HPAGE_PMD_NR)
+			return true;
+		/* fall through */
+	case SHMEM_HUGE_ADVISE:
+		return sgp == SGP_HUGE;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Check that nothing, neither page nor swap entry, occupies the range yet.
+ */
+static bool shmem_range_empty(struct address_space *mapping,
+			      pgoff_t start, unsigned int nr)
+{
+	void **slot;
+	pgoff_t index;
+	unsigned int found;
+
+	rcu_read_lock();
+	found = radix_tree_gang_lookup_slot(&mapping->page_tree,
+					    &slot, &index, start, 1);
+	rcu_read_unlock();
+	return !found || index >= start + nr;
+}
+
+static int shmem_add_new_page(struct page *page,
+		struct address_space *mapping, pgoff_t index, gfp_t gfp)
+{
+	int error;
+
+	SetPageSwapBacked(page);
+	__set_page_locked(page);
+	error = mem_cgroup_cache_charge(page, current->mm,
+					gfp & GFP_RECLAIM_MASK);
+	if (!error)
+		error = shmem_add_to_page_cache(page, mapping, index,
+					gfp, NULL);
+	if (error)
+		return error;
+	lru_cache_add_anon(page);
+	flush_dcache_page(page);
+	SetPageUptodate(page);
+	return 0;
+}
+
+/*
+ * Returns the new page at @index, locked and uptodate, or NULL if the
+ * caller should fall back to allocating a single page.  The rest of the
+ * block is added best-effort: a sibling index raced in by someone else
+ * just costs us the huge mapping of that range, not correctness.
+ */
+static struct page *shmem_alloc_and_add_huge(struct inode *inode,
+			pgoff_t index, enum sgp_type sgp, gfp_t gfp)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
+	pgoff_t hindex = round_down(index, HPAGE_PMD_NR);
+	struct page *head, *page;
+	gfp_t huge_gfp;
+	long nr = 1;
+	int i;
+
+	if (!shmem_range_empty(mapping, hindex, HPAGE_PMD_NR))
+		return NULL;
+	if (shmem_acct_blocks(info->flags, HPAGE_PMD_NR))
+		return NULL;
+	if (sbinfo->max_blocks) {
+		if (sbinfo->max_blocks < HPAGE_PMD_NR ||
+		    percpu_counter_compare(&sbinfo->used_blocks,
+				sbinfo->max_blocks - HPAGE_PMD_NR) > 0)
+			goto unacct;
+		percpu_counter_add(&sbinfo->used_blocks, HPAGE_PMD_NR);
+	}
+
+	huge_gfp = (gfp | __GFP_NOMEMALLOC | __GFP_NORETRY | __GFP_NOWARN |
+		    __GFP_NO_KSWAPD) & ~__GFP_COMP;
+	if (!(transparent_hugepage_flags &
+	      (1<<TRANSPARENT_HUGEPAGE_DEFRAG_FLAG)) &&
+	    !(sgp == SGP_HUGE && (transparent_hugepage_flags &
+	      (1<<TRANSPARENT_HUGEPAGE_DEFRAG_REQ_MADV_FLAG))))
+		huge_gfp &= ~__GFP_WAIT;
+	head = shmem_alloc_hugepage(huge_gfp, info, hindex);
+	if (!head) {
+		count_vm_event(THP_FILE_FALLBACK);
+		goto decused;
+	}
+	count_vm_event(THP_FILE_ALLOC);
+
+	split_page(head, HPAGE_PMD_ORDER);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		clear_highpage(head + i);
+		cond_resched();
+	}
+
+	page = head + (index - hindex);
+	if (shmem_add_new_page(page, mapping, index, gfp)) {
+		unlock_page(page);
+		for (i = 0; i < HPAGE_PMD_NR; i++)
+			page_cache_release(head + i);
+		goto decused;
+	}
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		struct page *sibling = head + i;
+
+		if (sibling == page)
+			continue;
+		if (!shmem_add_new_page(sibling, mapping, hindex + i, gfp))
+			nr++;
+		unlock_page(sibling);
+		page_cache_release(sibling);
+	}
+
+	spin_lock(&info->lock);
+	info->alloced += nr;
+	inode->i_blocks += nr * BLOCKS_PER_PAGE;
+	shmem_recalc_inode(inode);
+	spin_unlock(&info->lock);
+
+	if (nr < HPAGE_PMD_NR) {
+		if (sbinfo->max_blocks)
+			percpu_counter_add(&sbinfo->used_blocks,
+					   nr - HPAGE_PMD_NR);
+		shmem_unacct_blocks(info->flags, HPAGE_PMD_NR - nr);
+	}
+	return page;
+
+decused:
+	if (sbinfo->max_blocks)
+		percpu_counter_add(&sbinfo->used_blocks, -HPAGE_PMD_NR);
+unacct:
+	shmem_unacct_blocks(info->flags, HPAGE_PMD_NR);
+	return NULL;
+}
+#else /* !CONFIG_TRANSPARENT_HUGEPAGE */
+static inline bool shmem_should_alloc_huge(struct inode *inode,
+				pgoff_t index, enum sgp_type sgp)
+{
+	return false;
+}
+
+static inline struct page *shmem_alloc_and_add_huge(struct inode *inode,
+			pgoff_t index, enum sgp_type sgp, gfp_t gfp)
+{
+	return NULL;
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 /*
  * shmem_getpage_gfp - find page in cache, or get from swap, or allocate
  *
@@ -838,7 +1118,7 @@ static int shmem_getpage_gfp(struct inode *inode, pgoff_t index,
 		return -EFBIG;
 repeat:
 	swap.val = 0;
-	page = find_lock_page(mapping, index);
+	page = find_lock_entry(mapping, index);
 	if (radix_tree_exceptional_entry(page)) {
 		swap = radix_to_swp_entry(page);
 		page = NULL;
@@ -919,6 +1199,10 @@ repeat:
 		set_page_dirty(page);
 		swap_free(swap);
 
+	} else if (shmem_should_alloc_huge(inode, index, sgp) &&
+		   (page = shmem_alloc_and_add_huge(inode, index, sgp, gfp))) {
+		if (sgp == SGP_DIRTY)
+			set_page_dirty(page);
 	} else {
 		if (shmem_acct_block(info->flags)) {
 			error = -ENOSPC;
@@ -990,7 +1274,7 @@ unacct:
 	shmem_unacct_blocks(info->flags, 1);
 failed:
 	if (swap.val && error != -EINVAL) {
-		struct page *test = find_get_page(mapping, index);
+		struct page *test = find_get_entry(mapping, index);
 		if (test && !radix_tree_exceptional_entry(test))
 			page_cache_release(test);
 		/* Have another try if the entry has changed */
@@ -1013,19 +1297,104 @@ failed:
 	return error;
 }
 
+static inline enum sgp_type shmem_vma_sgp(struct vm_area_struct *vma)
+{
+	if (vma->vm_flags & VM_NOHUGEPAGE)
+		return SGP_NOHUGE;
+	if (vma->vm_flags & VM_HUGEPAGE)
+		return SGP_HUGE;
+	return SGP_CACHE;
+}
+
 static int shmem_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 {
 	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
 	int error;
 	int ret = VM_FAULT_LOCKED;
 
-	error = shmem_getpage(inode, vmf->pgoff, &vmf->page, SGP_CACHE, &ret);
+	error = shmem_getpage(inode, vmf->pgoff, &vmf->page,
+			      shmem_vma_sgp(vma), &ret);
 	if (error)
 		return ((error == -ENOMEM) ? VM_FAULT_OOM : VM_FAULT_SIGBUS);
 
 	return ret;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Instantiate the page at @address, which brings in the rest of its huge
+ * page too if the mount allows, then try to map the whole aligned range
+ * with a single pmd.  Anything that rules that out falls back to ptes.
+ */
+static int shmem_pmd_fault(struct vm_area_struct *vma, unsigned long address,
+			   pmd_t *pmd, unsigned int flags)
+{
+	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	struct page *page;
+	int error;
+	int ret = 0;
+
+	if (shmem_huge == SHMEM_HUGE_DENY ||
+	    (shmem_huge != SHMEM_HUGE_FORCE &&
+	     SHMEM_SB(inode->i_sb)->huge == SHMEM_HUGE_NEVER))
+		return VM_FAULT_FALLBACK;
+	if (!(vma->vm_flags & VM_SHARED) ||
+	    vma->vm_flags & (VM_NONLINEAR | VM_NOHUGEPAGE))
+		return VM_FAULT_FALLBACK;
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end ||
+	    linear_page_index(vma, haddr) & (HPAGE_PMD_NR - 1))
+		return VM_FAULT_FALLBACK;
+	if (unlikely(khugepaged_enter_file(vma)))
+		return VM_FAULT_OOM;
+
+	error = shmem_getpage(inode, linear_page_index(vma, address), &page,
+			      shmem_vma_sgp(vma), &ret);
+	if (error)
+		return ((error == -ENOMEM) ? VM_FAULT_OOM : VM_FAULT_SIGBUS);
+	unlock_page(page);
+	page_cache_release(page);
+
+	return ret | do_huge_pmd_file_page(vma->vm_mm, vma, address,
+					   pmd, flags);
+}
+
+/*
+ * Whether khugepaged should try to collapse this shared mapping of a
+ * tmpfs file into huge pmds.
+ */
+bool shmem_huge_enabled(struct vm_area_struct *vma)
+{
+	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
+	loff_t i_size;
+	pgoff_t off;
+
+	if (inode->i_sb->s_op != &shmem_ops || !S_ISREG(inode->i_mode))
+		return false;
+	if (!has_transparent_hugepage())
+		return false;
+	if (shmem_huge == SHMEM_HUGE_FORCE)
+		return true;
+	if (shmem_huge == SHMEM_HUGE_DENY)
+		return false;
+
+	switch (SHMEM_SB(inode->i_sb)->huge) {
+	case SHMEM_HUGE_ALWAYS:
+		return true;
+	case SHMEM_HUGE_WITHIN_SIZE:
+		off = round_up(vma->vm_pgoff, HPAGE_PMD_NR);
+		i_size = round_up(i_size_read(inode), PAGE_CACHE_SIZE);
+		if ((i_size >> PAGE_CACHE_SHIFT) >= off + HPAGE_PMD_NR)
+			return true;
+		/* fall through */
+	case SHMEM_HUGE_ADVISE:
+		return vma->vm_flags & VM_HUGEPAGE;
+	default:
+		return false;
+	}
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 #ifdef CONFIG_NUMA
 static int shmem_set_policy(struct vm_area_struct *vma, struct mempolicy *mpol)
 {
@@ -1078,6 +1447,83 @@ static int shmem_mmap(struct file *file, struct vm_area_struct *vma)
 	return 0;
 }
 
+/*
+ * Place a mapping big enough to be mapped by huge pmds so that its file
+ * offset and virtual address agree modulo HPAGE_PMD_SIZE: get a larger
+ * area than asked for and trim it.  Hints and MAP_FIXED are respected,
+ * and if anything goes wrong the unaligned address is used as before.
+ */
+unsigned long shmem_get_unmapped_area(struct file *file,
+				      unsigned long uaddr, unsigned long len,
+				      unsigned long pgoff, unsigned long flags)
+{
+	unsigned long (*get_area)(struct file *,
+		unsigned long, unsigned long, unsigned long, unsigned long);
+	unsigned long addr;
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	unsigned long offset;
+	unsigned long inflated_len;
+	unsigned long inflated_addr;
+	unsigned long inflated_offset;
+	struct super_block *sb;
+#endif
+
+	if (len > TASK_SIZE)
+		return -ENOMEM;
+
+	get_area = current->mm->get_unmapped_area;
+	addr = get_area(file, uaddr, len, pgoff, flags);
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (IS_ERR_VALUE(addr) || (addr & ~PAGE_MASK) ||
+	    addr > TASK_SIZE - len)
+		return addr;
+	if (shmem_huge == SHMEM_HUGE_DENY || !has_transparent_hugepage())
+		return addr;
+	if (len < HPAGE_PMD_SIZE || (flags & MAP_FIXED) || uaddr)
+		return addr;
+	/* Only shared mappings can stay huge, private ones get COWed */
+	if (!(flags & MAP_SHARED))
+		return addr;
+
+	if (shmem_huge != SHMEM_HUGE_FORCE) {
+		if (file)
+			sb = file->f_path.dentry->d_inode->i_sb;
+		else if (IS_ERR(shm_mnt))
+			return addr;
+		else	/* shared anonymous, shmem_zero_setup() comes later */
+			sb = shm_mnt->mnt_sb;
+		if (SHMEM_SB(sb)->huge == SHMEM_HUGE_NEVER)
+			return addr;
+	}
+
+	offset = (pgoff << PAGE_SHIFT) & (HPAGE_PMD_SIZE - 1);
+	if (offset && offset + len < 2 * HPAGE_PMD_SIZE)
+		return addr;
+	if ((addr & (HPAGE_PMD_SIZE - 1)) == offset)
+		return addr;
+
+	inflated_len = len + HPAGE_PMD_SIZE - PAGE_SIZE;
+	if (inflated_len > TASK_SIZE || inflated_len < len)
+		return addr;
+
+	inflated_addr = get_area(NULL, 0, inflated_len, 0, flags);
+	if (IS_ERR_VALUE(inflated_addr) || (inflated_addr & ~PAGE_MASK))
+		return addr;
+
+	inflated_offset = inflated_addr & (HPAGE_PMD_SIZE - 1);
+	inflated_addr += offset - inflated_offset;
+	if (inflated_offset > offset)
+		inflated_addr += HPAGE_PMD_SIZE;
+
+	if (inflated_addr > TASK_SIZE - len)
+		return addr;
+	return inflated_addr;
+#else
+	return addr;
+#endif
+}
+
 static struct inode *shmem_get_inode(struct super_block *sb, int mode,
 					dev_t dev, unsigned long flags)
 {
@@ -1855,6 +2301,17 @@ static int shmem_parse_options(char *options, struct shmem_sb_info *sbinfo,
 		} else if (!strcmp(this_char,"mpol")) {
 			if (mpol_parse_str(value, &sbinfo->mpol, 1))
 				goto bad_val;
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+		} else if (!strcmp(this_char,"huge")) {
+			int huge = shmem_parse_huge(value);
+
+			if (huge < 0)
+				goto bad_val;
+			if (!has_transparent_hugepage() &&
+			    huge != SHMEM_HUGE_NEVER)
+				goto bad_val;
+			sbinfo->huge = huge;
+#endif
 		} else {
 			printk(KERN_ERR "tmpfs: Bad mount option %s\n",
 			       this_char);
@@ -1901,6 +2358,7 @@ static int shmem_remount_fs(struct super_block *sb, int *flags, char *data)
 	sbinfo->max_blocks  = config.max_blocks;
 	sbinfo->max_inodes  = config.max_inodes;
 	sbinfo->free_inodes = config.max_inodes - inodes;
+	sbinfo->huge = config.huge;
 
 	/*
 	 * Preserve previous mempolicy unless mpol remount option was specified.
@@ -1929,6 +2387,11 @@ static int shmem_show_options(struct seq_file *seq, struct vfsmount *vfs)
 		seq_printf(seq, ",uid=%u", sbinfo->uid);
 	if (sbinfo->gid != 0)
 		seq_printf(seq, ",gid=%u", sbinfo->gid);
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	/* Rightly or wrongly, show huge mount option unmasked by shmem_huge */
+	if (sbinfo->huge)
+		seq_printf(seq, ",huge=%s", shmem_format_huge(sbinfo->huge));
+#endif
 	shmem_show_mpol(seq, sbinfo->mpol);
 	return 0;
 }
@@ -2066,6 +2529,7 @@ static const struct address_space_operations shmem_aops = {
 
 static const struct file_operations shmem_file_operations = {
 	.mmap		= shmem_mmap,
+	.get_unmapped_area = shmem_get_unmapped_area,
 #ifdef CONFIG_TMPFS
 	.llseek		= generic_file_llseek,
 	.read		= do_sync_read,
@@ -2140,6 +2604,9 @@ static const struct super_operations shmem_ops = {
 
 static const struct vm_operations_struct shmem_vm_ops = {
 	.fault		= shmem_fault,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.pmd_fault	= shmem_pmd_fault,
+#endif
 #ifdef CONFIG_NUMA
 	.set_policy     = shmem_set_policy,
 	.get_policy     = shmem_get_policy,
@@ -2185,6 +2652,13 @@ int __init shmem_init(void)
 		printk(KERN_ERR "Could not kern_mount tmpfs\n");
 		goto out1;
 	}
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (has_transparent_hugepage() && shmem_huge > SHMEM_HUGE_DENY)
+		SHMEM_SB(shm_mnt->mnt_sb)->huge = shmem_huge;
+	else
+		shmem_huge = 0; /* just in case it was patched */
+#endif
 	return 0;
 
 out1:
@@ -2198,6 +2672,77 @@ out4:
 	return error;
 }
 
+#if defined(CONFIG_TRANSPARENT_HUGEPAGE) && defined(CONFIG_SYSFS)
+static ssize_t shmem_enabled_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	int values[] = {
+		SHMEM_HUGE_ALWAYS,
+		SHMEM_HUGE_WITHIN_SIZE,
+		SHMEM_HUGE_ADVISE,
+		SHMEM_HUGE_NEVER,
+		SHMEM_HUGE_DENY,
+		SHMEM_HUGE_FORCE,
+	};
+	int i, count;
+
+	for (i = 0, count = 0; i < ARRAY_SIZE(values); i++) {
+		const char *fmt = shmem_huge == values[i] ? "[%s] " : "%s ";
+
+		count += sprintf(buf + count, fmt,
+				shmem_format_huge(values[i]));
+	}
+	buf[count - 1] = '\n';
+	return count;
+}
+
+static ssize_t shmem_enabled_store(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	char tmp[16];
+	int huge;
+
+	if (count + 1 > sizeof(tmp))
+		return -EINVAL;
+	memcpy(tmp, buf, count);
+	tmp[count] = '\0';
+	if (count && tmp[count - 1] == '\n')
+		tmp[count - 1] = '\0';
+
+	huge = shmem_parse_huge(tmp);
+	if (huge == -EINVAL)
+		return -EINVAL;
+	if (!has_transparent_hugepage() &&
+	    huge != SHMEM_HUGE_NEVER && huge != SHMEM_HUGE_DENY)
+		return -EINVAL;
+
+	shmem_huge = huge;
+	if (shmem_huge > SHMEM_HUGE_DENY)
+		SHMEM_SB(shm_mnt->mnt_sb)->huge = shmem_huge;
+	return count;
+}
+
+struct kobj_attribute shmem_enabled_attr =
+	__ATTR(shmem_enabled, 0644, shmem_enabled_show, shmem_enabled_store);
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE && CONFIG_SYSFS */
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static int __init setup_transparent_hugepage_shmem(char *str)
+{
+	int huge;
+
+	huge = shmem_parse_huge(str);
+	if (huge == -EINVAL) {
+		printk(KERN_WARNING "transparent_hugepage_shmem= cannot parse, ignored\n");
+		return 0;
+	}
+
+	shmem_huge = huge;
+	return 1;
+}
+__setup("transparent_hugepage_shmem=", setup_transparent_hugepage_shmem);
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 #else /* !CONFIG_SHMEM */
 
 /*
@@ -3662,6 +3662,61 @@ void *kmem_cache_alloc(struct kmem_cache *cachep, gfp_t flags)
 }
 EXPORT_SYMBOL(kmem_cache_alloc);
 
+/**
+ * kmem_cache_alloc_bulk - Allocate an array of objects
+ * @cachep: The cache to allocate from.
+ * @flags: See kmalloc().
+ * @size: The number of objects.
+ * @p: Array to store the objects in.
+ *
+ * Takes the objects from the per cpu array cache with interrupts disabled
+ * only once, refilling it as needed.  Returns @size on success; on
+ * failure nothing is allocated and 0 is returned.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *cachep, gfp_t flags, size_t size,
+			  void **p)
+{
+	void *caller = __builtin_return_address(0);
+	size_t i, nr;
+
+	flags &= gfp_allowed_mask;
+
+	lockdep_trace_alloc(flags);
+
+	if (slab_should_failslab(cachep, flags))
+		return 0;
+
+	cache_alloc_debugcheck_before(cachep, flags);
+	local_irq_disable();
+	for (nr = 0; nr < size; nr++) {
+		p[nr] = __do_cache_alloc(cachep, flags);
+		if (unlikely(!p[nr]))
+			break;
+	}
+	local_irq_enable();
+
+	for (i = 0; i < nr; i++) {
+		void *objp;
+
+		objp = cache_alloc_debugcheck_after(cachep, flags, p[i], caller);
+		kmemleak_alloc_recursive(objp, obj_size(cachep), 1,
+					 cachep->flags, flags);
+		kmemcheck_slab_alloc(cachep, flags, objp, obj_size(cachep));
+		if (unlikely(flags & __GFP_ZERO))
+			memset(objp, 0, obj_size(cachep));
+		trace_kmem_cache_alloc(_RET_IP_, objp, obj_size(cachep),
+				       cachep->buffer_size, flags);
+		p[i] = objp;
+	}
+
+	if (unlikely(nr < size)) {
+		kmem_cache_free_bulk(cachep, nr, p);
+		return 0;
+	}
+	return size;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 #ifdef CONFIG_KMEMTRACE
 void *kmem_cache_alloc_notrace(struct kmem_cache *cachep, gfp_t flags)
 {
@@ -3872,6 +3927,36 @@ void kmem_cache_free(struct kmem_cache *cachep, void *objp)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/**
+ * kmem_cache_free_bulk - Free an array of objects
+ * @cachep: The cache the objects were allocated from.
+ * @size: The number of objects.
+ * @p: The objects.
+ *
+ * Like kmem_cache_free() on each object, but with interrupts disabled
+ * only once for the whole array.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *cachep, size_t size, void **p)
+{
+	unsigned long flags;
+	size_t i;
+
+	local_irq_save(flags);
+	for (i = 0; i < size; i++) {
+		void *objp = p[i];
+
+		debug_check_no_locks_freed(objp, obj_size(cachep));
+		if (!(cachep->flags & SLAB_DEBUG_OBJECTS))
+			debug_check_no_obj_freed(objp, obj_size(cachep));
+		__cache_free(cachep, objp);
+	}
+	local_irq_restore(flags);
+
+	for (i = 0; i < size; i++)
+		trace_kmem_cache_free(_RET_IP_, p[i]);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
 /**
  * kfree - free previously allocated memory
  * @objp: pointer returned by kmalloc.
@@ -9,6 +9,7 @@
  */
 
 #include <linux/mm.h>
+#include <linux/uaccess.h>
 #include <linux/swap.h> /* struct reclaim_state */
 #include <linux/module.h>
 #include <linux/bit_spinlock.h>
@@ -224,6 +225,68 @@ static inline void stat(struct kmem_cache_cpu *c, enum stat_item si)
 #endif
 }
 
+/*
+ * The fastpaths run with interrupts enabled.  They read the cpu's tid,
+ * then the freelist, and commit with a cmpxchg of both.  Everything else
+ * that changes the cpu freelist or cpu slab does so with interrupts off
+ * and bumps the tid, so a fastpath interrupted by it fails the cmpxchg
+ * and retries.  The fastpaths disable preemption, so the tid does not
+ * need to identify the cpu.
+ */
+static inline unsigned long next_tid(unsigned long tid)
+{
+	return tid + 1;
+}
+
+#ifdef CONFIG_CMPXCHG_LOCAL
+/* Set if this cpu can do cmpxchg_double_local() */
+static int slub_cmpxchg_double __read_mostly;
+#endif
+
+static inline bool cpu_freelist_cmpxchg(struct kmem_cache_cpu *c,
+		void **freelist_old, unsigned long tid_old,
+		void **freelist_new, unsigned long tid_new)
+{
+	unsigned long flags;
+	bool ret;
+
+#ifdef CONFIG_CMPXCHG_LOCAL
+	/* Misaligned only if kmalloc'ed from a debug cache */
+	if (likely(slub_cmpxchg_double &&
+		   IS_ALIGNED((unsigned long)&c->freelist,
+			      2 * sizeof(void *))))
+		return cmpxchg_double_local(&c->freelist, &c->tid,
+					    freelist_old, tid_old,
+					    freelist_new, tid_new);
+#endif
+	local_irq_save(flags);
+	ret = c->freelist == freelist_old && c->tid == tid_old;
+	if (ret) {
+		c->freelist = freelist_new;
+		c->tid = tid_new;
+	}
+	local_irq_restore(flags);
+	return ret;
+}
+
+/*
+ * The fastpath may read the free pointer of an object that an interrupt
+ * has just handed out and whose slab has been freed since; its cmpxchg
+ * fails then, but the read must not fault.
+ */
+static inline void *get_freepointer_safe(struct kmem_cache_cpu *c,
+					 void **object)
+{
+	void *p;
+
+#ifdef CONFIG_DEBUG_PAGEALLOC
+	probe_kernel_read(&p, object + c->offset, sizeof(p));
+#else
+	p = object[c->offset];
+#endif
+	return p;
+}
+
 /********************************************************************
  * 			Core slab cache functions
  *******************************************************************/
@@ -1464,6 +1527,82 @@ static void unfreeze_slab(struct kmem_cache *s, struct page *page, int tail)
 	}
 }
 
+/*
+ * Move the cpu partial slabs back to the node partial lists, taking each
+ * node's list_lock once for a run of slabs from that node.  Slabs that
+ * have become empty meanwhile are freed if the node has enough partials.
+ *
+ * Interrupts must be disabled.
+ */
+static void unfreeze_partials(struct kmem_cache *s, struct kmem_cache_cpu *c)
+{
+	struct kmem_cache_node *n = NULL;
+	struct page *page, *discard_page = NULL;
+
+	while ((page = c->partial)) {
+		struct kmem_cache_node *n2 = get_node(s, page_to_nid(page));
+
+		c->partial = page->next;
+
+		if (n != n2) {
+			if (n)
+				spin_unlock(&n->list_lock);
+			n = n2;
+			spin_lock(&n->list_lock);
+		}
+
+		/* The slab lock nests outside the list_lock */
+		if (!slab_trylock(page)) {
+			spin_unlock(&n->list_lock);
+			slab_lock(page);
+			spin_lock(&n->list_lock);
+		}
+
+		__ClearPageSlubFrozen(page);
+		if (unlikely(!page->inuse && n->nr_partial >= s->min_partial)) {
+			/* No objects left to be freed into it */
+			slab_unlock(page);
+			page->next = discard_page;
+			discard_page = page;
+		} else {
+			n->nr_partial++;
+			list_add_tail(&page->lru, &n->partial);
+			slab_unlock(page);
+		}
+	}
+	if (n)
+		spin_unlock(&n->list_lock);
+	c->partial_objects = 0;
+	stat(c, CPU_PARTIAL_DRAIN);
+
+	while (discard_page) {
+		page = discard_page;
+		discard_page = page->next;
+		stat(c, FREE_SLAB);
+		discard_slab(s, page);
+	}
+}
+
+/*
+ * A free made a full slab partial. Keep it frozen on this cpu's partial
+ * list instead of taking the node list_lock, draining the list first if it
+ * holds more than s->cpu_partial free objects.
+ *
+ * Interrupts must be disabled.
+ */
+static void put_cpu_partial(struct kmem_cache *s, struct page *page, int free)
+{
+	struct kmem_cache_cpu *c = get_cpu_slab(s, smp_processor_id());
+
+	if (c->partial && c->partial_objects + free > s->cpu_partial)
+		unfreeze_partials(s, c);
+
+	page->next = c->partial;
+	c->partial = page;
+	c->partial_objects += free;
+	stat(c, CPU_PARTIAL_FREE);
+}
+
 /*
  * Remove the cpu slab
  */
@@ -1494,6 +1633,7 @@ static void deactivate_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 		page->inuse--;
 	}
 	c->page = NULL;
+	c->tid = next_tid(c->tid);
 	unfreeze_slab(s, page, tail);
 }
 
@@ -1515,6 +1655,8 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 
 	if (likely(c && c->page))
 		flush_slab(s, c);
+	if (c && c->partial)
+		unfreeze_partials(s, c);
 }
 
 static void flush_cpu_slab(void *d)
@@ -1609,7 +1751,7 @@ slab_out_of_memory(struct kmem_cache *s, gfp_t gfpflags, int nid)
  * Slow path. The lockless freelist is empty or we need to perform
  * debugging duties.
  *
- * Interrupts are disabled.
+ * Interrupts are disabled here, while we work on this cpu's slab.
  *
  * Processing is still very fast if new objects have been freed to the
  * regular freelist. In that case we simply take over the regular freelist
@@ -1624,14 +1766,29 @@ slab_out_of_memory(struct kmem_cache *s, gfp_t gfpflags, int nid)
  * a call to the page allocator and the setup of a new slab.
  */
 static void *__slab_alloc(struct kmem_cache *s, gfp_t gfpflags, int node,
-			  unsigned long addr, struct kmem_cache_cpu *c)
+			  unsigned long addr)
 {
 	void **object;
 	struct page *new;
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
 
 	/* We handle __GFP_ZERO in the caller */
 	gfpflags &= ~__GFP_ZERO;
 
+	local_irq_save(flags);
+	c = get_cpu_slab(s, smp_processor_id());
+
+	/* An interrupt may have refilled the freelist meanwhile */
+	object = c->freelist;
+	if (unlikely(object && node_match(c, node))) {
+		c->freelist = object[c->offset];
+		c->tid = next_tid(c->tid);
+		stat(c, ALLOC_FASTPATH);
+		local_irq_restore(flags);
+		return object;
+	}
+
 	if (!c->page)
 		goto new_slab;
 
@@ -1649,18 +1806,32 @@ load_freelist:
 		goto debug;
 
 	c->freelist = object[c->offset];
+	c->tid = next_tid(c->tid);
 	c->page->inuse = c->page->objects;
 	c->page->freelist = NULL;
 	c->node = page_to_nid(c->page);
 unlock_out:
 	slab_unlock(c->page);
 	stat(c, ALLOC_SLOWPATH);
+	local_irq_restore(flags);
 	return object;
 
 another_slab:
 	deactivate_slab(s, c);
 
 new_slab:
+	new = c->partial;
+	if (new && (node == -1 || page_to_nid(new) == node)) {
+		c->partial = new->next;
+		c->partial_objects -= new->objects - new->inuse;
+		if (!c->partial || c->partial_objects < 0)
+			c->partial_objects = 0;
+		c->page = new;
+		slab_lock(new);
+		stat(c, CPU_PARTIAL_ALLOC);
+		goto load_freelist;
+	}
+
 	new = get_partial(s, gfpflags, node);
 	if (new) {
 		c->page = new;
@@ -1686,6 +1857,7 @@ new_slab:
 		c->page = new;
 		goto load_freelist;
 	}
+	local_irq_restore(flags);
 	if (!(gfpflags & __GFP_NOWARN) && printk_ratelimit())
 		slab_out_of_memory(s, gfpflags, node);
 	return NULL;
@@ -1707,14 +1879,16 @@ debug:
  * The fastpath works by first checking if the lockless freelist can be used.
  * If not then __slab_alloc is called for slow processing.
  *
- * Otherwise we can simply pick the next object from the lockless free list.
+ * Otherwise we can simply pick the next object from the lockless free list,
+ * committing with a cmpxchg on (freelist, tid) rather than disabling
+ * interrupts.
  */
 static __always_inline void *slab_alloc(struct kmem_cache *s,
 		gfp_t gfpflags, int node, unsigned long addr)
 {
 	void **object;
 	struct kmem_cache_cpu *c;
-	unsigned long flags;
+	unsigned long tid;
 	unsigned int objsize;
 
 	gfpflags &= gfp_allowed_mask;
@@ -1725,24 +1899,38 @@ static __always_inline void *slab_alloc(struct kmem_cache *s,
 	if (should_failslab(s->objsize, gfpflags))
 		return NULL;
 
-	local_irq_save(flags);
+redo:
+	preempt_disable();
 	c = get_cpu_slab(s, smp_processor_id());
 	objsize = c->objsize;
-	if (unlikely(!c->freelist || !node_match(c, node)))
 
-		object = __slab_alloc(s, gfpflags, node, addr, c);
+	/*
+	 * The tid must be read before the freelist, so that a change to the
+	 * freelist by an interrupt in between makes the cmpxchg fail.
+	 */
+	tid = c->tid;
+	barrier();
 
-	else {
-		object = c->freelist;
-		c->freelist = object[c->offset];
+	object = c->freelist;
+	if (unlikely(!object || !node_match(c, node))) {
+		preempt_enable();
+		object = __slab_alloc(s, gfpflags, node, addr);
+	} else {
+		if (unlikely(!cpu_freelist_cmpxchg(c, object, tid,
+				get_freepointer_safe(c, object),
+				next_tid(tid)))) {
+			stat(c, CMPXCHG_DOUBLE_CPU_FAIL);
+			preempt_enable();
+			goto redo;
+		}
 		stat(c, ALLOC_FASTPATH);
+		preempt_enable();
 	}
-	local_irq_restore(flags);
 
 	if (unlikely((gfpflags & __GFP_ZERO) && object))
 		memset(object, 0, objsize);
 
-	kmemcheck_slab_alloc(s, gfpflags, object, c->objsize);
+	kmemcheck_slab_alloc(s, gfpflags, object, objsize);
 	kmemleak_alloc_recursive(object, objsize, 1, s->flags, gfpflags);
 
 	return object;
@@ -1796,12 +1984,17 @@ EXPORT_SYMBOL(kmem_cache_alloc_node_notrace);
  * So we still attempt to reduce cache line usage. Just take the slab
  * lock and free the item. If there is no additional partial page
  * handling required then we can return immediately.
+ *
+ * Bulk frees hand over cnt objects of the same slab at once, already
+ * chained from head to tail through their free pointers.  Slabs under
+ * debugging always get them one at a time.
  */
 static void __slab_free(struct kmem_cache *s, struct page *page,
-			void *x, unsigned long addr, unsigned int offset)
+			void *head, void *tail, int cnt,
+			unsigned long addr, unsigned int offset)
 {
 	void *prior;
-	void **object = (void *)x;
+	void **object = tail;
 	struct kmem_cache_cpu *c;
 
 	c = get_cpu_slab(s, raw_smp_processor_id());
@@ -1813,8 +2006,8 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 
 checks_ok:
 	prior = object[offset] = page->freelist;
-	page->freelist = object;
-	page->inuse--;
+	page->freelist = head;
+	page->inuse -= cnt;
 
 	if (unlikely(PageSlubFrozen(page))) {
 		stat(c, FREE_FROZEN);
@@ -1826,9 +2019,17 @@ checks_ok:
 
 	/*
 	 * Objects left in the slab. If it was not on the partial list before
-	 * then add it.
+	 * then add it, to this cpu's partial list if the cache keeps one.
 	 */
 	if (unlikely(!prior)) {
+		if (s->cpu_partial && !(SLABDEBUG && PageSlubDebug(page))) {
+			int free = page->objects - page->inuse;
+
+			__SetPageSlubFrozen(page);
+			slab_unlock(page);
+			put_cpu_partial(s, page, free);
+			return;
+		}
 		add_partial(get_node(s, page_to_nid(page)), page, 1);
 		stat(c, FREE_ADD_PARTIAL);
 	}
@@ -1851,11 +2052,20 @@ slab_empty:
 	return;
 
 debug:
-	if (!free_debug_processing(s, page, x, addr))
+	if (!free_debug_processing(s, page, head, addr))
 		goto out_unlock;
 	goto checks_ok;
 }
 
+static __always_inline void slab_free_hook(struct kmem_cache *s, void *x)
+{
+	kmemleak_free_recursive(x, s->flags);
+	kmemcheck_slab_free(s, x, s->objsize);
+	debug_check_no_locks_freed(x, s->objsize);
+	if (!(s->flags & SLAB_DEBUG_OBJECTS))
+		debug_check_no_obj_freed(x, s->objsize);
+}
+
 /*
  * Fastpath with forced inlining to produce a kfree and kmem_cache_free that
  * can perform fastpath freeing without additional function calls.
@@ -1872,23 +2082,35 @@ static __always_inline void slab_free(struct kmem_cache *s,
 {
 	void **object = (void *)x;
 	struct kmem_cache_cpu *c;
+	unsigned long tid;
 	unsigned long flags;
 
-	kmemleak_free_recursive(x, s->flags);
-	local_irq_save(flags);
+	slab_free_hook(s, x);
+
+redo:
+	preempt_disable();
 	c = get_cpu_slab(s, smp_processor_id());
-	kmemcheck_slab_free(s, object, c->objsize);
-	debug_check_no_locks_freed(object, c->objsize);
-	if (!(s->flags & SLAB_DEBUG_OBJECTS))
-		debug_check_no_obj_freed(object, c->objsize);
+	tid = c->tid;
+	barrier();
+
 	if (likely(page == c->page && c->node >= 0)) {
-		object[c->offset] = c->freelist;
-		c->freelist = object;
+		void **freelist = c->freelist;
+
+		object[c->offset] = freelist;
+		if (unlikely(!cpu_freelist_cmpxchg(c, freelist, tid,
+						   object, next_tid(tid)))) {
+			stat(c, CMPXCHG_DOUBLE_CPU_FAIL);
+			preempt_enable();
+			goto redo;
+		}
 		stat(c, FREE_FASTPATH);
-	} else
-		__slab_free(s, page, x, addr, c->offset);
-
-	local_irq_restore(flags);
+		preempt_enable();
+	} else {
+		preempt_enable();
+		local_irq_save(flags);
+		__slab_free(s, page, x, x, 1, addr, c->offset);
+		local_irq_restore(flags);
+	}
 }
 
 void kmem_cache_free(struct kmem_cache *s, void *x)
@@ -1903,6 +2125,161 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/*
+ * Chain up the objects of p[] that live in the same slab as p[idx],
+ * looking ahead a few misses at most, and clear their slots.  Returns
+ * the number of objects chained from *head to *tail.
+ */
+static int build_detached_freelist(struct kmem_cache *s, struct page *page,
+				   unsigned int offset, size_t idx, void **p,
+				   void **head, void **tail)
+{
+	void **object = p[idx];
+	int lookahead = 3;
+	int cnt = 1;
+
+	*head = *tail = object;
+	p[idx] = NULL;
+
+	/* Debug slabs need every object checked on its own */
+	if (SLABDEBUG && PageSlubDebug(page))
+		return cnt;
+
+	while (idx--) {
+		object = p[idx];
+		if (!object)
+			continue;
+
+		if (virt_to_head_page(object) != page) {
+			if (!--lookahead)
+				break;
+			continue;
+		}
+
+		object[offset] = *head;
+		*head = object;
+		p[idx] = NULL;
+		cnt++;
+	}
+	return cnt;
+}
+
+/*
+ * Free an array of objects with interrupts disabled once.  Objects of the
+ * cpu slab go straight onto the cpu freelist, the others are handed to
+ * __slab_free() a whole slab's worth at a time, so the slab lock and the
+ * list handling are paid once per slab rather than once per object.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		slab_free_hook(s, p[i]);
+		trace_kmem_cache_free(_RET_IP_, p[i]);
+	}
+
+	local_irq_save(flags);
+	c = get_cpu_slab(s, smp_processor_id());
+
+	while (size) {
+		void **object = p[--size];
+		struct page *page;
+		void *head, *tail;
+		int cnt;
+
+		if (!object)
+			continue;
+
+		page = virt_to_head_page(object);
+		if (page == c->page && c->node >= 0) {
+			object[c->offset] = c->freelist;
+			c->freelist = object;
+			stat(c, FREE_FASTPATH);
+			continue;
+		}
+
+		cnt = build_detached_freelist(s, page, c->offset, size, p,
+					      &head, &tail);
+		__slab_free(s, page, head, tail, cnt, _RET_IP_, c->offset);
+	}
+
+	/* Fail any fastpath that we interrupted */
+	c->tid = next_tid(c->tid);
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
+/*
+ * Allocate size objects into p[], detaching them from the cpu freelist in
+ * one go with interrupts disabled and refilling it through the slowpath as
+ * needed.  Returns size on success; on failure nothing is allocated and 0
+ * is returned.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
+			  void **p)
+{
+	struct kmem_cache_cpu *c;
+	size_t i;
+
+	flags &= gfp_allowed_mask;
+
+	lockdep_trace_alloc(flags);
+	might_sleep_if(flags & __GFP_WAIT);
+
+	if (should_failslab(s->objsize, flags))
+		return 0;
+
+	local_irq_disable();
+	c = get_cpu_slab(s, smp_processor_id());
+
+	for (i = 0; i < size; i++) {
+		void **object = c->freelist;
+
+		if (unlikely(!object || !node_match(c, -1))) {
+			/*
+			 * The slowpath may enable interrupts to allocate a
+			 * new slab; make interrupted fastpaths retry first.
+			 */
+			c->tid = next_tid(c->tid);
+			p[i] = __slab_alloc(s, flags, -1, _RET_IP_);
+			if (unlikely(!p[i]))
+				goto error;
+
+			c = get_cpu_slab(s, smp_processor_id());
+			continue;
+		}
+		c->freelist = object[c->offset];
+		p[i] = object;
+		stat(c, ALLOC_FASTPATH);
+	}
+	c->tid = next_tid(c->tid);
+	local_irq_enable();
+
+	for (i = 0; i < size; i++) {
+		if (unlikely(flags & __GFP_ZERO))
+			memset(p[i], 0, s->objsize);
+		kmemcheck_slab_alloc(s, flags, p[i], s->objsize);
+		kmemleak_alloc_recursive(p[i], s->objsize, 1, s->flags, flags);
+		trace_kmem_cache_alloc(_RET_IP_, p[i], s->objsize, s->size,
+				       flags);
+	}
+	return size;
+
+error:
+	local_irq_enable();
+	size = i;
+	for (i = 0; i < size; i++) {
+		kmemcheck_slab_alloc(s, flags, p[i], s->objsize);
+		kmemleak_alloc_recursive(p[i], s->objsize, 1, s->flags, flags);
+	}
+	kmem_cache_free_bulk(s, size, p);
+	return 0;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 /* Figure out on which slab page the object resides */
 static struct page *get_object_page(const void *x)
 {
@@ -2078,7 +2455,10 @@ static void init_kmem_cache_cpu(struct kmem_cache *s,
 {
 	c->page = NULL;
 	c->freelist = NULL;
+	c->tid = 0;
 	c->node = 0;
+	c->partial = NULL;
+	c->partial_objects = 0;
 	c->offset = s->offset / sizeof(void *);
 	c->objsize = s->objsize;
 #ifdef CONFIG_SLUB_STATS
@@ -2497,6 +2877,23 @@ static int kmem_cache_open(struct kmem_cache *s, gfp_t gfpflags,
 	 * list to avoid pounding the page allocator excessively.
 	 */
 	set_min_partial(s, ilog2(s->size));
+
+	/*
+	 * Free objects to keep on each cpu's partial slabs before handing
+	 * them back to the node: fewer for large objects, whose slabs hold
+	 * few of them, and none for debug caches, which track every slab.
+	 */
+	if (s->flags & DEBUG_DEFAULT_FLAGS)
+		s->cpu_partial = 0;
+	else if (s->size >= PAGE_SIZE)
+		s->cpu_partial = 2;
+	else if (s->size >= 1024)
+		s->cpu_partial = 6;
+	else if (s->size >= 256)
+		s->cpu_partial = 13;
+	else
+		s->cpu_partial = 30;
+
 	s->refcount = 1;
 #ifdef CONFIG_NUMA
 	s->remote_node_defrag_ratio = 1000;
@@ -3182,6 +3579,10 @@ void __init kmem_cache_init(void)
 
 	init_alloc_cpu();
 
+#ifdef CONFIG_CMPXCHG_LOCAL
+	slub_cmpxchg_double = system_has_cmpxchg_double();
+#endif
+
 #ifdef CONFIG_NUMA
 	/*
 	 * Must first have the slab cache available for the allocations of the
@@ -4092,6 +4493,30 @@ static ssize_t min_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(min_partial);
 
+static ssize_t cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%d\n", s->cpu_partial);
+}
+
+static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
+				 size_t length)
+{
+	unsigned long objects;
+	int err;
+
+	err = strict_strtoul(buf, 10, &objects);
+	if (err)
+		return err;
+	if (objects > INT_MAX || (objects && (s->flags & DEBUG_DEFAULT_FLAGS)))
+		return -EINVAL;
+
+	s->cpu_partial = objects;
+	if (!objects)
+		flush_all(s);
+	return length;
+}
+SLAB_ATTR(cpu_partial);
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (s->ctor) {
@@ -4127,6 +4552,29 @@ static ssize_t cpu_slabs_show(struct kmem_cache *s, char *buf)
 }
 SLAB_ATTR_RO(cpu_slabs);
 
+static ssize_t slabs_cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	int objects = 0;
+	int cpu;
+	int len;
+
+	for_each_online_cpu(cpu)
+		objects += get_cpu_slab(s, cpu)->partial_objects;
+
+	len = sprintf(buf, "%d", objects);
+
+#ifdef CONFIG_SMP
+	for_each_online_cpu(cpu) {
+		int x = get_cpu_slab(s, cpu)->partial_objects;
+
+		if (x && len < PAGE_SIZE - 20)
+			len += sprintf(buf + len, " C%d=%d", cpu, x);
+	}
+#endif
+	return len + sprintf(buf + len, "\n");
+}
+SLAB_ATTR_RO(slabs_cpu_partial);
+
 static ssize_t objects_show(struct kmem_cache *s, char *buf)
 {
 	return show_slab_objects(s, buf, SO_ALL|SO_OBJECTS);
@@ -4400,6 +4848,10 @@ STAT_ATTR(DEACTIVATE_TO_HEAD, deactivate_to_head);
 STAT_ATTR(DEACTIVATE_TO_TAIL, deactivate_to_tail);
 STAT_ATTR(DEACTIVATE_REMOTE_FREES, deactivate_remote_frees);
 STAT_ATTR(ORDER_FALLBACK, order_fallback);
+STAT_ATTR(CMPXCHG_DOUBLE_CPU_FAIL, cmpxchg_double_cpu_fail);
+STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
+STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
+STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
 #endif
 
 static struct attribute *slab_attrs[] = {
@@ -4408,12 +4860,14 @@ static struct attribute *slab_attrs[] = {
 	&objs_per_slab_attr.attr,
 	&order_attr.attr,
 	&min_partial_attr.attr,
+	&cpu_partial_attr.attr,
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&total_objects_attr.attr,
 	&slabs_attr.attr,
 	&partial_attr.attr,
 	&cpu_slabs_attr.attr,
+	&slabs_cpu_partial_attr.attr,
 	&ctor_attr.attr,
 	&aliases_attr.attr,
 	&align_attr.attr,
@@ -4454,6 +4908,10 @@ static struct attribute *slab_attrs[] = {
 	&deactivate_to_tail_attr.attr,
 	&deactivate_remote_frees_attr.attr,
 	&order_fallback_attr.attr,
+	&cmpxchg_double_cpu_fail_attr.attr,
+	&cpu_partial_alloc_attr.attr,
+	&cpu_partial_free_attr.attr,
+	&cpu_partial_drain_attr.attr,
 #endif
 	NULL
 };
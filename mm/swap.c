@@ -268,7 +268,8 @@ static void pagevec_move_tail(struct pagevec *pvec)
 
 			lruvec = mem_cgroup_lru_move_lists(page_zone(page),
 							   page, lru, lru);
-			list_move_tail(&page->lru, &lruvec->lists[lru]);
+			list_move_tail(&page->lru,
+				       lru_inactive_list(lruvec, lru));
 			pgmoved++;
 		}
 	}
@@ -356,6 +357,8 @@ void mark_page_accessed(struct page *page)
 			PageReferenced(page) && PageLRU(page)) {
 		activate_page(page);
 		ClearPageReferenced(page);
+		if (page_is_file_cache(page))
+			workingset_activation(page);
 	} else if (!PageReferenced(page)) {
 		SetPageReferenced(page);
 	}
@@ -473,7 +476,7 @@ static void lru_deactivate(struct page *page, struct zone *zone)
 		 * We moves tha page into tail of inactive.
 		 */
 		lruvec = mem_cgroup_lru_move_lists(zone, page, lru, lru);
-		list_move_tail(&page->lru, &lruvec->lists[lru]);
+		list_move_tail(&page->lru, lru_inactive_list(lruvec, lru));
 		__count_vm_event(PGROTATED);
 	}
 
@@ -181,6 +181,48 @@ int invalidate_inode_page(struct page *page)
 	return invalidate_complete_page(mapping, page);
 }
 
+/**
+ * truncate_shadow_entries - remove shadow entries from a range of a mapping
+ * @mapping: mapping to clear
+ * @start: first page index
+ * @end: last page index, inclusive
+ *
+ * Reclaim leaves shadow entries behind evicted pages (see
+ * mm/workingset.c); they are meaningless once the range is truncated.
+ */
+void truncate_shadow_entries(struct address_space *mapping,
+			     pgoff_t start, pgoff_t end)
+{
+	void **slots[PAGEVEC_SIZE];
+	void *entries[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	pgoff_t index = start;
+	unsigned int i, nr;
+
+	while (index <= end) {
+		spin_lock_irq(&mapping->tree_lock);
+		nr = 0;
+		if (mapping->nrshadows)
+			nr = radix_tree_gang_lookup_slot(&mapping->page_tree,
+					slots, indices, index, PAGEVEC_SIZE);
+		/* deleting can free nodes: read all the slots first */
+		for (i = 0; i < nr; i++)
+			entries[i] = radix_tree_deref_slot(slots[i]);
+		for (i = 0; i < nr && indices[i] <= end; i++) {
+			if (!radix_tree_exceptional_entry(entries[i]))
+				continue;
+			radix_tree_delete(&mapping->page_tree, indices[i]);
+			mapping->nrshadows--;
+		}
+		spin_unlock_irq(&mapping->tree_lock);
+
+		if (!nr || indices[nr - 1] >= end)
+			break;
+		index = indices[nr - 1] + 1;
+		cond_resched();
+	}
+}
+
 /**
  * truncate_inode_pages - truncate range of pages specified by start & end byte offsets
  * @mapping: mapping to truncate
@@ -211,7 +253,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	pgoff_t end;
 	int i;
 
-	if (mapping->nrpages == 0)
+	if (mapping->nrpages == 0 && mapping->nrshadows == 0)
 		return;
 
 	BUG_ON((lend & (PAGE_CACHE_SIZE - 1)) != (PAGE_CACHE_SIZE - 1));
@@ -289,6 +331,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		mem_cgroup_uncharge_end();
 		index++;
 	}
+	truncate_shadow_entries(mapping, start, end);
 }
 EXPORT_SYMBOL(truncate_inode_pages_range);
 
@@ -399,7 +442,7 @@ invalidate_complete_page2(struct address_space *mapping, struct page *page)
 
 	clear_page_mlock(page);
 	BUG_ON(page_has_private(page));
-	__remove_from_page_cache(page);
+	__remove_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 
@@ -431,9 +431,11 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
 
 /*
  * Same as remove_mapping, but if the page is removed from the mapping, it
- * gets returned with a refcount of 0.
+ * gets returned with a refcount of 0.  A page @reclaimed by the VM leaves
+ * a shadow entry behind for refault detection.
  */
-static int __remove_mapping(struct address_space *mapping, struct page *page)
+static int __remove_mapping(struct address_space *mapping, struct page *page,
+			    bool reclaimed)
 {
 	struct inode *inode = mapping->host;
 
@@ -481,11 +483,14 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		swapcache_free(swap, page);
 	} else {
 		void (*freepage)(struct page *) = NULL;
+		void *shadow = NULL;
 
 		if (IS_AOP_EXT(inode))
 			freepage = EXT_AOPS(mapping->a_ops)->freepage;
 
-		__remove_from_page_cache(page);
+		if (reclaimed && page_is_file_cache(page))
+			shadow = workingset_eviction(mapping, page);
+		__remove_from_page_cache(page, shadow);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
 
@@ -508,7 +513,7 @@ cannot_free:
  */
 int remove_mapping(struct address_space *mapping, struct page *page)
 {
-	if (__remove_mapping(mapping, page)) {
+	if (__remove_mapping(mapping, page, false)) {
 		/*
 		 * Unfreezing the refcount with 1 rather than 2 effectively
 		 * drops the pagecache ref for us without requiring another
@@ -853,7 +858,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (!mapping || !__remove_mapping(mapping, page, true))
 			goto keep_locked;
 
 		/*
@@ -1148,12 +1153,528 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 	return nr_taken;
 }
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * Multi-generational LRU, see Documentation/vm/multigen_lru.txt.
+ *
+ * Pages on the generation lists are accounted as inactive, so the
+ * classic scan balancing, isolation and shrink_page_list() are reused
+ * unchanged: eviction just isolates from the oldest generation instead
+ * of from the inactive list.  Switching modes at runtime leaves pages
+ * on the lists of the other mode; both modes pick those up lazily.
+ */
+#ifdef CONFIG_LRU_GEN_ENABLED
+int lru_gen_state __read_mostly = 1;
+#else
+int lru_gen_state __read_mostly;
+#endif
+
+/* Active pages moved into generations per lruvec and call */
+#define LRU_GEN_FILL_BATCH	(SWAP_CLUSTER_MAX * 4)
+/* Minimum time between two page table walks */
+#define LRU_GEN_WALK_INTERVAL	(HZ / 10)
+
+static LIST_HEAD(lru_gen_mm_list);
+static DEFINE_SPINLOCK(lru_gen_mm_lock);
+static unsigned long lru_gen_nr_mms;
+static DEFINE_MUTEX(lru_gen_walk_mutex);
+static unsigned long lru_gen_walk_stamp;
+
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_lock);
+	list_add_tail(&mm->lru_gen_list, &lru_gen_mm_list);
+	lru_gen_nr_mms++;
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_lock);
+	list_del(&mm->lru_gen_list);
+	lru_gen_nr_mms--;
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+static inline unsigned long lru_gen_nr_gens(struct lru_gen *lrugen, int file)
+{
+	return lrugen->max_seq - lrugen->min_seq[file] + 1;
+}
+
+static bool lru_gen_has_pages(struct lruvec *lruvec, int file)
+{
+	int gen;
+
+	for (gen = 0; gen < MAX_NR_GENS; gen++)
+		if (!list_empty(&lruvec->lrugen.lists[gen][file]))
+			return true;
+	return false;
+}
+
+/*
+ * Open a new youngest generation.  A type that already has MAX_NR_GENS
+ * generations, because nothing has been evicted from it, gets its two
+ * oldest generations folded together, the oldest pages staying at the
+ * tail.  Caller must hold the zone's lru_lock.
+ */
+static void lru_gen_inc_max_seq(struct lruvec *lruvec)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	int file;
+
+	for (file = 0; file < 2; file++) {
+		unsigned long min_seq = lrugen->min_seq[file];
+
+		if (lru_gen_nr_gens(lrugen, file) < MAX_NR_GENS)
+			continue;
+		list_splice_tail_init(lru_gen_list(lruvec, min_seq, file),
+				      lru_gen_list(lruvec, min_seq + 1, file));
+		lrugen->min_seq[file]++;
+	}
+	lrugen->max_seq++;
+	__count_vm_event(LRU_GEN_AGING);
+}
+
+/*
+ * Retire empty generations at the old end; if only MIN_NR_GENS are
+ * left, age the lruvec.  Returns the list to evict @file pages from,
+ * NULL if there are none.  Caller must hold the zone's lru_lock.
+ */
+static struct list_head *lru_gen_oldest_list(struct lruvec *lruvec, int file)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	struct list_head *list;
+
+	if (!lru_gen_has_pages(lruvec, file))
+		return NULL;
+
+	while (list_empty(list = lru_gen_list(lruvec, lrugen->min_seq[file],
+					      file))) {
+		if (lru_gen_nr_gens(lrugen, file) > MIN_NR_GENS)
+			lrugen->min_seq[file]++;
+		else
+			lru_gen_inc_max_seq(lruvec);
+	}
+	return list;
+}
+
+/* Pages still on the inactive list are older than any generation. */
+static struct list_head *lru_gen_isolate_list(struct lruvec *lruvec, int file)
+{
+	struct list_head *list = &lruvec->lists[LRU_BASE + file * LRU_FILE];
+
+	if (!list_empty(list))
+		return list;
+	return lru_gen_oldest_list(lruvec, file);
+}
+
+/*
+ * Move pages left on the classic lists into generations: inactive
+ * pages to the oldest, active pages to the youngest one.  The active
+ * lists are drained LRU_GEN_FILL_BATCH pages at a time to bound the
+ * lock hold time; returns true once they are empty.  Caller must hold
+ * the zone's lru_lock.
+ */
+static bool lru_gen_fill_lruvec(struct zone *zone, struct lruvec *lruvec)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	bool done = true;
+	int file;
+
+	for (file = 0; file < 2; file++) {
+		enum lru_list lru = LRU_BASE + file * LRU_FILE;
+		struct list_head *active = &lruvec->lists[lru + LRU_ACTIVE];
+		unsigned long batch = LRU_GEN_FILL_BATCH;
+		unsigned long nr_moved = 0;
+
+		list_splice_tail_init(&lruvec->lists[lru],
+			lru_gen_list(lruvec, lrugen->min_seq[file], file));
+
+		while (!list_empty(active) && batch--) {
+			struct page *page = list_entry(active->next,
+						       struct page, lru);
+
+			VM_BUG_ON(!PageActive(page));
+			ClearPageActive(page);
+			mem_cgroup_lru_move_lists(zone, page,
+						  lru + LRU_ACTIVE, lru);
+			list_move_tail(&page->lru,
+				lru_gen_list(lruvec, lrugen->max_seq, file));
+			nr_moved += hpage_nr_pages(page);
+		}
+		__mod_zone_page_state(zone, NR_LRU_BASE + lru + LRU_ACTIVE,
+				      -nr_moved);
+		__mod_zone_page_state(zone, NR_LRU_BASE + lru, nr_moved);
+
+		if (!list_empty(active))
+			done = false;
+	}
+	return done;
+}
+
+/**
+ * lru_gen_drain_lruvec - put the generations back on the inactive lists
+ * @lruvec: the lruvec to drain
+ *
+ * Pages are already accounted as inactive, the oldest generation ends
+ * up at the tail.  Caller must hold the zone's lru_lock.
+ */
+void lru_gen_drain_lruvec(struct lruvec *lruvec)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	unsigned long seq;
+	int file;
+
+	for (file = 0; file < 2; file++) {
+		enum lru_list lru = LRU_BASE + file * LRU_FILE;
+
+		for (seq = lrugen->min_seq[file]; seq <= lrugen->max_seq; seq++)
+			list_splice_init(lru_gen_list(lruvec, seq, file),
+					 &lruvec->lists[lru]);
+	}
+}
+
+/*
+ * Age once eviction has used up all but MIN_NR_GENS generations of a
+ * type that has pages.  Caller must hold the zone's lru_lock.
+ */
+static bool lru_gen_need_aging(struct lruvec *lruvec)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	int file;
+
+	for (file = 0; file < 2; file++) {
+		if (!lru_gen_has_pages(lruvec, file))
+			continue;
+		while (lru_gen_nr_gens(lrugen, file) > MIN_NR_GENS &&
+		       list_empty(lru_gen_list(lruvec, lrugen->min_seq[file],
+					       file)))
+			lrugen->min_seq[file]++;
+		if (lru_gen_nr_gens(lrugen, file) <= MIN_NR_GENS)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Move pages whose accessed bit the walk found set into the youngest
+ * generation of their lruvec and drop the references taken by the walk.
+ */
+static void lru_gen_promote_pagevec(struct pagevec *pvec)
+{
+	struct zone *zone = NULL;
+	unsigned long nr_promoted = 0;
+	int i;
+
+	for (i = 0; i < pagevec_count(pvec); i++) {
+		struct page *page = pvec->pages[i];
+		struct zone *pagezone = page_zone(page);
+
+		if (pagezone != zone) {
+			if (zone)
+				spin_unlock_irq(&zone->lru_lock);
+			zone = pagezone;
+			spin_lock_irq(&zone->lru_lock);
+		}
+		if (PageLRU(page) && !PageActive(page) &&
+		    !PageUnevictable(page) && lru_gen_enabled()) {
+			enum lru_list lru = page_lru_base_type(page);
+			struct lruvec *lruvec;
+
+			lruvec = mem_cgroup_lru_move_lists(zone, page, lru, lru);
+			list_move(&page->lru, lru_gen_list(lruvec,
+				  lruvec->lrugen.max_seq, is_file_lru(lru)));
+			nr_promoted += hpage_nr_pages(page);
+		}
+	}
+	if (zone)
+		spin_unlock_irq(&zone->lru_lock);
+	count_vm_events(LRU_GEN_PROMOTED, nr_promoted);
+	release_pages(pvec->pages, pvec->nr, pvec->cold);
+	pagevec_reinit(pvec);
+}
+
+static void lru_gen_promote_page(struct page *page, struct pagevec *pvec)
+{
+	get_page(page);
+	if (!pagevec_add(pvec, page))
+		lru_gen_promote_pagevec(pvec);
+}
+
+static void lru_gen_walk_pte_range(struct vm_area_struct *vma, pmd_t *pmd,
+				   unsigned long addr, unsigned long end,
+				   struct pagevec *pvec)
+{
+	pte_t *orig_pte, *pte;
+	spinlock_t *ptl;
+	struct page *page;
+
+	orig_pte = pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	do {
+		if (!pte_present(*pte) || !pte_young(*pte))
+			continue;
+		page = vm_normal_page(vma, addr, *pte);
+		if (!page)
+			continue;
+		if (ptep_test_and_clear_young(vma, addr, pte))
+			lru_gen_promote_page(page, pvec);
+	} while (pte++, addr += PAGE_SIZE, addr != end);
+	pte_unmap_unlock(orig_pte, ptl);
+}
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static void lru_gen_walk_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
+				  unsigned long addr, struct pagevec *pvec)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct page *page;
+	int i, nr;
+
+	spin_lock(&mm->page_table_lock);
+	if (pmd_trans_huge(*pmd) && !pmd_trans_splitting(*pmd) &&
+	    pmdp_test_and_clear_young(vma, addr & HPAGE_PMD_MASK, pmd)) {
+		page = pmd_page(*pmd);
+		/* a pagecache huge pmd maps HPAGE_PMD_NR separate pages */
+		nr = PageTransHuge(page) ? 1 : HPAGE_PMD_NR;
+		for (i = 0; i < nr; i++)
+			lru_gen_promote_page(page + i, pvec);
+	}
+	spin_unlock(&mm->page_table_lock);
+}
+#endif
+
+static void lru_gen_walk_pmd_range(struct vm_area_struct *vma, pud_t *pud,
+				   unsigned long addr, unsigned long end,
+				   struct pagevec *pvec)
+{
+	pmd_t *pmd = pmd_offset(pud, addr);
+	unsigned long next;
+
+	do {
+		pmd_t pmdval = *pmd;
+
+		next = pmd_addr_end(addr, end);
+		barrier();
+		if (pmd_none(pmdval))
+			continue;
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+		if (pmd_trans_huge(pmdval)) {
+			lru_gen_walk_huge_pmd(vma, pmd, addr, pvec);
+			continue;
+		}
+#endif
+		if (unlikely(pmd_bad(pmdval)))
+			continue;
+		lru_gen_walk_pte_range(vma, pmd, addr, next, pvec);
+		cond_resched();
+	} while (pmd++, addr = next, addr != end);
+}
+
+static void lru_gen_walk_vma(struct vm_area_struct *vma, struct pagevec *pvec)
+{
+	unsigned long addr = vma->vm_start, end = vma->vm_end, next;
+	pgd_t *pgd = pgd_offset(vma->vm_mm, addr);
+	pud_t *pud;
+
+	do {
+		next = pgd_addr_end(addr, end);
+		if (pgd_none_or_clear_bad(pgd))
+			continue;
+		pud = pud_offset(pgd, addr);
+		do {
+			unsigned long pud_next = pud_addr_end(addr, next);
+
+			if (!pud_none_or_clear_bad(pud))
+				lru_gen_walk_pmd_range(vma, pud, addr,
+						       pud_next, pvec);
+			addr = pud_next;
+		} while (pud++, addr != next);
+	} while (pgd++, addr = next, addr != end);
+}
+
+/*
+ * Harvest the accessed bits of every mm in one pass over its page
+ * tables, which is far cheaper than following the rmap of each page
+ * that reaches the oldest generation.  Only kswapd walks, at most once
+ * per LRU_GEN_WALK_INTERVAL; mm's that are busy are skipped.
+ */
+static void lru_gen_walk_mms(void)
+{
+	struct pagevec pvec;
+	unsigned long nr;
+
+	if (!mutex_trylock(&lru_gen_walk_mutex))
+		return;
+	if (time_before(jiffies, lru_gen_walk_stamp + LRU_GEN_WALK_INTERVAL))
+		goto out;
+
+	pagevec_init(&pvec, 0);
+	spin_lock(&lru_gen_mm_lock);
+	for (nr = lru_gen_nr_mms; nr && !list_empty(&lru_gen_mm_list); nr--) {
+		struct mm_struct *mm;
+		struct vm_area_struct *vma;
+
+		mm = list_first_entry(&lru_gen_mm_list, struct mm_struct,
+				      lru_gen_list);
+		list_move_tail(&mm->lru_gen_list, &lru_gen_mm_list);
+		if (!atomic_inc_not_zero(&mm->mm_users))
+			continue;
+		spin_unlock(&lru_gen_mm_lock);
+
+		if (down_read_trylock(&mm->mmap_sem)) {
+			for (vma = mm->mmap; vma; vma = vma->vm_next) {
+				if (vma->vm_flags & (VM_IO | VM_PFNMAP |
+						     VM_HUGETLB | VM_LOCKED |
+						     VM_SEQ_READ))
+					continue;
+				lru_gen_walk_vma(vma, &pvec);
+			}
+			up_read(&mm->mmap_sem);
+			count_vm_event(LRU_GEN_WALK);
+		}
+		if (pagevec_count(&pvec))
+			lru_gen_promote_pagevec(&pvec);
+		mmput(mm);
+		cond_resched();
+
+		spin_lock(&lru_gen_mm_lock);
+	}
+	spin_unlock(&lru_gen_mm_lock);
+	lru_gen_walk_stamp = jiffies;
+out:
+	mutex_unlock(&lru_gen_walk_mutex);
+}
+
+/*
+ * Called before each round of eviction from an lruvec: catch up with
+ * the current mode and open a new generation when eviction is about
+ * to run out of them.
+ */
+static void lru_gen_prepare(struct mem_cgroup_zone *mz)
+{
+	struct zone *zone = mz->zone;
+	struct lruvec *lruvec = mem_cgroup_zone_lruvec(zone, mz->mem_cgroup);
+	bool aged;
+
+	if (!lru_gen_enabled()) {
+		if (lru_gen_has_pages(lruvec, 0) ||
+		    lru_gen_has_pages(lruvec, 1)) {
+			spin_lock_irq(&zone->lru_lock);
+			lru_gen_drain_lruvec(lruvec);
+			spin_unlock_irq(&zone->lru_lock);
+		}
+		return;
+	}
+
+	spin_lock_irq(&zone->lru_lock);
+	lru_gen_fill_lruvec(zone, lruvec);
+	aged = lru_gen_need_aging(lruvec);
+	if (aged)
+		lru_gen_inc_max_seq(lruvec);
+	spin_unlock_irq(&zone->lru_lock);
+
+	if (aged && current_is_kswapd())
+		lru_gen_walk_mms();
+}
+
+static DEFINE_MUTEX(lru_gen_state_mutex);
+
+static void lru_gen_change_state(bool enable)
+{
+	struct mem_cgroup *memcg;
+	struct zone *zone;
+
+	mutex_lock(&lru_gen_state_mutex);
+	if (enable == lru_gen_enabled())
+		goto out;
+	lru_gen_state = enable;
+
+	memcg = mem_cgroup_iter(NULL, NULL, NULL);
+	do {
+		for_each_populated_zone(zone) {
+			struct lruvec *lruvec;
+			bool done = true;
+
+			lruvec = mem_cgroup_zone_lruvec(zone, memcg);
+			do {
+				spin_lock_irq(&zone->lru_lock);
+				if (enable)
+					done = lru_gen_fill_lruvec(zone, lruvec);
+				else
+					lru_gen_drain_lruvec(lruvec);
+				spin_unlock_irq(&zone->lru_lock);
+				cond_resched();
+			} while (!done);
+		}
+		memcg = mem_cgroup_iter(NULL, memcg, NULL);
+	} while (memcg);
+out:
+	mutex_unlock(&lru_gen_state_mutex);
+}
+
+#ifdef CONFIG_SYSFS
+static ssize_t lru_gen_enabled_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", lru_gen_enabled());
+}
+
+static ssize_t lru_gen_enabled_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	unsigned long enable;
+
+	if (strict_strtoul(buf, 10, &enable) || enable > 1)
+		return -EINVAL;
+
+	lru_gen_change_state(enable);
+	return count;
+}
+
+static struct kobj_attribute lru_gen_enabled_attr =
+	__ATTR(enabled, 0644, lru_gen_enabled_show, lru_gen_enabled_store);
+
+static struct attribute *lru_gen_attrs[] = {
+	&lru_gen_enabled_attr.attr,
+	NULL,
+};
+
+static struct attribute_group lru_gen_attr_group = {
+	.attrs = lru_gen_attrs,
+	.name = "lru_gen",
+};
+
+static int __init lru_gen_init(void)
+{
+	int err;
+
+	err = sysfs_create_group(mm_kobj, &lru_gen_attr_group);
+	if (err)
+		printk(KERN_ERR "lru_gen: failed to register sysfs group\n");
+	return err;
+}
+module_init(lru_gen_init)
+#endif /* CONFIG_SYSFS */
+#else /* !CONFIG_LRU_GEN */
+static inline struct list_head *lru_gen_isolate_list(struct lruvec *lruvec,
+						     int file)
+{
+	return NULL;
+}
+
+static inline void lru_gen_prepare(struct mem_cgroup_zone *mz)
+{
+}
+#endif /* CONFIG_LRU_GEN */
+
 static unsigned long isolate_pages(unsigned long nr, struct mem_cgroup_zone *mz,
 				   struct list_head *dst,
 				   unsigned long *scanned, int order,
 				   isolate_mode_t mode, int active, int file)
 {
 	struct lruvec *lruvec;
+	struct list_head *src;
 	int lru = LRU_BASE;
 
 	lruvec = mem_cgroup_zone_lruvec(mz->zone, mz->mem_cgroup);
@@ -1161,7 +1682,15 @@ static unsigned long isolate_pages(unsigned long nr, struct mem_cgroup_zone *mz,
 		lru += LRU_ACTIVE;
 	if (file)
 		lru += LRU_FILE;
-	return isolate_lru_pages(nr, &lruvec->lists[lru], dst,
+	src = &lruvec->lists[lru];
+	if (!active && lru_gen_enabled()) {
+		src = lru_gen_isolate_list(lruvec, file);
+		if (!src) {
+			*scanned = 0;
+			return 0;
+		}
+	}
+	return isolate_lru_pages(nr, src, dst,
 				 scanned, order, mode, file);
 }
 
@@ -1787,6 +2316,9 @@ static void shrink_mem_cgroup_zone(int priority, struct mem_cgroup_zone *mz,
 	unsigned long nr_to_reclaim = sc->nr_to_reclaim;
 	struct zone_reclaim_stat *reclaim_stat = get_reclaim_stat(mz);
 	int noswap = 0;
+	bool lru_gen = lru_gen_enabled();
+
+	lru_gen_prepare(mz);
 
 	/* If we have no swap space, do not bother scanning anon pages. */
 	if (!sc->may_swap || (nr_swap_pages <= 0)) {
@@ -1801,6 +2333,14 @@ static void shrink_mem_cgroup_zone(int priority, struct mem_cgroup_zone *mz,
 		unsigned long scan;
 
 		scan = zone_nr_lru_pages(mz, l);
+		if (lru_gen) {
+			/* evictable pages all sit in generations */
+			if (is_active_lru(l)) {
+				nr[l] = 0;
+				continue;
+			}
+			scan += zone_nr_lru_pages(mz, l + LRU_ACTIVE);
+		}
 		if (priority || noswap || !sc->swappiness) {
 			scan >>= priority;
 			scan = (scan * percent[file]) / 100;
@@ -1840,7 +2380,7 @@ static void shrink_mem_cgroup_zone(int priority, struct mem_cgroup_zone *mz,
 	 * Even if we did not try to evict anon pages at all, we want to
 	 * rebalance the anon lru active/inactive ratio.
 	 */
-	if (inactive_anon_is_low(mz) && nr_swap_pages > 0)
+	if (!lru_gen && inactive_anon_is_low(mz) && nr_swap_pages > 0)
 		shrink_active_list(SWAP_CLUSTER_MAX, mz, sc, priority, 0);
 
 	throttle_vm_writeout(sc->gfp_mask);
@@ -1922,8 +2462,18 @@ static inline bool should_continue_reclaim(struct zone *zone,
 	}
 }
 
-static void shrink_zone(int priority, struct zone *zone,
-			struct scan_control *sc)
+/*
+ * Global reclaim first goes after the memory cgroups that exceed their
+ * soft limit, and only falls back to scanning everybody if that did
+ * not find any pages in this zone.
+ */
+static bool should_soft_reclaim(struct scan_control *sc)
+{
+	return global_reclaim(sc) && !mem_cgroup_disabled();
+}
+
+static void __shrink_zone(int priority, struct zone *zone,
+			  struct scan_control *sc, bool soft_reclaim)
 {
 	unsigned long nr_reclaimed, nr_scanned;
 
@@ -1945,6 +2495,12 @@ static void shrink_zone(int priority, struct zone *zone,
 				.zone = zone,
 			};
 
+			if (soft_reclaim &&
+			    !mem_cgroup_soft_reclaim_eligible(memcg, root)) {
+				memcg = mem_cgroup_iter(root, memcg, &reclaim);
+				continue;
+			}
+
 			shrink_mem_cgroup_zone(priority, &mz, sc);
 			/*
 			 * Limit reclaim has historically picked one
@@ -1969,6 +2525,22 @@ static void shrink_zone(int priority, struct zone *zone,
 					 sc));
 }
 
+static void shrink_zone(int priority, struct zone *zone,
+			struct scan_control *sc)
+{
+	bool soft_reclaim = should_soft_reclaim(sc);
+	unsigned long nr_scanned = sc->nr_scanned;
+
+	__shrink_zone(priority, zone, sc, soft_reclaim);
+
+	/*
+	 * Nobody is over the soft limit, or those who are have no
+	 * pages in this zone: reclaim from everybody.
+	 */
+	if (soft_reclaim && sc->nr_scanned == nr_scanned)
+		__shrink_zone(priority, zone, sc, false);
+}
+
 /* Returns true if compaction should go ahead for a high-order request */
 static inline bool compaction_ready(struct zone *zone, struct scan_control *sc)
 {
@@ -2248,41 +2820,6 @@ unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR
 
-unsigned long mem_cgroup_shrink_node_zone(struct mem_cgroup *mem,
-						gfp_t gfp_mask, bool noswap,
-						unsigned int swappiness,
-						struct zone *zone, int nid)
-{
-	struct scan_control sc = {
-		.may_writepage = !laptop_mode,
-		.may_unmap = 1,
-		.may_swap = !noswap,
-		.swappiness = swappiness,
-		.order = 0,
-		.target_mem_cgroup = mem,
-	};
-	struct mem_cgroup_zone mz = {
-		.mem_cgroup = mem,
-		.zone = zone,
-	};
-	nodemask_t nm  = nodemask_of_node(nid);
-
-	sc.gfp_mask = (gfp_mask & GFP_RECLAIM_MASK) |
-			(GFP_HIGHUSER_MOVABLE & ~GFP_RECLAIM_MASK);
-	sc.nodemask = &nm;
-	sc.nr_reclaimed = 0;
-	sc.nr_scanned = 0;
-	/*
-	 * NOTE: Although we can get the priority field, using it
-	 * here is not a good idea, since it limits the pages we can scan.
-	 * if we don't reclaim here, the shrink_zone from balance_pgdat
-	 * will pick up pages from other mem cgroup's as well. We hack
-	 * the priority and make it zero.
-	 */
-	shrink_mem_cgroup_zone(0, &mz, &sc);
-	return sc.nr_reclaimed;
-}
-
 unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *mem_cont,
 					   gfp_t gfp_mask,
 					   bool noswap,
@@ -2339,7 +2876,7 @@ static void age_active_anon(struct zone *zone, struct scan_control *sc,
 {
 	struct mem_cgroup *memcg;
 
-	if (!total_swap_pages)
+	if (!total_swap_pages || lru_gen_enabled())
 		return;
 
 	memcg = mem_cgroup_iter(NULL, NULL, NULL);
@@ -2473,9 +3010,7 @@ loop_again:
 		for (i = 0; i <= end_zone; i++) {
 			struct zone *zone = pgdat->node_zones + i;
 			int nr_slab;
-			int nid, zid;
 			unsigned long balance_gap;
-			bool contended = false;
 
 			if (!populated_zone(zone))
 				continue;
@@ -2491,14 +3026,6 @@ loop_again:
 			sc.nr_scanned = 0;
 			note_zone_scanning_priority(zone, priority);
 
-			nid = pgdat->node_id;
-			zid = zone_idx(zone);
-			/*
-			 * Call soft limit reclaim before calling shrink_zone.
-			 * For now we ignore the return value
-			 */
-			mem_cgroup_soft_limit_reclaim(zone, order, sc.gfp_mask,
-							nid, zid);
 			/*
 			 * We put equal pressure on every zone, unless
 			 * one zone has way too many pages free
@@ -2536,15 +3063,6 @@ loop_again:
 			    total_scanned > sc.nr_reclaimed + sc.nr_reclaimed / 2)
 				sc.may_writepage = 1;
 
-			/*
-			 * Compact the zone for higher orders to reduce
-			 * latencies for higher-order allocations that
-			 * would ordinarily call try_to_compact_pages()
-			 */
-			if (sc.order > PAGE_ALLOC_COSTLY_ORDER)
-				compact_zone_order(zone, sc.order, sc.gfp_mask, 0,
-						&contended);
-
 			if (!zone_watermark_ok_safe(zone, order,
 					high_wmark_pages(zone), end_zone, 0)) {
 				/*
@@ -2708,6 +3226,15 @@ static int kswapd(void *p)
 				if (!sleeping_prematurely(pgdat, order, remaining)) {
 					trace_mm_vmscan_kswapd_sleep(pgdat->node_id);
 
+					/*
+					 * We have freed the memory, now we
+					 * should compact it to make
+					 * allocation of the requested order
+					 * possible.
+					 */
+					wakeup_kcompactd(pgdat, order,
+							 pgdat->nr_zones - 1);
+
 					/*
 					 * vmstat counters are not perfectly
 					 * accurate and the estimated value
@@ -3245,7 +3772,7 @@ retry:
 		__dec_zone_state(zone, NR_UNEVICTABLE);
 		lruvec = mem_cgroup_lru_move_lists(zone, page,
 						   LRU_UNEVICTABLE, l);
-		list_move(&page->lru, &lruvec->lists[l]);
+		list_move(&page->lru, lru_inactive_list(lruvec, l));
 		__inc_zone_state(zone, NR_INACTIVE_ANON + l);
 		__count_vm_event(UNEVICTABLE_PGRESCUED);
 	} else {
@@ -3324,37 +3851,57 @@ void scan_mapping_unevictable_pages(struct address_space *mapping)
  * evictable.  Move those that have to @zone's inactive list where they
  * become candidates for reclaim, unless shrink_inactive_zone() decides
  * to reactivate them.  Pages that are still unevictable are rotated
- * back onto @zone's unevictable list.
+ * back onto @zone's unevictable list.  Every memory cgroup has its own
+ * set of lists in the zone, so all of them are visited.
  */
 #define SCAN_UNEVICTABLE_BATCH_SIZE 16UL /* arbitrary lock hold batch size */
 static void scan_zone_unevictable_pages(struct zone *zone)
 {
-	struct list_head *l_unevictable = &zone->lruvec.lists[LRU_UNEVICTABLE];
-	unsigned long scan;
-	unsigned long nr_to_scan = zone_page_state(zone, NR_UNEVICTABLE);
+	struct mem_cgroup *memcg;
+
+	memcg = mem_cgroup_iter(NULL, NULL, NULL);
+	do {
+		struct mem_cgroup_zone mz = {
+			.mem_cgroup = memcg,
+			.zone = zone,
+		};
+		struct lruvec *lruvec = mem_cgroup_zone_lruvec(zone, memcg);
+		struct list_head *l_unevictable =
+					&lruvec->lists[LRU_UNEVICTABLE];
+		unsigned long scan;
+		unsigned long nr_to_scan;
 
-	while (nr_to_scan > 0) {
-		unsigned long batch_size = min(nr_to_scan,
+		nr_to_scan = zone_nr_lru_pages(&mz, LRU_UNEVICTABLE);
+		while (nr_to_scan > 0) {
+			unsigned long batch_size = min(nr_to_scan,
 						SCAN_UNEVICTABLE_BATCH_SIZE);
 
-		spin_lock_irq(&zone->lru_lock);
-		for (scan = 0;  scan < batch_size; scan++) {
-			struct page *page = lru_to_page(l_unevictable);
+			spin_lock_irq(&zone->lru_lock);
+			for (scan = 0;  scan < batch_size; scan++) {
+				struct page *page;
 
-			if (!trylock_page(page))
-				continue;
+				if (list_empty(l_unevictable))
+					break;
+				page = lru_to_page(l_unevictable);
 
-			prefetchw_prev_lru_page(page, l_unevictable, flags);
+				if (!trylock_page(page))
+					continue;
 
-			if (likely(PageLRU(page) && PageUnevictable(page)))
-				check_move_unevictable_page(page, zone);
+				prefetchw_prev_lru_page(page, l_unevictable,
+							flags);
 
-			unlock_page(page);
-		}
-		spin_unlock_irq(&zone->lru_lock);
+				if (likely(PageLRU(page) &&
+					   PageUnevictable(page)))
+					check_move_unevictable_page(page, zone);
 
-		nr_to_scan -= batch_size;
-	}
+				unlock_page(page);
+			}
+			spin_unlock_irq(&zone->lru_lock);
+
+			nr_to_scan -= batch_size;
+		}
+		memcg = mem_cgroup_iter(NULL, memcg, NULL);
+	} while (memcg);
 }
 
 
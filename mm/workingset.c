@@ -0,0 +1,126 @@
+/*
+ * mm/workingset.c - workingset detection for the page cache
+ *
+ * The inactive file list is sized by a fixed ratio against the active
+ * list.  A page that is accessed again before it reaches the tail of
+ * the inactive list gets activated; a working set that is larger than
+ * the inactive list but would fit into the memory held by the active
+ * list is evicted before its second access, every time, while a stream
+ * of use-once pages keeps the stale active list intact.
+ *
+ * To notice such thrashing, every zone counts the evictions from and
+ * the activations out of its inactive file list in inactive_age.  When
+ * reclaim evicts a page cache page, a shadow entry holding the current
+ * count is left in the mapping's radix tree in place of the page.  When
+ * the page is faulted back in, the difference between the count now
+ * and the one in the shadow entry is its refault distance: the number
+ * of slots the page would have needed on top of the inactive list to
+ * stay resident.
+ *
+ * All active pages could have been inactive; so if the refault distance
+ * is no larger than the active file list, the page would have been
+ * activated had the inactive list been big enough, and it is activated
+ * right away to compete with the active pages.  If it keeps being used
+ * more than they are, it stays; if not, it is deactivated and evicted
+ * again, and the active list has proven to hold the working set.
+ *
+ * Shadow entries are removed when a page is added at the same index or
+ * when the file is truncated, and all of them when the inode goes away.
+ */
+
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/swap.h>
+#include <linux/vmstat.h>
+#include <linux/module.h>
+#include <linux/pagemap.h>
+#include <linux/radix-tree.h>
+
+/*
+ * Shadow entries are exceptional radix tree entries, so that lookups
+ * can tell them from pages; they carry the zone and the eviction count,
+ * whose most significant bits do not fit and are lost.  The distance
+ * is computed modulo the remaining bits.
+ */
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *distance)
+{
+	unsigned long entry = (unsigned long)shadow;
+	unsigned long eviction, refault;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+	eviction = entry;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+
+	refault = atomic_long_read(&(*zone)->inactive_age);
+	*distance = (refault - eviction) & EVICTION_MASK;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place
+ * of the evicted @page so that a later refault can be detected.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the zone it was allocated in.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &refault_distance);
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
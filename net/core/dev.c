@@ -3036,8 +3036,9 @@ static void net_tx_action(struct softirq_action *h)
 
 			WARN_ON(atomic_read(&skb->users));
 			trace_kfree_skb(skb, net_tx_action);
-			__kfree_skb(skb);
+			__kfree_skb_defer(skb);
 		}
+		__kfree_skb_flush();
 	}
 
 	if (sd->output_queue) {
@@ -4077,6 +4078,9 @@ out:
 
 	local_irq_enable();
 
+	/* Free the sk_buff heads that the poll routines deferred */
+	__kfree_skb_flush();
+
 	net_rps_action(&rcpus->mask[select]);
 
 #ifdef CONFIG_NET_DMA
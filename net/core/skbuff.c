@@ -540,6 +540,96 @@ void consume_skb(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(consume_skb);
 
+/*
+ * sk_buff heads freed from softirq context are collected per cpu and
+ * handed back to the slab allocator in bulk.
+ */
+#define NAPI_SKB_CACHE_SIZE	64
+
+struct napi_skb_cache {
+	unsigned int count;
+	void *skb_cache[NAPI_SKB_CACHE_SIZE];
+};
+
+static DEFINE_PER_CPU(struct napi_skb_cache, napi_skb_cache);
+
+/**
+ *	__kfree_skb_flush - free the deferred sk_buff heads of this cpu
+ *
+ *	Must be called from softirq context, at the end of a batch of
+ *	napi_consume_skb() or __kfree_skb_defer() calls.
+ */
+void __kfree_skb_flush(void)
+{
+	struct napi_skb_cache *nc = &__get_cpu_var(napi_skb_cache);
+
+	if (nc->count) {
+		kmem_cache_free_bulk(skbuff_head_cache, nc->count,
+				     nc->skb_cache);
+		nc->count = 0;
+	}
+}
+
+static inline void _kfree_skb_defer(struct sk_buff *skb)
+{
+	struct napi_skb_cache *nc = &__get_cpu_var(napi_skb_cache);
+
+	skb_release_all(skb);
+
+	nc->skb_cache[nc->count++] = skb;
+	if (unlikely(nc->count == NAPI_SKB_CACHE_SIZE)) {
+		kmem_cache_free_bulk(skbuff_head_cache, NAPI_SKB_CACHE_SIZE,
+				     nc->skb_cache);
+		nc->count = 0;
+	}
+}
+
+/**
+ *	__kfree_skb_defer - free an unreferenced sk_buff from softirq context
+ *	@skb: buffer
+ *
+ *	Like __kfree_skb(), but the sk_buff head is only freed by the next
+ *	__kfree_skb_flush() on this cpu, together with others.
+ */
+void __kfree_skb_defer(struct sk_buff *skb)
+{
+	/* Fast clones are freed in pairs, not from skbuff_head_cache */
+	if (skb->fclone != SKB_FCLONE_UNAVAILABLE) {
+		__kfree_skb(skb);
+		return;
+	}
+	_kfree_skb_defer(skb);
+}
+
+/**
+ *	napi_consume_skb - free an skbuff from a NAPI poll routine
+ *	@skb: buffer to free
+ *	@budget: the NAPI budget, 0 when called from netpoll
+ *
+ *	Like consume_skb(), but the sk_buff head is freed in bulk when the
+ *	poll completes.  A zero budget means we may not be in softirq
+ *	context, so the buffer is freed right away.  The same goes for
+ *	netpoll, which calls the poll routine with interrupts disabled.
+ */
+void napi_consume_skb(struct sk_buff *skb, int budget)
+{
+	if (unlikely(!skb))
+		return;
+
+	if (unlikely(!budget || irqs_disabled())) {
+		dev_kfree_skb_any(skb);
+		return;
+	}
+
+	if (likely(atomic_read(&skb->users) == 1))
+		smp_rmb();
+	else if (likely(!atomic_dec_and_test(&skb->users)))
+		return;
+	trace_consume_skb(skb);
+	__kfree_skb_defer(skb);
+}
+EXPORT_SYMBOL(napi_consume_skb);
+
 /**
  *	skb_recycle_check - check if skb can be reused for receive
  *	@skb: buffer
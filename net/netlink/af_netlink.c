@@ -55,6 +55,7 @@
 #include <linux/types.h>
 #include <linux/audit.h>
 #include <linux/mutex.h>
+#include <linux/rhashtable.h>
 
 #include <net/net_namespace.h>
 #include <net/sock.h>
@@ -81,6 +82,8 @@ struct netlink_sock {
 	struct mutex		cb_def_mutex;
 	void			(*netlink_rcv)(struct sk_buff *skb);
 	struct module		*module;
+	struct rhash_head	node;
+	struct rcu_head		rcu;
 };
 
 struct listeners_rcu_head {
@@ -103,21 +106,8 @@ static inline int netlink_is_kernel(struct sock *sk)
 	return nlk_sk(sk)->flags & NETLINK_KERNEL_SOCKET;
 }
 
-struct nl_pid_hash {
-	struct hlist_head *table;
-	unsigned long rehash_time;
-
-	unsigned int mask;
-	unsigned int shift;
-
-	unsigned int entries;
-	unsigned int max_shift;
-
-	u32 rnd;
-};
-
 struct netlink_table {
-	struct nl_pid_hash hash;
+	struct rhashtable hash;
 	struct hlist_head mc_list;
 	unsigned long *listeners;
 	unsigned int nl_nonroot;
@@ -144,11 +134,6 @@ static u32 netlink_group_mask(u32 group)
 	return group ? 1 << (group - 1) : 0;
 }
 
-static struct hlist_head *nl_pid_hashfn(struct nl_pid_hash *hash, u32 pid)
-{
-	return &hash->table[jhash_1word(pid, hash->rnd) & hash->mask];
-}
-
 static void netlink_consume_callback(struct netlink_callback *cb)
 {
 	consume_skb(cb->skb);
@@ -234,100 +219,49 @@ netlink_unlock_table(void)
 		wake_up(&nl_table_wait);
 }
 
-static inline struct sock *netlink_lookup(struct net *net, int protocol,
-					  u32 pid)
-{
-	struct nl_pid_hash *hash = &nl_table[protocol].hash;
-	struct hlist_head *head;
-	struct sock *sk;
-	struct hlist_node *node;
-
-	read_lock(&nl_table_lock);
-	head = nl_pid_hashfn(hash, pid);
-	sk_for_each(sk, node, head) {
-		if (net_eq(sock_net(sk), net) && (nlk_sk(sk)->pid == pid)) {
-			sock_hold(sk);
-			goto found;
-		}
-	}
-	sk = NULL;
-found:
-	read_unlock(&nl_table_lock);
-	return sk;
-}
+struct netlink_compare_arg {
+	struct net *net;
+	u32 pid;
+};
 
-static inline struct hlist_head *nl_pid_hash_zalloc(size_t size)
+static bool netlink_compare(void *ptr, void *arg)
 {
-	if (size <= PAGE_SIZE)
-		return kzalloc(size, GFP_ATOMIC);
-	else
-		return (struct hlist_head *)
-			__get_free_pages(GFP_ATOMIC | __GFP_ZERO,
-					 get_order(size));
-}
+	struct netlink_compare_arg *x = arg;
+	struct sock *sk = ptr;
 
-static inline void nl_pid_hash_free(struct hlist_head *table, size_t size)
-{
-	if (size <= PAGE_SIZE)
-		kfree(table);
-	else
-		free_pages((unsigned long)table, get_order(size));
+	return nlk_sk(sk)->pid == x->pid && net_eq(sock_net(sk), x->net);
 }
 
-static int nl_pid_hash_rehash(struct nl_pid_hash *hash, int grow)
+/* Caller holds rcu_read_lock() */
+static struct sock *__netlink_lookup(struct netlink_table *table, u32 pid,
+				     struct net *net)
 {
-	unsigned int omask, mask, shift;
-	size_t osize, size;
-	struct hlist_head *otable, *table;
-	int i;
-
-	omask = mask = hash->mask;
-	osize = size = (mask + 1) * sizeof(*table);
-	shift = hash->shift;
+	struct netlink_compare_arg arg = {
+		.net = net,
+		.pid = pid,
+	};
 
-	if (grow) {
-		if (++shift > hash->max_shift)
-			return 0;
-		mask = mask * 2 + 1;
-		size *= 2;
-	}
-
-	table = nl_pid_hash_zalloc(size);
-	if (!table)
-		return 0;
-
-	otable = hash->table;
-	hash->table = table;
-	hash->mask = mask;
-	hash->shift = shift;
-	get_random_bytes(&hash->rnd, sizeof(hash->rnd));
-
-	for (i = 0; i <= omask; i++) {
-		struct sock *sk;
-		struct hlist_node *node, *tmp;
-
-		sk_for_each_safe(sk, node, tmp, &otable[i])
-			__sk_add_node(sk, nl_pid_hashfn(hash, nlk_sk(sk)->pid));
-	}
-
-	nl_pid_hash_free(otable, osize);
-	hash->rehash_time = jiffies + 10 * 60 * HZ;
-	return 1;
+	return rhashtable_lookup_compare(&table->hash, &pid,
+					 netlink_compare, &arg);
 }
 
-static inline int nl_pid_hash_dilute(struct nl_pid_hash *hash, int len)
+/*
+ * Lookups only hold rcu_read_lock(): the hash table holds a reference
+ * on each socket in it, and netlink_release() drops the last one after
+ * a grace period, so a socket found here can still be sock_hold()ed.
+ */
+static inline struct sock *netlink_lookup(struct net *net, int protocol,
+					  u32 pid)
 {
-	int avg = hash->entries >> hash->shift;
-
-	if (unlikely(avg > 1) && nl_pid_hash_rehash(hash, 1))
-		return 1;
+	struct sock *sk;
 
-	if (unlikely(len > avg) && time_after(jiffies, hash->rehash_time)) {
-		nl_pid_hash_rehash(hash, 0);
-		return 1;
-	}
+	rcu_read_lock();
+	sk = __netlink_lookup(&nl_table[protocol], pid, net);
+	if (sk)
+		sock_hold(sk);
+	rcu_read_unlock();
 
-	return 0;
+	return sk;
 }
 
 static const struct proto_ops netlink_ops;
@@ -354,49 +288,51 @@ netlink_update_listeners(struct sock *sk)
 
 static int netlink_insert(struct sock *sk, struct net *net, u32 pid)
 {
-	struct nl_pid_hash *hash = &nl_table[sk->sk_protocol].hash;
-	struct hlist_head *head;
-	int err = -EADDRINUSE;
-	struct sock *osk;
-	struct hlist_node *node;
-	int len;
+	struct netlink_table *table = &nl_table[sk->sk_protocol];
+	struct netlink_compare_arg arg = {
+		.net = net,
+		.pid = pid,
+	};
+	int err;
 
-	netlink_table_grab();
-	head = nl_pid_hashfn(hash, pid);
-	len = 0;
-	sk_for_each(osk, node, head) {
-		if (net_eq(sock_net(osk), net) && (nlk_sk(osk)->pid == pid))
-			break;
-		len++;
-	}
-	if (node)
-		goto err;
+	/* The socket lock keeps two binds of the same socket apart */
+	lock_sock(sk);
 
 	err = -EBUSY;
 	if (nlk_sk(sk)->pid)
 		goto err;
 
 	err = -ENOMEM;
-	if (BITS_PER_LONG > 32 && unlikely(hash->entries >= UINT_MAX))
+	if (unlikely(atomic_read(&table->hash.nelems) >= INT_MAX))
 		goto err;
 
-	if (len && nl_pid_hash_dilute(hash, len))
-		head = nl_pid_hashfn(hash, pid);
-	hash->entries++;
+	/* The pid is the hash key; the table holds a reference */
 	nlk_sk(sk)->pid = pid;
-	sk_add_node(sk, head);
-	err = 0;
+	sock_hold(sk);
+	err = rhashtable_lookup_compare_insert(&table->hash, &nlk_sk(sk)->node,
+					       netlink_compare, &arg);
+	if (err) {
+		if (err == -EEXIST)
+			err = -EADDRINUSE;
+		nlk_sk(sk)->pid = 0;
+		sock_put(sk);
+	}
 
 err:
-	netlink_table_ungrab();
+	release_sock(sk);
 	return err;
 }
 
 static void netlink_remove(struct sock *sk)
 {
+	struct netlink_table *table = &nl_table[sk->sk_protocol];
+
+	if (!rhashtable_remove(&table->hash, &nlk_sk(sk)->node)) {
+		WARN_ON(atomic_read(&sk->sk_refcnt) == 1);
+		__sock_put(sk);
+	}
+
 	netlink_table_grab();
-	if (sk_del_node_init(sk))
-		nl_table[sk->sk_protocol].hash.entries--;
 	if (nlk_sk(sk)->subscriptions)
 		__sk_del_bind_node(sk);
 	netlink_table_ungrab();
@@ -489,6 +425,14 @@ out_module:
 	goto out;
 }
 
+/* RCU lookups may still be looking at the socket; see netlink_lookup() */
+static void deferred_put_nlk_sk(struct rcu_head *head)
+{
+	struct netlink_sock *nlk = container_of(head, struct netlink_sock, rcu);
+
+	sock_put(&nlk->sk);
+}
+
 static int netlink_release(struct socket *sock)
 {
 	struct sock *sk = sock->sk;
@@ -541,7 +485,7 @@ static int netlink_release(struct socket *sock)
 	local_bh_disable();
 	sock_prot_inuse_add(sock_net(sk), &netlink_proto, -1);
 	local_bh_enable();
-	sock_put(sk);
+	call_rcu(&nlk->rcu, deferred_put_nlk_sk);
 	return 0;
 }
 
@@ -549,31 +493,23 @@ static int netlink_autobind(struct socket *sock)
 {
 	struct sock *sk = sock->sk;
 	struct net *net = sock_net(sk);
-	struct nl_pid_hash *hash = &nl_table[sk->sk_protocol].hash;
-	struct hlist_head *head;
-	struct sock *osk;
-	struct hlist_node *node;
+	struct netlink_table *table = &nl_table[sk->sk_protocol];
 	s32 pid = current->tgid;
 	int err;
 	static s32 rover = -4097;
 
 retry:
 	cond_resched();
-	netlink_table_grab();
-	head = nl_pid_hashfn(hash, pid);
-	sk_for_each(osk, node, head) {
-		if (!net_eq(sock_net(osk), net))
-			continue;
-		if (nlk_sk(osk)->pid == pid) {
-			/* Bind collision, search negative pid values. */
-			pid = rover--;
-			if (rover > -4097)
-				rover = -4097;
-			netlink_table_ungrab();
-			goto retry;
-		}
+	rcu_read_lock();
+	if (__netlink_lookup(table, pid, net)) {
+		/* Bind collision, search negative pid values. */
+		pid = rover--;
+		if (rover > -4097)
+			rover = -4097;
+		rcu_read_unlock();
+		goto retry;
 	}
-	netlink_table_ungrab();
+	rcu_read_unlock();
 
 	err = netlink_insert(sk, net, pid);
 	if (err == -EADDRINUSE)
@@ -1927,92 +1863,105 @@ int nlmsg_notify(struct sock *sk, struct sk_buff *skb, u32 pid,
 EXPORT_SYMBOL(nlmsg_notify);
 
 #ifdef CONFIG_PROC_FS
+/*
+ * The walk runs under rcu_read_lock() and resumes from the position on
+ * every netlink_seq_start(), as the tables may be resized in between.
+ * While a resize is in progress it also covers ->future_tbl, so a
+ * socket may be shown twice.
+ */
 struct nl_seq_iter {
 	struct seq_net_private p;
+	struct bucket_table *tbl;
 	int link;
 	int hash_idx;
 };
 
-static struct sock *netlink_seq_socket_idx(struct seq_file *seq, loff_t pos)
+static struct sock *netlink_seq_chain(struct seq_file *seq,
+				      struct rhash_head *pos)
+{
+	struct netlink_sock *nlk;
+
+	for (; pos; pos = rcu_dereference(pos->next)) {
+		nlk = container_of(pos, struct netlink_sock, node);
+		if (sock_net(&nlk->sk) == seq_file_net(seq))
+			return &nlk->sk;
+	}
+	return NULL;
+}
+
+/* First socket in or after the bucket the iterator points at */
+static struct sock *netlink_seq_walk(struct seq_file *seq)
 {
 	struct nl_seq_iter *iter = seq->private;
-	int i, j;
 	struct sock *s;
-	struct hlist_node *node;
-	loff_t off = 0;
 
-	for (i = 0; i < MAX_LINKS; i++) {
-		struct nl_pid_hash *hash = &nl_table[i].hash;
-
-		for (j = 0; j <= hash->mask; j++) {
-			sk_for_each(s, node, &hash->table[j]) {
-				if (sock_net(s) != seq_file_net(seq))
-					continue;
-				if (off == pos) {
-					iter->link = i;
-					iter->hash_idx = j;
+	for (; iter->link < MAX_LINKS; iter->link++) {
+		if (!iter->tbl) {
+			iter->tbl = rcu_dereference(nl_table[iter->link].hash.tbl);
+			iter->hash_idx = 0;
+		}
+		while (iter->tbl) {
+			for (; iter->hash_idx < iter->tbl->size; iter->hash_idx++) {
+				s = netlink_seq_chain(seq,
+					rcu_dereference(iter->tbl->buckets[iter->hash_idx]));
+				if (s)
 					return s;
-				}
-				++off;
 			}
+			iter->tbl = rcu_dereference(iter->tbl->future_tbl);
+			iter->hash_idx = 0;
 		}
 	}
 	return NULL;
 }
 
+static struct sock *netlink_seq_advance(struct seq_file *seq, struct sock *s)
+{
+	struct nl_seq_iter *iter = seq->private;
+	struct sock *next;
+
+	next = netlink_seq_chain(seq, rcu_dereference(nlk_sk(s)->node.next));
+	if (next)
+		return next;
+
+	iter->hash_idx++;
+	return netlink_seq_walk(seq);
+}
+
+static struct sock *netlink_seq_socket_idx(struct seq_file *seq, loff_t pos)
+{
+	struct nl_seq_iter *iter = seq->private;
+	struct sock *s;
+	loff_t off;
+
+	iter->link = 0;
+	iter->tbl = NULL;
+	s = netlink_seq_walk(seq);
+	for (off = 0; s && off < pos; off++)
+		s = netlink_seq_advance(seq, s);
+	return s;
+}
+
 static void *netlink_seq_start(struct seq_file *seq, loff_t *pos)
-	__acquires(nl_table_lock)
+	__acquires(RCU)
 {
-	read_lock(&nl_table_lock);
+	rcu_read_lock();
 	return *pos ? netlink_seq_socket_idx(seq, *pos - 1) : SEQ_START_TOKEN;
 }
 
 static void *netlink_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 {
-	struct sock *s;
-	struct nl_seq_iter *iter;
-	int i, j;
-
 	++*pos;
 
 	if (v == SEQ_START_TOKEN)
 		return netlink_seq_socket_idx(seq, 0);
 
-	iter = seq->private;
-	s = v;
-	do {
-		s = sk_next(s);
-	} while (s && sock_net(s) != seq_file_net(seq));
-	if (s)
-		return s;
-
-	i = iter->link;
-	j = iter->hash_idx + 1;
-
-	do {
-		struct nl_pid_hash *hash = &nl_table[i].hash;
-
-		for (; j <= hash->mask; j++) {
-			s = sk_head(&hash->table[j]);
-			while (s && sock_net(s) != seq_file_net(seq))
-				s = sk_next(s);
-			if (s) {
-				iter->link = i;
-				iter->hash_idx = j;
-				return s;
-			}
-		}
-
-		j = 0;
-	} while (++i < MAX_LINKS);
-
-	return NULL;
+	return netlink_seq_advance(seq, v);
 }
 
 static void netlink_seq_stop(struct seq_file *seq, void *v)
-	__releases(nl_table_lock)
+	__releases(RCU)
 {
-	read_unlock(&nl_table_lock);
+	rcu_read_unlock();
 }
 
 
@@ -2149,24 +2098,25 @@ static int __init netlink_proto_init(void)
 		limit = totalram_pages >> (23 - PAGE_SHIFT);
 
 	order = get_bitmask_order(limit) - 1 + PAGE_SHIFT;
-	limit = (1UL << order) / sizeof(struct hlist_head);
-	order = get_bitmask_order(min(limit, (unsigned long)UINT_MAX)) - 1;
+	limit = (1UL << order) / sizeof(struct rhash_head *);
+	order = get_bitmask_order(min(limit, (unsigned long)INT_MAX)) - 1;
 
 	for (i = 0; i < MAX_LINKS; i++) {
-		struct nl_pid_hash *hash = &nl_table[i].hash;
-
-		hash->table = nl_pid_hash_zalloc(1 * sizeof(*hash->table));
-		if (!hash->table) {
+		struct rhashtable_params params = {
+			.nelem_hint		= 3,
+			.key_offset		= offsetof(struct netlink_sock, pid),
+			.key_len		= sizeof(u32),
+			.head_offset		= offsetof(struct netlink_sock, node),
+			.max_size		= 1U << order,
+			.automatic_shrinking	= true,
+		};
+
+		if (rhashtable_init(&nl_table[i].hash, &params) < 0) {
 			while (i-- > 0)
-				nl_pid_hash_free(nl_table[i].hash.table,
-						 1 * sizeof(*hash->table));
+				rhashtable_destroy(&nl_table[i].hash);
 			kfree(nl_table);
 			goto panic;
 		}
-		hash->max_shift = order;
-		hash->shift = 0;
-		hash->mask = 0;
-		hash->rehash_time = jiffies;
 	}
 
 	sock_register(&netlink_family_ops);
@@ -2211,6 +2211,52 @@ out:
 	return err;
 }
 
+/*
+ *	sendmsg()/recvmsg() on behalf of an aio kiocb.  Retries may run from
+ *	the aio workqueue, whose pid and file table are not the submitter's,
+ *	so only inet sockets are served: their ancillary data never carries
+ *	file descriptors or credentials.
+ */
+
+static struct socket *sock_from_aio_file(struct file *file, int *err)
+{
+	struct socket *sock = sock_from_file(file, err);
+
+	if (!sock)
+		return NULL;
+	if (sock->ops->family != PF_INET && sock->ops->family != PF_INET6) {
+		*err = -EOPNOTSUPP;
+		return NULL;
+	}
+	return sock;
+}
+
+long sock_file_sendmsg(struct file *file, struct msghdr __user *msg,
+		       unsigned flags)
+{
+	struct msghdr msg_sys;
+	struct socket *sock;
+	int err;
+
+	sock = sock_from_aio_file(file, &err);
+	if (!sock)
+		return err;
+	return __sys_sendmsg(sock, msg, &msg_sys, flags, NULL);
+}
+
+long sock_file_recvmsg(struct file *file, struct msghdr __user *msg,
+		       unsigned flags)
+{
+	struct msghdr msg_sys;
+	struct socket *sock;
+	int err;
+
+	sock = sock_from_aio_file(file, &err);
+	if (!sock)
+		return err;
+	return __sys_recvmsg(sock, msg, &msg_sys, flags, 0);
+}
+
 /*
  *     Linux recvmmsg interface
  */
@@ -0,0 +1,296 @@
+/*
+ *
+ * aio-ring.c
+ *
+ * ring: Benchmark for small reads through plain pread(), io_submit()
+ *       and the io_ring_setup() submission ring
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <linux/aio_abi.h>
+
+#ifndef __NR_io_ring_setup
+# if defined(__x86_64__)
+#  define __NR_io_ring_setup	312
+#  define __NR_io_ring_enter	313
+# elif defined(__i386__)
+#  define __NR_io_ring_setup	349
+#  define __NR_io_ring_enter	350
+# else
+#  define __NR_io_ring_setup	-1
+#  define __NR_io_ring_enter	-1
+# endif
+#endif
+
+/* Mirrors of the kernel's ring layouts, for older installed headers */
+struct bench_sq_ring {
+	__u32	head;
+	__u32	tail;
+	__u32	nr;
+	__u32	mask;
+	__u32	magic;
+	__u32	header_length;
+	__u32	dropped;
+	__u32	resv[9];
+
+	struct iocb	iocbs[0];
+};
+
+struct bench_ring_params {
+	__u32	sq_entries;
+	__u32	flags;
+	__u64	ctx_id;
+	__u64	sq_ring;
+	__u64	resv[3];
+};
+
+struct bench_cq_ring {
+	unsigned	id;
+	unsigned	nr;
+	unsigned	head;
+	unsigned	tail;
+
+	unsigned	magic;
+	unsigned	compat_features;
+	unsigned	incompat_features;
+	unsigned	header_length;
+
+	struct io_event	io_events[0];
+};
+
+#define LOOPS_DEFAULT 1000000
+static int loops = LOOPS_DEFAULT;
+static int batch = 32;
+static int size = 64;
+static const char *mode_str = "ring";
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of reads"),
+	OPT_INTEGER('b', "batch", &batch,
+		    "Specify number of reads submitted at once"),
+	OPT_INTEGER('s', "size", &size,
+		    "Specify size of each read in bytes"),
+	OPT_STRING('m', "mode", &mode_str, "ring",
+		    "Specify submission mode: syscall, aio, ring"),
+	OPT_END()
+};
+
+static const char * const bench_aio_ring_usage[] = {
+	"perf bench aio ring <options>",
+	NULL
+};
+
+static void prep_pread(struct iocb *iocb, int fd, void *buf, int i)
+{
+	memset(iocb, 0, sizeof(*iocb));
+	iocb->aio_lio_opcode = IOCB_CMD_PREAD;
+	iocb->aio_fildes = fd;
+	iocb->aio_buf = (unsigned long)buf;
+	iocb->aio_nbytes = size;
+	iocb->aio_data = i;
+}
+
+static int run_syscall(int fd, char *buf)
+{
+	int i;
+
+	for (i = 0; i < loops; i++)
+		if (pread(fd, buf, size, 0) != size)
+			return -1;
+	return 0;
+}
+
+static int run_aio(int fd, char *buf)
+{
+	aio_context_t ctx = 0;
+	struct iocb *iocbs = calloc(batch, sizeof(*iocbs));
+	struct iocb **iocbpp = calloc(batch, sizeof(*iocbpp));
+	struct io_event *events = calloc(batch, sizeof(*events));
+	int done, i, n, ret = -1;
+
+	if (!iocbs || !iocbpp || !events)
+		goto out_free;
+	if (syscall(__NR_io_setup, batch, &ctx)) {
+		perror("io_setup");
+		goto out_free;
+	}
+
+	for (i = 0; i < batch; i++)
+		iocbpp[i] = &iocbs[i];
+
+	for (done = 0; done < loops; done += n) {
+		n = min(batch, loops - done);
+		for (i = 0; i < n; i++)
+			prep_pread(&iocbs[i], fd, buf, i);
+		if (syscall(__NR_io_submit, ctx, n, iocbpp) != n)
+			goto out_destroy;
+		if (syscall(__NR_io_getevents, ctx, n, n, events, NULL) != n)
+			goto out_destroy;
+	}
+	ret = 0;
+
+out_destroy:
+	syscall(__NR_io_destroy, ctx);
+out_free:
+	free(events);
+	free(iocbpp);
+	free(iocbs);
+	return ret;
+}
+
+static int run_ring(int fd, char *buf)
+{
+	struct bench_ring_params p;
+	struct bench_sq_ring *sq;
+	struct bench_cq_ring *cq;
+	unsigned entries = 1;
+	int done, i, n;
+
+	while (entries < (unsigned)batch)
+		entries <<= 1;
+
+	memset(&p, 0, sizeof(p));
+	p.sq_entries = entries;
+	if (syscall(__NR_io_ring_setup, 2 * entries, &p)) {
+		perror("io_ring_setup");
+		return -1;
+	}
+	sq = (struct bench_sq_ring *)(unsigned long)p.sq_ring;
+	cq = (struct bench_cq_ring *)(unsigned long)p.ctx_id;
+
+	for (done = 0; done < loops; done += n) {
+		unsigned tail = sq->tail;
+
+		n = min(batch, loops - done);
+		for (i = 0; i < n; i++, tail++)
+			prep_pread(&sq->iocbs[tail & sq->mask], fd, buf, i);
+		__sync_synchronize();
+		sq->tail = tail;
+
+		if (syscall(__NR_io_ring_enter, p.ctx_id, n, n, 0) != n)
+			break;
+
+		/* reap the completions straight from the event ring */
+		for (i = 0; i < n; i++) {
+			struct io_event *ev = &cq->io_events[cq->head];
+
+			if (ev->res != size)
+				break;
+			__sync_synchronize();
+			cq->head = (cq->head + 1) % cq->nr;
+		}
+		if (i != n)
+			break;
+	}
+
+	syscall(__NR_io_destroy, p.ctx_id);
+	return done < loops ? -1 : 0;
+}
+
+static const struct {
+	const char *name;
+	int (*fn)(int fd, char *buf);
+} modes[] = {
+	{ "syscall",	run_syscall	},
+	{ "aio",	run_aio		},
+	{ "ring",	run_ring	},
+	{ NULL,		NULL		}
+};
+
+int bench_aio_ring(int argc, const char **argv,
+		   const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec;
+	char path[] = "/tmp/perf-bench-aio-XXXXXX";
+	char *buf;
+	int fd, i, ret;
+
+	argc = parse_options(argc, argv, options,
+			     bench_aio_ring_usage, 0);
+
+	for (i = 0; modes[i].name; i++)
+		if (!strcmp(modes[i].name, mode_str))
+			break;
+	if (!modes[i].name) {
+		fprintf(stderr, "Unknown mode: %s\n", mode_str);
+		return 1;
+	}
+	if (loops <= 0 || batch <= 0 || size <= 0) {
+		fprintf(stderr, "loop, batch and size must be positive\n");
+		return 1;
+	}
+
+	buf = calloc(1, size);
+	fd = mkstemp(path);
+	if (!buf || fd < 0) {
+		perror("perf bench aio ring");
+		return 1;
+	}
+	unlink(path);
+	if (write(fd, buf, size) != size) {
+		perror("write");
+		return 1;
+	}
+
+	gettimeofday(&start, NULL);
+	ret = modes[i].fn(fd, buf);
+	gettimeofday(&stop, NULL);
+	close(fd);
+	free(buf);
+
+	if (ret) {
+		fprintf(stderr, "%s reads failed: %s\n",
+			mode_str, strerror(errno));
+		return 1;
+	}
+
+	timersub(&stop, &start, &diff);
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Executed %d %d-byte reads via %s, batch %d\n\n",
+		       loops, size, mode_str, batch);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf nsecs/op\n",
+		       (double)result_usec * 1000.0 / (double)loops);
+		printf(" %14llu ops/sec\n",
+		       (unsigned long long)((double)loops /
+			     ((double)result_usec / (double)1000000)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
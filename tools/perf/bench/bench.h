@@ -3,8 +3,23 @@
 
 extern int bench_sched_messaging(int argc, const char **argv, const char *prefix);
 extern int bench_sched_pipe(int argc, const char **argv, const char *prefix);
+extern int bench_sched_fork(int argc, const char **argv, const char *prefix);
 extern int bench_mem_memcpy(int argc, const char **argv,
 			    const char *prefix __maybe_unused);
+extern int bench_mem_tlb(int argc, const char **argv,
+			 const char *prefix __maybe_unused);
+extern int bench_mem_reclaim(int argc, const char **argv,
+			     const char *prefix __maybe_unused);
+extern int bench_mem_fault(int argc, const char **argv,
+			   const char *prefix __maybe_unused);
+extern int bench_mem_readahead(int argc, const char **argv,
+			       const char *prefix __maybe_unused);
+extern int bench_mem_mmap_sem(int argc, const char **argv,
+			      const char *prefix __maybe_unused);
+extern int bench_time_gettime(int argc, const char **argv,
+			      const char *prefix __maybe_unused);
+extern int bench_aio_ring(int argc, const char **argv,
+			  const char *prefix __maybe_unused);
 
 #define BENCH_FORMAT_DEFAULT_STR	"default"
 #define BENCH_FORMAT_DEFAULT		0
@@ -0,0 +1,206 @@
+/*
+ *
+ * mem-fault.c
+ *
+ * fault: Benchmark for page faults charged to nested memory cgroups
+ *
+ * Creates a chain of nested memory cgroups, moves itself into the
+ * innermost one and keeps faulting in and unmapping anonymous memory,
+ * so that every fault goes through the memcg charge path at each
+ * level of the hierarchy.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define MAX_DEPTH 16
+
+static int loops = 100;
+static int depth = 4;
+static const char *size_str = "64MB";
+static const char *limit_str;
+static const char *cgroup_str = "/cgroup/memory";
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of map/fault/unmap rounds"),
+	OPT_STRING('s', "size", &size_str, "64MB",
+		    "Specify size of the memory faulted in per round. "
+		    "Available units: B, MB, GB (upper and lower)"),
+	OPT_INTEGER('d', "depth", &depth,
+		    "Specify nesting depth of the cgroups (0: don't use one)"),
+	OPT_STRING('L', "limit", &limit_str, "1GB",
+		    "Set this memory limit on the outermost cgroup"),
+	OPT_STRING('c', "cgroup", &cgroup_str, "/cgroup/memory",
+		    "Specify the mount point of the memory cgroup hierarchy"),
+	OPT_END()
+};
+
+static const char * const bench_mem_fault_usage[] = {
+	"perf bench mem fault <options>",
+	NULL
+};
+
+static int write_file(const char *dir, const char *name, const char *val)
+{
+	char path[PATH_MAX + NAME_MAX + 2];
+	int fd, ret = 0;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -1;
+	if (write(fd, val, strlen(val)) != (ssize_t)strlen(val))
+		ret = -1;
+	close(fd);
+	return ret;
+}
+
+/* path of the cgroup at nesting level @level, 0 being the mount point */
+static void cgroup_path(char *path, size_t len, int level)
+{
+	int i, n;
+
+	n = snprintf(path, len, "%s", cgroup_str);
+	for (i = 1; i <= level; i++)
+		n += snprintf(path + n, len - n, "/perf-bench-%d", i);
+}
+
+static void destroy_cgroups(int nr)
+{
+	char path[PATH_MAX], pid[32];
+
+	snprintf(pid, sizeof(pid), "%d\n", getpid());
+	write_file(cgroup_str, "tasks", pid);
+	while (nr > 0) {
+		cgroup_path(path, sizeof(path), nr--);
+		rmdir(path);
+	}
+}
+
+static int create_cgroups(void)
+{
+	char path[PATH_MAX], pid[32];
+	int i;
+
+	for (i = 1; i <= depth; i++) {
+		cgroup_path(path, sizeof(path), i);
+		if (mkdir(path, 0755) && errno != EEXIST) {
+			perror(path);
+			destroy_cgroups(i - 1);
+			return -1;
+		}
+		if (i == 1) {
+			write_file(path, "memory.use_hierarchy", "1");
+			if (limit_str &&
+			    write_file(path, "memory.limit_in_bytes", limit_str)) {
+				perror("memory.limit_in_bytes");
+				destroy_cgroups(i);
+				return -1;
+			}
+		}
+	}
+
+	snprintf(pid, sizeof(pid), "%d\n", getpid());
+	if (write_file(path, "tasks", pid)) {
+		perror("tasks");
+		destroy_cgroups(depth);
+		return -1;
+	}
+	return 0;
+}
+
+int bench_mem_fault(int argc, const char **argv,
+		    const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec, nr_faults;
+	size_t size, off;
+	char *p;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_fault_usage, 0);
+
+	size = (size_t)perf_atoll((char *)size_str);
+	if ((s64)size <= 0) {
+		fprintf(stderr, "Invalid size:%s\n", size_str);
+		return 1;
+	}
+	if (depth < 0 || depth > MAX_DEPTH) {
+		fprintf(stderr, "Invalid depth:%d (max %d)\n",
+			depth, MAX_DEPTH);
+		return 1;
+	}
+
+	if (depth && create_cgroups())
+		return 1;
+
+	nr_faults = (unsigned long long)loops * (size / page_size);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < loops; i++) {
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) {
+			perror("mmap");
+			destroy_cgroups(depth);
+			return 1;
+		}
+		for (off = 0; off < size; off += page_size)
+			p[off] = 1;
+		munmap(p, size);
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	if (depth)
+		destroy_cgroups(depth);
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %llu page faults in %d nested memory cgroup%s\n\n",
+		       nr_faults, depth, depth == 1 ? "" : "s");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/fault\n",
+		       (double)result_usec / (double)nr_faults);
+		printf(" %14d faults/sec\n",
+		       (int)(nr_faults * 1000000 / result_usec));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
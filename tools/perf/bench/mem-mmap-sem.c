@@ -0,0 +1,257 @@
+/*
+ *
+ * mem-mmap-sem.c
+ *
+ * mmap-sem: Benchmark for mmap_sem contention
+ *
+ * Fault threads keep faulting in and zapping their own anonymous
+ * region, which takes mmap_sem for reading, while mapper threads keep
+ * mapping and unmapping small regions of the same process, which takes
+ * it for writing: the pattern of a multi-threaded JVM.  Reports fault
+ * and map rates and how often the threads had to sleep, plus the
+ * mmap_sem entries of /proc/lock_stat if asked to (CONFIG_LOCK_STAT).
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#define LOCK_STAT "/proc/lock_stat"
+
+static int nr_faulters;
+static int nr_mappers = 1;
+static int runtime = 5;
+static const char *size_str = "16MB";
+static bool lock_stat;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_faulters,
+		    "Specify number of fault threads (default: one per cpu)"),
+	OPT_INTEGER('m', "mappers", &nr_mappers,
+		    "Specify number of mmap/munmap threads"),
+	OPT_STRING('s', "size", &size_str, "16MB",
+		    "Specify size of the region each fault thread faults in. "
+		    "Available units: B, KB, MB, GB (upper and lower)"),
+	OPT_INTEGER('r', "runtime", &runtime,
+		    "Specify run time in seconds"),
+	OPT_BOOLEAN('L', "lock-stat", &lock_stat,
+		    "Reset " LOCK_STAT " first and show its mmap_sem entries"),
+	OPT_END()
+};
+
+static const char * const bench_mem_mmap_sem_usage[] = {
+	"perf bench mem mmap-sem <options>",
+	NULL
+};
+
+static volatile int done;
+static size_t size;
+
+struct worker {
+	pthread_t		thread;
+	unsigned long long	ops;
+};
+
+static void *faulter(void *arg)
+{
+	struct worker *w = arg;
+	size_t off;
+	char *p;
+
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	while (!done) {
+		for (off = 0; off < size && !done; off += page_size) {
+			p[off] = 1;
+			w->ops++;
+		}
+		madvise(p, size, MADV_DONTNEED);
+	}
+
+	munmap(p, size);
+	return NULL;
+}
+
+static void *mapper(void *arg)
+{
+	struct worker *w = arg;
+	char *p;
+
+	while (!done) {
+		p = mmap(NULL, page_size * 4, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		p[0] = 1;
+		munmap(p, page_size * 4);
+		w->ops++;
+	}
+	return NULL;
+}
+
+static int reset_lock_stat(void)
+{
+	int fd = open(LOCK_STAT, O_WRONLY);
+
+	if (fd < 0 || write(fd, "0", 1) != 1) {
+		perror(LOCK_STAT);
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+static void show_lock_stat(void)
+{
+	char line[BUFSIZ];
+	FILE *f = fopen(LOCK_STAT, "r");
+	int header = 0;
+
+	if (!f) {
+		perror(LOCK_STAT);
+		return;
+	}
+
+	printf("\n");
+	while (fgets(line, sizeof(line), f)) {
+		/* the column names, then the mmap_sem write and read stats */
+		if (strstr(line, "class name") && !header++)
+			fputs(line, stdout);
+		else if (strstr(line, "mmap_sem-W:") ||
+			 strstr(line, "mmap_sem-R:"))
+			fputs(line, stdout);
+	}
+	fclose(f);
+}
+
+static unsigned long long sum_ops(struct worker *w, int nr)
+{
+	unsigned long long ops = 0;
+	int i;
+
+	for (i = 0; i < nr; i++)
+		ops += w[i].ops;
+	return ops;
+}
+
+int bench_mem_mmap_sem(int argc, const char **argv,
+		       const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff;
+	struct rusage before, after;
+	unsigned long long faults, maps, result_usec;
+	long csw, nvcsw;
+	struct worker *w;
+	int i, nr;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_mmap_sem_usage, 0);
+
+	size = (size_t)perf_atoll((char *)size_str);
+	if ((s64)size < (s64)page_size) {
+		fprintf(stderr, "Invalid size:%s\n", size_str);
+		return 1;
+	}
+	if (!nr_faulters)
+		nr_faulters = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_faulters < 0 || nr_mappers < 0 || runtime <= 0) {
+		fprintf(stderr, "Invalid thread count or run time\n");
+		return 1;
+	}
+
+	nr = nr_faulters + nr_mappers;
+	w = calloc(nr, sizeof(*w));
+	if (!w) {
+		perror("calloc");
+		return 1;
+	}
+
+	if (lock_stat && reset_lock_stat())
+		return 1;
+
+	getrusage(RUSAGE_SELF, &before);
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr; i++) {
+		if (pthread_create(&w[i].thread, NULL,
+				   i < nr_faulters ? faulter : mapper, &w[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+
+	sleep(runtime);
+	done = 1;
+
+	for (i = 0; i < nr; i++)
+		pthread_join(w[i].thread, NULL);
+	gettimeofday(&stop, NULL);
+	getrusage(RUSAGE_SELF, &after);
+	timersub(&stop, &start, &diff);
+
+	faults = sum_ops(w, nr_faulters);
+	maps = sum_ops(w + nr_faulters, nr_mappers);
+	result_usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+	nvcsw = after.ru_nvcsw - before.ru_nvcsw;
+	csw = nvcsw + after.ru_nivcsw - before.ru_nivcsw;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d fault thread%s (%s each) and "
+		       "%d mmap/munmap thread%s\n\n",
+		       nr_faulters, nr_faulters == 1 ? "" : "s", size_str,
+		       nr_mappers, nr_mappers == 1 ? "" : "s");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000));
+
+		printf(" %14llu faults/sec\n",
+		       faults * 1000000 / result_usec);
+		printf(" %14llu mmap+munmap/sec\n",
+		       maps * 1000000 / result_usec);
+		printf(" %14llu context switches/sec (%ld voluntary)\n",
+		       (unsigned long long)csw * 1000000 / result_usec, nvcsw);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu %llu %llu\n",
+		       faults * 1000000 / result_usec,
+		       maps * 1000000 / result_usec,
+		       (unsigned long long)csw * 1000000 / result_usec);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	if (lock_stat)
+		show_lock_stat();
+
+	free(w);
+	return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ *
+ * mem-readahead.c
+ *
+ * readahead: Benchmark for page cache readahead
+ *
+ * Drops a file from the page cache and reads it in blocks, every Nth
+ * block, the way a columnar scan does (N = 1 is a plain sequential read).
+ * mincore() before each read tells whether readahead already brought the
+ * block in, and after the pass how many pages were read ahead for nothing.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+static const char *file_str;
+static const char *block_str = "64KB";
+static int every = 8;
+static int loops = 1;
+
+static const struct option options[] = {
+	OPT_STRING('f', "file", &file_str, "path",
+		    "Specify the file to read (its clean pages get dropped)"),
+	OPT_STRING('b', "block", &block_str, "64KB",
+		    "Specify size of each read. "
+		    "Available units: B, KB, MB, GB (upper and lower)"),
+	OPT_INTEGER('n', "every", &every,
+		    "Read every Nth block (1: sequential)"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of passes, each from a cold cache"),
+	OPT_END()
+};
+
+static const char * const bench_mem_readahead_usage[] = {
+	"perf bench mem readahead -f <file> <options>",
+	NULL
+};
+
+/* Number of pages of [off, off + len) of the mapping in the page cache */
+static size_t resident(char *map, unsigned char *vec, size_t off, size_t len)
+{
+	size_t i, nr = (len + page_size - 1) / page_size, count = 0;
+
+	if (mincore(map + off, len, vec))
+		return 0;
+	for (i = 0; i < nr; i++)
+		count += vec[i] & 1;
+	return count;
+}
+
+int bench_mem_readahead(int argc, const char **argv,
+			const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff, total;
+	unsigned long long pages_read = 0, pages_hit = 0, pages_wasted = 0;
+	size_t block, off, len, file_pages;
+	unsigned char *vec;
+	struct stat st;
+	char *buf, *map;
+	int fd, i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_readahead_usage, 0);
+
+	if (!file_str)
+		usage_with_options(bench_mem_readahead_usage, options);
+
+	block = (size_t)perf_atoll((char *)block_str);
+	if ((s64)block <= 0) {
+		fprintf(stderr, "Invalid block size:%s\n", block_str);
+		return 1;
+	}
+	if (every <= 0 || loops <= 0) {
+		fprintf(stderr, "Invalid block interval or loop count\n");
+		return 1;
+	}
+
+	fd = open(file_str, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(file_str);
+		return 1;
+	}
+	if (!st.st_size) {
+		fprintf(stderr, "%s is empty\n", file_str);
+		return 1;
+	}
+
+	file_pages = (st.st_size + page_size - 1) / page_size;
+	buf = malloc(block);
+	vec = malloc(file_pages);
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (!buf || !vec || map == MAP_FAILED) {
+		perror("malloc/mmap");
+		return 1;
+	}
+
+	timerclear(&total);
+	for (i = 0; i < loops; i++) {
+		unsigned long long pass_read = 0;
+
+		fdatasync(fd);
+		if (posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED))
+			perror("posix_fadvise");
+
+		gettimeofday(&start, NULL);
+		for (off = 0; off < (size_t)st.st_size;
+		     off += block * (size_t)every) {
+			len = block;
+			if (off + len > (size_t)st.st_size)
+				len = st.st_size - off;
+
+			pages_hit += resident(map, vec, off, len);
+			pass_read += (len + page_size - 1) / page_size;
+
+			if (pread(fd, buf, len, off) < 0) {
+				perror("pread");
+				return 1;
+			}
+		}
+		gettimeofday(&stop, NULL);
+		timersub(&stop, &start, &diff);
+		timeradd(&total, &diff, &total);
+
+		/* Everything cached that was not asked for was read in vain */
+		len = resident(map, vec, 0, st.st_size);
+		if (len > pass_read)
+			pages_wasted += len - pass_read;
+		pages_read += pass_read;
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Read every %d%s block of %s bytes of %s, %d pass%s\n\n",
+		       every, every == 1 ? "st" : "th", block_str, file_str,
+		       loops, loops == 1 ? "" : "es");
+
+		printf(" %14s: %lu.%03lu [sec]\n", "Total time",
+		       total.tv_sec, (unsigned long) (total.tv_usec / 1000));
+		printf(" %14s: %llu\n", "pages read", pages_read);
+		printf(" %14s: %.2f %%\n", "hit ratio",
+		       100.0 * pages_hit / pages_read);
+		printf(" %14s: %llu (%.2f %% of pages read)\n", "pages wasted",
+		       pages_wasted, 100.0 * pages_wasted / pages_read);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu %.2f %llu\n",
+		       total.tv_sec, (unsigned long) (total.tv_usec / 1000),
+		       100.0 * pages_hit / pages_read, pages_wasted);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	munmap(map, st.st_size);
+	free(vec);
+	free(buf);
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,249 @@
+/*
+ *
+ * mem-reclaim.c
+ *
+ * reclaim: Benchmark for page reclaim under memory pressure
+ *
+ * Keeps touching a hot working set while sweeping through cold memory
+ * or a file, so that reclaim has to tell them apart.  Reports how often
+ * the hot set had to be faulted back in and what reclaim cost kswapd.
+ * Use more memory than is available, e.g. inside a memory cgroup.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+static int loops = 10;
+static int hot_percent = 20;
+static const char *size_str = "1GB";
+static const char *file_str;
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of passes over the cold memory"),
+	OPT_STRING('s', "size", &size_str, "1GB",
+		    "Specify size of the anonymous memory. "
+		    "Available units: B, MB, GB (upper and lower)"),
+	OPT_INTEGER('H', "hot", &hot_percent,
+		    "Specify percentage of the memory that is hot"),
+	OPT_STRING('f', "file", &file_str, "path",
+		    "Stream through this file instead of cold anonymous memory"),
+	OPT_END()
+};
+
+static const char * const bench_mem_reclaim_usage[] = {
+	"perf bench mem reclaim <options>",
+	NULL
+};
+
+static const char * const vmstat_items[] = {
+	"pgscan_kswapd",
+	"pgscan_direct",
+	"pgsteal",
+	"pgmajfault",
+	"pswpin",
+	"pswpout",
+	"workingset_refault",
+	"workingset_activate",
+	"lru_gen_aging",
+	"lru_gen_walk",
+	"lru_gen_promoted",
+	NULL
+};
+
+/* Sum of all /proc/vmstat counters starting with @prefix */
+static unsigned long long read_vmstat(const char *prefix)
+{
+	unsigned long long sum = 0, val;
+	char name[64];
+	FILE *fp;
+
+	fp = fopen("/proc/vmstat", "r");
+	if (!fp)
+		return 0;
+	while (fscanf(fp, "%63s %llu", name, &val) == 2)
+		if (!strncmp(name, prefix, strlen(prefix)))
+			sum += val;
+	fclose(fp);
+	return sum;
+}
+
+/* CPU time of all kswapd threads, in clock ticks */
+static unsigned long long read_kswapd_ticks(void)
+{
+	unsigned long long sum = 0, utime, stime;
+	struct dirent *dent;
+	char path[PATH_MAX], buf[512], *p;
+	DIR *dir;
+	FILE *fp;
+
+	dir = opendir("/proc");
+	if (!dir)
+		return 0;
+	while ((dent = readdir(dir)) != NULL) {
+		if (!isdigit(dent->d_name[0]))
+			continue;
+		snprintf(path, sizeof(path), "/proc/%s/stat", dent->d_name);
+		fp = fopen(path, "r");
+		if (!fp)
+			continue;
+		if (fgets(buf, sizeof(buf), fp) &&
+		    strstr(buf, "(kswapd") && (p = strrchr(buf, ')')) &&
+		    sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+			   "%llu %llu", &utime, &stime) == 2)
+			sum += utime + stime;
+		fclose(fp);
+	}
+	closedir(dir);
+	return sum;
+}
+
+static long majflt(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_majflt;
+}
+
+static void touch(char *p, size_t size)
+{
+	size_t off;
+
+	for (off = 0; off < size; off += page_size)
+		(*(volatile char *)(p + off))++;
+}
+
+static int stream_file(char *buf, size_t len)
+{
+	int fd;
+	ssize_t ret;
+
+	fd = open(file_str, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	while ((ret = read(fd, buf, len)) > 0)
+		;
+	close(fd);
+	return ret < 0 ? -1 : 0;
+}
+
+int bench_mem_reclaim(int argc, const char **argv,
+		      const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff;
+	unsigned long long before[ARRAY_SIZE(vmstat_items)];
+	unsigned long long kswapd_ticks;
+	size_t size, hot_size;
+	long hot_majflt = 0, total_majflt, flt;
+	char *p, *buf = NULL;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_reclaim_usage, 0);
+
+	size = (size_t)perf_atoll((char *)size_str);
+	if ((s64)size <= 0) {
+		fprintf(stderr, "Invalid size:%s\n", size_str);
+		return 1;
+	}
+	if (hot_percent <= 0 || hot_percent >= 100) {
+		fprintf(stderr, "Invalid hot percentage:%d\n", hot_percent);
+		return 1;
+	}
+
+	hot_size = size / 100 * hot_percent;
+	if (file_str) {
+		hot_size = size;
+		buf = malloc(1 << 20);
+		if (!buf) {
+			perror("malloc");
+			return 1;
+		}
+	}
+
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	touch(p, size);
+
+	for (i = 0; vmstat_items[i]; i++)
+		before[i] = read_vmstat(vmstat_items[i]);
+	kswapd_ticks = read_kswapd_ticks();
+	total_majflt = majflt();
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < loops; i++) {
+		/* the hot set is used twice as often as anything else */
+		flt = majflt();
+		touch(p, hot_size);
+		touch(p, hot_size);
+		hot_majflt += majflt() - flt;
+
+		if (file_str) {
+			if (stream_file(buf, 1 << 20)) {
+				perror(file_str);
+				return 1;
+			}
+		} else
+			touch(p + hot_size, size - hot_size);
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	total_majflt = majflt() - total_majflt;
+	kswapd_ticks = read_kswapd_ticks() - kswapd_ticks;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d passes, %zu MB hot out of %zu MB anonymous%s%s\n\n",
+		       loops, hot_size >> 20, size >> 20,
+		       file_str ? ", streaming " : "", file_str ? file_str : "");
+
+		printf(" %14s: %lu.%03lu [sec]\n", "Total time",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000));
+		printf(" %14s: %.2f [sec]\n", "kswapd CPU",
+		       (double)kswapd_ticks / sysconf(_SC_CLK_TCK));
+		printf(" %14s: %ld\n", "hot refaults", hot_majflt);
+		printf(" %14s: %ld\n\n", "all refaults", total_majflt);
+
+		for (i = 0; vmstat_items[i]; i++)
+			printf(" %14s: %llu\n", vmstat_items[i],
+			       read_vmstat(vmstat_items[i]) - before[i]);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu %.2f %ld\n",
+		       diff.tv_sec, (unsigned long) (diff.tv_usec / 1000),
+		       (double)kswapd_ticks / sysconf(_SC_CLK_TCK),
+		       hot_majflt);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	munmap(p, size);
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ *
+ * mem-tlb.c
+ *
+ * tlb: Benchmark for TLB reach of shared memory mappings
+ *
+ * Dependent random loads over a MAP_SHARED region, so that nearly every
+ * access misses the TLB unless the region is mapped with huge pmds.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+#include <sys/time.h>
+
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE	14
+#endif
+#ifndef MADV_NOHUGEPAGE
+#define MADV_NOHUGEPAGE	15
+#endif
+
+#define LOOPS_DEFAULT 10000000
+static int loops = LOOPS_DEFAULT;
+static const char *size_str = "1GB";
+static const char *file_str;
+static const char *madvise_str = "none";
+static bool use_sysv;
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of loads"),
+	OPT_STRING('s', "size", &size_str, "1GB",
+		    "Specify size of the mapping. "
+		    "Available units: B, MB, GB (upper and lower)"),
+	OPT_STRING('f', "file", &file_str, "path",
+		    "Map this file (e.g. on a huge=always tmpfs) instead of "
+		    "shared anonymous memory"),
+	OPT_BOOLEAN('S', "sysv", &use_sysv,
+		    "Use a SysV shared memory segment"),
+	OPT_STRING('m', "madvise", &madvise_str, "none",
+		    "Specify madvise advice: none, hugepage, nohugepage"),
+	OPT_END()
+};
+
+static const char * const bench_mem_tlb_usage[] = {
+	"perf bench mem tlb <options>",
+	NULL
+};
+
+static void *map_region(size_t size)
+{
+	void *p;
+	int fd, shmid;
+
+	if (use_sysv) {
+		shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+		if (shmid < 0)
+			return MAP_FAILED;
+		p = shmat(shmid, NULL, 0);
+		shmctl(shmid, IPC_RMID, NULL);
+		return p == (void *)-1 ? MAP_FAILED : p;
+	}
+
+	if (!file_str)
+		return mmap(NULL, size, PROT_READ | PROT_WRITE,
+			    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	fd = open(file_str, O_RDWR | O_CREAT, 0600);
+	if (fd < 0)
+		return MAP_FAILED;
+	if (ftruncate(fd, size)) {
+		close(fd);
+		return MAP_FAILED;
+	}
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	return p;
+}
+
+int bench_mem_tlb(int argc, const char **argv,
+		  const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec;
+	unsigned long *slots, nr_slots, i, j, tmp, next;
+	size_t size, stride;
+	int advice = -1;
+	char *p;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_tlb_usage, 0);
+
+	size = (size_t)perf_atoll((char *)size_str);
+	if ((s64)size <= 0) {
+		fprintf(stderr, "Invalid size:%s\n", size_str);
+		return 1;
+	}
+
+	if (!strcmp(madvise_str, "hugepage"))
+		advice = MADV_HUGEPAGE;
+	else if (!strcmp(madvise_str, "nohugepage"))
+		advice = MADV_NOHUGEPAGE;
+	else if (strcmp(madvise_str, "none")) {
+		fprintf(stderr, "Unknown madvise advice: %s\n", madvise_str);
+		return 1;
+	}
+
+	p = map_region(size);
+	if (p == MAP_FAILED) {
+		perror("map");
+		return 1;
+	}
+	if (advice >= 0 && madvise(p, size, advice))
+		perror("madvise");
+
+	/*
+	 * One slot per cache line; link them into a single random cycle
+	 * so the loads depend on each other and cannot be prefetched.
+	 */
+	stride = 64;
+	nr_slots = size / stride;
+	slots = malloc(nr_slots * sizeof(*slots));
+	if (!slots) {
+		perror("malloc");
+		return 1;
+	}
+	for (i = 0; i < nr_slots; i++)
+		slots[i] = i;
+	srand48(1);
+	for (i = nr_slots - 1; i > 0; i--) {
+		j = lrand48() % (i + 1);
+		tmp = slots[i];
+		slots[i] = slots[j];
+		slots[j] = tmp;
+	}
+	for (i = 0; i < nr_slots; i++)
+		*(unsigned long *)(p + slots[i] * stride) =
+			slots[(i + 1) % nr_slots] * stride;
+	free(slots);
+
+	next = 0;
+	gettimeofday(&start, NULL);
+	for (i = 0; i < (unsigned long)loops; i++)
+		next = *(volatile unsigned long *)(p + next);
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Executed %d random loads over %s of %s memory\n\n",
+		       loops, size_str,
+		       use_sysv ? "SysV shm" : file_str ? file_str :
+		       "shared anonymous");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf nsecs/load\n",
+		       (double)result_usec * 1000.0 / (double)loops);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	if (use_sysv)
+		shmdt(p);
+	else
+		munmap(p, size);
+	return 0;
+}
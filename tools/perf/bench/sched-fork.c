@@ -0,0 +1,166 @@
+/*
+ *
+ * sched-fork.c
+ *
+ * fork: Benchmark for process creation
+ *
+ * Several workers fork short lived children and reap them as fast as
+ * they can, the way a build or CI host does.  Each fork allocates a pid
+ * and the other per task ids, and each exit releases them again.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#define LOOPS_DEFAULT 10000
+static int loops = LOOPS_DEFAULT;
+static int nr_workers;
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of forks per worker"),
+	OPT_INTEGER('w', "workers", &nr_workers,
+		    "Specify number of forking workers (default: online cpus)"),
+	OPT_END()
+};
+
+static const char * const bench_sched_fork_usage[] = {
+	"perf bench sched fork <options>",
+	NULL
+};
+
+static void worker(int ready_fd, int start_fd)
+{
+	int i, status;
+	char c = 0;
+	pid_t pid;
+
+	/* Tell the parent we exist, then wait for the common start */
+	if (write(ready_fd, &c, 1) != 1 || read(start_fd, &c, 1) != 1)
+		exit(1);
+
+	for (i = 0; i < loops; i++) {
+		pid = fork();
+		if (pid < 0)
+			exit(1);
+		if (!pid)
+			_exit(0);
+		if (waitpid(pid, &status, 0) != pid)
+			exit(1);
+	}
+	exit(0);
+}
+
+int bench_sched_fork(int argc, const char **argv,
+		     const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec, total;
+	int ready[2], go[2];
+	int i, status, failed = 0;
+	pid_t *pids;
+	char c = 0;
+
+	argc = parse_options(argc, argv, options,
+			     bench_sched_fork_usage, 0);
+
+	if (nr_workers <= 0)
+		nr_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (loops <= 0) {
+		fprintf(stderr, "Invalid loop count:%d\n", loops);
+		return 1;
+	}
+
+	pids = calloc(nr_workers, sizeof(*pids));
+	if (!pids || pipe(ready) || pipe(go)) {
+		perror("calloc/pipe");
+		return 1;
+	}
+
+	for (i = 0; i < nr_workers; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			perror("fork");
+			return 1;
+		}
+		if (!pids[i]) {
+			close(ready[0]);
+			close(go[1]);
+			worker(ready[1], go[0]);
+		}
+	}
+	close(ready[1]);
+	close(go[0]);
+
+	for (i = 0; i < nr_workers; i++)
+		if (read(ready[0], &c, 1) != 1) {
+			fprintf(stderr, "worker died before start\n");
+			return 1;
+		}
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr_workers; i++)
+		if (write(go[1], &c, 1) != 1) {
+			perror("write");
+			return 1;
+		}
+	for (i = 0; i < nr_workers; i++) {
+		if (waitpid(pids[i], &status, 0) != pids[i] ||
+		    !WIFEXITED(status) || WEXITSTATUS(status))
+			failed++;
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	if (failed)
+		fprintf(stderr, "%d worker(s) failed to fork\n", failed);
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+	total = (unsigned long long)loops * nr_workers;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d workers forked and reaped %d children each\n\n",
+		       nr_workers, loops);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/fork\n",
+		       (double)result_usec / (double)total);
+		printf(" %14d forks/sec\n",
+		       (int)((double)total /
+			     ((double)result_usec / (double)1000000)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(pids);
+	return failed ? 1 : 0;
+}
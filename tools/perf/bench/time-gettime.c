@@ -0,0 +1,145 @@
+/*
+ *
+ * time-gettime.c
+ *
+ * gettime: Benchmark for clock_gettime() through the vDSO and the syscall
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+
+#ifndef CLOCK_MONOTONIC_RAW
+#define CLOCK_MONOTONIC_RAW		4
+#endif
+#ifndef CLOCK_REALTIME_COARSE
+#define CLOCK_REALTIME_COARSE		5
+#endif
+#ifndef CLOCK_MONOTONIC_COARSE
+#define CLOCK_MONOTONIC_COARSE		6
+#endif
+#ifndef CLOCK_BOOTTIME
+#define CLOCK_BOOTTIME			7
+#endif
+
+#define LOOPS_DEFAULT 10000000
+static int loops = LOOPS_DEFAULT;
+static const char *clock_str = "monotonic";
+static bool use_syscall;
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of loops"),
+	OPT_STRING('c', "clock", &clock_str, "monotonic",
+		    "Specify clock: realtime, monotonic, monotonic-raw, "
+		    "boottime, realtime-coarse, monotonic-coarse"),
+	OPT_BOOLEAN('s', "syscall", &use_syscall,
+		    "Always enter the kernel instead of using the vDSO"),
+	OPT_END()
+};
+
+static const char * const bench_time_gettime_usage[] = {
+	"perf bench time gettime <options>",
+	NULL
+};
+
+static const struct {
+	const char *name;
+	clockid_t id;
+} clocks[] = {
+	{ "realtime",		CLOCK_REALTIME		},
+	{ "monotonic",		CLOCK_MONOTONIC		},
+	{ "monotonic-raw",	CLOCK_MONOTONIC_RAW	},
+	{ "boottime",		CLOCK_BOOTTIME		},
+	{ "realtime-coarse",	CLOCK_REALTIME_COARSE	},
+	{ "monotonic-coarse",	CLOCK_MONOTONIC_COARSE	},
+	{ NULL,			0			}
+};
+
+int bench_time_gettime(int argc, const char **argv,
+		       const char *prefix __maybe_unused)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec;
+	struct timespec ts;
+	clockid_t clk = CLOCK_MONOTONIC;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_time_gettime_usage, 0);
+
+	for (i = 0; clocks[i].name; i++) {
+		if (!strcmp(clocks[i].name, clock_str)) {
+			clk = clocks[i].id;
+			break;
+		}
+	}
+	if (!clocks[i].name) {
+		fprintf(stderr, "Unknown clock: %s\n", clock_str);
+		return 1;
+	}
+
+	if (clock_gettime(clk, &ts)) {
+		fprintf(stderr, "clock %s is not supported by this kernel\n",
+			clock_str);
+		return 1;
+	}
+
+	gettimeofday(&start, NULL);
+
+	if (use_syscall) {
+		for (i = 0; i < loops; i++)
+			syscall(__NR_clock_gettime, clk, &ts);
+	} else {
+		for (i = 0; i < loops; i++)
+			clock_gettime(clk, &ts);
+	}
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Executed %d clock_gettime(%s) calls via %s\n\n",
+		       loops, clock_str, use_syscall ? "syscall" : "vDSO");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf nsecs/op\n",
+		       (double)result_usec * 1000.0 / (double)loops);
+		printf(" %14llu ops/sec\n",
+		       (unsigned long long)((double)loops /
+			     ((double)result_usec / (double)1000000)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
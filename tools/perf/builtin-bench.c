@@ -13,6 +13,8 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  time  ... timekeeping interfaces
+ *  aio   ... asynchronous and batched i/o submission
  *
  */
 
@@ -42,6 +44,9 @@ static struct bench_suite sched_suites[] = {
 	{ "pipe",
 	  "Flood of communication over pipe() between two processes",
 	  bench_sched_pipe      },
+	{ "fork",
+	  "Flood of fork() and wait() from several processes",
+	  bench_sched_fork      },
 	suite_all,
 	{ NULL,
 	  NULL,
@@ -52,12 +57,47 @@ static struct bench_suite mem_suites[] = {
 	{ "memcpy",
 	  "Simple memory copy in various ways",
 	  bench_mem_memcpy },
+	{ "tlb",
+	  "Random loads over a shared mapping, for TLB reach",
+	  bench_mem_tlb },
+	{ "reclaim",
+	  "Hot working set against a cold stream, for page reclaim",
+	  bench_mem_reclaim },
+	{ "fault",
+	  "Anonymous page faults charged to nested memory cgroups",
+	  bench_mem_fault },
+	{ "readahead",
+	  "Strided and sequential file reads, for readahead hit ratio",
+	  bench_mem_readahead },
+	{ "mmap-sem",
+	  "Page faults against mmap/munmap, for mmap_sem contention",
+	  bench_mem_mmap_sem },
 	suite_all,
 	{ NULL,
 	  NULL,
 	  NULL             }
 };
 
+static struct bench_suite time_suites[] = {
+	{ "gettime",
+	  "clock_gettime() through the vDSO or the syscall",
+	  bench_time_gettime },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL               }
+};
+
+static struct bench_suite aio_suites[] = {
+	{ "ring",
+	  "Small reads through pread(), io_submit() or the submission ring",
+	  bench_aio_ring },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL           }
+};
+
 struct bench_subsys {
 	const char *name;
 	const char *summary;
@@ -71,6 +111,12 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "time",
+	  "timekeeping interfaces",
+	  time_suites },
+	{ "aio",
+	  "asynchronous and batched i/o submission",
+	  aio_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "all benchmark subsystem",
 	  NULL },
@@ -0,0 +1,48 @@
+/*
+ * Userspace stand-ins for the slab allocator, just enough to run
+ * lib/radix-tree.c: every object is a separate malloc() so that valgrind
+ * or -fsanitize=address catch use after free, and nr_allocated catches
+ * leaked nodes.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/slab.h>
+
+struct kmem_cache {
+	size_t size;
+	void (*ctor)(void *);
+};
+
+int nr_allocated;
+
+void *kmem_cache_alloc(struct kmem_cache *cachep, gfp_t flags)
+{
+	void *p = malloc(cachep->size);
+
+	if (!p)
+		return NULL;
+	if (cachep->ctor)
+		cachep->ctor(p);
+	nr_allocated++;
+	return p;
+}
+
+void kmem_cache_free(struct kmem_cache *cachep, void *objp)
+{
+	nr_allocated--;
+	memset(objp, 0x6b, cachep->size);	/* poison, like SLAB_DEBUG */
+	free(objp);
+}
+
+struct kmem_cache *kmem_cache_create(const char *name, size_t size,
+		size_t align, unsigned long flags, void (*ctor)(void *))
+{
+	struct kmem_cache *cachep = malloc(sizeof(*cachep));
+
+	if (!cachep)
+		abort();
+	cachep->size = size;
+	cachep->ctor = ctor;
+	return cachep;
+}
@@ -0,0 +1,13 @@
+#ifndef _CPU_H
+#define _CPU_H
+
+#include <linux/notifier.h>
+
+#define CPU_DEAD		0x0007
+#define CPU_TASKS_FROZEN	0x0010
+#define CPU_DEAD_FROZEN		(CPU_DEAD | CPU_TASKS_FROZEN)
+
+/* No cpus come or go here: just keep the callback referenced */
+#define hotcpu_notifier(fn, pri)	((void)(fn), (void)(pri))
+
+#endif /* _CPU_H */
@@ -0,0 +1,15 @@
+#ifndef _GFP_H
+#define _GFP_H
+
+#define __GFP_HIGH	0x20u
+#define __GFP_IO	0x40u
+#define __GFP_FS	0x80u
+#define __GFP_WAIT	0x10u
+
+#define __GFP_BITS_SHIFT 23
+#define __GFP_BITS_MASK ((1 << __GFP_BITS_SHIFT) - 1)
+
+#define GFP_ATOMIC	(__GFP_HIGH)
+#define GFP_KERNEL	(__GFP_WAIT | __GFP_IO | __GFP_FS)
+
+#endif /* _GFP_H */
@@ -0,0 +1,8 @@
+#ifndef _PERCPU_H
+#define _PERCPU_H
+
+#define DEFINE_PER_CPU(type, name)	__typeof__(type) name
+#define __get_cpu_var(var)		(var)
+#define per_cpu(var, cpu)		(*((void)(cpu), &(var)))
+
+#endif /* _PERCPU_H */
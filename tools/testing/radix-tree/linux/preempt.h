@@ -0,0 +1,7 @@
+#ifndef _PREEMPT_H
+#define _PREEMPT_H
+
+#define preempt_disable()	do { } while (0)
+#define preempt_enable()	do { } while (0)
+
+#endif /* _PREEMPT_H */
@@ -0,0 +1 @@
+#include "../../../../include/linux/radix-tree.h"
@@ -0,0 +1,6 @@
+#ifndef _SCHED_H
+#define _SCHED_H
+
+#define cond_resched()		do { } while (0)
+
+#endif /* _SCHED_H */
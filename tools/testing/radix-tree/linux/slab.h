@@ -0,0 +1,19 @@
+#ifndef _SLAB_H
+#define _SLAB_H
+
+#include <linux/types.h>
+
+#define SLAB_PANIC		2
+#define SLAB_RECLAIM_ACCOUNT	0x00020000UL
+
+struct kmem_cache;
+
+void *kmem_cache_alloc(struct kmem_cache *cachep, gfp_t flags);
+void kmem_cache_free(struct kmem_cache *cachep, void *objp);
+struct kmem_cache *kmem_cache_create(const char *name, size_t size,
+		size_t align, unsigned long flags, void (*ctor)(void *));
+
+/* Objects handed out by kmem_cache_alloc() and not yet freed */
+extern int nr_allocated;
+
+#endif /* _SLAB_H */
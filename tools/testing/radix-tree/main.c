@@ -0,0 +1,469 @@
+/*
+ * Userspace tests for lib/radix-tree.c.
+ *
+ * The library is compiled unchanged against the stub headers in linux/
+ * (with RADIX_TREE_MAP_SHIFT of 3, so trees get tall quickly) and checked
+ * against a flat model of the index space: single and multi-order
+ * inserts, lookups, gang lookups with and without tags, tag propagation,
+ * deletion and shrinking, and that no node is leaked at the end.
+ *
+ *	make && ./main [seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <linux/gfp.h>
+#include <linux/slab.h>
+#include <linux/radix-tree.h>
+
+struct item {
+	unsigned long index;
+	unsigned int order;
+};
+
+static struct item *item_create(unsigned long index, unsigned int order)
+{
+	struct item *item = malloc(sizeof(*item));
+
+	assert(item);
+	item->index = index;
+	item->order = order;
+	return item;
+}
+
+static int item_insert(struct radix_tree_root *root, unsigned long index,
+		       unsigned int order)
+{
+	struct item *item = item_create(index, order);
+	int err = __radix_tree_insert(root, index, order, item);
+
+	if (err)
+		free(item);
+	return err;
+}
+
+static void item_check_present(struct radix_tree_root *root,
+			       unsigned long index, struct item *expect)
+{
+	struct item *item = radix_tree_lookup(root, index);
+
+	if (item != expect) {
+		printf("lookup(%lu) = %p, expected %p\n", index, item, expect);
+		abort();
+	}
+	if (item)
+		assert(index - item->index < (1UL << item->order));
+}
+
+/* Delete everything and check the tree gave back all its nodes */
+static void item_kill_tree(struct radix_tree_root *root)
+{
+	void *items[32];
+	unsigned int nr, i;
+
+	while ((nr = radix_tree_gang_lookup(root, items, 0, 32))) {
+		for (i = 0; i < nr; i++) {
+			struct item *item = items[i];
+
+			assert(radix_tree_delete(root, item->index) == item);
+			free(item);
+		}
+	}
+	assert(radix_tree_gang_lookup(root, items, 0, 32) == 0);
+	assert(root->rnode == NULL);
+	assert(root->height == 0);
+	if (nr_allocated) {
+		printf("%d nodes leaked\n", nr_allocated);
+		abort();
+	}
+}
+
+/*
+ * Single order 0 items, spread over the whole index space.
+ */
+static void single_test(void)
+{
+	RADIX_TREE(tree, GFP_KERNEL);
+	static const unsigned long indices[] = {
+		0, 1, 2, 7, 8, 9, 63, 64, 65, 511, 4096, 1UL << 20,
+		(1UL << 31) + 5, ULONG_MAX - 1, ULONG_MAX,
+	};
+	unsigned long next;
+	void **slots[4];
+	unsigned long got[4];
+	unsigned int i, nr, n = ARRAY_SIZE(indices);
+
+	for (i = 0; i < n; i++)
+		assert(item_insert(&tree, indices[i], 0) == 0);
+	for (i = 0; i < n; i++) {
+		struct item *item = radix_tree_lookup(&tree, indices[i]);
+
+		assert(item && item->index == indices[i]);
+		assert(item_insert(&tree, indices[i], 0) == -EEXIST);
+	}
+	item_check_present(&tree, 3, NULL);
+	item_check_present(&tree, ULONG_MAX - 2, NULL);
+
+	/* gang lookup returns them in order, in small batches */
+	next = 0;
+	i = 0;
+	while ((nr = radix_tree_gang_lookup_slot(&tree, slots, got, next, 4))) {
+		unsigned int j;
+
+		for (j = 0; j < nr; j++, i++) {
+			assert(got[j] == indices[i]);
+			assert(((struct item *)*slots[j])->index == indices[i]);
+		}
+		next = got[nr - 1] + 1;
+		if (!next)
+			break;
+	}
+	assert(i == n);
+
+	for (i = 0; i < n; i += 2)
+		radix_tree_tag_set(&tree, indices[i], 0);
+	for (i = 0; i < n; i++)
+		assert(radix_tree_tag_get(&tree, indices[i], 0) == !(i & 1));
+
+	item_kill_tree(&tree);
+}
+
+/*
+ * One multi-order entry, on its own: every index it covers must find it,
+ * its neighbours must not, and lookups and tag operations starting
+ * anywhere inside it must see it exactly once.
+ */
+static void multiorder_check(unsigned long index, unsigned int order)
+{
+	RADIX_TREE(tree, GFP_KERNEL);
+	unsigned long size = 1UL << order, last = index + size - 1;
+	unsigned long probe[] = { index, index + size / 2, last };
+	unsigned long got, first;
+	struct item *item;
+	void **slot;
+	void *result;
+	unsigned int i;
+
+	assert(item_insert(&tree, index, order) == 0);
+	item = radix_tree_lookup(&tree, index);
+	assert(item && item->order == order);
+
+	if (index)
+		item_check_present(&tree, index - 1, NULL);
+	if (last != ULONG_MAX)
+		item_check_present(&tree, last + 1, NULL);
+
+	for (i = 0; i < ARRAY_SIZE(probe); i++) {
+		item_check_present(&tree, probe[i], item);
+		assert(radix_tree_lookup_slot(&tree, probe[i]) ==
+		       radix_tree_lookup_slot(&tree, index));
+		assert(item_insert(&tree, probe[i], 0) == -EEXIST);
+
+		assert(radix_tree_gang_lookup_slot(&tree, &slot, &got,
+						   probe[i], 1) == 1);
+		assert(*slot == item && got == index);
+		assert(radix_tree_gang_lookup(&tree, &result, probe[i], 1) == 1);
+		assert(result == item);
+	}
+	if (order < BITS_PER_LONG - 1 && !(index & (2 * size - 1)))
+		assert(item_insert(&tree, index, order + 1) == -EEXIST);
+	if (last != ULONG_MAX)
+		assert(radix_tree_gang_lookup(&tree, &result, last + 1, 1) == 0);
+
+	/* Tags live on the entry, whichever index they were set through */
+	radix_tree_tag_set(&tree, probe[1], 0);
+	for (i = 0; i < ARRAY_SIZE(probe); i++) {
+		assert(radix_tree_tag_get(&tree, probe[i], 0));
+		assert(!radix_tree_tag_get(&tree, probe[i], 1));
+		assert(radix_tree_gang_lookup_tag(&tree, &result, probe[i],
+						  1, 0) == 1);
+		assert(result == item);
+		assert(radix_tree_gang_lookup_tag(&tree, &result, probe[i],
+						  1, 1) == 0);
+	}
+	first = probe[2];
+	assert(radix_tree_range_tag_if_tagged(&tree, &first, ULONG_MAX,
+					      10, 0, 1) == 1);
+	assert(radix_tree_tag_get(&tree, index, 1));
+	assert(radix_tree_tagged(&tree, 1));
+	radix_tree_tag_clear(&tree, probe[2], 1);
+	assert(!radix_tree_tag_get(&tree, probe[1], 1));
+	assert(!radix_tree_tagged(&tree, 1));
+
+	assert(radix_tree_locate_item(&tree, item) == index);
+
+	/* Deleting through any index removes the whole entry */
+	assert(radix_tree_delete(&tree, probe[2]) == item);
+	for (i = 0; i < ARRAY_SIZE(probe); i++)
+		item_check_present(&tree, probe[i], NULL);
+	assert(!radix_tree_tagged(&tree, 0));
+	free(item);
+	item_kill_tree(&tree);
+}
+
+static void multiorder_test(void)
+{
+	unsigned int order;
+
+	for (order = 0; order < BITS_PER_LONG; order++) {
+		unsigned long size = 1UL << order;
+
+		multiorder_check(0, order);
+		if (order < BITS_PER_LONG - 1) {
+			multiorder_check(size, order);
+			multiorder_check(ULONG_MAX - size + 1, order);
+		}
+		if (order < BITS_PER_LONG - 4)
+			multiorder_check(size * 5, order);
+	}
+}
+
+/*
+ * A huge page sized entry among small ones: lookups skip it as one item,
+ * and the tree shrinks back around it once the small ones are gone.
+ */
+static void multiorder_mixed_test(void)
+{
+	RADIX_TREE(tree, GFP_KERNEL);
+	static const unsigned long expect[] = { 511, 512, 1024, 1025, 1028 };
+	unsigned long got[8], first;
+	void **slots[8];
+	struct item *big;
+	unsigned int i, nr, height;
+
+	assert(item_insert(&tree, 512, 9) == 0);
+	assert(item_insert(&tree, 511, 0) == 0);
+	assert(item_insert(&tree, 1024, 0) == 0);
+	assert(item_insert(&tree, 1025, 0) == 0);
+	assert(item_insert(&tree, 1028, 2) == 0);
+	assert(item_insert(&tree, 520, 0) == -EEXIST);
+	assert(item_insert(&tree, 1030, 0) == -EEXIST);
+	assert(item_insert(&tree, 1024, 2) == -EEXIST);
+	assert(item_insert(&tree, 0, 10) == -EEXIST);
+	big = radix_tree_lookup(&tree, 1000);
+	assert(big && big->index == 512);
+
+	nr = radix_tree_gang_lookup_slot(&tree, slots, got, 0, 8);
+	assert(nr == ARRAY_SIZE(expect));
+	for (i = 0; i < nr; i++) {
+		assert(got[i] == expect[i]);
+		assert(((struct item *)*slots[i])->index == expect[i]);
+	}
+
+	radix_tree_tag_set(&tree, 1023, 0);
+	radix_tree_tag_set(&tree, 1025, 0);
+	radix_tree_tag_set(&tree, 1031, 0);
+	nr = radix_tree_gang_lookup_tag_slot(&tree, slots, 600, 8, 0);
+	assert(nr == 3);
+	assert(*slots[0] == big);
+	assert(((struct item *)*slots[1])->index == 1025);
+	assert(((struct item *)*slots[2])->index == 1028);
+
+	first = 600;
+	assert(radix_tree_range_tag_if_tagged(&tree, &first, 1026,
+					      100, 0, 1) == 2);
+	assert(radix_tree_tag_get(&tree, 800, 1));
+	assert(radix_tree_tag_get(&tree, 1025, 1));
+	assert(!radix_tree_tag_get(&tree, 1028, 1));
+
+	assert(radix_tree_next_hole(&tree, 512, 1000) == 1026);
+	assert(radix_tree_prev_hole(&tree, 1023, 1000) == 510);
+	assert(radix_tree_locate_item(&tree, big) == 512);
+
+	/* Drop the small items: the tree shrinks down to the big entry */
+	height = tree.height;
+	free(radix_tree_delete(&tree, 511));
+	free(radix_tree_delete(&tree, 1024));
+	free(radix_tree_delete(&tree, 1025));
+	free(radix_tree_delete(&tree, 1029));
+	assert(tree.height <= height);
+	item_check_present(&tree, 512, big);
+	item_check_present(&tree, 1023, big);
+	item_check_present(&tree, 1024, NULL);
+	assert(radix_tree_tag_get(&tree, 700, 0));
+	assert(!radix_tree_tag_get(&tree, 1025, 0));
+
+	item_kill_tree(&tree);
+}
+
+/*
+ * Random inserts, deletes and tag operations of mixed orders, checked
+ * index by index against a flat model.
+ */
+#define MODEL_SHIFT	14
+#define MODEL_SIZE	(1UL << MODEL_SHIFT)
+
+static struct item *model[MODEL_SIZE];
+static unsigned char model_tags[MODEL_SIZE];	/* by entry base index */
+
+static void model_check(struct radix_tree_root *root)
+{
+	unsigned long index, next, got[5];
+	void **slots[5];
+	unsigned int nr, i, tag;
+
+	for (index = 0; index < MODEL_SIZE; index++) {
+		struct item *item = model[index];
+
+		item_check_present(root, index, item);
+		for (tag = 0; tag < 2; tag++)
+			assert(radix_tree_tag_get(root, index, tag) ==
+			       (item && (model_tags[item->index] >> tag & 1)));
+	}
+
+	/* Every entry once, in order, from an arbitrary start */
+	next = random() % MODEL_SIZE;
+	index = next;
+	if (model[index])
+		index = model[index]->index;
+	else
+		while (index < MODEL_SIZE && !model[index])
+			index++;
+
+	while ((nr = radix_tree_gang_lookup_slot(root, slots, got, next, 5))) {
+		for (i = 0; i < nr; i++) {
+			struct item *item = *slots[i];
+
+			assert(index < MODEL_SIZE);
+			assert(item == model[index]);
+			assert(got[i] == index);
+			index += 1UL << item->order;
+			while (index < MODEL_SIZE && !model[index])
+				index++;
+		}
+		next = got[nr - 1] + (1UL << ((struct item *)*slots[nr - 1])->order);
+	}
+	assert(index >= MODEL_SIZE);
+
+	for (tag = 0; tag < 2; tag++) {
+		index = 0;
+		next = 0;
+		while ((nr = radix_tree_gang_lookup_tag_slot(root, slots, next,
+							     5, tag))) {
+			for (i = 0; i < nr; i++) {
+				struct item *item = *slots[i];
+
+				while (index < MODEL_SIZE &&
+				       !(model[index] &&
+					 model[index]->index == index &&
+					 (model_tags[index] >> tag & 1)))
+					index++;
+				assert(item == model[index]);
+				index += 1UL << item->order;
+			}
+			next = index;
+		}
+		while (index < MODEL_SIZE &&
+		       !(model[index] && model[index]->index == index &&
+			 (model_tags[index] >> tag & 1)))
+			index++;
+		assert(index >= MODEL_SIZE);
+	}
+}
+
+static void random_test(void)
+{
+	RADIX_TREE(tree, GFP_KERNEL);
+	unsigned long index, i, j;
+	int loop, op;
+
+	for (loop = 0; loop < 20000; loop++) {
+		unsigned int order = random() % 4 ? random() % 4 :
+				     random() % (MODEL_SHIFT - 2);
+		unsigned long size = 1UL << order;
+		struct item *item;
+
+		index = random() % MODEL_SIZE & ~(size - 1);
+		op = random() % 8;
+
+		if (op < 4) {
+			int busy = 0;
+
+			for (i = 0; i < size; i++)
+				busy |= model[index + i] != NULL;
+			if (item_insert(&tree, index, order)) {
+				assert(busy);
+				continue;
+			}
+			assert(!busy);
+			item = radix_tree_lookup(&tree, index);
+			for (i = 0; i < size; i++)
+				model[index + i] = item;
+			model_tags[index] = 0;
+		} else if (op < 6) {
+			item = radix_tree_delete(&tree, index);
+			assert(item == model[index]);
+			if (!item)
+				continue;
+			for (i = 0; i < 1UL << item->order; i++)
+				model[item->index + i] = NULL;
+			free(item);
+		} else if (op == 6) {
+			unsigned int tag = random() % 2;
+
+			item = model[index];
+			if (!item)
+				continue;
+			if (random() % 2) {
+				radix_tree_tag_set(&tree, index, tag);
+				model_tags[item->index] |= 1 << tag;
+			} else {
+				radix_tree_tag_clear(&tree, index, tag);
+				model_tags[item->index] &= ~(1 << tag);
+			}
+		} else {
+			unsigned long first = index, last, tagged = 0;
+
+			last = first + random() % 512;
+			for (i = 0; i < MODEL_SIZE; i++) {
+				item = model[i];
+				if (!item || item->index != i ||
+				    !(model_tags[i] & 1))
+					continue;
+				if (i > last || i + (1UL << item->order) <= first)
+					continue;
+				model_tags[i] |= 2;
+				tagged++;
+			}
+			assert(radix_tree_range_tag_if_tagged(&tree, &first,
+					last, ULONG_MAX, 0, 1) == tagged);
+		}
+
+		if (loop % 500 == 0)
+			model_check(&tree);
+	}
+	model_check(&tree);
+
+	/* Knock out everything through a random index of each entry */
+	for (i = 0; i < MODEL_SIZE; i++) {
+		struct item *item = model[i];
+
+		if (!item)
+			continue;
+		j = item->index + random() % (1UL << item->order);
+		assert(radix_tree_delete(&tree, j) == item);
+		for (j = 0; j < 1UL << item->order; j++)
+			model[item->index + j] = NULL;
+		free(item);
+	}
+	item_kill_tree(&tree);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int seed = argc > 1 ? atoi(argv[1]) : 1;
+
+	srandom(seed);
+	radix_tree_init();
+
+	single_test();
+	multiorder_test();
+	multiorder_mixed_test();
+	random_test();
+
+	printf("radix-tree: all tests passed (seed %u)\n", seed);
+	return 0;
+}